@@ -0,0 +1,252 @@
+"""
+Measure how far the profiles of the samplers are from the truth.
+
+Usage:
+  python benchmarks/accuracy_bench.py [--workloads W ...] [--samplers S ...]
+      [--intervals US ...] [--seconds S] [--repeat R] [--max-error E]
+
+Every workload burns CPU in functions of known names and records with
+time.thread_time how long it spent in each, which is the ground truth:
+
+  mix       alpha, beta and gamma in the ratio 1:2:4, interleaved in short
+            slices on the main thread
+  threads   four threads, each splitting its time between alpha and beta
+            in a different ratio, so the GIL hands over between them
+  c_call    a Python loop (interpret) against sorted() (native), half of the
+            time each, where the time in C has to land on its caller
+  periodic  1ms of tick then 4ms of tock, a period that intervals which are
+            a multiple of 5ms alias with
+
+Each run is a fresh interpreter (see runner.py) under TelexSysSampler ("sync") or
+TelexSysAsyncSampler ("async") in CPU time mode. A sample counts for the
+function named in its stack, per thread for the threads workload, and the
+share of the samples every function got is compared with its share of the
+CPU time. The medians of --repeat runs are reported as JSON: the total
+variation distance between the two distributions (half the sum of the
+absolute differences, 0 is exact and 1 disjoint), the largest error of a
+single function, and the share of the samples in none of the functions.
+With --max-error the exit status is 1 when a total variation distance
+exceeds it, to catch regressions of the sampling engine.
+"""
+
+from __future__ import annotations
+
+import argparse
+import itertools
+import re
+import statistics
+import sys
+import threading
+import time
+
+import runner
+
+WORKLOADS = ("mix", "threads", "c_call", "periodic")
+
+# seconds spent per thread and function, the ground truth
+spent: dict[tuple[str, str], float] = {}
+lock = threading.Lock()
+
+
+def record(name: str, seconds: float) -> None:
+    key = (threading.current_thread().name, name)
+    with lock:
+        spent[key] = spent.get(key, 0.0) + seconds
+
+
+def spin(seconds: float) -> None:
+    end = time.thread_time() + seconds
+    while time.thread_time() < end:
+        for _ in range(200):
+            pass
+
+
+def alpha(seconds: float) -> None:
+    spin(seconds)
+
+
+def beta(seconds: float) -> None:
+    spin(seconds)
+
+
+def gamma(seconds: float) -> None:
+    spin(seconds)
+
+
+def tick(seconds: float) -> None:
+    spin(seconds)
+
+
+def tock(seconds: float) -> None:
+    spin(seconds)
+
+
+def interpret(seconds: float) -> None:
+    spin(seconds)
+
+
+DATA = list(range(200_000, 0, -1))
+
+
+def native(seconds: float) -> None:
+    end = time.thread_time() + seconds
+    while time.thread_time() < end:
+        sorted(DATA)
+
+
+def timed(func, seconds: float) -> None:
+    start = time.thread_time()
+    func(seconds)
+    record(func.__name__, time.thread_time() - start)
+
+
+def run_slices(plan: list[tuple], total: float) -> None:
+    """Run the (function, seconds) slices of the plan until total CPU seconds."""
+    end = time.thread_time() + total
+    while time.thread_time() < end:
+        for func, seconds in plan:
+            timed(func, seconds)
+
+
+def mix_work(total: float) -> None:
+    run_slices([(alpha, 0.0005), (beta, 0.001), (gamma, 0.002)], total)
+
+
+def threads_work(total: float) -> None:
+    ratios = [(1, 3), (1, 1), (3, 1), (1, 0)]
+    threads = [
+        threading.Thread(
+            target=run_slices,
+            args=([(alpha, 0.0005 * a), (beta, 0.0005 * b)], total / len(ratios)),
+            name=f"worker-{i}",
+        )
+        for i, (a, b) in enumerate(ratios)
+    ]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+
+def c_call_work(total: float) -> None:
+    # a slice is at least one sorted(), a few milliseconds
+    run_slices([(interpret, 0.01), (native, 0.01)], total)
+
+
+def periodic_work(total: float) -> None:
+    run_slices([(tick, 0.001), (tock, 0.004)], total)
+
+
+WORK = {
+    "mix": mix_work,
+    "threads": threads_work,
+    "c_call": c_call_work,
+    "periodic": periodic_work,
+}
+
+NAMES = ("alpha", "beta", "gamma", "tick", "tock", "interpret", "native")
+FRAME = re.compile(r":(%s):\d+$" % "|".join(NAMES))
+
+
+def attribute(folded: str) -> tuple[dict[tuple[str, str], int], int]:
+    """The samples of every thread and function, and those of no function."""
+    counts: dict[tuple[str, str], int] = {}
+    other = 0
+    for line in folded.splitlines():
+        stack, _, count = line.rpartition(" ")
+        frames = stack.split(";")
+        # the innermost of the functions, the thread is the first frame
+        name = next(
+            (m.group(1) for m in map(FRAME.search, reversed(frames)) if m), None
+        )
+        if name is None:
+            other += int(count)
+            continue
+        key = (frames[0], name)
+        counts[key] = counts.get(key, 0) + int(count)
+    return counts, other
+
+
+def child(run: dict) -> dict:
+    """One measurement, in this fresh interpreter."""
+    from telex.sampler import TelexSysAsyncSampler, TelexSysSampler
+
+    cls = TelexSysSampler if run["sampler"] == "sync" else TelexSysAsyncSampler
+    sampler = cls(sampling_interval=run["interval"], time_mode="cpu")
+    WORK[run["workload"]](0.05)  # warm up
+    spent.clear()
+    sampler.start()
+    WORK[run["workload"]](run["seconds"])
+    sampler.stop()
+
+    counts, other = attribute(sampler.dumps())
+    truth_total = sum(spent.values())
+    sampled_total = sum(counts.values())
+    functions = {}
+    for key in sorted(set(spent) | set(counts)):
+        functions[" ".join(key)] = {
+            "truth": spent.get(key, 0.0) / truth_total,
+            "sampled": counts.get(key, 0) / sampled_total if sampled_total else 0.0,
+        }
+    errors = [abs(f["truth"] - f["sampled"]) for f in functions.values()]
+    return {
+        "samples": sampled_total + other,
+        "tv_error": sum(errors) / 2,
+        "max_error": max(errors),
+        "unattributed": other / (sampled_total + other) if other else 0.0,
+        "functions": functions,
+    }
+
+
+def aggregate(results: list[dict]) -> dict:
+    """The medians of the runs, with the shares of the median one."""
+    median = {
+        key: round(statistics.median(r[key] for r in results), 4)
+        for key in ("samples", "tv_error", "max_error", "unattributed")
+    }
+    # the shares of the run with the median error
+    results.sort(key=lambda r: r["tv_error"])
+    functions = results[len(results) // 2]["functions"]
+    median["functions"] = {
+        name: {k: round(v, 4) for k, v in shares.items()}
+        for name, shares in functions.items()
+    }
+    return median
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--workloads", nargs="*", choices=WORKLOADS, default=WORKLOADS)
+    parser.add_argument(
+        "--samplers", nargs="*", choices=("sync", "async"), default=["sync", "async"]
+    )
+    parser.add_argument("--intervals", type=int, nargs="*", default=[1_000, 5_000])
+    # CPU seconds of every workload
+    parser.add_argument("--seconds", type=float, default=2.0)
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--max-error", type=float, default=None)
+    args = runner.parse_args(parser, child)
+    if args is None:
+        return
+
+    runs = []
+    grid = itertools.product(args.workloads, args.samplers, args.intervals)
+    for workload, sampler, interval in grid:
+        run = {
+            "workload": workload,
+            "sampler": sampler,
+            "interval": interval,
+            "seconds": args.seconds,
+        }
+        runs.append({**run, **runner.measure(__file__, run, args.repeat, aggregate)})
+        print(f"{workload} {sampler} {interval}us done", file=sys.stderr)
+
+    runner.report(runs)
+    if args.max_error is not None and any(
+        "error" in r or r["tv_error"] > args.max_error for r in runs
+    ):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
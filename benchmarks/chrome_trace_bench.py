@@ -0,0 +1,138 @@
+"""
+Measure the streaming Chrome trace converter on a large synthetic trace.
+
+Usage:
+  python benchmarks/chrome_trace_bench.py [--gb G] [--python-mb M] [--keep FILE]
+
+A PyTorch like trace of nested complete events on a few threads is written to
+a temporary file of about G gigabytes, then converted to folded stacks by the
+native converter. The in-memory python converter (json.load and the same sweep)
+runs on a trace of M megabytes and both outputs are checked to be identical.
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+import os
+import random
+import tempfile
+import time
+
+from telex import _telexsys
+from telex.chrome_trace_converter import ChromeTraceConverter
+
+OPS = [f"aten::op_{i}" for i in range(200)]
+ANNOTATIONS = ["ProfilerStep", "forward", "backward", "Optimizer.step"]
+
+
+def make_callees(rng: random.Random) -> dict[str, list[str]]:
+    """Every function always calls the same ones, as real programs do."""
+    callees = {name: rng.sample(OPS, rng.randint(0, 3)) for name in OPS}
+    for name in ANNOTATIONS:
+        callees[name] = rng.sample(OPS, 8)
+    return callees
+
+
+def add_event(
+    out: list[str],
+    rng: random.Random,
+    callees: dict[str, list[str]],
+    name: str,
+    tid: int,
+    ts: float,
+    depth: int,
+) -> float:
+    """Add an event and the ones nested in it to out, returns where it ends."""
+    cat = "user_annotation" if name in ANNOTATIONS else "cpu_op"
+    index = len(out)
+    out.append("")  # written once the children tell its duration
+    end = ts + rng.uniform(0.5, 5)
+    if depth > 0:
+        for callee in callees[name]:
+            end = add_event(out, rng, callees, callee, tid, end, depth - 1)
+            end += rng.uniform(0, 5)
+    out[index] = (
+        f'{{"ph": "X", "cat": "{cat}", "name": "{name}", "pid": 4242, '
+        f'"tid": {tid}, "ts": {ts:.3f}, "dur": {end - ts:.3f}, "args": '
+        f'{{"External id": {rng.randint(0, 1 << 20)}, "Input Dims": '
+        f'[[32, 100], [10, 100]], "Ev Idx": {rng.randint(0, 1 << 20)}}}}},\n'
+    )
+    return end
+
+
+def make_trace(filename: str, size: int, seed: int) -> None:
+    rng = random.Random(seed)
+    callees = make_callees(rng)
+    clocks = {tid: 0.0 for tid in range(1, 5)}
+    with open(filename, "w") as f:
+        f.write('{"schemaVersion": 1, "traceEvents": [\n')
+        while f.tell() < size:
+            out: list[str] = []
+            for _ in range(20):
+                tid = rng.randint(1, 4)
+                name = rng.choice(ANNOTATIONS)
+                clocks[tid] = add_event(out, rng, callees, name, tid, clocks[tid], 6) + 1
+            f.write("".join(out))
+        f.write('{"ph": "i", "name": "end", "pid": 4242, "tid": 1, "ts": 0}\n]}\n')
+
+
+def load_folded(filename: str) -> dict[str, int]:
+    stacks = {}
+    with open(filename) as f:
+        for line in f:
+            stack, count = line.rsplit(" ", 1)
+            stacks[stack] = int(count)
+    return stacks
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--gb", type=float, default=2.0)
+    parser.add_argument("--python-mb", type=float, default=32.0)
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--keep", help="write the large trace here and keep it")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        trace = args.keep or os.path.join(tmp, "trace.json")
+        folded = os.path.join(tmp, "trace.folded")
+        if not (args.keep and os.path.exists(args.keep)):
+            make_trace(trace, int(args.gb * (1 << 30)), args.seed)
+        size = os.path.getsize(trace)
+        start = time.perf_counter()
+        stats = _telexsys.chrome_trace_to_folded(trace, folded)
+        native_time = time.perf_counter() - start
+
+        small = os.path.join(tmp, "small.json")
+        make_trace(small, int(args.python_mb * (1 << 20)), args.seed)
+        start = time.perf_counter()
+        converter = ChromeTraceConverter(small)
+        converter.load_trace()
+        expected = converter.convert_to_folded()
+        python_time = time.perf_counter() - start
+        start = time.perf_counter()
+        _telexsys.chrome_trace_to_folded(small, folded)
+        small_time = time.perf_counter() - start
+        identical = load_folded(folded) == expected
+        small_size = os.path.getsize(small)
+
+    print(
+        json.dumps(
+            {
+                "trace_bytes": size,
+                **stats,
+                "native_seconds": round(native_time, 3),
+                "native_mb_per_s": round(size / native_time / (1 << 20), 1),
+                "python_trace_bytes": small_size,
+                "python_mb_per_s": round(small_size / python_time / (1 << 20), 1),
+                "speedup": round(python_time / small_time, 2),
+                "identical": identical,
+            },
+            indent=2,
+        )
+    )
+
+
+if __name__ == "__main__":
+    main()
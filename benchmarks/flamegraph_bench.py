@@ -0,0 +1,89 @@
+"""
+Compare the python flamegraph renderer with the native one.
+
+Usage:
+  python benchmarks/flamegraph_bench.py [--stacks N] [--depth D] [--repeat R]
+
+A synthetic profile is generated with a zipf like distribution of function
+names, then rendered by FlameGraph.generate_svg (python) and FlameGraph.save
+(native). Both outputs are checked to be identical.
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+import os
+import random
+import tempfile
+import time
+
+from telex.flamegraph import FlameGraph
+
+
+def make_profile(stacks: int, depth: int, names: int, seed: int) -> list[str]:
+    rng = random.Random(seed)
+    pool = [f"src/pkg/module_{i % 97}.py:function_{i}:{i * 3}" for i in range(names)]
+    weights = [1 / (i + 1) for i in range(names)]
+    lines = []
+    for _ in range(stacks):
+        frames = rng.choices(pool, weights=weights, k=rng.randint(1, depth))
+        lines.append(f"MainThread;{';'.join(frames)} {rng.randint(1, 100)}")
+    return lines
+
+
+def bench(fn, repeat: int) -> float:
+    best = float("inf")
+    for _ in range(repeat):
+        start = time.perf_counter()
+        fn()
+        best = min(best, time.perf_counter() - start)
+    return best
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--stacks", type=int, default=100_000)
+    parser.add_argument("--depth", type=int, default=40)
+    parser.add_argument("--names", type=int, default=2_000)
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--seed", type=int, default=0)
+    args = parser.parse_args()
+
+    lines = make_profile(args.stacks, args.depth, args.names, args.seed)
+    with tempfile.TemporaryDirectory() as tmp:
+        py_file = os.path.join(tmp, "python.svg")
+        native_file = os.path.join(tmp, "native.svg")
+
+        def render_python():
+            fg = FlameGraph(lines, minwidth=0)
+            fg.parse_input()
+            with open(py_file, "w", encoding="utf-8") as f:
+                f.write(fg.generate_svg())
+
+        def render_native():
+            FlameGraph(lines, minwidth=0).save(native_file)
+
+        python_time = bench(render_python, args.repeat)
+        native_time = bench(render_native, args.repeat)
+        with open(py_file, "rb") as a, open(native_file, "rb") as b:
+            identical = a.read() == b.read()
+        size = os.path.getsize(native_file)
+
+    print(
+        json.dumps(
+            {
+                "stacks": args.stacks,
+                "svg_bytes": size,
+                "python_seconds": round(python_time, 4),
+                "native_seconds": round(native_time, 4),
+                "speedup": round(python_time / native_time, 2),
+                "identical": identical,
+            },
+            indent=2,
+        )
+    )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,135 @@
+"""
+Measure the parallel native folded loader against python parsing.
+
+Usage:
+  python benchmarks/folded_load_bench.py [--mb M] [--files F] [--threads T ...]
+
+F folded files of M megabytes in total are written the way the processes of a
+multiprocess run dump them: every file holds the stacks of one process, which
+share most frames with the others. They are loaded by _telexsys.load_folded
+with each thread count, then a part of them is parsed into a call tree by
+FlameGraph (python) and the merged stacks are checked to be identical.
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+import os
+import random
+import tempfile
+import time
+from collections import Counter
+
+from telex import _telexsys
+from telex.flamegraph import FlameGraph
+
+
+def make_stacks(count: int, depth: int, names: int, seed: int) -> list[str]:
+    """Random walks down a call graph, every function calls the same ones."""
+    rng = random.Random(seed)
+    pool = [f"src/pkg/module_{i % 97}.py:function_{i}:{i * 3}" for i in range(names)]
+    callees = [rng.sample(pool, rng.randint(1, 4)) for _ in pool]
+    index = {name: i for i, name in enumerate(pool)}
+    stacks = set()
+    while len(stacks) < count:
+        frames = [pool[rng.randrange(8)]]
+        for _ in range(rng.randint(1, depth)):
+            frames.append(rng.choice(callees[index[frames[-1]]]))
+        stacks.add(";".join(["MainThread", *frames]))
+    # a sampler dumps its tree depth first, neighbours share a prefix
+    return sorted(stacks)
+
+
+def make_files(folder: str, size: int, files: int, seed: int) -> list[str]:
+    rng = random.Random(seed)
+    stacks = make_stacks(50_000, 40, 2_000, seed)
+    names = []
+    for index in range(files):
+        name = os.path.join(folder, f"{1000 + index}-999.folded")
+        prefix = f"Process(pid-{1000 + index}, ppid-999);"
+        with open(name, "w") as f:
+            while f.tell() < size // files:
+                start = rng.randrange(len(stacks))
+                f.write(
+                    "".join(
+                        f"{prefix}{stack} {rng.randint(1, 100)}\n"
+                        for stack in stacks[start : start + 1000]
+                    )
+                )
+        names.append(name)
+    return names
+
+
+def merged(text: str) -> Counter[str]:
+    stacks: Counter[str] = Counter()
+    for line in text.splitlines():
+        stack, count = line.rsplit(" ", 1)
+        stacks[stack] += int(count)
+    return stacks
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--mb", type=float, default=1024.0)
+    parser.add_argument("--files", type=int, default=16)
+    # 0 is one thread per CPU
+    parser.add_argument("--threads", type=int, nargs="*", default=[1, 0])
+    parser.add_argument("--python-mb", type=float, default=64.0)
+    parser.add_argument("--seed", type=int, default=0)
+    args = parser.parse_args()
+
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        files = make_files(tmp, int(args.mb * (1 << 20)), args.files, args.seed)
+        size = sum(os.path.getsize(name) for name in files)
+        for threads in args.threads:
+            start = time.perf_counter()
+            tree = _telexsys.load_folded(files, threads=threads)
+            seconds = time.perf_counter() - start
+            results.append(
+                {
+                    "threads": threads,
+                    "used": tree.stats["threads"],
+                    "seconds": round(seconds, 3),
+                    "gb_per_s": round(size / seconds / (1 << 30), 3),
+                }
+            )
+
+        # the python merge path reads the files and builds a call tree
+        part, part_size = [], 0
+        for name in files:
+            if part and part_size + os.path.getsize(name) > args.python_mb * (1 << 20):
+                break
+            part.append(name)
+            part_size += os.path.getsize(name)
+        start = time.perf_counter()
+        lines = []
+        for name in part:
+            with open(name) as f:
+                lines.extend(line.strip() for line in f)
+        fg = FlameGraph(lines)
+        fg.parse_input()
+        fg._build_call_tree()
+        python_time = time.perf_counter() - start
+        identical = merged(_telexsys.load_folded(part).dumps()) == fg.stacks
+
+    print(
+        json.dumps(
+            {
+                "bytes": size,
+                "files": args.files,
+                "lines": tree.stats["lines"],
+                "samples": tree.samples,
+                "native": results,
+                "python_bytes": part_size,
+                "python_gb_per_s": round(part_size / python_time / (1 << 30), 3),
+                "identical": identical,
+            },
+            indent=2,
+        )
+    )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,68 @@
+"""
+Fresh-interpreter runs shared by the sampler benchmarks.
+
+A script measures every point of its grid in new interpreters: it runs itself
+again with ``--child RUN``, RUN being the JSON of the point, so that memory,
+signal handlers and samplers do not carry over from one run to the next. The
+child prints its result as JSON on the last line of its output.
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+from collections.abc import Callable
+
+
+def medians(results: list[dict]) -> dict:
+    """The median of every value of the results."""
+    return {key: statistics.median(r[key] for r in results) for key in results[0]}
+
+
+def measure(
+    script: str,
+    run: dict,
+    repeat: int,
+    aggregate: Callable[[list[dict]], dict] = medians,
+) -> dict:
+    """
+    The results of ``repeat`` children of ``script`` for ``run``, aggregated,
+    or the error of the first one that failed.
+    """
+    results = []
+    for _ in range(repeat):
+        proc = subprocess.run(
+            [sys.executable, script, "--child", json.dumps(run)],
+            capture_output=True,
+            text=True,
+        )
+        if proc.returncode != 0:
+            lines = proc.stderr.strip().splitlines()
+            return {"error": lines[-1] if lines else f"exit {proc.returncode}"}
+        results.append(json.loads(proc.stdout.splitlines()[-1]))
+    return aggregate(results)
+
+
+def parse_args(
+    parser: argparse.ArgumentParser, child: Callable[[dict], dict]
+) -> argparse.Namespace | None:
+    """The arguments of the script, or None once the run of --child is done."""
+    parser.add_argument("--child", help=argparse.SUPPRESS)
+    args = parser.parse_args()
+    if args.child:
+        print(json.dumps(child(json.loads(args.child))))
+        return None
+    return args
+
+
+def report(runs: list[dict]) -> None:
+    print(
+        json.dumps(
+            {"python": sys.version.split()[0], "cpus": os.cpu_count(), "runs": runs},
+            indent=2,
+        )
+    )
@@ -0,0 +1,211 @@
+"""
+Measure what a sampler costs the program it profiles.
+
+Usage:
+  python benchmarks/sampler_overhead_bench.py [--workloads W ...]
+      [--samplers S ...] [--intervals US ...] [--threads N ...]
+      [--filters F ...] [--time cpu|wall] [--repeat R] [--scale X]
+
+Every workload does a fixed amount of work, split between --threads threads:
+cpu (arithmetic loops), threads_io (socketpair round trips), recursion (deep
+recursive calls) and asyncio (tasks switching on an event loop). It runs
+without a sampler, then under TelexSysSampler ("sync") and
+TelexSysAsyncSampler ("async") for every interval (microseconds) and filter
+setting of the grid. Filters are none, frozen (ignore_frozen), focus
+(focus_mode), regex (regex_patterns matching the workload) and tree
+(tree_mode).
+
+Each run is a fresh interpreter (see runner.py), so memory and signal
+handlers do not carry over, and the medians of --repeat runs are reported as
+JSON: wall and CPU
+seconds, the slowdown and the extra CPU against the run without a sampler of
+the same workload and threads, the time the sampler measured in its own
+routine, the samples per second achieved against the ones asked for and the
+growth of the resident set while sampling.
+"""
+
+from __future__ import annotations
+
+import argparse
+import asyncio
+import itertools
+import os
+import socket
+import sys
+import threading
+import time
+
+import runner
+
+WORKLOADS = ("cpu", "threads_io", "recursion", "asyncio")
+FILTERS = ("none", "frozen", "focus", "regex", "tree")
+
+
+def cpu_work(units: int) -> int:
+    total = 0
+    for i in range(units * 1000):
+        total += i * i % 7
+    return total
+
+
+def threads_io_work(units: int) -> None:
+    left, right = socket.socketpair()
+    with left, right:
+        for _ in range(units * 20):
+            left.sendall(b"x" * 64)
+            right.recv(64)
+
+
+def descend(depth: int) -> int:
+    if depth == 0:
+        return sum(range(20))
+    return descend(depth - 1) + 1
+
+
+def recursion_work(units: int) -> None:
+    # deep, but within the 16KiB a sampler formats a stack into
+    for _ in range(units * 5):
+        descend(150)
+
+
+async def ticker(rounds: int) -> int:
+    total = 0
+    for i in range(rounds):
+        total += i % 3
+        await asyncio.sleep(0)
+    return total
+
+
+def asyncio_work(units: int) -> None:
+    async def main() -> None:
+        await asyncio.gather(*(ticker(units) for _ in range(100)))
+
+    asyncio.run(main())
+
+
+WORK = {
+    "cpu": (cpu_work, 3000),
+    "threads_io": (threads_io_work, 1000),
+    "recursion": (recursion_work, 1000),
+    "asyncio": (asyncio_work, 300),
+}
+
+
+def resident_bytes() -> int:
+    try:
+        with open("/proc/self/statm") as f:
+            return int(f.read().split()[1]) * os.sysconf("SC_PAGE_SIZE")
+    except OSError:  # pragma: no cover
+        import resource
+
+        # the peak, in KiB on Linux and bytes on macOS
+        scale = 1 if sys.platform == "darwin" else 1024
+        return resource.getrusage(resource.RUSAGE_SELF).ru_maxrss * scale
+
+
+def make_sampler(run: dict):
+    from telex.sampler import TelexSysAsyncSampler, TelexSysSampler
+
+    cls = TelexSysSampler if run["sampler"] == "sync" else TelexSysAsyncSampler
+    flt = run["filter"]
+    return cls(
+        sampling_interval=run["interval"],
+        ignore_frozen=flt == "frozen",
+        focus_mode=flt == "focus",
+        tree_mode=flt == "tree",
+        regex_patterns=[r"_work$|descend|ticker"] if flt == "regex" else None,
+        time_mode=run["time"],
+    )
+
+
+def child(run: dict) -> dict:
+    """One measurement, in this fresh interpreter."""
+    from telex import _telexsys
+
+    sys.setrecursionlimit(10_000)
+    work, units = WORK[run["workload"]]
+    units = max(1, int(units * run["scale"] / run["threads"]))
+    work(1)  # warm up imports and caches
+    sampler = None if run["sampler"] == "none" else make_sampler(run)
+    rss = resident_bytes()
+    if sampler is not None:
+        sampler.start()
+    wall, cpu = time.perf_counter(), time.process_time()
+    if run["threads"] == 1:
+        work(units)
+    else:
+        threads = [
+            threading.Thread(target=work, args=(units,)) for _ in range(run["threads"])
+        ]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+    wall, cpu = time.perf_counter() - wall, time.process_time() - cpu
+    result = {"wall": wall, "cpu": cpu, "rss_growth": 0}
+    if sampler is not None:
+        sampler.stop()
+        result.update(
+            rss_growth=resident_bytes() - rss,
+            sampler_seconds=sampler.acc_sampling_time / 1e6,
+            rounds=sampler.sampling_times,
+            samples=_telexsys.snapshot_stacks(sampler).samples,
+        )
+    return result
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--workloads", nargs="*", choices=WORKLOADS, default=WORKLOADS)
+    parser.add_argument(
+        "--samplers", nargs="*", choices=("sync", "async"), default=["sync", "async"]
+    )
+    parser.add_argument("--intervals", type=int, nargs="*", default=[10_000, 1_000])
+    parser.add_argument("--threads", type=int, nargs="*", default=[1, 8])
+    parser.add_argument("--filters", nargs="*", choices=FILTERS, default=["none"])
+    parser.add_argument("--time", choices=("cpu", "wall"), default="cpu")
+    parser.add_argument("--repeat", type=int, default=3)
+    # multiplies the work of every workload
+    parser.add_argument("--scale", type=float, default=1.0)
+    args = runner.parse_args(parser, child)
+    if args is None:
+        return
+
+    runs = []
+    for workload, threads in itertools.product(args.workloads, args.threads):
+        base = {
+            "workload": workload,
+            "threads": threads,
+            "scale": args.scale,
+            "time": args.time,
+        }
+        baseline = runner.measure(
+            __file__,
+            {**base, "sampler": "none", "interval": 0, "filter": "none"},
+            args.repeat,
+        )
+        runs.append({**base, "sampler": "none", **baseline})
+        grid = itertools.product(args.samplers, args.intervals, args.filters)
+        for sampler, interval, flt in grid:
+            run = {**base, "sampler": sampler, "interval": interval, "filter": flt}
+            result = runner.measure(__file__, run, args.repeat)
+            if "error" in result or "error" in baseline:
+                runs.append({**run, "error": result.get("error", baseline.get("error"))})
+                continue
+            runs.append(
+                {
+                    **run,
+                    **result,
+                    "slowdown": round(result["wall"] / baseline["wall"], 4),
+                    "extra_cpu": round(result["cpu"] - baseline["cpu"], 4),
+                    "target_rate": 1e6 / interval,
+                    "achieved_rate": round(result["rounds"] / result["wall"], 1),
+                }
+            )
+        print(f"{workload} x{threads} done", file=sys.stderr)
+
+    runner.report(runs)
+
+
+if __name__ == "__main__":
+    main()
@@ -44,12 +44,24 @@ def prepare_flags():
 
 flags = prepare_flags()
 
+# C++ sources linked into telex._telexsys
+CXX_SOURCES = [
+    "src/telex/telexsys/tree.cc",
+    "src/telex/telexsys/flamegraph.cc",
+    "src/telex/telexsys/pprof.cc",
+    "src/telex/telexsys/sample_log.cc",
+    "src/telex/telexsys/chrome_trace.cc",
+    "src/telex/telexsys/folded.cc",
+    "src/telex/telexsys/compress.cc",
+    "src/telex/telexsys/shm_ring.cc",
+]
+
 
 class Builder(build_ext):
     def run(self):
         if IS_WINDOWS:
             # On Windows, let setuptools handle the compilation via MSVC
-            # We need to compile tree.cc first as a separate step
+            # We need to compile the C++ sources first as a separate step
             from distutils.ccompiler import new_compiler
             from distutils.sysconfig import customize_compiler
 
@@ -65,9 +77,9 @@ class Builder(build_ext):
             else:
                 extra_args = flags
 
-            # Compile tree.cc
+            # Compile the C++ sources
             objects = compiler.compile(
-                ["src/telex/telexsys/tree.cc"],
+                CXX_SOURCES,
                 output_dir="build/temp",
                 extra_postargs=extra_args,
             )
@@ -75,19 +87,23 @@ class Builder(build_ext):
             self.tree_objects = objects
         else:
             # Use g++ on Unix-like systems
-            cmd = [
-                "g++",
-                "-c",
-                "-std=c++11",
-                "-fPIC",
-                "src/telex/telexsys/tree.cc",
-                "-pthread",
-                "-o",
-                "build/tree.o",
-                *flags,
-            ]
-            subprocess.check_call(cmd)
-            self.tree_objects = ["build/tree.o"]
+            self.tree_objects = []
+            for source in CXX_SOURCES:
+                name = os.path.splitext(os.path.basename(source))[0]
+                obj = f"build/{name}.o"
+                cmd = [
+                    "g++",
+                    "-c",
+                    "-std=c++11",
+                    "-fPIC",
+                    source,
+                    "-pthread",
+                    "-o",
+                    obj,
+                    *flags,
+                ]
+                subprocess.check_call(cmd)
+                self.tree_objects.append(obj)
         super().run()
 
     def build_extensions(self):
@@ -103,6 +119,11 @@ class Builder(build_ext):
                     else:
                         # On Unix, add as extra link args
                         ext.extra_link_args.extend(self.tree_objects)
+                        # after the objects that need it: pprof.cc and
+                        # compress.cc gzip with zlib, which Windows lacks
+                        ext.extra_link_args.append("-lz")
+                        # folded.cc parses with std::thread
+                        ext.extra_link_args.append("-pthread")
         super().build_extensions()
 
 
@@ -112,6 +133,23 @@ ext_modules = [
         sources=[
             "src/telex/telexsys/telexsys.c",
             "src/telex/telexsys/inject.c",
+            "src/telex/telexsys/remote.c",
+            "src/telex/telexsys/phase_stats.c",
+        ],
+        depends=[
+            *CXX_SOURCES,
+            "src/telex/telexsys/tree_impl.h",
+            "src/telex/telexsys/encode.h",
+            "src/telex/telexsys/flamegraph.h",
+            "src/telex/telexsys/pprof.h",
+            "src/telex/telexsys/sample_log.h",
+            "src/telex/telexsys/chrome_trace.h",
+            "src/telex/telexsys/folded.h",
+            "src/telex/telexsys/folded_line.h",
+            "src/telex/telexsys/compress.h",
+            "src/telex/telexsys/shm_ring.h",
+            "src/telex/telexsys/remote.h",
+            "src/telex/telexsys/phase_stats.h",
         ],
         include_dirs=["src/telex/telexsys"],
         extra_compile_args=flags,
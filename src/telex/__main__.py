@@ -31,8 +31,10 @@ from . import logger
 from ._telexsys import __version__
 from .config import TeleXConfig, TeleXSamplerConfig, merge_config_with_args
 from .environment import CodeMode, telex_env, telex_finalize
-from .flamegraph import FlameGraph
+from .flamegraph import FlameGraph, decompressed, open_folded, parse_minwidth
+from .sampler import PPROF_SUFFIXES, write_pprof
 from .shell import TeleXShell
+from .shm import aggregate
 
 console = logger.console
 err_console = logger.err_console
@@ -146,6 +148,15 @@ def _positive_int(value: str) -> int:
     return ivalue
 
 
+def _minwidth(value: str) -> float | str:
+    try:
+        return parse_minwidth(value)
+    except ValueError:
+        raise argparse.ArgumentTypeError(
+            "minwidth must be a non-negative number of pixels or a percentage"
+        ) from None
+
+
 def register_handler(handler: type[ArgsHandler]) -> None:
     """Register a handler class to be used in the application.
 
@@ -156,6 +167,35 @@ def register_handler(handler: type[ArgsHandler]) -> None:
     heapq.heappush(handlers, handler.build())
 
 
+def render_folded(folded_lines: list[str], args: argparse.Namespace) -> str:
+    """
+    Write folded lines to ``args.output`` as a flamegraph svg, an html viewer
+    or a pprof profile, by its suffix.
+
+    Returns:
+        What was written, for the success message.
+    """
+    flamegraph = FlameGraph(
+        folded_lines,
+        inverted=getattr(args, "inverted", False),
+        width=getattr(args, "width", 1200),
+        minwidth=getattr(args, "minwidth", 0.1),
+    )
+    kind = "flamegraph svg"
+    if args.output.endswith(PPROF_SUFFIXES):
+        kind = "pprof profile"
+        write_pprof(folded_lines, args.output)
+    elif args.output.endswith(".html"):
+        flamegraph.save_html(args.output)
+    elif getattr(args, "diff", None):
+        kind = "differential flamegraph svg"
+        with open_folded(args.diff) as f:
+            flamegraph.save(args.output, baseline=f.readlines())
+    else:
+        flamegraph.save(args.output)
+    return kind
+
+
 @register_handler
 class StackTraceHandler(ArgsHandler):
     """
@@ -183,29 +223,51 @@ class StackTraceHandler(ArgsHandler):
 
         for file_obj in input_files:
             input_names.append(getattr(file_obj, "name", "<unknown>"))
-            folded_lines.extend(line for line in file_obj if line.strip() != "")
-
-        flamegraph = FlameGraph(
-            folded_lines,
-            inverted=getattr(args, "inverted", False),
-            width=getattr(args, "width", 1200),
-        )
-        flamegraph.parse_input()
-        svg = flamegraph.generate_svg()
+            folded_lines.extend(
+                line for line in decompressed(file_obj) if line.strip() != ""
+            )
 
         for file_obj in input_files:
             file_obj.close()
-        with open(args.output, "w") as f:
-            f.write(svg)
+        kind = render_folded(folded_lines, args)
 
         input_display = ", ".join(input_names) if input_names else "<unknown>"
         logger.log_success_panel(
-            f"Generated a flamegraph svg file `{args.output}` from the stack "
+            f"Generated a {kind} file `{args.output}` from the stack "
             f"trace file(s) `{input_display}`, "
             f"please check it out via `open {args.output}`"
         )
 
 
+@register_handler
+class ShmAttachHandler(ArgsHandler):
+    """
+    Aggregating the samples another process exports to a shared-memory ring.
+    """
+
+    @classmethod
+    def build(cls) -> ArgsHandler:
+        return cls()
+
+    def __init__(self, priority: int = 4096) -> None:
+        super().__init__("ShmAttachHandler", priority=priority)
+
+    @override
+    def handle(self, args: argparse.Namespace) -> bool:
+        if not getattr(args, "shm_attach", None):
+            return False
+        counts, reader = aggregate(args.shm_attach, args.shm_seconds)
+        folded_lines = [f"{stack} {count}" for stack, count in counts.items()]
+        kind = render_folded(folded_lines, args)
+        logger.log_success_panel(
+            f"Generated a {kind} file `{args.output}` from "
+            f"{sum(counts.values())} samples of `{args.shm_attach}` "
+            f"({reader.lost} lost, {reader.dropped} dropped), "
+            f"please check it out via `open {args.output}`"
+        )
+        return True
+
+
 @register_handler
 class PythonFileProfilingHandler(ArgsHandler):
     @classmethod
@@ -358,6 +420,13 @@ def _pre_checks(args: argparse.Namespace, parser: argparse.ArgumentParser) -> No
         config_manager.create_example_config()
         sys.exit(0)
 
+    # a differential flamegraph is only rendered from parsed folded files
+    if args.diff is not None:
+        if not args.parse:
+            parser.error("--diff needs --parse")
+        if args.output.endswith((*PPROF_SUFFIXES, ".html")):
+            parser.error("--diff renders an svg, not a pprof profile or an html viewer")
+
 
 def main():
     arguments = sys.argv[1:]
@@ -399,6 +468,50 @@ def main():
         "such as `telex -p result.folded`. Multiple input files are supported, "
         "TeleX will merge them into a single SVG file.",
     )
+    parser.add_argument(
+        "--diff",
+        metavar="BASELINE",
+        type=str,
+        help="With --parse, render a differential flamegraph svg against this "
+        "older folded file: frames are as wide as in the input and red or blue by "
+        "how much their share of the samples grew or shrank.",
+    )
+    parser.add_argument(
+        "--shm-ring",
+        metavar="PATH",
+        type=str,
+        help="Also write every sample to this file, usually under /dev/shm, so that "
+        "another process can follow the profile with --shm-attach without touching "
+        "the profiled interpreter.",
+    )
+    parser.add_argument(
+        "--shm-attach",
+        metavar="PATH",
+        type=str,
+        help="Read the samples a profiled process writes to its --shm-ring file for "
+        "--shm-seconds and render them to --output.",
+    )
+    parser.add_argument(
+        "--shm-seconds",
+        type=float,
+        default=10,
+        help="Seconds --shm-attach follows the ring for (default: 10).",
+    )
+    parser.add_argument(
+        "--dump-signal",
+        metavar="SIGNAL",
+        type=str,
+        help="Write the profile so far to telex-<pid>-<time>.folded (or .pb.gz for a "
+        "pprof --output) whenever the process gets this signal, e.g. USR2, for "
+        "deployments that can not open the monitor port.",
+    )
+    parser.add_argument(
+        "--remote-children",
+        action="store_true",
+        help="Sample the child processes, including forkserver and subprocess ones, "
+        "by reading their memory from this process instead of running telex in "
+        "them. They must run the same Python version. Linux only.",
+    )
     parser.add_argument(
         "-i",
         "--interval",
@@ -458,11 +571,19 @@ def main():
         "--folded-file",
         type=str,
         default="result.folded",
-        help="Save folded stack traces into a file (default: result.folded). "
+        help="Save folded stack traces into a file (default: result.folded), "
+        "gzipped if its name ends with `.gz`. "
         "You should enable --folded-save if using this option.",
     )
     parser.add_argument(
-        "-o", "--output", default="result.svg", help="Output file (default: result.svg)."
+        "-o",
+        "--output",
+        default="result.svg",
+        help="Output file (default: result.svg). A `.html` file is a viewer that "
+        "loads frames lazily and keeps the ones narrower than --minwidth, a "
+        "`.pprof` or `.pb.gz` file is a gzipped pprof profile. When profiling, "
+        "a `.speedscope.json` or `.trace.json` file is the timeline of every "
+        "sample for speedscope or Chrome's trace viewer.",
     )
     parser.add_argument(
         "--width",
@@ -470,6 +591,13 @@ def main():
         default=1200,
         help="SVG width in pixels for generated flamegraphs (default: 1200).",
     )
+    parser.add_argument(
+        "--minwidth",
+        type=_minwidth,
+        default=0.1,
+        help="Frames narrower than this are coalesced into one box per parent, given "
+        "in pixels or as a percentage of all samples such as `0.5%%` (default: 0.1).",
+    )
     add_boolean_argument(
         parser,
         "--merge",
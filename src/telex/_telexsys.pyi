@@ -4,11 +4,14 @@
 An utility module for telexsys
 """
 
-from collections.abc import Callable
+from collections.abc import Callable, Iterable, Sequence
 from threading import Thread
 from types import FrameType
+from typing import Any
 
 __version__: str
+# whether folded and pprof files are gzipped natively, False on Windows
+HAVE_ZLIB: bool
 
 def current_frames() -> dict[int, FrameType]: ...
 def unix_micro_time() -> int: ...
@@ -56,6 +59,31 @@ def vm_read(tid: int, name: str, level: int = 0) -> object | None:
     """
     ...
 
+def vm_read_many(
+    requests: Iterable[tuple[int, str] | tuple[int, str, int]],
+) -> list[object | None]:
+    """
+    Read many variables at once, each request holds the arguments of vm_read:
+    (tid, name) or (tid, name, level).
+
+    All threads are resolved from a single snapshot of their frames, and the
+    locals of a frame are gathered once for all the variables read from it.
+
+    Returns:
+        The value of every request in order, None where vm_read would
+        return None.
+
+    Raises:
+        TypeError: If a request is not such a tuple
+        ValueError: If a level is negative
+
+    Example:
+        >>> values = _telexsys.vm_read_many(
+        ...     [(thread.ident, "local_var"), (thread.ident, "some_var", 1)]
+        ... )
+    """
+    ...
+
 def vm_write(tid: int, name: str, value: object) -> bool:
     """
     Write a variable to the specified thread's frame.
@@ -138,6 +166,324 @@ def top_namespace(
     """
     ...
 
+def render_flamegraph(
+    source: Sampler | AsyncSampler | StackTree | Iterable[str],
+    filename: str,
+    width: int = 1200,
+    height: int = 15,
+    minwidth: float = 0.1,
+    title: str = "TeleX Flame Graph",
+    countname: str = "samples",
+    header_lines: Sequence[str] = (),
+    script: str = "",
+    inverted: bool = False,
+    strip_prefixes: Sequence[str] = (),
+    baseline: Sampler | AsyncSampler | StackTree | Iterable[str] | None = None,
+) -> int:
+    """
+    Render folded stack lines into a flamegraph svg file.
+
+    The output is byte for byte the same as FlameGraph.generate_svg(), but the
+    tree is built and laid out natively and the svg is streamed to the file,
+    so large profiles render without building the whole document in memory.
+
+    Args:
+        source: A sampler or StackTree, whose stack tree is walked directly
+            without dumping it to text, or folded stack lines such as
+            "a;b;c 10". Invalid lines are reported to stderr and ignored.
+        filename: The svg file to write.
+        header_lines: Already wrapped header lines shown under the title.
+        script: The content of script.js.
+        strip_prefixes: Prefixes removed in order from every frame name,
+            each distinct name is shortened only once.
+        baseline: An older profile, of any kind `source` accepts, for a
+            differential flamegraph. Both are merged into one tree, frames
+            keep their width in `source` and are coloured red if their share
+            of the samples grew since `baseline`, blue if it shrank, the more
+            saturated the larger the change. Titles show the change in
+            percentage points, frames only `baseline` has are not drawn.
+
+    Returns:
+        int: The total number of samples.
+
+    Raises:
+        OSError: if the file can not be written.
+    """
+    ...
+
+def flamegraph_chunks(
+    source: Sampler | AsyncSampler | StackTree | Iterable[str],
+    min_fraction: float = 0.0,
+    max_nodes: int = 4096,
+    strip_prefixes: Sequence[str] = (),
+) -> tuple[int, list[bytes]]:
+    """
+    Split the call tree into JSON chunks for the lazy html viewer.
+
+    Chunk 0 holds the frames seen before any zoom, the children left out of a
+    chunk are packed into later ones, see flamegraph.cc for the format.
+
+    Args:
+        source: A sampler or folded stack lines, as for render_flamegraph.
+        min_fraction: Frames narrower than this fraction of the root of their
+            chunk are left to a later chunk.
+        max_nodes: The most frames a chunk holds, always at least one.
+        strip_prefixes: Prefixes removed in order from every frame name.
+
+    Returns:
+        tuple[int, list[bytes]]: The total number of samples and the chunks.
+
+    Raises:
+        ValueError: if max_nodes is not positive.
+    """
+    ...
+
+def write_pprof(
+    source: Sampler | AsyncSampler | StackTree | Iterable[str],
+    filename: str,
+    period: int = 0,
+    sample_type: str = "cpu",
+    time_nanos: int = 0,
+    duration_nanos: int = 0,
+    compress: bool = True,
+) -> int:
+    """
+    Write a profile in the pprof format (profile.proto).
+
+    Samples are encoded and gzipped while the stacks are walked, only the
+    string, function and location tables are held until the end. Frames named
+    "file:function:line" become a function in that file, other frames (thread
+    names for instance) a function without a file.
+
+    Args:
+        source: A sampler or StackTree, whose stack tree is walked directly,
+            or folded stack lines such as "a;b;c 10". Invalid lines are reported to
+            stderr and ignored.
+        filename: The file to write.
+        period: Nanoseconds between two samples. When set, samples carry their
+            time too, as a second `sample_type` value in nanoseconds.
+        sample_type: The name of that value, e.g. "cpu" or "wall".
+        time_nanos: When the profile was started, since the epoch.
+        duration_nanos: How long the profile was collected for.
+        compress: Whether to gzip the output, see telex.sampler.write_pprof
+            where HAVE_ZLIB is False.
+
+    Returns:
+        int: The total number of samples.
+
+    Raises:
+        OSError: if the file can not be written, ENOSYS if it is to be
+            compressed without HAVE_ZLIB.
+    """
+    ...
+
+def chrome_trace_to_folded(
+    trace_file: str,
+    output_file: str,
+    scale: float = 100.0,
+) -> dict[str, int]:
+    """
+    Convert a Chrome trace to folded stacks without loading it in memory.
+
+    The complete ("X") events are nested per (pid, tid) and each frame is
+    charged its self time, in 1/scale microseconds, under
+    "Process(pid);Thread(tid)".
+
+    Args:
+        trace_file: An object holding "traceEvents" or a bare array of events.
+        output_file: The folded file to write, gzipped if it ends with ".gz".
+        scale: Units per microsecond, must be positive.
+
+    Returns:
+        dict[str, int]: events, threads, stacks, samples and max_depth.
+
+    Raises:
+        OSError: if a file can not be read or written.
+        ValueError: if the trace is not valid JSON.
+    """
+    ...
+
+def load_folded(filenames: str | Sequence[str], threads: int = 0) -> StackTree:
+    """
+    Load folded stack files into a StackTree, parsed by several threads.
+
+    The files are mapped and split into ranges of whole lines, one per thread.
+    Every range is parsed into a trie of its own, scanning for newlines 16
+    bytes at a time, and the tries are merged in input order, so the result
+    does not depend on the number of threads. Lines follow the rules of
+    render_flamegraph, except that negative counts are invalid.
+
+    Gzipped files are recognized by their first bytes. The ones saved with a
+    ".gz" name are a series of gzip members of whole lines which record their
+    size, they are split between the threads by member and inflated one
+    member at a time. Other gzip files are inflated whole before parsing.
+
+    Args:
+        filenames: A path or a sequence of paths.
+        threads: The number of parser threads, 0 for one per CPU. Inputs of
+            less than 1MiB per thread use fewer.
+
+    Returns:
+        StackTree: The merged stacks. Lines without a count are skipped and
+            counted in its stats.
+
+    Raises:
+        OSError: if a file can not be read or is not valid gzip, the tree is
+            left unchanged. ENOSYS for gzip without HAVE_ZLIB, see
+            telex.flamegraph.load_stacks.
+    """
+    ...
+
+def take_stacks(sampler: Sampler | AsyncSampler) -> StackTree:
+    """
+    Take the stacks a sampler collected so far and leave it an empty tree,
+    the sampler may keep running. No sample is lost or counted twice.
+    """
+    ...
+
+def snapshot_stacks(sampler: Sampler | AsyncSampler) -> StackTree:
+    """
+    Copy the stacks a sampler collected so far, the sampler keeps them.
+    """
+    ...
+
+def thread_stacks(strip: Sequence[str] = (), indent: str = "") -> dict[int, str]:
+    """
+    Format the stack of every thread natively in one pass, innermost frame
+    first and one "path:lineno qualname" per line. The first prefix in
+    `strip` a filename starts with is removed, `indent` starts every line.
+    """
+    ...
+
+ShmRingCursor = tuple[int, int, int, int, int]
+
+def shm_ring_read(
+    path: str, cursor: ShmRingCursor = (0, 0, 0, 0, 0)
+) -> tuple[ShmRingCursor, list[tuple[int, int, int]], list[str]]:
+    """
+    Read the samples a sampler exported to `path` (see Sampler.shm_ring)
+    after `cursor`, which is (next sample, stack table offset, lost,
+    dropped, generation). Returns the new cursor, the samples as (time, tid,
+    stack id) and the stacks added since, the n-th stack read has id n. A
+    ring created again at the same path has another generation, its stack
+    ids start over.
+    Raises:
+        OSError: if the file can not be read or is not a ring
+    """
+    ...
+
+class StackTree:
+    """
+    Folded stacks merged in a tree, as a sampler keeps them. It is accepted
+    by render_flamegraph, flamegraph_chunks and write_pprof like a sampler.
+    """
+
+    # the sum of the counts of every line added
+    samples: int
+    # bytes, lines, invalid (lines), samples added and the threads used by
+    # the last load
+    stats: dict[str, int]
+    # the shape and memory of the tree, kept up to date as it changes:
+    # nodes (frames, thread names included), leaves (frames without
+    # children), max_depth and total_depth (the sum of the depths of the
+    # leaves), name_bytes (the frame names) and heap_bytes (the nodes and
+    # their names, without the allocator's overhead)
+    tree_stats: dict[str, int]
+
+    def load(self, filenames: str | Sequence[str], threads: int = 0) -> None:
+        """Add the stacks of folded files, see load_folded."""
+        ...
+
+    def add_lines(self, lines: Iterable[str]) -> None:
+        """
+        Add folded stack lines such as "a;b;c 10", invalid lines are reported
+        to stderr and ignored.
+        """
+        ...
+
+    def dumps(self) -> str:
+        """Return the stacks as folded lines."""
+        ...
+
+    def save(self, filename: str) -> None:
+        """
+        Save the stacks to a folded file. A name ending with ".gz" is
+        gzipped while the tree is walked, by one thread per CPU, in blocks
+        of about 1MiB that are never all held in memory, see load_folded.
+        Raises:
+            OSError: if the file can not be written, ENOSYS for ".gz" without
+                HAVE_ZLIB, see telex.flamegraph.save_stacks
+        """
+        ...
+
+    def merge(self, other: StackTree) -> None:
+        """Add every stack of another tree."""
+        ...
+
+    def subtract(self, other: StackTree) -> None:
+        """
+        Remove every stack of another tree that was merged before, frames
+        left without samples are freed.
+        """
+        ...
+
+    def pack(self) -> bytes:
+        """
+        The stacks in a compact binary form for merge_packed, every distinct
+        frame name is stored once.
+        """
+        ...
+
+    def merge_packed(self, data: bytes) -> None:
+        """
+        Add the stacks of a tree packed by pack(), possibly in another process.
+        Raises ValueError, adding nothing, if data is not a packed tree.
+        """
+        ...
+
+    def top(self, k: int = 10) -> list[tuple[str, int, int]]:
+        """
+        The k frames with the most samples of their own, as
+        (name, self, total), total counts a recursive frame once per stack.
+        """
+        ...
+
+class RemoteProcess:
+    """
+    Another local process running this Python version, sampled by reading
+    its memory without running anything in it, see telex.remote. Linux
+    only, for Python 3.11 and 3.12.
+    """
+
+    # the process read
+    pid: int
+
+    def __init__(self, pid: int) -> None:
+        """
+        Find the interpreter of process pid through the ELF symbols of the
+        libpython or executable it maps.
+        Raises:
+            ValueError: if the process does not run this Python version
+            OSError: if it does not exist or can not be read
+            NotImplementedError: on other platforms and Python versions
+        """
+        ...
+
+    def sample(self, tree: StackTree, prefix: str | None = None) -> int:
+        """
+        Add the stack of every thread to tree, as
+        "prefix;ThreadName;file:qualname:firstlineno;...", and return the
+        number of stacks added. Threads are named MainThread or
+        Thread-<native id>, the threading module is not read.
+        Raises:
+            ProcessLookupError: once the process exited
+        """
+        ...
+
+    def close(self) -> None:
+        """Forget the process, sample can not be called afterwards."""
+        ...
+
 class Sampler:
     def __init__(self) -> None:
         # sampling interval in microseconds
@@ -146,11 +492,22 @@ class Sampler:
         self.sampler_life_time: int
         self.acc_sampling_time: int
         self.sampling_times: int
+        # nodes, leaves, max_depth, total_depth, name_bytes and heap_bytes
+        # of the stack tree, see StackTree.tree_stats
+        self.tree_stats: dict[str, int]
+        self.start_time: int
+        self.end_time: int
         self.debug: bool = False
         self.ignore_frozen: bool = False
         self.ignore_self: bool = False
         self.tree_mode: bool = False
         self.focus_mode: bool = False
+        # keep every sample in order, for the timeline exports
+        self.sample_log: bool = False
+        # a file the samples are exported to, see shm_ring_read
+        self.shm_ring: str | None = None
+        # time every phase of a sampling round, see stats
+        self.phase_stats: bool = False
         self.regex_patterns: list | None = None
 
     def start(self) -> None:
@@ -176,13 +533,49 @@ class Sampler:
         ...
 
     def save(self, path: str) -> None:
-        """save the sampled frames to a file"""
+        """save the sampled frames to a folded file, gzipped if `path` ends
+        with ".gz"
+        """
         ...
 
     def dumps(self) -> str:
         """dump the sampled frames to a string"""
         ...
 
+    def save_speedscope(self, filename: str, name: str = "telex") -> int:
+        """
+        save the sample log in speedscope's file format, a sampled profile
+        per thread whose samples weigh the time until the next one.
+        Returns the number of samples.
+        Raises:
+            RuntimeError: if sample_log is not enabled
+            OSError: if the file can not be written
+        """
+        ...
+
+    def save_chrome_trace(self, filename: str, pid: int = 0) -> int:
+        """
+        save the sample log as Chrome trace events, a frame opens (B) at the
+        first sample it shows up in and closes (E) at the first one it is
+        gone from. Returns the number of samples.
+        Raises:
+            RuntimeError: if sample_log is not enabled
+            OSError: if the file can not be written
+        """
+        ...
+
+    def stats(self) -> dict[str, dict[str, Any]]:
+        """
+        the time spent in every phase of the sampling rounds: round,
+        current_frames, threads, thread_name, frame_walk, filter, format and
+        add. Each has count, total_ns, mean_ns, max_ns, p50_ns, p99_ns and
+        histogram, the counts of log2 buckets of nanoseconds by their lower
+        bound. Quantiles are the upper bound of their bucket.
+        Raises:
+            RuntimeError: if phase_stats is not enabled
+        """
+        ...
+
 class AsyncSampler:
     def __init__(self) -> None:
         # sampling interval in microseconds
@@ -190,6 +583,8 @@ class AsyncSampler:
         self.sampler_life_time: int
         self.acc_sampling_time: int
         self.sampling_times: int
+        # see Sampler.tree_stats
+        self.tree_stats: dict[str, int]
         self.debug: bool = False
         self.ignore_frozen: bool = False
         self.sampling_tid: int
@@ -198,6 +593,12 @@ class AsyncSampler:
         self.ignore_self: bool = False
         self.tree_mode: bool = False
         self.focus_mode: bool = False
+        # keep every sample in order, for the timeline exports
+        self.sample_log: bool = False
+        # a file the samples are exported to, see shm_ring_read
+        self.shm_ring: str | None = None
+        # time every phase of a sampling round, see stats
+        self.phase_stats: bool = False
         self.regex_patterns: list | None = None
 
     def start(self) -> None:
@@ -217,7 +618,9 @@ class AsyncSampler:
         ...
 
     def save(self, path: str) -> None:
-        """save the sampled frames to a file"""
+        """save the sampled frames to a folded file, gzipped if `path` ends
+        with ".gz"
+        """
         ...
 
     def dumps(self) -> str:
@@ -227,6 +630,40 @@ class AsyncSampler:
         """
         ...
 
+    def save_speedscope(self, filename: str, name: str = "telex") -> int:
+        """
+        save the sample log in speedscope's file format, a sampled profile
+        per thread whose samples weigh the time until the next one.
+        Returns the number of samples.
+        Raises:
+            RuntimeError: if sample_log is not enabled
+            OSError: if the file can not be written
+        """
+        ...
+
+    def save_chrome_trace(self, filename: str, pid: int = 0) -> int:
+        """
+        save the sample log as Chrome trace events, a frame opens (B) at the
+        first sample it shows up in and closes (E) at the first one it is
+        gone from. Returns the number of samples.
+        Raises:
+            RuntimeError: if sample_log is not enabled
+            OSError: if the file can not be written
+        """
+        ...
+
+    def stats(self) -> dict[str, dict[str, Any]]:
+        """
+        the time spent in every phase of the sampling rounds: round,
+        current_frames, threads, thread_name, frame_walk, filter, format and
+        add. Each has count, total_ns, mean_ns, max_ns, p50_ns, p99_ns and
+        histogram, the counts of log2 buckets of nanoseconds by their lower
+        bound. Quantiles are the upper bound of their bucket.
+        Raises:
+            RuntimeError: if phase_stats is not enabled
+        """
+        ...
+
     def _async_routine(self, sig_num: int, frame: FrameType | None) -> None:
         """async routine"""
         ...
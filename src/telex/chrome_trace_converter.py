@@ -4,6 +4,12 @@ Convert Chrome Trace Event Format trace.json to folded stack format.
 This module reads Chrome Trace Event Format trace.json files and converts them
 to the folded stack format used by TeleX for flame graph generation.
 Each trace line starts with Process(pid);Thread(tid); followed by the stack trace.
+
+Complete events are nested by their time ranges and every one of them is charged
+its self time, its duration minus the durations of the events it encloses, in
+hundredths of a microsecond. `convert` and the `tracec` command stream the trace
+through the native converter, ChromeTraceConverter.convert_to_folded is the same
+sweep over events loaded in memory.
 """
 
 from __future__ import annotations
@@ -16,7 +22,10 @@ from typing import Any
 
 from rich_argparse import RichHelpFormatter
 
-from . import logger
+from . import _telexsys, logger
+
+# counts are in units of 1/SCALE microseconds
+SCALE = 100
 
 console = logger.console
 err_console = logger.err_console
@@ -35,6 +44,7 @@ class ChromeTraceConverter:
         self.trace_file = Path(trace_file)
         self.events: list[dict[str, Any]] = []
         self.stacks: dict[str, int] = defaultdict(int)
+        self.stats: dict[str, int] = {}
 
     def load_trace(self) -> None:
         """Load trace events from the JSON file."""
@@ -102,10 +112,10 @@ class ChromeTraceConverter:
             ts = event.get("ts", 0)
             dur = event.get("dur", 0)
 
-            # Add start and end times
+            # Add start and end times, rounded as the native converter does
             event_copy = event.copy()
-            event_copy["start"] = ts
-            event_copy["end"] = ts + dur
+            event_copy["start"] = round(ts * SCALE)
+            event_copy["end"] = event_copy["start"] + round(dur * SCALE)
 
             thread_events[(pid, tid)].append(event_copy)
 
@@ -115,101 +125,50 @@ class ChromeTraceConverter:
 
         return thread_events
 
-    def _build_stack_trace(
-        self, events: list[dict[str, Any]], index: int, current_time: float
-    ) -> list[str]:
+    def _close_frame(self, frames: list[list[Any]]) -> None:
         """
-        Build a stack trace by finding parent events.
-
-        An event A is a parent of event B if:
-        - A.start <= B.start
-        - A.end >= B.end
-        - A is the closest such event to B
+        Pop the innermost open event and charge its self time.
 
         Args:
-            events: Sorted list of events for a thread
-            index: Index of the current event
-            current_time: Current timestamp
-
-        Returns:
-            Stack trace from root to current event
+            frames: The open events of a thread, outermost first, as
+                    [end, folded line, start, time of their children]
         """
-        if index >= len(events):
-            return []
-
-        current_event = events[index]
-        current_start = current_event["start"]
-        current_end = current_event["end"]
-
-        # Build stack by finding all enclosing events
-        stack = []
-
-        # Find all events that contain the current event
-        for i in range(len(events)):
-            if i == index:
-                continue
-
-            parent = events[i]
-            parent_start = parent["start"]
-            parent_end = parent["end"]
-
-            # Check if parent contains current event
-            if parent_start <= current_start and parent_end >= current_end:
-                # Get parent name
-                name = self._extract_event_name(parent)
-                if name:
-                    # Store with depth info for sorting
-                    duration = parent_end - parent_start
-                    stack.append((parent_start, parent_end, duration, name))
-
-        # Sort by start time and duration (larger durations first = outer frames)
-        stack.sort(key=lambda x: (x[0], -x[2]))
-
-        # Extract just the names
-        result = [item[3] for item in stack]
-
-        # Add current event at the end (top of stack)
-        current_name = self._extract_event_name(current_event)
-        if current_name:
-            result.append(current_name)
-
-        return result
+        end, line, start, children = frames.pop()
+        total = end - start
+        if frames:
+            frames[-1][3] += total
+        if total > children:
+            self.stacks[line] += total - children
 
     def convert_to_folded(self) -> dict[str, int]:
         """
         Convert trace events to folded stack format.
 
-        This method builds proper call stacks by analyzing event nesting.
-        Events are grouped by thread, sorted by time, and nested based on
-        their time ranges.
+        Events are grouped by thread and sorted by time, then a single sweep
+        keeps the events enclosing the current one: an event is the child of
+        the innermost open event that ends after it starts, and is clipped to
+        its end. Each event is charged its self time.
 
         Returns:
             Dictionary mapping folded stack lines to sample counts
         """
-        # Build call tree organized by thread
-        thread_events = self._build_call_tree()
-
-        # Process each thread's events
-        for (pid, tid), events in thread_events.items():
-            # Process each event
-            for i, event in enumerate(events):
-                duration = event.get("dur", 0)
-                if duration <= 0:
+        for (pid, tid), events in self._build_call_tree().items():
+            prefix = self._format_stack_line(pid, tid, [])
+            frames: list[list[Any]] = []
+            for event in events:
+                name = self._extract_event_name(event)
+                start, end = event["start"], event["end"]
+                if name is None or end <= start:
                     continue
-
-                # Build stack trace for this event
-                stack = self._build_stack_trace(events, i, event["start"])
-
-                if not stack:
-                    continue
-
-                # Format the folded line
-                folded_line = self._format_stack_line(pid, tid, stack)
-
-                # Use duration as the sample count (rounded to nearest int)
-                # Duration is in microseconds, multiply by 100 for better visibility
-                count = max(1, round(duration * 100))
-                self.stacks[folded_line] += count
+                while frames and frames[-1][0] <= start:
+                    self._close_frame(frames)
+                parent = prefix
+                if frames:
+                    end = min(end, frames[-1][0])
+                    parent = frames[-1][1]
+                frames.append([end, f"{parent};{name}", start, 0])
+            while frames:
+                self._close_frame(frames)
 
         return self.stacks
 
@@ -227,22 +186,28 @@ class ChromeTraceConverter:
 
     def convert(self, output_file: str | None = None) -> str:
         """
-        Complete conversion pipeline: load, convert, and save.
+        Complete conversion pipeline: the trace is streamed through the native
+        converter, without loading it in memory.
 
         Args:
             output_file: Path to save the folded output.
                         If None, defaults to trace_file with .folded extension
 
+        The events, threads, stacks, samples and max_depth of the output are
+        kept in `stats`.
+
         Returns:
             Path to the output file
+
+        Raises:
+            OSError: If a file can not be read or written.
+            ValueError: If the trace is not valid JSON.
         """
         if output_file is None:
             output_file = str(self.trace_file.with_suffix(".folded"))
-
-        self.load_trace()
-        self.convert_to_folded()
-        self.save_folded(output_file)
-
+        self.stats = _telexsys.chrome_trace_to_folded(
+            str(self.trace_file), output_file, scale=SCALE
+        )
         return output_file
 
 
@@ -352,9 +317,10 @@ def main():
     parser.add_argument(
         "--minwidth",
         metavar="MINWIDTH",
-        type=float,
-        default=0.1,
-        help="Minimum width percentage for a frame to be shown (default: 0.1)",
+        type=str,
+        default="0.1",
+        help="Frames narrower than this are coalesced into one box, in pixels or "
+        "as a percentage of samples such as 0.5%% (default: 0.1)",
     )
 
     parser.add_argument(
@@ -422,31 +388,24 @@ def main():
                 f"[yellow]{args.trace_file}[/yellow]"
             )
 
-        converter.load_trace()
+        output_file = converter.convert(args.output_file)
+        stats = converter.stats
 
         if args.verbose:
             console.print(
-                f"[green]✓[/green] Loaded [bold cyan]{len(converter.events)}"
-                f"[/bold cyan] trace events"
+                f"[green]✓[/green] Loaded [bold cyan]{stats['events']}"
+                f"[/bold cyan] complete events of [bold cyan]{stats['threads']}"
+                f"[/bold cyan] threads"
             )
-
-        stacks = converter.convert_to_folded()
-
-        if args.verbose:
             console.print(
-                f"[green]✓[/green] Generated [bold cyan]{len(stacks)}"
+                f"[green]✓[/green] Generated [bold cyan]{stats['stacks']}"
                 f"[/bold cyan] unique stack traces"
             )
             console.print(
                 f"[green]✓[/green] Total samples: "
-                f"[bold magenta]{sum(stacks.values()):,}[/bold magenta]"
+                f"[bold magenta]{stats['samples']:,}[/bold magenta]"
             )
 
-        output_file = args.output_file or str(
-            Path(args.trace_file).with_suffix(".folded")
-        )
-        converter.save_folded(output_file)
-
         console.print(
             f"[green]✓[/green] Converted trace saved to: "
             f"[bold yellow]{output_file}[/bold yellow]"
@@ -454,10 +413,9 @@ def main():
 
         if args.verbose:
             # Show some statistics
-            max_depth = max(len(stack.split(";")) for stack in stacks.keys())
             console.print(
                 f"[green]✓[/green] Maximum stack depth: "
-                f"[bold cyan]{max_depth}[/bold cyan]"
+                f"[bold cyan]{stats['max_depth']}[/bold cyan]"
             )
             file_size = Path(output_file).stat().st_size
             console.print(
@@ -471,10 +429,10 @@ def main():
                 console.print("\n[cyan]Generating flame graph...[/cyan]")
 
             try:
-                from telex.flamegraph import FlameGraph
+                from telex.flamegraph import FlameGraph, open_folded
 
                 # Read the folded file
-                with open(output_file) as f:
+                with open_folded(output_file) as f:
                     lines = f.readlines()
 
                 if args.verbose:
@@ -540,7 +498,7 @@ def main():
     except FileNotFoundError as e:
         logger.log_error_panel(f"File not found: {e}")
         sys.exit(1)
-    except json.JSONDecodeError as e:
+    except ValueError as e:
         logger.log_error_panel(
             f"Invalid JSON format: {e}\n\n"
             f"Please ensure the file is a valid Chrome Trace Event Format "
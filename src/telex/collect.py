@@ -0,0 +1,210 @@
+"""
+Profiles of child processes sent to their parent over a Unix socket.
+
+A process that forks or spawns profiled children listens on a socket in a
+directory of its own that only its user can enter, and publishes the path in
+the environment its children inherit, see ``collector_path``. A child that
+exits connects to the path of its parent and sends its stacks, packed with
+``StackTree.pack``, and the parent merges them at once, so the merged profile
+is ready when the parent itself stops instead of after it read a folded file
+per child.
+
+Children fall back to the ``pid-ppid.folded`` files when their parent does
+not listen, such as on Windows.
+"""
+
+from __future__ import annotations
+
+import json
+import os
+import socket
+import stat
+import struct
+import tempfile
+import threading
+
+from . import _telexsys
+
+# seconds a child may take to send its stacks
+SEND_TIMEOUT = 10.0
+# the size of the packed stacks that follow
+HEADER = struct.Struct("!Q")
+# the sockets of the collectors of this process and its ancestors, a JSON
+# object of pid to path
+COLLECTORS_ENV = "TELEX_COLLECTORS"
+
+
+def _collectors() -> dict[str, str]:
+    try:
+        paths = json.loads(os.environ.get(COLLECTORS_ENV, "{}"))
+    except ValueError:
+        return {}
+    return paths if isinstance(paths, dict) else {}
+
+
+def _publish(pid: int, path: str | None) -> None:
+    paths = _collectors()
+    if path is None:
+        paths.pop(str(pid), None)
+    else:
+        paths[str(pid)] = path
+    if paths:
+        os.environ[COLLECTORS_ENV] = json.dumps(paths)
+    else:
+        os.environ.pop(COLLECTORS_ENV, None)
+
+
+def collector_path(pid: int) -> str | None:
+    """The socket the collector of process ``pid`` listens on, if any."""
+    path = _collectors().get(str(pid))
+    return path if isinstance(path, str) else None
+
+
+def _private(path: str) -> bool:
+    """Whether only this user can reach the socket at ``path``."""
+    try:
+        st = os.lstat(os.path.dirname(path))
+    except OSError:
+        return False
+    return (
+        stat.S_ISDIR(st.st_mode)
+        and st.st_uid == os.getuid()
+        and st.st_mode & 0o077 == 0
+    )
+
+
+class ChildCollector:
+    def __init__(self, path: str | None = None) -> None:
+        """
+        Listen for the stacks of child processes.
+
+        Args:
+            path: The socket, in a new directory that only this user can
+                enter by default.
+        Raises:
+            OSError: If the socket can not be created.
+        """
+        # the directory made for the socket, removed with it
+        self._dir: str | None = None
+        if path is None:
+            self._dir = tempfile.mkdtemp(prefix="telex-")
+            path = os.path.join(self._dir, "collect.sock")
+        self.path = path
+        self.tree = _telexsys.StackTree()
+        # children that sent their stacks, valid or not
+        self.received = 0
+        self.invalid = 0
+        self._pid = os.getpid()
+        self._cond = threading.Condition()
+        self._stopped = threading.Event()
+        self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            self._sock.bind(self.path)
+            self._sock.listen(128)
+            self._sock.settimeout(0.1)
+        except OSError:
+            self._sock.close()
+            if self._dir is not None:
+                os.rmdir(self._dir)
+            raise
+        _publish(self._pid, self.path)
+        self._thread = threading.Thread(
+            target=self._run, name="telex-collect", daemon=True
+        )
+        self._thread.start()
+
+    def _run(self) -> None:
+        while not self._stopped.is_set():
+            try:
+                conn, _ = self._sock.accept()
+            except socket.timeout:
+                continue
+            except OSError:
+                return
+            with conn:
+                conn.settimeout(SEND_TIMEOUT)
+                self._receive(conn)
+
+    @staticmethod
+    def _read(conn: socket.socket, size: int) -> bytearray | None:
+        data = bytearray(size)
+        view = memoryview(data)
+        while view:
+            n = conn.recv_into(view)
+            if n == 0:
+                return None
+            view = view[n:]
+        return data
+
+    def _receive(self, conn: socket.socket) -> None:
+        data: bytearray | None = None
+        try:
+            header = self._read(conn, HEADER.size)
+            if header is not None:
+                data = self._read(conn, HEADER.unpack(header)[0])
+        except OSError:
+            pass
+        with self._cond:
+            try:
+                self.tree.merge_packed(b"" if data is None else data)
+            except ValueError:
+                self.invalid += 1
+            self.received += 1
+            self._cond.notify_all()
+
+    def take(self) -> _telexsys.StackTree:
+        """The stacks received so far, later ones go to a new tree."""
+        with self._cond:
+            tree, self.tree = self.tree, _telexsys.StackTree()
+            return tree
+
+    def wait(self, count: int, timeout: float) -> bool:
+        """
+        Wait until ``count`` children sent their stacks.
+
+        Returns:
+            False if it timed out first.
+        """
+        with self._cond:
+            return self._cond.wait_for(lambda: self.received >= count, timeout)
+
+    def close(self) -> None:
+        """Stop listening and remove the socket."""
+        self._stopped.set()
+        if os.getpid() != self._pid:
+            # a forked child has the socket but not the thread, nor the path
+            self._sock.close()
+            return
+        self._thread.join()
+        self._sock.close()
+        _publish(self._pid, None)
+        try:
+            os.unlink(self.path)
+            if self._dir is not None:
+                os.rmdir(self._dir)
+        except FileNotFoundError:  # closed already
+            pass
+
+
+def send_tree(tree: _telexsys.StackTree, pid: int) -> bool:
+    """
+    Send the stacks of this process to the collector of process ``pid``.
+
+    Returns:
+        False if that process does not collect, or its socket is in a
+        directory other users can enter, the caller falls back to writing a
+        file.
+    """
+    path = collector_path(pid)
+    if not hasattr(socket, "AF_UNIX") or path is None or not _private(path):
+        return False
+    data = tree.pack()
+    try:
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+            sock.settimeout(SEND_TIMEOUT)
+            sock.connect(path)
+            sock.sendall(HEADER.pack(len(data)))
+            sock.sendall(data)
+    except OSError:
+        return False
+    return True
@@ -1,6 +1,8 @@
 from __future__ import annotations
 
+import contextlib
 import json
+import time
 from typing import Any, Final
 from urllib import request
 from urllib.error import HTTPError, URLError
@@ -108,6 +110,67 @@ class Profile(CommandProcessor):
         return super().process(*args)
 
 
+@register_command("continuous", "start or stop continuous profiling")
+class Continuous(CommandProcessor):
+    pass
+
+
+@register_command("window", "read a window of the continuous profile")
+class Window(CommandProcessor):
+    pass
+
+
+def format_delta(delta: dict[str, Any]) -> str:
+    """Render one delta of /profile/stream as a top view."""
+    samples = delta["samples"]
+    stamp = time.strftime("%H:%M:%S", time.localtime(delta["time"]))
+    lines = [f"{stamp}  {samples} samples in {delta['seconds']:.1f}s"]
+    if "folded" in delta:
+        lines.append(delta["folded"])
+    elif samples > 0:
+        lines.append(f"{'self':>7} {'total':>7}  frame")
+        for frame, own, total in delta["top"]:
+            lines.append(
+                f"{own * 100 / samples:6.1f}% {total * 100 / samples:6.1f}%  {frame}"
+            )
+    return "\n".join(lines)
+
+
+@register_command("live", "live top view of the continuous profile")
+class Live(CommandProcessor):
+    """
+    Follow /profile/stream and print the top frames of every delta until
+    the stream ends or Ctrl-C is pressed.
+    """
+
+    def process(self, *args: str) -> tuple[Any, bool]:  # type: ignore
+        assert args[0] == "live"
+        # the read timeout has to outlast the gap between two deltas
+        interval = 2.0
+        for flag, value in zip(args, args[1:]):
+            if flag == "--interval":
+                with contextlib.suppress(ValueError):
+                    interval = max(float(value), 0)
+        url = f"http://{self.host}:{self.port}/profile/stream"
+        req = request.Request(url, headers={"args": " ".join(args[1:])})
+        received = 0
+        try:
+            with request.urlopen(req, timeout=interval + self.timeout) as resp:
+                for line in resp:
+                    data = json.loads(line)
+                    if "code" in data:  # the help or an error, not a delta
+                        return data["data"], data["code"] == SUCCESS_CODE
+                    print(format_delta(data), end="\n\n", flush=True)
+                    received += 1
+        except KeyboardInterrupt:  # pragma: no cover
+            pass
+        except URLError as e:  # pragma: no cover
+            return f"Url Error: {e.reason}", False
+        except Exception as e:  # pragma: no cover
+            return f"Error: {e}", False
+        return f"{received} deltas received", True
+
+
 @register_command("help", "show available commands")
 class Help(CommandProcessor):
     def process(self, *args):  # pragma: no cover
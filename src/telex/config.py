@@ -190,6 +190,9 @@ class TeleXSamplerConfig:
         inverted: bool = False,
         reverse: bool = False,
         time: str = "cpu",
+        shm_ring: str | None = None,
+        dump_signal: str | None = None,
+        remote_children: bool = False,
         # Filtering options
         ignore_frozen: bool = False,
         include_telex: bool = False,
@@ -200,6 +203,7 @@ class TeleXSamplerConfig:
         folded_file: str = "result.folded",
         folded_save: bool = False,
         width: int = 1200,
+        minwidth: float | str = 0.1,
         # Process handling
         merge: bool = True,
         mp: bool = False,
@@ -248,6 +252,17 @@ class TeleXSamplerConfig:
             time: Select the timer source for asynchronous sampling. "cpu" uses
                 CPU time via SIGPROF/ITIMER_PROF; "wall" uses real time via
                 SIGALRM/ITIMER_REAL. Default: "cpu".
+            shm_ring: A file, usually under /dev/shm, every sample is also
+                written to, so that another process can follow the profile
+                without running code in this one. Child processes do not
+                inherit it. Default: None.
+            dump_signal: A signal, such as "USR2", on which the profile so far
+                is written to telex-<pid>-<time>.folded in the current
+                directory, or .pb.gz when the output is a pprof profile.
+                Default: None.
+            remote_children: Sample the child processes from this one by
+                reading their memory, see telex.remote, instead of running
+                telex in them. Linux only. Default: False.
             ignore_frozen: Ignore frozen modules (compiled modules) in the stack
                 trace. Helps focus on user code by excluding standard library
                 internals. Default: False.
@@ -260,8 +275,10 @@ class TeleXSamplerConfig:
             regex_patterns: List of regex pattern strings for filtering stack
                 traces. Only files or function/class names matching at least one pattern
                 will be included. If None or empty, all files are included. Default: None.
-            output: Output filename for the SVG flamegraph file.
-                Default: "result.svg".
+            output: Output filename for the SVG flamegraph file. A ".html" file is
+                the lazily loading viewer, a ".pprof" or ".pb.gz" file a gzipped
+                pprof profile, a ".speedscope.json" or ".trace.json" file the
+                timeline of every sample. Default: "result.svg".
             folded_file: Output filename for the folded stack trace file, which
                 contains the raw profiling data in a text format.
                 Default: "result.folded".
@@ -270,6 +287,9 @@ class TeleXSamplerConfig:
                 flamegraphs. Default: False.
             width: Width in pixels for generated flamegraph SVGs.
                 Default: 1200.
+            minwidth: Frames narrower than this are coalesced into one box,
+                in pixels or as a percentage of samples like "0.5%".
+                Default: 0.1.
             merge: Merge multiple flamegraph files in multiprocess environments.
                 When True, child process data is combined into a single output.
                 When False, separate files are created for each process.
@@ -329,6 +349,9 @@ class TeleXSamplerConfig:
         if time_mode not in {"cpu", "wall"}:
             raise ValueError("time must be either 'cpu' or 'wall'")
         self.time = time_mode
+        self.shm_ring = shm_ring
+        self.dump_signal = dump_signal
+        self.remote_children = remote_children
 
         # Filtering options
         self.ignore_frozen = ignore_frozen
@@ -343,6 +366,7 @@ class TeleXSamplerConfig:
         if width <= 0:
             raise ValueError("width must be a positive integer")
         self.width = width
+        self.minwidth = minwidth
 
         # Process handling
         self.merge = merge
@@ -392,6 +416,9 @@ class TeleXSamplerConfig:
             inverted=getattr(args_namespace, "inverted", False),
             reverse=getattr(args_namespace, "reverse", False),
             time=getattr(args_namespace, "time", "cpu"),
+            shm_ring=getattr(args_namespace, "shm_ring", None),
+            dump_signal=getattr(args_namespace, "dump_signal", None),
+            remote_children=getattr(args_namespace, "remote_children", False),
             ignore_frozen=getattr(args_namespace, "ignore_frozen", False),
             include_telex=getattr(args_namespace, "include_telex", False),
             focus_mode=getattr(args_namespace, "focus_mode", False),
@@ -400,6 +427,7 @@ class TeleXSamplerConfig:
             folded_file=getattr(args_namespace, "folded_file", "result.folded"),
             folded_save=getattr(args_namespace, "folded_save", False),
             width=getattr(args_namespace, "width", 1200),
+            minwidth=getattr(args_namespace, "minwidth", 0.1),
             merge=getattr(args_namespace, "merge", True),
             mp=getattr(args_namespace, "mp", False),
             fork_server=getattr(args_namespace, "fork_server", False),
@@ -470,6 +498,9 @@ class TeleXSamplerConfig:
         if self.width:
             res.append("--width")
             res.append(str(self.width))
+        if self.minwidth != 0.1:
+            res.append("--minwidth")
+            res.append(str(self.minwidth))
         if self.mp:
             res.append("--mp")
         if self.fork_server:  # pragma: no cover
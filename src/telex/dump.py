@@ -0,0 +1,128 @@
+"""
+Profiles dumped on a signal, for processes whose monitor port can not be
+opened: ``kill -USR2 <pid>`` writes ``telex-<pid>-<time>.folded``.
+
+The handler only queues the time the signal arrived. A dumper thread copies
+the sampler's stacks, see ``_telexsys.snapshot_stacks``, and writes them, so
+the profiled code is held up for no more than the queueing and the copy and
+the sampler keeps everything it collected.
+"""
+
+from __future__ import annotations
+
+import os
+import queue
+import signal
+import threading
+import time
+from types import FrameType
+from typing import Any, Literal
+
+from . import _telexsys, logger
+from .sampler import TelexSysAsyncSampler, TelexSysSampler, save_pprof
+
+DumpFormat = Literal["folded", "pprof"]
+
+
+def parse_signal(name: str | int) -> signal.Signals:
+    """A signal from its number or name, with or without the SIG prefix."""
+    if isinstance(name, int) or name.isdigit():
+        return signal.Signals(int(name))
+    name = name.upper()
+    if not name.startswith("SIG"):
+        name = f"SIG{name}"
+    try:
+        return signal.Signals[name]
+    except KeyError:
+        raise ValueError(f"unknown signal {name}") from None
+
+
+class SignalDump:
+    def __init__(
+        self,
+        sampler: TelexSysSampler | TelexSysAsyncSampler,
+        signum: str | int = "SIGUSR2",
+        directory: str = ".",
+        format: DumpFormat = "folded",
+    ) -> None:
+        """
+        Args:
+            sampler: The sampler whose stacks are dumped, it is neither
+                started nor stopped.
+            signum: The signal to dump on, by number or name.
+            directory: Where the profiles are written.
+            format: "folded" for folded stack lines or "pprof" for a gzipped
+                profile.proto.
+        """
+        if format not in ("folded", "pprof"):
+            raise ValueError("format must be either 'folded' or 'pprof'")
+        self.sampler = sampler
+        self.signum = parse_signal(signum)
+        self.directory = directory
+        self.format = format
+        self.paths: list[str] = []
+        # SimpleQueue.put is reentrant, safe to call from a signal handler
+        self._requests: queue.SimpleQueue[float | None] = queue.SimpleQueue()
+        self._previous: Any = signal.SIG_DFL
+        self._pid = os.getpid()
+        self._thread: threading.Thread | None = None
+
+    def install(self) -> SignalDump:
+        """
+        Start the dumper thread and handle the signal, from the main thread.
+        """
+        self._pid = os.getpid()
+        self._thread = threading.Thread(
+            target=self._run, name="telex-dump", daemon=True
+        )
+        self._thread.start()
+        self._previous = signal.signal(self.signum, self._handler)
+        return self
+
+    def uninstall(self) -> None:
+        """Restore the previous handler and wait for the pending dumps."""
+        if self._thread is None:
+            return
+        signal.signal(self.signum, self._previous)
+        self._requests.put(None)
+        self._thread.join()
+        self._thread = None
+
+    def _handler(self, signum: int, frame: FrameType | None) -> None:
+        # a forked child inherits the handler but not the thread
+        if os.getpid() == self._pid:
+            self._requests.put(time.time())
+
+    def _run(self) -> None:
+        while True:
+            requested = self._requests.get()
+            if requested is None:
+                return
+            try:
+                self.paths.append(self.dump(requested))
+            except OSError as e:  # pragma: no cover
+                logger.log_error_panel(f"Failed to dump the profile: {e}")
+
+    def dump(self, requested: float | None = None) -> str:
+        """
+        Write the stacks collected so far.
+
+        Args:
+            requested: The time.time() the dump was asked for, now by default.
+        Returns:
+            The file written.
+        """
+        tree = _telexsys.snapshot_stacks(self.sampler)
+        stamp = int(time.time() if requested is None else requested)
+        suffix = ".folded" if self.format == "folded" else ".pb.gz"
+        name = os.path.join(self.directory, f"telex-{os.getpid()}-{stamp}")
+        path = f"{name}{suffix}"
+        n = 1
+        while os.path.exists(path):
+            path = f"{name}-{n}{suffix}"
+            n += 1
+        if self.format == "pprof":
+            save_pprof(self.sampler, path, lines=tree)
+        else:
+            tree.save(path)
+        return path
@@ -6,6 +6,7 @@ import functools
 import os
 import platform
 import site
+import socket
 import sys
 import threading
 import time
@@ -16,18 +17,35 @@ from typing import Any, Final, Union
 from rich.table import Table
 
 from . import logger
-from ._telexsys import sched_yield
+from ._telexsys import StackTree, sched_yield
+from .collect import ChildCollector, send_tree
 from .config import TeleXSamplerConfig
-from .flamegraph import FlameGraph, process_stack_trace
+from .dump import SignalDump
+from .flamegraph import (
+    FlameGraph,
+    load_stacks,
+    open_folded,
+    process_stack_trace,
+    save_stacks,
+    stack_trace_prefixes,
+)
+from .remote import RemoteProfiler
 from .sampler import (
+    CHROME_TRACE_SUFFIX,
+    PPROF_SUFFIXES,
+    SPEEDSCOPE_SUFFIX,
     PyTorchProfilerMiddleware,
     TelexSysAsyncWorkerSampler,
     TelexSysSampler,
+    save_pprof,
 )
 
 # Detect platform
 IS_WINDOWS = sys.platform == "win32" or platform.system() == "Windows"
 
+# outputs written from the sampler's sample log rather than its stack tree
+TIMELINE_SUFFIXES = (SPEEDSCOPE_SUFFIX, CHROME_TRACE_SUFFIX)
+
 # Type alias for the sampler that can be either type based on platform
 SamplerType = Union[TelexSysAsyncWorkerSampler, TelexSysSampler]  # noqa
 
@@ -60,7 +78,15 @@ def patch_os_fork_in_child():
     args = Environment.get_args()
     assert sampler is not None
     assert args is not None
+    if args.remote_children:
+        # the root samples this process from outside
+        Environment._remote = None
+        sampler.stop()
+        sampler.clear()
+        return
     sampler.clear()
+    # the parent's collector, our own children report to one of ours
+    Environment.stop_collector()
     # for the forkserver mode, which is a little bit magic and tricky.
     if sampler.started:
         sampler.stop()  # stop it first.
@@ -80,7 +106,8 @@ def patch_os_fork_in_parent():
     args = Environment.get_args()
     assert sampler is not None
     assert args is not None
-    sampler.child_cnt += 1
+    if not args.remote_children:
+        sampler.child_cnt += 1
 
 
 def patch_before_fork():
@@ -88,6 +115,8 @@ def patch_before_fork():
     args = Environment.get_args()
     assert sampler is not None
     assert args is not None
+    if not args.remote_children:
+        Environment.start_collector()
 
 
 def get_child_process_args() -> list[str]:
@@ -110,7 +139,8 @@ def patch_multiprocesssing():
 
     @functools.wraps(_spawnv_passfds)
     def spawnv_passfds(path, args, passfds):
-        if "-c" in args:
+        # with remote_children the child is sampled from outside instead
+        if "-c" in args and not parser_args.remote_children:
             idx = args.index("-c")
             cmd = args[idx + 1]
 
@@ -148,6 +178,7 @@ def patch_multiprocesssing():
                     new_args += [CMD_SEPARATOR, *rest]
                 args = new_args
                 sampler.child_cnt += 1
+                Environment.start_collector()
         ret = _spawnv_passfds(path, args, passfds)
         return ret
 
@@ -172,6 +203,11 @@ class Environment:
     # Class attributes to store singleton instances
     _sampler: None | SamplerType = None
     _args: None | TeleXSamplerConfig = None
+    _dump: None | SignalDump = None
+    # merges the stacks the child processes send, see telex.collect
+    _collector: None | ChildCollector = None
+    # samples the child processes from outside, see telex.remote
+    _remote: None | RemoteProfiler = None
 
     def __new__(cls):
         """Prevent instantiation of Environment class."""
@@ -191,6 +227,42 @@ class Environment:
             raise RuntimeError(ERROR_SAMPLER_EXISTS)
         cls._sampler = sampler
 
+    @classmethod
+    def start_collector(cls) -> None:
+        """
+        Listen for the stacks of the child processes about to be created,
+        unless their files are not merged or there is no Unix socket.
+        """
+        args = cls.get_args()
+        if cls._collector is not None or args is None or not args.merge:
+            return
+        if not hasattr(socket, "AF_UNIX"):  # pragma: no cover
+            return
+        try:
+            cls._collector = ChildCollector()
+        except OSError as e:  # pragma: no cover
+            if args.debug:
+                logger.log_warning_panel(
+                    f"Process {os.getpid()} can not collect its children's "
+                    f"stacks over a socket, they will write files: {e}"
+                )
+
+    @classmethod
+    def stop_collector(cls) -> None:
+        """Stop listening for the stacks of child processes."""
+        if cls._collector is not None:
+            cls._collector.close()
+            cls._collector = None
+
+    @classmethod
+    def stop_remote(cls) -> None | StackTree:
+        """Stop sampling the child processes, returns what was sampled."""
+        if cls._remote is None:
+            return None
+        tree = cls._remote.stop()
+        cls._remote = None
+        return tree
+
     @classmethod
     def get_args(cls) -> None | TeleXSamplerConfig:
         """Get the singleton args instance."""
@@ -205,6 +277,11 @@ class Environment:
     def clear_instances(cls) -> None:
         """Clear the singleton instances."""
         with cls._lock:
+            if cls._dump is not None:
+                cls._dump.uninstall()
+                cls._dump = None
+            cls.stop_collector()
+            cls.stop_remote()
             cls._sampler = None
             cls._args = None
             cls.initialized = False
@@ -240,6 +317,8 @@ class Environment:
                 forkserver=config.fork_server,
                 from_mp=config.mp,
                 time_mode=config.time,  # Accept for consistency
+                sample_log=config.output.endswith(TIMELINE_SUFFIXES),
+                shm_ring=config.shm_ring,
             )
             sampler.adjust()
         else:
@@ -256,6 +335,8 @@ class Environment:
                 forkserver=config.fork_server,
                 from_mp=config.mp,
                 time_mode=config.time,
+                sample_log=config.output.endswith(TIMELINE_SUFFIXES),
+                shm_ring=config.shm_ring,
             )
             sampler.adjust()
 
@@ -350,6 +431,14 @@ class Environment:
             # Create and set the sampler
             sampler = cls._create_sampler(config)
             cls.set_sampler(sampler)
+            if config.dump_signal:
+                cls._dump = SignalDump(
+                    sampler,
+                    config.dump_signal,
+                    format="pprof" if config.output.endswith(PPROF_SUFFIXES) else "folded",
+                ).install()
+            if config.remote_children and not (config.fork_server or config.mp):
+                cls._remote = RemoteProfiler(interval=config.interval / 1e6).start()
 
             sys.exit = cls.patch_sys_exit
             os._exit = cls.patch_os__exit
@@ -487,6 +576,7 @@ class FlameGraphSaver:
         full_path: bool = False,
         inverted: bool = False,
         width: int = 1200,
+        minwidth: float | str = 0.1,
         output: str = "result.svg",
         verbose: bool = False,
         folded_save: bool = False,
@@ -494,11 +584,14 @@ class FlameGraphSaver:
         merge: bool = True,
         debug: bool = False,
         timeout: float = 10,
+        collector: ChildCollector | None = None,
+        remote: StackTree | None = None,
     ) -> None:
         self.sampler = sampler
         self.full_path = full_path
         self.inverted = inverted
         self.width = width
+        self.minwidth = minwidth
         self.output = output
         self.verbose = verbose
         self.folded_save = folded_save
@@ -506,31 +599,67 @@ class FlameGraphSaver:
         self.merge = merge
         self.debug = debug
         self.timeout_limit = timeout
+        self.collector = collector
+        # the child processes sampled from outside, always merged
+        self.remote = remote
         self.site_path = site.getsitepackages()[0]
         self.work_dir = os.getcwd()
         self.title = TITLE
-        self.lines = sampler.dumps().splitlines()  # no more last empty line
-        if not self.full_path:
-            self.lines = process_stack_trace(self.lines, self.site_path, self.work_dir)
+        # folded lines are only materialized when something needs the text,
+        # a plain svg is rendered straight from the sampler's stack tree
+        self._lines: list[str] | None = None
+        # our stacks and the ones of the child processes, once merged
+        self._merged: StackTree | None = None
 
         self.timeout = False
         self.pid = os.getpid()
 
+    @property
+    def lines(self) -> list[str]:
+        if self._lines is None:
+            lines = self.sampler.dumps().splitlines()  # no more last empty line
+            if not self.full_path:
+                lines = process_stack_trace(lines, self.site_path, self.work_dir)
+            self._lines = lines
+        return self._lines
+
+    @lines.setter
+    def lines(self, lines: list[str]) -> None:
+        self._lines = lines
+
     def _save_svg(self, filename: str) -> None:
+        if filename.endswith(PPROF_SUFFIXES):
+            # file names are not shortened, pprof looks the sources up by them
+            save_pprof(self.sampler, filename, lines=self._merged or self._lines)
+            return
+        if filename.endswith(SPEEDSCOPE_SUFFIX):
+            self.sampler.save(filename, format="speedscope")
+            return
+        if filename.endswith(CHROME_TRACE_SUFFIX):
+            self.sampler.save(filename, format="chrome")
+            return
         fg = FlameGraph(
-            self.lines,
+            [],
             title=TITLE,
             command=" ".join([sys.executable, *sys.argv]),
             package_path=os.path.dirname(self.site_path),
             work_dir=self.work_dir,
             inverted=self.inverted,
             width=self.width,
+            minwidth=self.minwidth,
         )
 
-        fg.parse_input()
-        svg_content = fg.generate_svg()
-        with open(filename, "w+") as fp:
-            fp.write(svg_content)
+        # an .html output is the lazily loading viewer instead of an svg
+        save = fg.save_html if filename.endswith(".html") else fg.save
+        if self._merged is not None:
+            save(filename, source=self._merged)
+        elif self._lines is not None:
+            save(filename, source=self._lines)
+        else:
+            prefixes = []
+            if not self.full_path:
+                prefixes = stack_trace_prefixes(self.site_path, self.work_dir)
+            save(filename, source=self.sampler, strip_prefixes=prefixes)
 
         if fg.sample_count < _MIN_SAMPLE_COUNT:
             logger.log_warning_panel(
@@ -540,7 +669,10 @@ class FlameGraphSaver:
             )
 
     def _save_folded(self, filename: str) -> None:
-        with open(filename, "w+") as fp:
+        if self._merged is not None:
+            save_stacks(self._merged, filename)
+            return
+        with open_folded(filename, "w") as fp:
             for idx, line in enumerate(self.lines):
                 if idx < len(self.lines) - 1:
                     fp.write(line + "\n")
@@ -551,6 +683,27 @@ class FlameGraphSaver:
     def add_pid_prefix(lines: list[str], pid: int | str) -> list[str]:
         return [f"Process({pid});" + line for line in lines]
 
+    def _merge_children(self, foldeds: list[str], prefix: str) -> None:
+        """Merge the stacks of the child processes into ours.
+
+        Most were sent to the collector and merged as the children exited,
+        the files of the others are parsed natively by several threads. The
+        stacks are kept in a tree, which the svg and folded outputs are
+        written from.
+        """
+        merged = StackTree() if self.collector is None else self.collector.take()
+        if self.remote is not None:
+            merged.merge(self.remote)
+        merged.add_lines(self.add_pid_prefix(self.lines, prefix))
+        load_stacks(merged, foldeds)
+        for file in foldeds:
+            os.unlink(file)
+            if self.debug:
+                logger.log_success_panel(
+                    f"Process {self.pid} read and removed file {file}"
+                )
+        self._merged = merged
+
     def _single_process_root(self) -> None:
         self._save_svg(self.output)
         if self.verbose:
@@ -585,6 +738,10 @@ class FlameGraphSaver:
             self.lines = self.add_pid_prefix(
                 self.lines, f"pid-{self.pid}, ppid-{os.getppid()}"
             )
+            tree = StackTree()
+            tree.add_lines(self.lines)
+            if self._send(tree):
+                return
             self._save_folded(filename)
             if self.debug:
                 logger.log_success_panel(
@@ -592,24 +749,9 @@ class FlameGraphSaver:
                 )
 
     def _multi_process_root(self) -> None:
-        if self.merge:
-            files = os.listdir(os.getcwd())
-            foldeds = [file for file in files if file.endswith(f"{self.pid}.folded")]
-
-            self.lines = self.add_pid_prefix(self.lines, f"root, pid={self.pid}")
-
-            def load_chidren_file():
-                for file in foldeds:
-                    with open(file, "r+") as fp:
-                        lines = fp.readlines()
-                    os.unlink(file)
-                    if self.debug:
-                        logger.log_success_panel(
-                            f"Root process {self.pid} read and removed file {file}"
-                        )
-                    self.lines.extend([line.strip() for line in lines])
-
-            load_chidren_file()
+        if self.merge or self.remote is not None:
+            foldeds = self._child_foldeds()
+            self._merge_children(foldeds, f"root, pid={self.pid}")
             self._save_svg(self.output)
             if self.verbose:
                 logger.log_success_panel(
@@ -640,24 +782,11 @@ class FlameGraphSaver:
 
     def _multi_process_child(self) -> None:
         if self.merge:
-            files = os.listdir(os.getcwd())
-            foldeds = [file for file in files if file.endswith(f"{self.pid}.folded")]
-            self.lines = self.add_pid_prefix(
-                self.lines, f"pid-{self.pid}, ppid-{os.getppid()}"
-            )
-
-            def load_chidren_file():
-                for file in foldeds:
-                    with open(file, "r+") as fp:
-                        lines = fp.readlines()
-                    os.unlink(file)
-                    if self.debug:
-                        logger.log_success_panel(
-                            f"Process {self.pid} read and removed file {file}"
-                        )
-                    self.lines.extend([line.strip() for line in lines])
-
-            load_chidren_file()
+            foldeds = self._child_foldeds()
+            self._merge_children(foldeds, f"pid-{self.pid}, ppid-{os.getppid()}")
+            assert self._merged is not None
+            if self._send(self._merged):
+                return
             filename = f"{self.pid}-{os.getppid()}.folded"
             self._save_folded(filename)
             if self.debug:
@@ -680,8 +809,25 @@ class FlameGraphSaver:
                         f"Process {self.pid} saved the profiling data to the folded file {filename}"  # noqa: E501
                     )
 
+    def _send(self, tree: StackTree) -> bool:
+        """Send our stacks to the parent's collector instead of a file."""
+        if not send_tree(tree, os.getppid()):
+            return False
+        if self.debug:
+            logger.log_success_panel(
+                f"Process {self.pid} sent the profiling data to process {os.getppid()}"
+            )
+        return True
+
+    def _child_foldeds(self) -> list[str]:
+        """The files of the child processes that could not send their stacks."""
+        files = os.listdir(os.getcwd())
+        return [file for file in files if file.endswith(f"{self.pid}.folded")]
+
     def save(self) -> None:
-        if self.sampler.child_cnt > 0:
+        if self.remote is not None and self.remote.samples > 0:
+            self._multi_process_root()
+        elif self.sampler.child_cnt > 0:
             self.wait_children()
             if self.sampler.is_root:
                 self._multi_process_root()
@@ -694,23 +840,28 @@ class FlameGraphSaver:
                 self._single_process_child()
 
     def wait_children(self) -> None:
-        """Wait for all child processes to exit."""
+        """Wait for all child processes to send their stacks or write files."""
         if not self.merge:
             return
-        res: list[str] = []
         begin = time.time()
         if self.debug:
             logger.log_success_panel(
                 f"Process {self.pid} are waiting for {self.sampler.child_cnt} "
                 "child processes to complete"
             )
-        while len(res) != self.sampler.child_cnt:
-            sched_yield()
-            files = os.listdir(os.getcwd())
-            res = [file for file in files if file.endswith(f"{self.pid}.folded")]
+        while True:
+            received = 0 if self.collector is None else self.collector.received
+            reported = received + len(self._child_foldeds())
+            if reported >= self.sampler.child_cnt:
+                break
             if time.time() - begin > self.timeout_limit:  # pragma: no cover
                 self.timeout = True
                 break
+            if self.collector is not None:
+                # files only come from children that failed to send
+                self.collector.wait(received + 1, 0.05)
+            else:
+                sched_yield()
         if self.timeout:  # pragma: no cover
             logger.log_error_panel("Timeout waiting for child processes to complete")
 
@@ -745,6 +896,9 @@ def telex_finalize(save: bool = True) -> None:
         current_sampler.stop()
         if save:
             _do_save()
+    if current_sampler is not None:
+        # removes the exported ring, readers stop once it is gone
+        current_sampler.shm_ring = None
     Environment.clear_instances()
 
 
@@ -758,6 +912,7 @@ def _do_save():
         full_path=current_args.full_path,
         inverted=current_args.inverted,
         width=current_args.width,
+        minwidth=getattr(current_args, "minwidth", 0.1),
         output=current_args.output,
         verbose=current_args.verbose,
         folded_save=current_args.folded_save,
@@ -765,8 +920,12 @@ def _do_save():
         merge=current_args.merge,
         debug=current_args.debug,
         timeout=current_args.timeout,
+        collector=Environment._collector,
+        remote=Environment.stop_remote(),
     )
     saver.save()
+    # the stacks of the children are merged, late ones write files
+    Environment.stop_collector()
     if current_args.debug:
         from .logger import console
 
@@ -17,12 +17,50 @@ Input format:
 from __future__ import annotations
 
 import collections
+import gzip
 import hashlib
 import html
+import io
+import json
 import os
+import shutil
 import sys
+import tempfile
 import textwrap
 from collections import defaultdict
+from collections.abc import Sequence
+from typing import IO, TYPE_CHECKING, BinaryIO
+
+if TYPE_CHECKING:
+    from telex._telexsys import StackTree
+
+# the first bytes of a gzip file, such as a folded file saved as ".gz"
+GZIP_MAGIC = b"\x1f\x8b"
+
+# fill colour of a box standing in for coalesced frames
+COALESCED_COLOR = "hsl(0, 0%, 80%)"
+
+# <defs> and <style> shared by the svg and the html viewer
+SVG_STYLE = [
+    "<defs>",
+    '<linearGradient id="background" y1="0" y2="1" x1="0" x2="0">',
+    '<stop stop-color="#eeeeee" offset="5%" />',
+    '<stop stop-color="#eeeeb0" offset="95%" />',
+    "</linearGradient>",
+    "</defs>",
+    '<style type="text/css">',
+    "text { font-family: Source Serif Pro, Palatino, gentium plus, Arial, sans-serif; font-size: 11px; fill: rgb(0, 0, 0);}",  # noqa: E501
+    "#search, #ignorecase { opacity: 0.9; cursor: pointer; }",
+    "#search:hover, #search.show, #ignorecase:hover, #ignorecase.show { opacity: 1; }",
+    "#subtitle { text-anchor: middle; font-color: rgb(160, 160, 160);}",
+    "#title { text-anchor: middle; font-size: 17px }",
+    "#under_title { text-anchor: middle; font-size: 13px }",
+    "#unzoom { cursor: pointer; }",
+    "#frames > *:hover { stroke: black; stroke-width: 0.5; cursor: pointer; }",
+    ".hide { display: none; }",
+    ".parent { opacity: 0.5; }",
+    "</style>",
+]
 
 
 # Python 3.8 compatibility helper
@@ -40,7 +78,17 @@ def _removeprefix(text: str, prefix: str) -> str:
 
 class FlameGraph:
     class Node:
-        __slots__ = ("children", "depth", "name", "parent", "total", "width", "x")
+        __slots__ = (
+            "children",
+            "coalesced",
+            "depth",
+            "name",
+            "parent",
+            "shown",
+            "total",
+            "width",
+            "x",
+        )
 
         def __init__(self, name: str):
             """
@@ -55,6 +103,10 @@ class FlameGraph:
                 children (dict): Child nodes organized by name.
                 x (int): X-coordinate position for visualization.
                 depth (int): Depth level in the flame graph hierarchy.
+                shown (list): Children laid out by _layout_tree, including the
+                    box of coalesced narrow children.
+                coalesced (int): Number of frames this box stands for, 0 for
+                    a regular frame.
             """
             self.name = name
             self.total = 0
@@ -63,6 +115,8 @@ class FlameGraph:
             self.depth = 0
             self.parent: None | FlameGraph.Node = None
             self.width: float = 0
+            self.shown: list[FlameGraph.Node] = []
+            self.coalesced = 0
 
         def __str__(self):
             return f"{self.name} ({self.total})"
@@ -75,7 +129,7 @@ class FlameGraph:
         lines: list[str],
         height: int = 15,
         width: int = 1200,
-        minwidth: float = 0.1,
+        minwidth: float | str = 0.1,
         title: str = "TeleX Flame Graph",
         countname: str = "samples",
         command: str = "",
@@ -89,7 +143,9 @@ class FlameGraph:
             lines (list[str]): List of stack trace lines to process.
             height (int): Height of the flame graph in lines (default: 15).
             width (int): Width of the flame graph in characters (default: 1200).
-            minwidth (float): Minimum width percentage for a frame to be shown (default: 0.1).
+            minwidth (float | str): Minimum width of a frame in pixels, or a
+                percentage of all samples such as "0.5%" (default: 0.1).
+                Narrower sibling frames are coalesced into a single box.
             title (str): Title of the flame graph (default: "Flame Graph").
             countname (str): Label for the count/samples (default: "samples").
             command (str): Command that generated the profile data.
@@ -182,8 +238,23 @@ class FlameGraph:
 
         return root
 
+    def _min_pixels(self) -> float:
+        """The minimum frame width in pixels, see ``minwidth``."""
+        if isinstance(self.minwidth, str):
+            value = self.minwidth.strip()
+            if value.endswith("%"):
+                return float(value[:-1]) / 100 * (self.width - 20)
+            return float(value)
+        return self.minwidth
+
     def _layout_tree(
-        self, node: Node, x: float, scale: float, L: float, R: float
+        self,
+        node: Node,
+        x: float,
+        scale: float,
+        L: float,
+        R: float,
+        minwidth: float = 0,
     ) -> None:
         """Recursively layout a flame graph tree node and its children.
 
@@ -193,6 +264,8 @@ class FlameGraph:
             scale: Scaling factor to convert node values to pixel widths.
             L: Left boundary constraint for node positioning.
             R: Right boundary constraint for node positioning.
+            minwidth: Children narrower than this (pixels) are not laid out,
+                they are coalesced into one box left of their siblings.
 
         The method calculates node width and position, enforces boundary constraints,
         and recursively lays out children nodes from right to left.
@@ -203,15 +276,37 @@ class FlameGraph:
             node.x = L
         if node.x + node.width > R:  # pragma: no cover
             node.width = R - node.x
+        if node.width < minwidth:
+            # not drawn, and neither is anything below it
+            return
         sorted_children = list(reversed(node.children.values()))
 
-        for child in sorted_children:
-            child.depth = node.depth + 1
-
         current_x = x
+        coalesced = 0
+        coalesced_total = 0
         for child in sorted_children:
-            self._layout_tree(child, current_x, scale, node.x, node.x + node.width)
+            if child.total * scale < minwidth:
+                coalesced += 1
+                coalesced_total += child.total
+                continue
+            child.depth = node.depth + 1
+            node.shown.append(child)
+            self._layout_tree(
+                child, current_x, scale, node.x, node.x + node.width, minwidth
+            )
             current_x -= child.width
+        node.shown.reverse()
+
+        if coalesced and coalesced_total * scale >= minwidth:
+            box = self.Node(f"[{coalesced} frames]")
+            box.total = coalesced_total
+            box.coalesced = coalesced
+            box.depth = node.depth + 1
+            box.parent = node
+            node.shown.insert(0, box)
+            self._layout_tree(
+                box, current_x, scale, node.x, node.x + node.width, minwidth
+            )
 
     def _collect_nodes_by_depth(self, root: Node) -> dict[int, list[Node]]:
         """Collect nodes grouped by their depth using BFS traversal.
@@ -231,8 +326,7 @@ class FlameGraph:
             if node.depth > 0:
                 nodes_by_depth[node.depth].append(node)
 
-            children = list(node.children.values())
-            for child in children:
+            for child in node.shown:
                 queue.append(child)
 
         return nodes_by_depth
@@ -247,36 +341,13 @@ class FlameGraph:
         self.total_samples = max(1, self.total_samples)
         scale = (self.width - 20) / root.total
         root.depth = 1
-        self._layout_tree(root, self.width - 10, scale, 10, self.width - 10)
+        minwidth = self._min_pixels()
+        self._layout_tree(root, self.width - 10, scale, 10, self.width - 10, minwidth)
 
         nodes_by_depth = self._collect_nodes_by_depth(root)
         max_depth = max(nodes_by_depth.keys()) if nodes_by_depth else 0
 
-        header_sections = [
-            ("Environment", self.package_path),
-            ("Working Directory", self.work_dir),
-            ("Command", self.command),
-        ]
-        header_line_height = 18
-        header_texts: list[str] = []
-        current_y = 44
-        header_line_count = 0
-        for label, value in header_sections:
-            content = f"{label}: {value}" if value else f"{label}:"
-            wrapped_lines = self._wrap_text_to_width(content, self.width - 40)
-            if not wrapped_lines:
-                wrapped_lines = [content]
-            for line in wrapped_lines:
-                header_texts.append(
-                    f'<text id="under_title" x="{self.width // 2}" '
-                    f'y="{current_y}">{html.escape(line)}</text>'
-                )
-                current_y += header_line_height
-                header_line_count += 1
-
-        base_top_margin = 120
-        extra_lines = max(0, header_line_count - 3)
-        top_margin = base_top_margin + extra_lines * header_line_height
+        header_texts, top_margin = self._header_texts()
         bottom_margin = 50
         svg_height = max_depth * self.height + top_margin + bottom_margin
         orientation = "inverted" if self.inverted else "standard"
@@ -291,24 +362,7 @@ class FlameGraph:
             'xmlns="http://www.w3.org/2000/svg" xmlns:xlink="http://www.w3.org/1999/xlink">',
             "<!-- Flame graph stack visualization. See https://github.com/brendangregg/FlameGraph for latest version, and http://www.brendangregg.com/flamegraphs.html for examples. -->",  # noqa: E501
             "<!-- NOTES:  -->",
-            "<defs>",
-            '<linearGradient id="background" y1="0" y2="1" x1="0" x2="0">',
-            '<stop stop-color="#eeeeee" offset="5%" />',
-            '<stop stop-color="#eeeeb0" offset="95%" />',
-            "</linearGradient>",
-            "</defs>",
-            '<style type="text/css">',
-            "text { font-family: Source Serif Pro, Palatino, gentium plus, Arial, sans-serif; font-size: 11px; fill: rgb(0, 0, 0);}",  # noqa: E501
-            "#search, #ignorecase { opacity: 0.9; cursor: pointer; }",
-            "#search:hover, #search.show, #ignorecase:hover, #ignorecase.show { opacity: 1; }",  # noqa: E501
-            "#subtitle { text-anchor: middle; font-color: rgb(160, 160, 160);}",
-            "#title { text-anchor: middle; font-size: 17px }",
-            "#under_title { text-anchor: middle; font-size: 13px }",
-            "#unzoom { cursor: pointer; }",
-            "#frames > *:hover { stroke: black; stroke-width: 0.5; cursor: pointer; }",
-            ".hide { display: none; }",
-            ".parent { opacity: 0.5; }",
-            "</style>",
+            *SVG_STYLE,
             '<script type="text/ecmascript">\n<![CDATA[',
             self._get_javascript(),
             "]]>\n</script>",
@@ -337,10 +391,13 @@ class FlameGraph:
                 else:
                     rect_y = svg_height - bottom_margin - depth * self.height
                 width = node.width
-                if width < self.minwidth:  # pragma: no cover
+                if width < minwidth:
                     continue
 
-                color = self._get_color(node.name)
+                if node.coalesced:
+                    color = COALESCED_COLOR
+                else:
+                    color = self._get_color(node.name)
                 text = self._trim_text(node.name, width)
                 text_y = rect_y + self.height - 4.5
 
@@ -358,6 +415,199 @@ class FlameGraph:
         self._svg_generated = True
         return self._cached_svg
 
+    def save(
+        self,
+        filename: str,
+        source: object = None,
+        strip_prefixes: list[str] | tuple[str, ...] = (),
+        baseline: object = None,
+    ) -> None:
+        """Render the flame graph natively and stream it to ``filename``.
+
+        Produces the same document as ``generate_svg`` without building the
+        python call tree or the svg string, which matters for large profiles.
+
+        Args:
+            filename: The svg file to write.
+            source: A sampler whose stack tree is rendered directly, without
+                dumping it to folded text first. Defaults to ``self.lines``.
+            strip_prefixes: Prefixes removed in order from every frame name,
+                see ``stack_trace_prefixes``.
+            baseline: An older profile, folded lines or a sampler, to render
+                a differential flame graph against. Frames are as wide as in
+                this profile and red or blue by how much their share of the
+                samples grew or shrank.
+        """
+        from telex import _telexsys
+
+        total = _telexsys.render_flamegraph(
+            self.lines if source is None else source,
+            filename,
+            width=self.width,
+            height=self.height,
+            minwidth=self._min_pixels(),
+            title=self.title,
+            countname=self.countname,
+            header_lines=self._header_lines(),
+            script=self._get_javascript(),
+            inverted=self.inverted,
+            strip_prefixes=strip_prefixes,
+            baseline=baseline,
+        )
+        self.total_samples = max(1, total)
+
+    def html_chunks(
+        self,
+        source: object = None,
+        strip_prefixes: list[str] | tuple[str, ...] = (),
+        max_nodes: int = 4096,
+    ) -> list[bytes]:
+        """Split the call tree into the json chunks the html viewer loads.
+
+        A chunk holds the frames wide enough to be drawn when its first frame
+        is zoomed into, at most ``max_nodes`` of them, narrower ones are left
+        to later chunks. Chunk 0 holds the root frame.
+
+        Args:
+            source: A sampler, or folded lines. Defaults to ``self.lines``.
+            strip_prefixes: Prefixes removed in order from every frame name.
+            max_nodes: The maximum number of frames in a chunk.
+        """
+        from telex import _telexsys
+
+        total, chunks = _telexsys.flamegraph_chunks(
+            self.lines if source is None else source,
+            min_fraction=self._min_pixels() / max(1, self.width - 20),
+            max_nodes=max_nodes,
+            strip_prefixes=strip_prefixes,
+        )
+        self.total_samples = max(1, total)
+        return chunks
+
+    def write_html(
+        self, out: BinaryIO, chunks: list[bytes], chunk_url: str | None = None
+    ) -> None:
+        """Write the html viewer page for ``chunks`` to ``out``.
+
+        The page draws frames with viewer.js on top of the script.js
+        interactions and only parses a chunk once its frames become visible.
+        All chunks are embedded in the page, unless ``chunk_url`` is given:
+        then only chunk 0 is, and chunk ``i`` is fetched from
+        ``chunk_url + str(i)`` when the viewer needs it.
+        """
+        header_texts, top_margin = self._header_texts()
+        bottom_margin = 50
+        # the viewer sets the height of the frames it draws
+        height = top_margin + bottom_margin
+        orientation = "inverted" if self.inverted else "standard"
+        config = {
+            "width": self.width,
+            "frame_height": self.height,
+            "minwidth": self._min_pixels(),
+            "top_margin": top_margin,
+            "bottom_margin": bottom_margin,
+            "countname": self.countname,
+            "chunk_url": chunk_url,
+        }
+        page = [
+            "<!DOCTYPE html>",
+            "<html>",
+            "<head>",
+            '<meta charset="utf-8">',
+            f"<title>{html.escape(self.title)}</title>",
+            "</head>",
+            "<body>",
+            f'<svg version="1.1" width="{self.width}" height="{height}" '
+            f'data-orientation="{orientation}" viewBox="0 0 {self.width} {height}" '
+            'xmlns="http://www.w3.org/2000/svg">',
+            *SVG_STYLE,
+            f'<rect id="canvas" x="0" y="0" width="{self.width}" height="{height}" '
+            'fill="url(#background)" rx="2" ry="2" />',
+            f'<text id="title" x="{self.width // 2}" y="24">'
+            f"{html.escape(self.title)}</text>",
+            *header_texts,
+            f'<text id="details" x="10" y="{height - 10}"> </text>',
+            '<text id="unzoom" x="10" y="24" class="hide">Reset Zoom</text>',
+            f'<text id="search" x="{self.width - 110}" y="24">Search</text>',
+            f'<text id="ignorecase" x="{self.width - 30}" y="24">ic</text>',
+            f'<text id="matched" x="{self.width - 110}" y="{height - 10}"> </text>',
+            f'<g id="frames" data-orientation="{orientation}"></g>',
+            "</svg>",
+            '<script type="application/json" id="telex-config">'
+            + json.dumps(config).replace("<", "\\u003c")
+            + "</script>",
+            "",
+        ]
+        out.write("\n".join(page).encode())
+        for idx, chunk in enumerate(chunks if chunk_url is None else chunks[:1]):
+            tag = f'<script type="application/json" id="telex-chunk-{idx}">'
+            out.write(tag.encode())
+            out.write(chunk)
+            out.write(b"</script>\n")
+        scripts = [
+            "<script>",
+            self._get_javascript(),
+            self._get_javascript("viewer.js"),
+            "viewer_init();",
+            "</script>",
+            "</body>",
+            "</html>",
+        ]
+        out.write("\n".join(scripts).encode())
+
+    def save_html(
+        self,
+        filename: str,
+        source: object = None,
+        strip_prefixes: list[str] | tuple[str, ...] = (),
+    ) -> None:
+        """Save a lazily loading html flame graph with every chunk embedded.
+
+        Unlike the svg, frames narrower than ``minwidth`` are not lost: they
+        are drawn once the frame they belong to is zoomed into.
+
+        Args:
+            filename: The html file to write.
+            source: A sampler whose stack tree is split directly. Defaults to
+                ``self.lines``.
+            strip_prefixes: Prefixes removed in order from every frame name.
+        """
+        chunks = self.html_chunks(source, strip_prefixes)
+        with open(filename, "wb") as f:
+            self.write_html(f, chunks)
+
+    def _header_texts(self) -> tuple[list[str], int]:
+        """The header elements under the title and the top margin they need."""
+        header_line_height = 18
+        header_texts: list[str] = []
+        current_y = 44
+        for line in self._header_lines():
+            header_texts.append(
+                f'<text id="under_title" x="{self.width // 2}" '
+                f'y="{current_y}">{html.escape(line)}</text>'
+            )
+            current_y += header_line_height
+
+        base_top_margin = 120
+        extra_lines = max(0, len(header_texts) - 3)
+        return header_texts, base_top_margin + extra_lines * header_line_height
+
+    def _header_lines(self) -> list[str]:
+        """Header lines shown under the title, wrapped to the svg width."""
+        header_sections = [
+            ("Environment", self.package_path),
+            ("Working Directory", self.work_dir),
+            ("Command", self.command),
+        ]
+        lines: list[str] = []
+        for label, value in header_sections:
+            content = f"{label}: {value}" if value else f"{label}:"
+            wrapped_lines = self._wrap_text_to_width(content, self.width - 40)
+            if not wrapped_lines:
+                wrapped_lines = [content]
+            lines.extend(wrapped_lines)
+        return lines
+
     def _get_color(self, frame):
         """Generate color for frame based on its name"""
         # Hash function name to get consistent color
@@ -389,18 +639,113 @@ class FlameGraph:
         )
         return wrapped or [text]
 
-    def _get_javascript(self):
+    def _get_javascript(self, name: str = "script.js"):
         """Return the JavaScript code for interactive features"""
         base = os.path.dirname(os.path.abspath(__file__))
-        script = os.path.join(base, "script.js")
+        script = os.path.join(base, name)
         with open(script) as f:
             content = f.read()
         return content
 
 
+def open_folded(filename: str, mode: str = "r") -> IO[str]:
+    """Open a folded file as text.
+
+    A file is read through gzip if it starts with the gzip magic bytes, and
+    written through it if its name ends with ".gz", as the native dump does.
+    """
+    if "r" in mode:
+        with open(filename, "rb") as f:
+            compressed = f.read(2) == GZIP_MAGIC
+    else:
+        compressed = filename.endswith(".gz")
+    if compressed:
+        return gzip.open(filename, mode + "t")
+    return open(filename, mode)
+
+
+def decompressed(file: IO[str]) -> IO[str]:
+    """The text of an opened folded file, inflated if it is gzipped."""
+    buffer = getattr(file, "buffer", None)
+    peek = getattr(buffer, "peek", None)
+    if peek is None or peek(2)[:2] != GZIP_MAGIC:
+        return file
+    return io.TextIOWrapper(gzip.GzipFile(fileobj=buffer), encoding=file.encoding)
+
+
+def python_gzip(filename: str) -> bool:
+    """Whether a folded file named `filename` is gzipped by python.
+
+    The extension gzips ".gz" files itself where it was built with zlib, it
+    is not on Windows.
+    """
+    from telex import _telexsys
+
+    return filename.endswith(".gz") and not _telexsys.HAVE_ZLIB
+
+
+def save_stacks(tree: StackTree, filename: str) -> None:
+    """Save a StackTree to a folded file, gzipped if the name ends with ".gz"."""
+    if not python_gzip(filename):
+        tree.save(filename)
+        return
+    with open_folded(filename, "w") as f:
+        f.write(tree.dumps())
+
+
+def load_stacks(tree: StackTree, filenames: Sequence[str]) -> None:
+    """Add the stacks of folded files to a StackTree, see load_folded.
+
+    Where the extension has no zlib, gzipped files are inflated by python
+    into temporary files first.
+    """
+    from telex import _telexsys
+
+    if _telexsys.HAVE_ZLIB:
+        tree.load(filenames)
+        return
+    names = []
+    inflated = []
+    try:
+        for name in filenames:
+            with open(name, "rb") as f:
+                if f.read(2) != GZIP_MAGIC:
+                    names.append(name)
+                    continue
+                f.seek(0)
+                fd, path = tempfile.mkstemp(suffix=".folded")
+                inflated.append(path)
+                with os.fdopen(fd, "wb") as out, gzip.GzipFile(fileobj=f) as text:
+                    shutil.copyfileobj(text, out)
+            names.append(path)
+        tree.load(names)
+    finally:
+        for path in inflated:
+            os.unlink(path)
+
+
+def parse_minwidth(value: str) -> float | str:
+    """Validate a ``minwidth`` given on the command line.
+
+    Returns a float for a width in pixels, or the string itself for a
+    fraction of the samples written as ``"0.5%"``.
+    """
+    text = value.strip()
+    number = float(text[:-1] if text.endswith("%") else text)
+    if number < 0:
+        raise ValueError("minwidth must not be negative")
+    return text if text.endswith("%") else number
+
+
+def stack_trace_prefixes(site_path: str, work_dir: str) -> list[str]:
+    """Prefixes removed, in order, from every frame by process_stack_trace."""
+    base_dir = "/".join(site_path.split("/")[:-1])
+    return [site_path, work_dir, base_dir, "/"]
+
+
 def process_stack_trace(lines: list[str], site_path: str, work_dir: str) -> list[str]:
     res: list[str] = []
-    base_dir = "/".join(site_path.split("/")[:-1])
+    prefixes = stack_trace_prefixes(site_path, work_dir)
     for line in lines:
         line = line.strip()
         if not line:  # pragma: no cover
@@ -408,11 +753,8 @@ def process_stack_trace(lines: list[str], site_path: str, work_dir: str) -> list
         t = []
         for item in line.split(";"):
             # Use version-aware removeprefix helper
-            item = _removeprefix(item, site_path)
-            item = _removeprefix(item, work_dir)
-            item = _removeprefix(item, base_dir)
-            # Remove leading slash if present
-            item = _removeprefix(item, "/")
+            for prefix in prefixes:
+                item = _removeprefix(item, prefix)
             t.append(item)
         res.append(";".join(t))
     return res
@@ -13,12 +13,17 @@ If code is 0, the data represents the successful msg, otherwise it represent err
 from __future__ import annotations
 
 import argparse
-import io
+import contextlib
+import json
+import os
 import sys
-from collections.abc import Callable
-from typing import Final, cast
+import tempfile
+from collections.abc import Callable, Iterator
+from http import HTTPStatus
+from typing import Final, NoReturn, cast
 
 from .gc_analyzer import get_analyzer
+from .rolling import WINDOWS
 from .server import TeleXApp, TeleXRequest, TeleXResponse
 from .system import TeleXSystem
 
@@ -28,11 +33,15 @@ SUCCESS_CODE: Final = 0
 
 # Global registry for endpoints
 ENDPOINT_REGISTRY: dict[str, Callable[[TeleXRequest, TeleXResponse], None]] = {}
+# seconds an endpoint may take before the client gets a 503, see TeleXApp.route
+ENDPOINT_BUDGETS: dict[str, float] = {}
 
 
 def safe_parse_args(parser: argparse.ArgumentParser, args: list[str]):
     """
     Safely parse arguments handling both ArgumentError and SystemExit exceptions.
+    Errors are taken from the parser rather than from sys.stderr, since
+    requests are parsed on several threads at once.
 
     Args:
         parser: The ArgumentParser instance
@@ -41,44 +50,26 @@ def safe_parse_args(parser: argparse.ArgumentParser, args: list[str]):
     Returns:
         tuple: (success: bool, result: Namespace or error_message: str)
     """
-    # Capture stderr to get error messages
-    old_stderr = sys.stderr
-    sys.stderr = io.StringIO()
 
-    try:
-        parsed_args = parser.parse_args(args)
-        return True, parsed_args
-    except (argparse.ArgumentError, SystemExit) as e:
-        error_output = sys.stderr.getvalue()
-
-        # Extract the error message from stderr or exception
-        if error_output:
-            # Remove 'usage:' line and keep only the error
-            lines = error_output.strip().split("\n")
-            error_msg = "\n".join(
-                line for line in lines if line and not line.startswith("usage:")
-            )
-            # Remove the program name prefix from error line
-            if ":" in error_msg:
-                error_msg = error_msg.split(":", 1)[1].strip()
-                if error_msg.startswith("error:"):
-                    error_msg = error_msg[6:].strip()
-        elif isinstance(e, argparse.ArgumentError):
-            error_msg = e.message
-        else:
-            error_msg = str(e)
+    def error(message: str) -> NoReturn:
+        raise argparse.ArgumentError(None, message)
 
-        return False, error_msg
-    finally:
-        sys.stderr = old_stderr
+    parser.error = error  # type: ignore[method-assign]
+    try:
+        return True, parser.parse_args(args)
+    except argparse.ArgumentError as e:
+        return False, e.message
+    except SystemExit as e:
+        return False, str(e)
 
 
-def register_endpoint(path: str):
+def register_endpoint(path: str, budget: float | None = None):
     """
     Decorator to register an endpoint with the global endpoint registry.
 
     Args:
         path: The endpoint path (e.g., "/shutdown", "/stack")
+        budget: Seconds the endpoint may take, None for no limit
 
     Raises:
         ValueError: If the path is already registered
@@ -98,6 +89,8 @@ def register_endpoint(path: str):
                 f"Cannot overwrite existing endpoint."
             )
         ENDPOINT_REGISTRY[path] = func
+        if budget is not None:
+            ENDPOINT_BUDGETS[path] = budget
         return func
 
     return decorator
@@ -114,7 +107,7 @@ def shutdown(req: TeleXRequest, resp: TeleXResponse) -> None:
     req.app.defered_shutdown()
 
 
-@register_endpoint("/stack")
+@register_endpoint("/stack", budget=10)
 def stack(req: TeleXRequest, resp: TeleXResponse):
     """
     Get the stack trace of all threads and format it on the server side.
@@ -166,52 +159,22 @@ def stack(req: TeleXRequest, resp: TeleXResponse):
         resp.return_json({"data": parser.format_help(), "code": SUCCESS_CODE})
         return
 
-    system = cast(TeleXSystem, req.app.lookup(TELEX_SYSTEM))
-    thread_data = system.thread()
-
-    # Get sys.base_prefix for stripping
-    base_prefix = sys.base_prefix if parse_args.strip_site_packages else None
+    # the native snapshot strips the prefixes, in this order of precedence
+    prefixes = []
+    if parse_args.strip_site_packages:
+        prefixes.append(sys.base_prefix)
+    if parse_args.strip_cwd:
+        prefixes.append(os.getcwd())
 
-    # Get current working directory for stripping
-    cwd = os.getcwd() if parse_args.strip_cwd else None
-
-    def strip_path(path: str) -> str:
-        """Strip common path prefixes from a file path.
-
-        Applies path stripping based on command-line flags:
-        - strip_site_packages: Remove sys.base_prefix from paths
-        - strip_cwd: Remove current working directory prefix
-        """
-        # Strip sys.base_prefix (if requested)
-        if base_prefix and path.startswith(base_prefix):
-            return path[len(base_prefix) :].lstrip("/")
-
-        # Strip current working directory (if requested)
-        if cwd and path.startswith(cwd):
-            return path[len(cwd) :].lstrip("/")
-
-        return path
+    system = cast(TeleXSystem, req.app.lookup(TELEX_SYSTEM))
+    thread_data = system.thread(strip=prefixes, indent="  ")
 
-    # Format the stack traces with simple indentation
     lines = []
     for idx, item in enumerate(thread_data):
         if idx > 0:
             lines.append("")  # Add blank line between threads
-
-        # Thread header
         lines.append(f"Thread ({item['id']}, {item['name']}, daemon={item['daemon']})")
-
-        # Add indented stack frames with path stripping
-        stack_lines = item["stack"].strip().split("\n")
-        for frame_line in stack_lines:
-            # Always strip standard lib paths, conditionally strip cwd
-            # Frame format: "path:line function_name"
-            if ":" in frame_line:
-                path_part, rest = frame_line.split(":", 1)
-                stripped_path = strip_path(path_part)
-                frame_line = f"{stripped_path}:{rest}"
-
-            lines.append(f"  {frame_line}")
+        lines.append(item["stack"])
 
     formatted_output = "\n".join(lines)
 
@@ -234,7 +197,7 @@ def ping(req: TeleXRequest, resp: TeleXResponse):
     )
 
 
-@register_endpoint("/profile")
+@register_endpoint("/profile", budget=60)
 def profile(req: TeleXRequest, resp: TeleXResponse):
     def create_start_parser():
         parser = argparse.ArgumentParser(add_help=False)
@@ -256,6 +219,12 @@ def profile(req: TeleXRequest, resp: TeleXResponse):
             default=False,
             help="Ignore the telex profiler itself",
         )
+        parser.add_argument(
+            "--phase-stats",
+            action="store_true",
+            default=False,
+            help="Time every phase of sampling, see sampler-stats",
+        )
         parser.add_argument(
             "--help",
             "-h",
@@ -324,6 +293,7 @@ def profile(req: TeleXRequest, resp: TeleXResponse):
             interval=parse_args.interval,
             ignore_frozen=parse_args.ignore_frozen,
             ignore_self=parse_args.ignore_self,
+            phase_stats=parse_args.phase_stats,
         )
         if ret:
             resp.return_json({"data": "Profiler started", "code": SUCCESS_CODE})
@@ -364,6 +334,368 @@ def profile(req: TeleXRequest, resp: TeleXResponse):
         )
 
 
+@register_endpoint("/flamegraph", budget=30)
+def flamegraph(req: TeleXRequest, resp: TeleXResponse):
+    """
+    Render the running profile as a lazily loading html flame graph.
+
+    Meant to be opened in a browser, so the page is returned as is rather than
+    wrapped in json. It fetches the rest of the call tree from
+    /flamegraph/chunk as it is zoomed into.
+
+    Query:
+        inverted: Render the root frame at the top if set to 1.
+    """
+    system = cast(TeleXSystem, req.app.lookup(TELEX_SYSTEM))
+    inverted = req.query.get("inverted", ["0"])[0] == "1"
+    try:
+        page = system.html_snapshot("/flamegraph/chunk?", inverted=inverted)
+    except RuntimeError as e:
+        resp.return_json({"data": str(e), "code": ERROR_CODE})
+        return
+    resp.headers["Content-Type"] = "text/html; charset=utf-8"
+    resp.return_raw(page)
+
+
+@register_endpoint("/flamegraph/chunk")
+def flamegraph_chunk(req: TeleXRequest, resp: TeleXResponse):
+    """Serve a chunk of the last /flamegraph page, see TeleXSystem.chunk."""
+    system = cast(TeleXSystem, req.app.lookup(TELEX_SYSTEM))
+    try:
+        snapshot = int(req.query["snapshot"][0])
+        idx = int(req.query["id"][0])
+    except (KeyError, ValueError):
+        resp.status_code = HTTPStatus.BAD_REQUEST.value
+        resp.return_json({"data": "snapshot and id are required", "code": ERROR_CODE})
+        return
+    chunk = system.chunk(snapshot, idx)
+    if chunk is None:
+        resp.status_code = HTTPStatus.NOT_FOUND.value
+        resp.return_json(
+            {"data": "chunk not found, reload the flame graph", "code": ERROR_CODE}
+        )
+        return
+    resp.headers["Content-Type"] = "application/json; charset=utf-8"
+    resp.return_raw(chunk)
+
+
+@register_endpoint("/continuous")
+def continuous(req: TeleXRequest, resp: TeleXResponse):
+    """
+    Keep a sampler running with rolling windows, see TeleXSystem.start_continuous.
+
+    Args:
+        start [--interval N] [--slot S] [--ignore-frozen] [--ignore-self]
+            [--phase-stats]
+        stop
+    """
+    parser = argparse.ArgumentParser(add_help=False)
+    parser.add_argument("action", nargs="?", choices=["start", "stop"])
+    parser.add_argument(
+        "--interval",
+        type=int,
+        default=10_000,
+        help="Interval between samples in microseconds (default: 10000)",
+    )
+    parser.add_argument(
+        "--slot",
+        type=float,
+        default=5.0,
+        help="Seconds between two updates of the windows (default: 5)",
+    )
+    parser.add_argument(
+        "--ignore-frozen",
+        action="store_true",
+        default=False,
+        help="Ignore frozen objects",
+    )
+    parser.add_argument(
+        "--ignore-self",
+        action="store_true",
+        default=False,
+        help="Ignore the telex profiler itself",
+    )
+    parser.add_argument(
+        "--phase-stats",
+        action="store_true",
+        default=False,
+        help="Time every phase of sampling, see sampler-stats",
+    )
+    parser.add_argument(
+        "--help",
+        "-h",
+        default=False,
+        action="store_true",
+        help="Show this help message and exit",
+    )
+
+    args = req.headers.get("args", "").strip().split()
+    success, result = safe_parse_args(parser, args)
+    if not success:
+        resp.return_json({"data": result, "code": ERROR_CODE})
+        return
+
+    parse_args = result
+    if parse_args.help or parse_args.action is None:
+        resp.return_json({"data": parser.format_help(), "code": SUCCESS_CODE})
+        return
+    if parse_args.slot <= 0:
+        resp.return_json({"data": "--slot must be positive", "code": ERROR_CODE})
+        return
+
+    system = cast(TeleXSystem, req.app.lookup(TELEX_SYSTEM))
+    if parse_args.action == "start":
+        if system.start_continuous(
+            interval=parse_args.interval,
+            slot=parse_args.slot,
+            ignore_frozen=parse_args.ignore_frozen,
+            ignore_self=parse_args.ignore_self,
+            phase_stats=parse_args.phase_stats,
+        ):
+            resp.return_json(
+                {"data": "Continuous profiling started", "code": SUCCESS_CODE}
+            )
+        else:
+            resp.return_json(
+                {"data": "A profiler is already running", "code": ERROR_CODE}
+            )
+    elif system.stop_continuous():
+        resp.return_json({"data": "Continuous profiling stopped", "code": SUCCESS_CODE})
+    else:
+        resp.return_json(
+            {"data": "Continuous profiling not started", "code": ERROR_CODE}
+        )
+
+
+@register_endpoint("/sampler-stats")
+def sampler_stats(req: TeleXRequest, resp: TeleXResponse):
+    """
+    The rounds of the running sampler and the nodes, depths and bytes of
+    its stack tree, and of every window for continuous profiling. With
+    --phase-stats, also the time it spends in every phase of sampling.
+    """
+    parser = argparse.ArgumentParser(add_help=False)
+    parser.add_argument(
+        "--help",
+        "-h",
+        default=False,
+        action="store_true",
+        help="Show this help message and exit",
+    )
+
+    args = req.headers.get("args", "").strip().split()
+    success, result = safe_parse_args(parser, args)
+    if not success:
+        resp.return_json({"data": result, "code": ERROR_CODE})
+        return
+
+    parse_args = result
+    if parse_args.help:
+        resp.return_json({"data": parser.format_help(), "code": SUCCESS_CODE})
+        return
+
+    system = cast(TeleXSystem, req.app.lookup(TELEX_SYSTEM))
+    try:
+        stats = system.sampler_stats()
+    except RuntimeError as e:
+        resp.return_json({"data": str(e), "code": ERROR_CODE})
+        return
+    resp.return_json({"data": stats, "code": SUCCESS_CODE})
+
+
+@register_endpoint("/window", budget=30)
+def window(req: TeleXRequest, resp: TeleXResponse):
+    """
+    Read a rolling window of the continuous profile without pausing sampling.
+
+    Args:
+        --window, -w: 1m, 5m, 15m or all (default: 1m)
+        --format: folded, top or pprof (default: folded)
+        --top, -k: Number of frames for the top format (default: 20)
+        --filename, -f: File to write the pprof format to
+    """
+    parser = argparse.ArgumentParser(add_help=False)
+    parser.add_argument(
+        "--window",
+        "-w",
+        choices=list(WINDOWS),
+        default="1m",
+        help="The window to read (default: 1m)",
+    )
+    parser.add_argument(
+        "--format",
+        choices=["folded", "top", "pprof"],
+        default="folded",
+        help="folded stack lines, the frames with the most samples, or a gzipped "
+        "pprof file (default: folded)",
+    )
+    parser.add_argument(
+        "--top",
+        "-k",
+        type=int,
+        default=20,
+        help="Number of frames for the top format (default: 20)",
+    )
+    parser.add_argument(
+        "--filename",
+        "-f",
+        type=str,
+        default=None,
+        help="File to write the pprof format to",
+    )
+    parser.add_argument(
+        "--help",
+        "-h",
+        default=False,
+        action="store_true",
+        help="Show this help message and exit",
+    )
+
+    args = req.headers.get("args", "").strip().split()
+    success, result = safe_parse_args(parser, args)
+    if not success:
+        resp.return_json({"data": result, "code": ERROR_CODE})
+        return
+
+    parse_args = result
+    if parse_args.help:
+        resp.return_json({"data": parser.format_help(), "code": SUCCESS_CODE})
+        return
+
+    system = cast(TeleXSystem, req.app.lookup(TELEX_SYSTEM))
+    try:
+        if parse_args.format == "folded":
+            data: object = system.window_folded(parse_args.window)
+        elif parse_args.format == "top":
+            data = [
+                {"frame": frame, "self": own, "total": total}
+                for frame, own, total in system.window_top(
+                    parse_args.window, max(0, parse_args.top)
+                )
+            ]
+        else:
+            filename = os.path.abspath(
+                parse_args.filename
+                or f"telex-window-{parse_args.window}-{os.getpid()}.pb.gz"
+            )
+            samples = system.window_pprof(parse_args.window, filename)
+            data = f"{samples} samples of {parse_args.window} saved to {filename}"
+    except RuntimeError as e:
+        resp.return_json({"data": str(e), "code": ERROR_CODE})
+        return
+    resp.return_json({"data": data, "code": SUCCESS_CODE})
+
+
+@register_endpoint("/window/pprof", budget=30)
+def window_pprof(req: TeleXRequest, resp: TeleXResponse):
+    """
+    A rolling window as a gzipped pprof profile, for `go tool pprof <url>`.
+
+    Query:
+        window: 1m, 5m, 15m or all (default: 1m)
+    """
+    system = cast(TeleXSystem, req.app.lookup(TELEX_SYSTEM))
+    name = req.query.get("window", ["1m"])[0]
+    if name not in WINDOWS:
+        resp.status_code = HTTPStatus.BAD_REQUEST.value
+        resp.return_json({"data": f"unknown window {name}", "code": ERROR_CODE})
+        return
+    fd, filename = tempfile.mkstemp(suffix=".pb.gz")
+    os.close(fd)
+    try:
+        system.window_pprof(name, filename)
+        with open(filename, "rb") as f:
+            profile = f.read()
+    except RuntimeError as e:
+        resp.return_json({"data": str(e), "code": ERROR_CODE})
+        return
+    finally:
+        os.unlink(filename)
+    resp.headers["Content-Type"] = "application/octet-stream"
+    resp.return_raw(profile)
+
+
+@register_endpoint("/profile/stream")
+def profile_stream(req: TeleXRequest, resp: TeleXResponse):
+    """
+    Stream what continuous profiling sampled every few seconds, one JSON
+    object per line, until the client leaves or sampling is stopped.
+
+    Args:
+        --interval: Seconds between two deltas (default: 2)
+        --top, -k: Number of frames of each delta (default: 20)
+        --folded: Send the folded stacks of each delta instead of the top frames
+        --count: Number of deltas to send, 0 for no limit (default: 0)
+    """
+    parser = argparse.ArgumentParser(add_help=False)
+    parser.add_argument(
+        "--interval",
+        type=float,
+        default=2.0,
+        help="Seconds between two deltas (default: 2)",
+    )
+    parser.add_argument(
+        "--top",
+        "-k",
+        type=int,
+        default=20,
+        help="Number of frames of each delta (default: 20)",
+    )
+    parser.add_argument(
+        "--folded",
+        action="store_true",
+        default=False,
+        help="Send the folded stacks of each delta instead of the top frames",
+    )
+    parser.add_argument(
+        "--count",
+        type=int,
+        default=0,
+        help="Number of deltas to send, 0 for no limit (default: 0)",
+    )
+    parser.add_argument(
+        "--help",
+        "-h",
+        default=False,
+        action="store_true",
+        help="Show this help message and exit",
+    )
+
+    args = req.headers.get("args", "").strip().split()
+    success, result = safe_parse_args(parser, args)
+    if not success:
+        resp.return_json({"data": result, "code": ERROR_CODE})
+        return
+
+    parse_args = result
+    if parse_args.help:
+        resp.return_json({"data": parser.format_help(), "code": SUCCESS_CODE})
+        return
+    if parse_args.interval <= 0:
+        resp.return_json({"data": "--interval must be positive", "code": ERROR_CODE})
+        return
+
+    system = cast(TeleXSystem, req.app.lookup(TELEX_SYSTEM))
+    try:
+        deltas = system.stream_deltas(
+            interval=parse_args.interval,
+            k=max(0, parse_args.top),
+            folded=parse_args.folded,
+            count=max(0, parse_args.count),
+        )
+    except RuntimeError as e:
+        resp.return_json({"data": str(e), "code": ERROR_CODE})
+        return
+
+    def lines() -> Iterator[bytes]:
+        with contextlib.closing(deltas):
+            for delta in deltas:
+                yield json.dumps(delta).encode() + b"\n"
+
+    resp.headers["Content-Type"] = "application/x-ndjson"
+    resp.stream(lines())
+
+
 @register_endpoint("/gc-status")
 def gc_status(req: TeleXRequest, resp: TeleXResponse):
     """Get Python garbage collection status."""
@@ -420,7 +752,7 @@ def gc_stats(req: TeleXRequest, resp: TeleXResponse):
     resp.return_json({"data": stats, "code": SUCCESS_CODE})
 
 
-@register_endpoint("/gc-objects")
+@register_endpoint("/gc-objects", budget=10)
 def gc_objects(req: TeleXRequest, resp: TeleXResponse):
     """Get statistics about tracked objects by type."""
     parser = argparse.ArgumentParser(add_help=False)
@@ -498,7 +830,7 @@ def gc_objects(req: TeleXRequest, resp: TeleXResponse):
         resp.return_json({"data": str(e), "code": ERROR_CODE})
 
 
-@register_endpoint("/gc-garbage")
+@register_endpoint("/gc-garbage", budget=10)
 def gc_garbage(req: TeleXRequest, resp: TeleXResponse):
     """Get information about uncollectable garbage objects."""
     parser = argparse.ArgumentParser(add_help=False)
@@ -526,7 +858,7 @@ def gc_garbage(req: TeleXRequest, resp: TeleXResponse):
     resp.return_json({"data": garbage_info, "code": SUCCESS_CODE})
 
 
-@register_endpoint("/gc-collect")
+@register_endpoint("/gc-collect", budget=10)
 def gc_collect(req: TeleXRequest, resp: TeleXResponse):
     """Manually trigger garbage collection."""
     parser = argparse.ArgumentParser(add_help=False)
@@ -591,13 +923,15 @@ def gc_monitor(req: TeleXRequest, resp: TeleXResponse):
 
 
 class TeleXMonitor:
-    def __init__(self, port: int = 8026, host: str = "127.0.0.1", log=True):
-        app = TeleXApp(port=port, host=host, log=log)
+    def __init__(
+        self, port: int = 8026, host: str = "127.0.0.1", log=True, workers: int = 8
+    ):
+        app = TeleXApp(port=port, host=host, log=log, workers=workers)
         app.register(TELEX_SYSTEM, TeleXSystem())
 
         # Automatically register all endpoints from the global registry
         for path, handler in ENDPOINT_REGISTRY.items():
-            app.route(path)(handler)
+            app.route(path, budget=ENDPOINT_BUDGETS.get(path))(handler)
 
         self.app = app
 
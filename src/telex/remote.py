@@ -0,0 +1,154 @@
+"""
+Child processes sampled from outside, by reading their memory.
+
+``RemoteProfiler`` runs in the root process and samples every descendant
+running this Python version with ``_telexsys.RemoteProcess``, which reads
+the interpreter state of the child with process_vm_readv. The children need
+no telex and do not cooperate, so unlike the fork and multiprocessing patches
+this covers the ``forkserver`` start method and processes started by
+``subprocess``. Linux only, and the root must be allowed to read the memory
+of its descendants, which it is unless Yama's ptrace_scope forbids it.
+"""
+
+from __future__ import annotations
+
+import errno
+import os
+import threading
+import time
+
+from . import _telexsys
+
+
+def parent_pids() -> dict[int, int]:
+    """The parent of every process, from /proc."""
+    parents: dict[int, int] = {}
+    for entry in os.listdir("/proc"):
+        if not entry.isdigit():
+            continue
+        try:
+            with open(f"/proc/{entry}/stat", "rb") as f:
+                stat = f.read()
+        except OSError:  # exited meanwhile
+            continue
+        # the command name in parentheses may hold spaces and parentheses
+        fields = stat[stat.rfind(b")") + 2 :].split()
+        if len(fields) > 1:
+            parents[int(entry)] = int(fields[1])
+    return parents
+
+
+def descendants(pid: int) -> dict[int, int]:
+    """The descendants of process ``pid``, with their parents."""
+    children: dict[int, list[int]] = {}
+    for child, parent in parent_pids().items():
+        children.setdefault(parent, []).append(child)
+    found: dict[int, int] = {}
+    pending = [pid]
+    while pending:
+        parent = pending.pop()
+        for child in children.get(parent, ()):
+            if child not in found:
+                found[child] = parent
+                pending.append(child)
+    return found
+
+
+class RemoteProfiler:
+    def __init__(
+        self,
+        pid: int | None = None,
+        interval: float = 0.008,
+        refresh: float = 0.1,
+    ) -> None:
+        """
+        Sample the descendants of a process into ``tree``.
+
+        Each stack starts with "Process(pid-<pid>, ppid-<ppid>)", as the
+        stacks the fork and multiprocessing patches merge do.
+
+        Args:
+            pid: The process whose descendants are sampled, this one by
+                default. It is not sampled itself.
+            interval: Seconds between two samples of every descendant.
+            refresh: Seconds between two looks for new descendants.
+        """
+        self.pid = os.getpid() if pid is None else pid
+        self.interval = interval
+        self.refresh = refresh
+        self.tree = _telexsys.StackTree()
+        # the processes sampled, and the ones which can not be, such as those
+        # running another program or Python version
+        self.sampled: set[int] = set()
+        self.skipped: set[int] = set()
+        self._processes: dict[int, tuple[_telexsys.RemoteProcess, str]] = {}
+        self._stopped = threading.Event()
+        self._thread: threading.Thread | None = None
+
+    def start(self) -> RemoteProfiler:
+        self._stopped.clear()
+        self._thread = threading.Thread(
+            target=self._run, name="telex-remote", daemon=True
+        )
+        self._thread.start()
+        return self
+
+    def stop(self) -> _telexsys.StackTree:
+        """Stop sampling and return the stacks sampled."""
+        if self._thread is not None:
+            self._stopped.set()
+            self._thread.join()
+            self._thread = None
+        for remote, _ in self._processes.values():
+            remote.close()
+        self._processes.clear()
+        return self.tree
+
+    def attach(self) -> None:
+        """Start sampling the descendants created since the last look."""
+        for pid, ppid in descendants(self.pid).items():
+            if pid in self._processes or pid in self.skipped:
+                continue
+            try:
+                remote = _telexsys.RemoteProcess(pid)
+            except (OSError, ValueError):
+                # another program, unless the child of one that has not
+                # exec'd yet, which is looked at again
+                if not self._is_forked_copy(pid, ppid):
+                    self.skipped.add(pid)
+                continue
+            self._processes[pid] = (remote, f"Process(pid-{pid}, ppid-{ppid})")
+            self.sampled.add(pid)
+
+    @staticmethod
+    def _is_forked_copy(pid: int, ppid: int) -> bool:
+        try:
+            return os.readlink(f"/proc/{pid}/exe") == os.readlink(
+                f"/proc/{ppid}/exe"
+            )
+        except OSError:
+            return False
+
+    def sample(self) -> int:
+        """Sample every descendant once, returns the stacks added."""
+        added = 0
+        for pid, (remote, prefix) in list(self._processes.items()):
+            try:
+                added += remote.sample(self.tree, prefix)
+            except OSError as e:
+                if e.errno not in (errno.ESRCH, errno.EFAULT, errno.EPERM):
+                    raise  # pragma: no cover
+                # exited, or exec'd another program which is attached anew
+                remote.close()
+                del self._processes[pid]
+        return added
+
+    def _run(self) -> None:
+        next_refresh = 0.0
+        while not self._stopped.is_set():
+            now = time.monotonic()
+            if now >= next_refresh:
+                self.attach()
+                next_refresh = now + self.refresh
+            self.sample()
+            self._stopped.wait(self.interval)
@@ -0,0 +1,186 @@
+"""
+Rolling windows over a sampler that keeps running, for always-on profiling.
+
+The stacks the sampler collected are taken every ``slot`` seconds, see
+``_telexsys.take_stacks``, and merged into one StackTree per window. The
+slots a window covers are kept too and subtracted from it again once they
+are older than the window, so every window is ready to be read at any time:
+a query merges the samples taken since the last query or slot into the
+windows, they only become a slot with the next one.
+
+Subscribers, such as a live stream, also get every slot merged into a tree
+of their own and read it with ``delta``.
+"""
+
+from __future__ import annotations
+
+import contextlib
+import itertools
+import threading
+import time
+from collections import deque
+from collections.abc import Callable, Iterator
+from typing import Final
+
+from . import _telexsys
+from .sampler import TelexSysAsyncSampler, TelexSysSampler
+
+# seconds a window looks back, None for the whole lifetime
+WINDOWS: Final[dict[str, float | None]] = {
+    "1m": 60.0,
+    "5m": 300.0,
+    "15m": 900.0,
+    "all": None,
+}
+
+
+class RollingProfile:
+    def __init__(
+        self,
+        sampler: TelexSysSampler | TelexSysAsyncSampler,
+        slot: float = 5.0,
+        windows: dict[str, float | None] = WINDOWS,
+        clock: Callable[[], float] = time.monotonic,
+    ) -> None:
+        """
+        Args:
+            sampler: The sampler whose stacks are taken, it is started and
+                stopped with the profile.
+            slot: Seconds between two takes. A window of ``n`` seconds holds
+                the samples of the last ``n`` to ``n + slot`` seconds.
+            windows: Names and lengths in seconds of the windows kept, None
+                for the whole lifetime.
+            clock: The time in seconds, monotonic.
+        """
+        if slot <= 0:
+            raise ValueError("slot must be positive")
+        self.sampler = sampler
+        self.slot = slot
+        self.spans = dict(windows)
+        self.started_at = 0.0
+        self._clock = clock
+        self._lock = threading.Lock()
+        # the taken stacks with the time their last samples were taken, oldest
+        # first
+        self._slots: deque[tuple[float, _telexsys.StackTree]] = deque()
+        # the stacks taken by queries since the last slot, in the windows
+        # already, and when the last of them were taken
+        self._pending = _telexsys.StackTree()
+        self._pending_at = 0.0
+        self._trees = {name: _telexsys.StackTree() for name in windows}
+        # the number of newest slots each bounded window holds
+        self._held = {name: 0 for name, span in windows.items() if span is not None}
+        # the stacks each subscriber has not read yet
+        self._deltas: dict[int, _telexsys.StackTree] = {}
+        self._keys = itertools.count()
+        self._stopped = threading.Event()
+        self._thread: threading.Thread | None = None
+
+    def start(self) -> None:
+        """Start the sampler and take its stacks every ``slot`` seconds."""
+        self.started_at = self._clock()
+        self.sampler.start()
+        self._stopped.clear()
+        self._thread = threading.Thread(
+            target=self._run, name="telex-rolling", daemon=True
+        )
+        self._thread.start()
+
+    def stop(self) -> None:
+        """Stop the sampler, the windows keep what they hold."""
+        self._stopped.set()
+        if self._thread is not None:
+            self._thread.join()
+            self._thread = None
+        self.sampler.stop()
+        self.rotate()
+
+    def _run(self) -> None:
+        while not self._stopped.wait(self.slot):
+            self.rotate()
+
+    def rotate(self) -> None:
+        """Take the stacks sampled since the last slot into the windows."""
+        with self._lock:
+            self._rotate()
+
+    def _rotate(self) -> None:
+        self._take()
+        slot, self._pending = self._pending, _telexsys.StackTree()
+        if slot.samples > 0:
+            self._slots.append((self._pending_at, slot))
+            for name in self._held:
+                self._held[name] += 1
+        self._expire()
+
+    def _take(self) -> None:
+        """Merge the stacks sampled since the last take into every tree."""
+        taken = _telexsys.take_stacks(self.sampler)
+        if taken.samples == 0:
+            return
+        self._pending_at = self._clock()
+        for tree in itertools.chain(
+            self._trees.values(), self._deltas.values(), (self._pending,)
+        ):
+            tree.merge(taken)
+
+    def _expire(self) -> None:
+        now = self._clock()
+        for name, held in self._held.items():
+            span = self.spans[name]
+            assert span is not None
+            # a slot leaves a window once all of it is older than the window
+            while held > 0 and self._slots[-held][0] <= now - span:
+                self._trees[name].subtract(self._slots[-held][1])
+                held -= 1
+            self._held[name] = held
+        keep = max(self._held.values(), default=0)
+        while len(self._slots) > keep:
+            self._slots.popleft()
+
+    def wait(self, timeout: float) -> bool:
+        """Wait up to ``timeout`` seconds, False once the profile is stopped."""
+        return not self._stopped.wait(timeout)
+
+    def subscribe(self) -> int:
+        """Start collecting the stacks of every slot, returns the key of ``delta``."""
+        with self._lock:
+            key = next(self._keys)
+            self._deltas[key] = _telexsys.StackTree()
+            return key
+
+    def unsubscribe(self, key: int) -> None:
+        with self._lock:
+            self._deltas.pop(key, None)
+
+    def delta(self, key: int) -> _telexsys.StackTree:
+        """The stacks sampled since the last delta of a subscriber."""
+        with self._lock:
+            self._take()
+            tree = self._deltas[key]
+            self._deltas[key] = _telexsys.StackTree()
+            return tree
+
+    @contextlib.contextmanager
+    def window(self, name: str) -> Iterator[_telexsys.StackTree]:
+        """
+        The stacks of a window, up to now.
+
+        The tree is only valid inside the ``with`` block, it is not changed
+        by the next slot until the block ends.
+
+        Raises:
+            KeyError: if there is no window of that name.
+        """
+        if name not in self._trees:
+            raise KeyError(name)
+        with self._lock:
+            self._take()
+            self._expire()
+            yield self._trees[name]
+
+    def duration(self, name: str) -> float:
+        """Seconds the samples of a window were collected in."""
+        elapsed = self._clock() - self.started_at
+        span = self.spans[name]
+        return elapsed if span is None else min(span, elapsed)
@@ -1,11 +1,17 @@
 from __future__ import annotations
 
+import gzip
+import os
 import re
+import shutil
 import signal
 import sys
+import tempfile
 import threading
+import time
 from abc import ABC, abstractmethod
-from typing import Literal, cast
+from collections.abc import Callable
+from typing import Any, Literal, cast
 
 try:
     from typing import override
@@ -19,6 +25,7 @@ except ImportError:
 
 
 from . import _telexsys
+from .flamegraph import open_folded, python_gzip
 from .thread import in_main_thread
 
 # Check if we're on Windows
@@ -247,6 +254,54 @@ class SamplerMixin(ABC):
                 self.stop()
         return False
 
+    def _save(
+        self,
+        filename: str,
+        format: SaveFormat,
+        save_tree: Callable[[str], None],
+    ) -> None:
+        """
+        Save the sampler data to a file.
+
+        Args:
+            filename: The file to write. Folded lines are gzipped if it ends
+                with ".gz".
+            format: "folded" for folded stack lines, "pprof" for a gzipped
+                profile.proto as read by `go tool pprof`, or "speedscope" and
+                "chrome" for the timeline of the sample log.
+            save_tree: The native save of the sampler's extension type, which
+                writes the folded lines while the tree is walked.
+
+        Raises:
+            RuntimeError: If a timeline is asked for without `sample_log`.
+        """
+        sampler = cast("TelexSysSampler | TelexSysAsyncSampler", self)
+        if format == "pprof":
+            save_pprof(sampler, filename)
+            return
+        if format == "speedscope":
+            sampler.save_speedscope(
+                filename, name=os.path.basename(sys.argv[0]) or "telex"
+            )
+            return
+        if format == "chrome":
+            sampler.save_chrome_trace(filename, pid=os.getpid())
+            return
+        if format != "folded":
+            raise ValueError(
+                "format must be one of 'folded', 'pprof', 'speedscope' or 'chrome'"
+            )
+        filename = os.fspath(filename)
+        with self._middleware_lock:
+            plain = not self._middleware
+        if plain and not python_gzip(filename):
+            # written natively while the tree is walked, gzipped for ".gz"
+            save_tree(filename)
+            return
+        content = sampler.dumps()
+        with open_folded(filename, "w") as f:
+            f.write(content)  # no need to remove last newline anymore
+
     @staticmethod
     def setswitchinterval(val: float) -> None:
         """
@@ -280,6 +335,78 @@ class SamplerMixin(ABC):
         return compiled_patterns
 
 
+# output files with these suffixes are written in the pprof format
+PPROF_SUFFIXES = (".pprof", ".pb.gz")
+# and these are timelines written from the sample log
+SPEEDSCOPE_SUFFIX = ".speedscope.json"
+CHROME_TRACE_SUFFIX = ".trace.json"
+
+SaveFormat = Literal["folded", "pprof", "speedscope", "chrome"]
+
+
+def write_pprof(
+    source: TelexSysSampler | TelexSysAsyncSampler | list[str] | _telexsys.StackTree,
+    filename: str,
+    **options: Any,
+) -> int:
+    """_telexsys.write_pprof, gzipped by python where the extension has no zlib.
+
+    The profile is written uncompressed next to `filename` first, then
+    gzipped into it.
+    """
+    if _telexsys.HAVE_ZLIB or not options.get("compress", True):
+        return _telexsys.write_pprof(source, filename, **options)
+    fd, raw = tempfile.mkstemp(dir=os.path.dirname(os.path.abspath(filename)))
+    os.close(fd)
+    try:
+        total = _telexsys.write_pprof(source, raw, **options, compress=False)
+        with open(raw, "rb") as f, gzip.open(filename, "wb") as out:
+            shutil.copyfileobj(f, out)
+    finally:
+        os.unlink(raw)
+    return total
+
+
+def save_pprof(
+    sampler: TelexSysSampler | TelexSysAsyncSampler,
+    filename: str,
+    lines: list[str] | _telexsys.StackTree | None = None,
+) -> None:
+    """Write the sampler's profile to a gzipped pprof (profile.proto) file.
+
+    Every sample also carries its time in nanoseconds, named after the
+    sampler's time mode. Middleware only works on folded text, so once any is
+    registered the processed dump is written instead of the stack tree.
+
+    Args:
+        sampler: The sampler the profile and its timing come from.
+        filename: The file to write.
+        lines: Folded stack lines, or a merged StackTree, to write instead of
+            the sampler's own.
+    """
+    source: TelexSysSampler | TelexSysAsyncSampler | list[str] | _telexsys.StackTree = (
+        sampler
+    )
+    if lines is not None:
+        source = lines
+    else:
+        with sampler._middleware_lock:
+            if len(sampler._middleware) > 0:
+                source = sampler.dumps().splitlines()
+    # the sampler times itself with a monotonic clock in microseconds
+    now = _telexsys.unix_micro_time()
+    start = sampler.start_time
+    end = now if sampler.started else sampler.end_time
+    write_pprof(
+        source,
+        filename,
+        period=sampler.sampling_interval * 1000,
+        sample_type=sampler.time_mode,
+        time_nanos=time.time_ns() - (now - start) * 1000,
+        duration_nanos=max(0, end - start) * 1000,
+    )
+
+
 # Deprecated: Use TelexSysAsyncWorkerSampler instead.
 class TelexSysSampler(_telexsys.Sampler, SamplerMixin, MultiProcessEnv):
     """
@@ -300,6 +427,9 @@ class TelexSysSampler(_telexsys.Sampler, SamplerMixin, MultiProcessEnv):
         from_mp: bool = False,
         forkserver: bool = False,
         time_mode: str = "cpu",
+        sample_log: bool = False,
+        shm_ring: str | None = None,
+        phase_stats: bool = False,
     ) -> None:
         """
         Args:
@@ -326,6 +456,15 @@ class TelexSysSampler(_telexsys.Sampler, SamplerMixin, MultiProcessEnv):
                 Whether the sampler is running in the child process with the multiprocessing.
             forkserver (bool):
                 Whether the current process is the forkserver.
+            sample_log (bool):
+                Whether to also keep every sample in order, for the speedscope and Chrome
+                trace timelines.
+            shm_ring (str | None):
+                A file, usually under /dev/shm, every sample is also written to so that
+                another process can follow the profile, see telex.shm.
+            phase_stats (bool):
+                Whether to time every phase of the sampling rounds into histograms,
+                see stats().
         """  # noqa: E501
         _telexsys.Sampler.__init__(self)
         SamplerMixin.__init__(self)
@@ -338,6 +477,9 @@ class TelexSysSampler(_telexsys.Sampler, SamplerMixin, MultiProcessEnv):
         self.ignore_self = ignore_self
         self.tree_mode = tree_mode
         self.focus_mode = focus_mode
+        self.sample_log = sample_log
+        self.shm_ring = shm_ring
+        self.phase_stats = phase_stats
         self.regex_patterns = self._compile_regex_patterns(regex_patterns)
         self.is_root = is_root
         self.from_fork = from_fork
@@ -348,6 +490,13 @@ class TelexSysSampler(_telexsys.Sampler, SamplerMixin, MultiProcessEnv):
             raise ValueError("time_mode must be either 'cpu' or 'wall'")
         self.time_mode = cast(Literal["cpu", "wall"], normalized_time_mode)
 
+    def set_interval(self, sampling_interval: int) -> None:
+        """
+        Change the sampling interval in microseconds, a started sampler
+        switches to it after the sleep it is in.
+        """
+        self.sampling_interval = sampling_interval
+
     def adjust_interval(self) -> bool:
         """
         Adjusts sys's interval to match TelexSys's interval.
@@ -412,13 +561,9 @@ class TelexSysSampler(_telexsys.Sampler, SamplerMixin, MultiProcessEnv):
         return result
 
     @override
-    def save(self, filename: str) -> None:
-        """
-        Save the sampler data to a file.
-        """
-        content = self.dumps()
-        with open(filename, "w") as f:
-            f.write(content)  # no need to remove last newline anymore
+    def save(self, filename: str, format: SaveFormat = "folded") -> None:
+        """Save the sampler data to a file, see `SamplerMixin.save`."""
+        self._save(filename, format, super().save)
 
     @override
     def start(self) -> None:
@@ -479,6 +624,9 @@ class TelexSysAsyncSampler(_telexsys.AsyncSampler, SamplerMixin, MultiProcessEnv
         from_mp: bool = False,
         forkserver: bool = False,
         time_mode: str = "cpu",
+        sample_log: bool = False,
+        shm_ring: str | None = None,
+        phase_stats: bool = False,
     ) -> None:
         """
         Args:
@@ -507,6 +655,15 @@ class TelexSysAsyncSampler(_telexsys.AsyncSampler, SamplerMixin, MultiProcessEnv
                 Whether the current process is the forkserver.
             time_mode (str):
                 Timer source for sampling. "cpu" uses SIGPROF/ITIMER_PROF, "wall" uses SIGALRM/ITIMER_REAL.
+            sample_log (bool):
+                Whether to also keep every sample in order, for the speedscope and Chrome
+                trace timelines.
+            shm_ring (str | None):
+                A file, usually under /dev/shm, every sample is also written to so that
+                another process can follow the profile, see telex.shm.
+            phase_stats (bool):
+                Whether to time every phase of the sampling rounds into histograms,
+                see stats().
         """  # noqa: E501
         _telexsys.AsyncSampler.__init__(self)
         SamplerMixin.__init__(self)
@@ -521,6 +678,9 @@ class TelexSysAsyncSampler(_telexsys.AsyncSampler, SamplerMixin, MultiProcessEnv
         self.ignore_self = ignore_self
         self.tree_mode = tree_mode
         self.focus_mode = focus_mode
+        self.sample_log = sample_log
+        self.shm_ring = shm_ring
+        self.phase_stats = phase_stats
         self.regex_patterns = self._compile_regex_patterns(regex_patterns)
         self.is_root = is_root
         self.from_fork = from_fork
@@ -538,13 +698,9 @@ class TelexSysAsyncSampler(_telexsys.AsyncSampler, SamplerMixin, MultiProcessEnv
             self._timer_type = signal.ITIMER_REAL
 
     @override
-    def save(self, filename: str) -> None:
-        """
-        Save the sampler data to a file.
-        """
-        content = self.dumps()
-        with open(filename, "w") as f:
-            f.write(content)  # no need to remove last newline anymore
+    def save(self, filename: str, format: SaveFormat = "folded") -> None:
+        """Save the sampler data to a file, see `SamplerMixin.save`."""
+        self._save(filename, format, super().save)
 
     @property
     def started(self):
@@ -636,6 +792,16 @@ class TelexSysAsyncSampler(_telexsys.AsyncSampler, SamplerMixin, MultiProcessEnv
             # If stop fails, clean up
             raise
 
+    def set_interval(self, sampling_interval: int) -> None:
+        """
+        Change the sampling interval in microseconds, the timer of a started
+        sampler is re-armed with it at once. It may be called from any thread.
+        """
+        self.sampling_interval = sampling_interval
+        if self.started:
+            interval_sec = sampling_interval * 1e-6
+            signal.setitimer(self._timer_type, interval_sec, interval_sec)
+
     @override
     def adjust(self) -> bool:
         interval = self.sampling_interval / 1000_000
@@ -673,6 +839,9 @@ class TelexSysAsyncWorkerSampler(TelexSysAsyncSampler):
         from_mp: bool = False,
         forkserver: bool = False,
         time_mode: str = "cpu",
+        sample_log: bool = False,
+        shm_ring: str | None = None,
+        phase_stats: bool = False,
     ) -> None:
         super().__init__(
             sampling_interval=sampling_interval,
@@ -687,6 +856,9 @@ class TelexSysAsyncWorkerSampler(TelexSysAsyncSampler):
             from_mp=from_mp,
             forkserver=forkserver,
             time_mode=time_mode,
+            sample_log=sample_log,
+            shm_ring=shm_ring,
+            phase_stats=phase_stats,
         )
 
     @override
@@ -378,7 +378,7 @@ function search(term) {
 	var lastx = -1;
 	var lastw = 0;
 	var keys = Array();
-	for (k in matches) {
+	for (var k in matches) {
 		if (matches.hasOwnProperty(k))
 			keys.push(k);
 	}
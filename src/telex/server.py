@@ -1,12 +1,17 @@
 from __future__ import annotations
 
+import contextlib
 import io
 import json
 import logging
+import queue
+import selectors
+import socket
 import sys
 import threading
+import time
 from collections import defaultdict
-from collections.abc import Callable
+from collections.abc import Callable, Iterable
 from http import HTTPStatus
 from http.server import BaseHTTPRequestHandler, HTTPServer
 from typing import Any, Final
@@ -39,6 +44,11 @@ class TeleXHandler(BaseHTTPRequestHandler):
     app: TeleXApp
     server: HTTPServer
 
+    # keep-alive, see TeleXServer
+    protocol_version = "HTTP/1.1"
+    # seconds a client may take to send a request or read a response
+    timeout = 30
+
     def __init__(self, request, client_address, server) -> None:
         """
         Initializes a new request handler instance.
@@ -76,6 +86,18 @@ class TeleXHandler(BaseHTTPRequestHandler):
             if not self.resp.flow:
                 return
 
+    @override
+    def handle(self):
+        """Handle one request, a TeleXServer waits for the next one itself."""
+        if not isinstance(self.server, TeleXServer):
+            super().handle()
+            return
+        self.ready_at = self.server.ready_at.pop(self.request, time.monotonic())
+        self.close_connection = True
+        self.handle_one_request()
+        if not self.close_connection:
+            self.server.keep(self.request)
+
     @override
     def handle_one_request(self):  # pragma: no cover
         """Handle a single HTTP request.
@@ -120,12 +142,14 @@ class TeleXHandler(BaseHTTPRequestHandler):
                 status_code=HTTPStatus.OK.value, headers={}
             )
             self.resp = self.interceptor
+            self.responded = False
             self.before_request()
             if self.interceptor.forward:
                 method()
             self.interceptor.flow = True
             self.after_request()
-            self._request_finished()
+            if not self.responded:
+                self._request_finished()
             self.wfile.flush()  # actually send the response if not already done.
         except TimeoutError as e:  # pragma: no cover
             # a read or a write timed out.  Discard this connection
@@ -137,14 +161,124 @@ class TeleXHandler(BaseHTTPRequestHandler):
         for key, val in self.resp.headers.items():
             self.send_header(key, val)
         self.end_headers()
-        self.wfile.write(self.resp.buf.getvalue())
+        if self.resp.chunks is None:
+            self.wfile.write(self.resp.buf.getvalue())
+        elif isinstance(self.server, TeleXServer):
+            # the worker goes back to the pool, the stream has a thread of
+            # its own which closes the connection once it is done
+            self.wfile.flush()
+            self.server.detach(self.request)
+            threading.Thread(
+                target=self._stream, name="telex-stream", daemon=True
+            ).start()
+        else:
+            self._write_chunks(self.resp.chunks, self.wfile.write)
+
+    def _stream(self) -> None:
+        assert isinstance(self.server, TeleXServer)
+        try:
+            self._write_chunks(self.resp.chunks, self.request.sendall)
+        finally:
+            self.server.close_stream(self.request)
+
+    def _start_stream(self) -> None:
+        """Prepare the headers of a response set by TeleXResponse.stream."""
+        if isinstance(self.server, TeleXServer) and not self.server.open_stream():
+            close = getattr(self.resp.chunks, "close", None)
+            if close is not None:
+                close()
+            self._unavailable(
+                f"{self.req.url} has more than {self.server.streams} streams open"
+            )
+            return
+        # chunked transfer needs an HTTP/1.1 client, older ones read until
+        # the connection is closed
+        if self.request_version == "HTTP/1.1":
+            self.resp.headers["Transfer-Encoding"] = "chunked"
+        self.resp.headers["Connection"] = "close"
+        self.close_connection = True
+
+    def _write_chunks(
+        self, chunks: Iterable[bytes] | None, write: Callable[[bytes], Any]
+    ) -> None:
+        assert chunks is not None
+        chunked = self.resp.headers.get("Transfer-Encoding") == "chunked"
+        try:
+            for data in chunks:
+                if not data:
+                    continue
+                if chunked:
+                    write(b"%x\r\n%s\r\n" % (len(data), data))
+                else:
+                    write(data)
+            if chunked:
+                write(b"0\r\n\r\n")
+        except (BrokenPipeError, ConnectionResetError, TimeoutError):
+            # the client left before the end of the stream
+            self.close_connection = True
+        finally:
+            close = getattr(chunks, "close", None)
+            if close is not None:
+                close()
+
+    def _dispatch(self, method: str, path: str) -> None:
+        """Call a route, answer 503 if it does not finish within its budget."""
+        route = self.routers[method][path]
+        budget = self.app.budget(method, path)
+        if budget is None:
+            route(self.req, self.resp)
+            return
+        remaining = budget - (time.monotonic() - getattr(self, "ready_at", 0.0))
+        if remaining <= 0:
+            self._over_budget(budget)
+            return
+        resp = self.resp
+        done = threading.Event()
+        errors: list[BaseException] = []
+
+        def run() -> None:
+            try:
+                route(self.req, resp)
+            except BaseException as e:  # pragma: no cover
+                errors.append(e)
+            finally:
+                done.set()
+
+        threading.Thread(target=run, name="telex-route", daemon=True).start()
+        if not done.wait(remaining):
+            # the route goes on in its own thread, its response is dropped
+            self._over_budget(budget)
+            return
+        if errors:  # pragma: no cover
+            raise errors[0]
+
+    def _over_budget(self, budget: float) -> None:
+        self._unavailable(f"{self.req.url} exceeded its budget of {budget}s")
+
+    def _unavailable(self, message: str) -> None:
+        """Replace the response with a 503 the client may retry."""
+        self.interceptor = TeleXInterceptor(
+            status_code=HTTPStatus.SERVICE_UNAVAILABLE.value,
+            headers={"Retry-After": "1"},
+        )
+        self.resp = self.interceptor
+        self.resp.return_json(
+            {
+                "error": {
+                    "code": HTTPStatus.SERVICE_UNAVAILABLE.value,
+                    "message": message,
+                }
+            }
+        )
 
     def do_GET(self):
         parsed_url = urlparse(self.path)
         path = parsed_url.path
         if path in self.routers[GET]:
             self.resp.start()
-            self.routers[GET][path](self.req, self.resp)
+            self._dispatch(GET, path)
+            if self.resp.chunks is not None:
+                self._start_stream()
             self.send_response(self.resp.status_code)
             self.resp.finish()
             return
@@ -166,25 +300,31 @@ class TeleXHandler(BaseHTTPRequestHandler):
         path = parsed_url.path
         if path in self.routers[POST]:
             self.req.body = self.rfile.read(content_length)
-            resp = self.resp
-            resp.start()
-            self.routers[POST][path](self.req, self.resp)
+            self.resp.start()
+            self._dispatch(POST, path)
+            if self.resp.chunks is not None:
+                self._start_stream()
             self.send_response(self.resp.status_code)
-            resp.finish()
+            self.resp.finish()
             return
         self.send_error_response(HTTPStatus.NOT_FOUND.value, HTTPStatus.NOT_FOUND.phrase)
 
     def send_error_response(self, status_code: int, message: str):
-        self.send_response(status_code)
-        self.send_header("Content-Type", "application/json")
-        self.end_headers()
         body = {
             "error": {
                 "code": status_code,
                 "message": message,
             }
         }
-        self.wfile.write(json.dumps(body).encode())
+        data = json.dumps(body).encode()
+        self.send_response(status_code)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        # the body of a rejected request may not have been read
+        self.send_header("Connection", "close")
+        self.end_headers()
+        self.wfile.write(data)
+        self.responded = True
         self.wfile.flush()  # Ensure the error response is sent before connection closes
 
     def log_message(self, format, *args):
@@ -208,6 +348,188 @@ class TeleXHandler(BaseHTTPRequestHandler):
         self.send_header("Date", self.date_time_string())
 
 
+class TeleXServer(HTTPServer):
+    """
+    An HTTPServer that handles requests on a pool of worker threads.
+
+    Accepted connections wait in a bounded queue, a connection that finds
+    it full is answered 503 right away. Between two requests a keep-alive
+    connection waits in a selector instead of on a worker, and a streaming
+    response is sent by a thread of its own, so idle clients such as
+    dashboards and open streams can not hold up health checks.
+    """
+
+    def __init__(
+        self,
+        server_address: tuple[str, int],
+        RequestHandlerClass: type[TeleXHandler],
+        workers: int = 8,
+        backlog: int = 64,
+        idle_timeout: float = 60.0,
+        streams: int = 16,
+    ) -> None:
+        """
+        Args:
+            workers: Number of requests handled at the same time.
+            backlog: Number of connections waiting for a worker.
+            idle_timeout: Seconds a keep-alive connection is kept between
+                two requests.
+            streams: Number of streaming responses sent at the same time,
+                the next ones are answered 503.
+        """
+        super().__init__(server_address, RequestHandlerClass)
+        self.idle_timeout = idle_timeout
+        self.streams = streams
+        self._detached: set[socket.socket] = set()
+        self._streams_lock = threading.Lock()
+        self._open_streams = 0
+        # when each queued connection was ready to be read, for the budgets
+        self.ready_at: dict[socket.socket, float] = {}
+        self._queue: queue.Queue[tuple[socket.socket, Any] | None] = queue.Queue(
+            backlog
+        )
+        self._kept: set[socket.socket] = set()
+        self._idle = selectors.DefaultSelector()
+        self._idle_lock = threading.Lock()
+        self._wakeup, self._waker = socket.socketpair()
+        self._wakeup.setblocking(False)
+        self._idle.register(self._wakeup, selectors.EVENT_READ)
+        self._closed = False
+        self._workers = [
+            threading.Thread(target=self._work, name=f"telex-worker-{i}", daemon=True)
+            for i in range(workers)
+        ]
+        self._watcher = threading.Thread(
+            target=self._watch_idle, name="telex-idle", daemon=True
+        )
+        for t in [*self._workers, self._watcher]:
+            t.start()
+
+    @override
+    def process_request(self, request, client_address) -> None:
+        self._submit(request, client_address)
+
+    def keep(self, request: socket.socket) -> None:
+        """Wait for the next request of a connection once the handler is done."""
+        self._kept.add(request)
+
+    def open_stream(self) -> bool:
+        """Reserve one of the streams, False if they are all open."""
+        with self._streams_lock:
+            if self._open_streams >= self.streams:
+                return False
+            self._open_streams += 1
+            return True
+
+    def detach(self, request: socket.socket) -> None:
+        """Leave a connection open once the handler is done, see close_stream."""
+        self._detached.add(request)
+
+    def close_stream(self, request: socket.socket) -> None:
+        """Close the connection of a stream and release its reservation."""
+        self.shutdown_request(request)
+        with self._streams_lock:
+            self._open_streams -= 1
+
+    def _submit(self, request: socket.socket, client_address: Any) -> None:
+        self.ready_at[request] = time.monotonic()
+        try:
+            self._queue.put_nowait((request, client_address))
+        except queue.Full:
+            self.ready_at.pop(request, None)
+            self._reject(request)
+
+    def _reject(self, request: socket.socket) -> None:
+        body = b'{"error": {"code": 503, "message": "Server busy"}}'
+        with contextlib.suppress(OSError):
+            request.sendall(
+                b"HTTP/1.1 503 Service Unavailable\r\n"
+                b"Content-Type: application/json\r\n"
+                b"Content-Length: %d\r\n"
+                b"Retry-After: 1\r\n"
+                b"Connection: close\r\n\r\n%s" % (len(body), body)
+            )
+        self.shutdown_request(request)
+
+    def _work(self) -> None:
+        while (item := self._queue.get()) is not None:
+            request, client_address = item
+            try:
+                self.finish_request(request, client_address)
+            except Exception:
+                self.handle_error(request, client_address)
+                self._kept.discard(request)
+            if request in self._detached:
+                self._detached.discard(request)
+            elif request in self._kept:
+                self._kept.discard(request)
+                self._park(request, client_address)
+            else:
+                self.shutdown_request(request)
+
+    def _park(self, request: socket.socket, client_address: Any) -> None:
+        with self._idle_lock:
+            if self._closed:
+                self.shutdown_request(request)
+                return
+            self._idle.register(
+                request, selectors.EVENT_READ, (client_address, time.monotonic())
+            )
+            self._waker.send(b"\0")
+
+    def _watch_idle(self) -> None:
+        while True:
+            events = self._idle.select(timeout=1.0)
+            now = time.monotonic()
+            ready = []
+            with self._idle_lock:
+                if self._closed:
+                    return
+                for key, _ in events:
+                    if key.fileobj is self._wakeup:
+                        with contextlib.suppress(BlockingIOError):
+                            self._wakeup.recv(4096)
+                        continue
+                    self._idle.unregister(key.fileobj)
+                    ready.append((key.fileobj, key.data[0]))
+                expired = [
+                    key.fileobj
+                    for key in list(self._idle.get_map().values())
+                    if key.data is not None and now - key.data[1] > self.idle_timeout
+                ]
+                for request in expired:
+                    self._idle.unregister(request)
+            # a closed connection is readable too, its handler sees the end
+            for request, client_address in ready:
+                self._submit(request, client_address)
+            for request in expired:
+                self.shutdown_request(request)
+
+    @override
+    def server_close(self) -> None:
+        super().server_close()
+        with self._idle_lock:
+            if self._closed:
+                return
+            self._closed = True
+            parked = [
+                key.fileobj
+                for key in self._idle.get_map().values()
+                if key.data is not None
+            ]
+            for request in parked:
+                self._idle.unregister(request)
+        for request in parked:
+            self.shutdown_request(request)
+        self._waker.send(b"\0")
+        for _ in self._workers:
+            self._queue.put(None)
+        self._watcher.join(timeout=2)
+        self._idle.close()
+        self._wakeup.close()
+        self._waker.close()
+
+
 class TeleXException(Exception):
     def __init__(self, message: str) -> None:
         super().__init__(message)
@@ -286,10 +608,20 @@ class TeleXResponse(TeleXResponseMixin):
         self.headers = headers
         self.buf = io.BytesIO()
         self.close: bool = False
+        self.chunks: Iterable[bytes] | None = None
 
     def return_raw(self, data: bytes) -> None:
         self.buf.write(data)
 
+    def stream(self, chunks: Iterable[bytes]) -> None:
+        """
+        Send the chunks as they are produced instead of a buffered body,
+        with chunked transfer encoding for HTTP/1.1 clients. The iterable
+        is closed when the client leaves early, so a generator can clean
+        up in a ``finally`` block.
+        """
+        self.chunks = chunks
+
     def return_str(self, data: str) -> None:
         self.headers["Content-Type"] = "text/plain; charset=utf-8"
         self.return_raw(data.encode())
@@ -300,7 +632,7 @@ class TeleXResponse(TeleXResponseMixin):
 
     def finish(self):
         super().finish()
-        if "Content-Length" not in self.headers:
+        if self.chunks is None and "Content-Length" not in self.headers:
             self.headers["Content-Length"] = str(len(self.buf.getvalue()))
         if "Content-Type" not in self.headers:
             self.headers["Content-Type"] = "text/plain; charset=utf-8"
@@ -340,14 +672,22 @@ class TeleXApp:
         host: str = "127.0.0.1",
         filename: str | None = None,
         log: bool = True,
+        workers: int = 8,
+        backlog: int = 64,
+        streams: int = 16,
     ) -> None:
         self.port = port
         self.host = host
+        self.workers = workers
+        self.backlog = backlog
+        self.streams = streams
         self._close = False
 
         self._register_values: dict[str, Any] = dict()
 
         self._routers: dict[str, dict[str, Callable[..., Any]]] = defaultdict(dict)
+        # seconds a route may take, waiting for a worker included
+        self._budgets: dict[tuple[str, str], float] = {}
 
         self._before_routers: list[Callable[..., Any]] = []
         self._after_routers: list[Callable[..., Any]] = []
@@ -396,17 +736,30 @@ class TeleXApp:
         return self._register_values.get(name)
 
     def route(
-        self, path: str, method: str = "GET"
+        self, path: str, method: str = "GET", budget: float | None = None
     ) -> Callable[[Callable[..., Any]], Callable[..., Any]]:
+        """
+        Register a route.
+
+        Args:
+            budget: Seconds the route may take, waiting for a worker
+                included. The client gets a 503 once it is exceeded while
+                the route finishes in the background, None for no limit.
+        """
         if method not in self.supported_methods:
             raise TeleXException(f"Method {method} is not supported")
 
         def decorator(func: Callable[..., Any]) -> Callable[..., Any]:
             self._routers[method.upper()][path] = func
+            if budget is not None:
+                self._budgets[method.upper(), path] = budget
             return func
 
         return decorator
 
+    def budget(self, method: str, path: str) -> float | None:
+        return self._budgets.get((method, path))
+
     def run(self) -> None:
         clazz = type(
             "TeleXAppHandler",
@@ -418,7 +771,13 @@ class TeleXApp:
                 "logger": self.logger,
             },
         )
-        self.server = HTTPServer((self.host, self.port), clazz)
+        self.server = TeleXServer(
+            (self.host, self.port),
+            clazz,
+            workers=self.workers,
+            backlog=self.backlog,
+            streams=self.streams,
+        )
 
         self.server.serve_forever()
 
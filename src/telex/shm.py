@@ -0,0 +1,85 @@
+"""
+Following a profile from outside the profiled process.
+
+A sampler given a ``shm_ring`` file writes every sample into it as well: a
+ring of (time, tid, stack id) slots and a table of the distinct stacks, see
+``telexsys/shm_ring.h``. Reading the file takes nothing from the target, no
+code runs in its interpreter, so ``ShmRingReader`` can poll it as often as
+it likes from any process that can open the file.
+"""
+
+from __future__ import annotations
+
+import collections
+import time
+from collections.abc import Callable
+
+from . import _telexsys
+
+
+class ShmRingReader:
+    def __init__(self, path: str) -> None:
+        """
+        Args:
+            path: The ring a sampler exports its samples to.
+        """
+        self.path = path
+        self.stacks: list[str] = []
+        self.cursor: tuple[int, int, int, int, int] = (0, 0, 0, 0, 0)
+
+    @property
+    def lost(self) -> int:
+        """Samples the writer overwrote before they were read."""
+        return self.cursor[2]
+
+    @property
+    def dropped(self) -> int:
+        """Samples the writer dropped, its stack table was full."""
+        return self.cursor[3]
+
+    def poll(self) -> list[tuple[int, int, str]]:
+        """
+        Returns:
+            The samples written since the last poll as (time in microseconds,
+            thread id, folded stack), the first poll returns the ones still
+            in the ring.
+        Raises:
+            OSError: If the ring can not be read.
+        """
+        cursor, samples, stacks = _telexsys.shm_ring_read(self.path, self.cursor)
+        if cursor[4] != self.cursor[4]:
+            # a new ring at the path, its stack ids start over
+            self.stacks.clear()
+        self.cursor = cursor
+        self.stacks.extend(stacks)
+        return [(t, tid, self.stacks[stack]) for t, tid, stack in samples]
+
+
+def aggregate(
+    path: str,
+    seconds: float,
+    interval: float = 0.2,
+    clock: Callable[[], float] = time.monotonic,
+) -> tuple[collections.Counter[str], ShmRingReader]:
+    """
+    Poll the ring at ``path`` for ``seconds`` and count its stacks.
+
+    Returns:
+        The number of samples of every folded stack and the reader, which
+        knows how many samples were lost. It stops early once the target
+        exits and removes its ring.
+    Raises:
+        OSError: If the ring can not be read at the first poll.
+    """
+    reader = ShmRingReader(path)
+    counts: collections.Counter[str] = collections.Counter()
+    counts.update(stack for _, _, stack in reader.poll())
+    deadline = clock() + seconds
+    while clock() < deadline:
+        time.sleep(interval)
+        try:
+            samples = reader.poll()
+        except FileNotFoundError:
+            break
+        counts.update(stack for _, _, stack in samples)
+    return counts, reader
@@ -1,45 +1,76 @@
 from __future__ import annotations
 
+import functools
+import io
+import itertools
 import os
 import site
 import sys
 import threading
-from typing import Any, Final
-
-import telex
+import time
+from collections.abc import Callable, Iterator, Sequence
+from typing import Any, Final, TypeVar
 
+from . import _telexsys
 from .flamegraph import FlameGraph
-from .sampler import TelexSysAsyncWorkerSampler
+from .rolling import RollingProfile
+from .sampler import TelexSysAsyncWorkerSampler, write_pprof
 
 TITLE: Final = "TeleX System Monitor Flame Graph"
 
+F = TypeVar("F", bound=Callable[..., Any])
+
+
+def locked(method: F) -> F:
+    """Run a TeleXSystem method under its lock, the monitor serves requests
+    on several threads at once."""
+
+    @functools.wraps(method)
+    def wrapper(self: TeleXSystem, *args: Any, **kwargs: Any) -> Any:
+        with self.lock:
+            return method(self, *args, **kwargs)
+
+    return wrapper  # type: ignore[return-value]
+
 
 class TeleXSystem:
     def __init__(self) -> None:
         self.profiling = False
         self.profiler: None | TelexSysAsyncWorkerSampler = None
+        # chunks of the last html snapshot, see html_snapshot
+        self.snapshot = 0
+        self.chunks: list[bytes] = []
+        # always-on sampling, see start_continuous
+        self.rolling: None | RollingProfile = None
+        self.lock = threading.RLock()
 
     @staticmethod
-    def thread() -> list[dict[str, Any]]:
-        stacks = telex.join_current_stacks(telex.current_stacks())
+    def thread(strip: Sequence[str] = (), indent: str = "") -> list[dict[str, Any]]:
+        """
+        Stacks of all threads, formatted natively, see _telexsys.thread_stacks
+        for `strip` and `indent`.
+        """
+        stacks = _telexsys.thread_stacks(strip=strip, indent=indent)
         threads = {t.ident: (t.name, t.daemon) for t in threading.enumerate()}
         t_infos = [
             {
                 "id": str(t_id),
-                "name": threads[t_id][0],
-                "daemon": threads[t_id][1],
-                "stack": stacks[t_id],
+                "name": threads.get(t_id, ("<unknown>", False))[0],
+                "daemon": threads.get(t_id, ("<unknown>", False))[1],
+                "stack": stack,
             }
-            for t_id in stacks.keys()
+            for t_id, stack in stacks.items()
         ]
         return t_infos
 
+    @locked
     def start_profiling(
         self,
         interval: int = 10_000,
         ignore_frozen: bool = False,
         ignore_self: bool = True,
         tree_mode: bool = False,
+        phase_stats: bool = False,
     ) -> bool:
         """
         Start profiling the system.
@@ -48,8 +79,10 @@ class TeleXSystem:
             ignore_frozen (bool): Whether to ignore frozen objects.
             ignore_self (bool): Whether to ignore the telex.
             tree_mode (bool): Whether to use tree mode.
+            phase_stats (bool): Whether to time the phases of sampling, see
+                sampler_stats.
         """
-        if self.profiling:  # pragma: no cover
+        if self.profiling or self.rolling is not None:  # pragma: no cover
             return False
         self.profiling = True
         self.profiler = TelexSysAsyncWorkerSampler(
@@ -59,11 +92,176 @@ class TeleXSystem:
             ignore_self=ignore_self,
             tree_mode=tree_mode,
             is_root=True,
+            phase_stats=phase_stats,
         )
         self.profiler.adjust()
         self.profiler.start()
         return True
 
+    @locked
+    def start_continuous(
+        self,
+        interval: int = 10_000,
+        slot: float = 5.0,
+        ignore_frozen: bool = False,
+        ignore_self: bool = True,
+        phase_stats: bool = False,
+    ) -> bool:
+        """
+        Start sampling for good, into the rolling windows of ``rolling``.
+        Args:
+            interval (int): The interval between samples in microseconds.
+            slot (float): Seconds between two updates of the windows.
+            phase_stats (bool): Whether to time the phases of sampling, see
+                sampler_stats.
+        Returns:
+            False if a profile, continuous or not, is already running.
+        """
+        if self.profiling or self.rolling is not None:
+            return False
+        sampler = TelexSysAsyncWorkerSampler(
+            sampling_interval=interval,
+            debug=False,
+            ignore_frozen=ignore_frozen,
+            ignore_self=ignore_self,
+            is_root=True,
+            phase_stats=phase_stats,
+        )
+        sampler.adjust()
+        self.rolling = RollingProfile(sampler, slot=slot)
+        self.rolling.start()
+        return True
+
+    @locked
+    def stop_continuous(self) -> bool:
+        """Stop continuous sampling, returns False if it is not running."""
+        if self.rolling is None:
+            return False
+        self.rolling.stop()
+        self.rolling = None
+        return True
+
+    def window_folded(self, window: str) -> str:
+        """
+        The folded stacks of a rolling window.
+        Raises:
+            RuntimeError: If continuous sampling is not running.
+            KeyError: If there is no such window.
+        """
+        with self._rolling().window(window) as tree:
+            return tree.dumps()
+
+    def window_top(self, window: str, k: int = 20) -> list[tuple[str, int, int]]:
+        """
+        The ``k`` frames of a rolling window with the most self samples, as
+        (frame, self, total) tuples.
+        Raises:
+            RuntimeError: If continuous sampling is not running.
+            KeyError: If there is no such window.
+        """
+        with self._rolling().window(window) as tree:
+            return tree.top(k)
+
+    def window_pprof(self, window: str, filename: str) -> int:
+        """
+        Write a rolling window as a gzipped pprof profile.
+        Returns:
+            The number of samples written.
+        Raises:
+            RuntimeError: If continuous sampling is not running.
+            KeyError: If there is no such window.
+        """
+        rolling = self._rolling()
+        sampler = rolling.sampler
+        with rolling.window(window) as tree:
+            duration = rolling.duration(window)
+            return write_pprof(
+                tree,
+                filename,
+                period=sampler.sampling_interval * 1000,
+                sample_type=sampler.time_mode,
+                time_nanos=time.time_ns() - int(duration * 1e9),
+                duration_nanos=int(duration * 1e9),
+            )
+
+    def stream_deltas(
+        self, interval: float = 2.0, k: int = 20, folded: bool = False, count: int = 0
+    ) -> Iterator[dict[str, Any]]:
+        """
+        The stacks sampled every ``interval`` seconds while continuous
+        sampling keeps running, as the ``k`` top frames or folded lines.
+        Args:
+            count (int): The number of deltas, 0 until sampling is stopped.
+        Raises:
+            RuntimeError: If continuous sampling is not running, when called
+                rather than on the first delta.
+        """
+        rolling = self._rolling()
+
+        def deltas() -> Iterator[dict[str, Any]]:
+            key = rolling.subscribe()
+            try:
+                last = time.monotonic()
+                for n in itertools.count(1):
+                    if not rolling.wait(interval):
+                        return
+                    tree = rolling.delta(key)
+                    now = time.monotonic()
+                    delta: dict[str, Any] = {
+                        "time": time.time(),
+                        "seconds": now - last,
+                        "samples": tree.samples,
+                    }
+                    if folded:
+                        delta["folded"] = tree.dumps()
+                    else:
+                        delta["top"] = tree.top(k)
+                    last = now
+                    yield delta
+                    if n == count:
+                        return
+            finally:
+                rolling.unsubscribe(key)
+
+        return deltas()
+
+    def sampler_stats(self) -> dict[str, Any]:
+        """
+        The sampling rounds and interval of the running sampler, the shape and
+        memory of its stack tree (see Sampler.tree_stats), those of every
+        window of continuous profiling and, when it times them, the time it
+        spent in every phase of its rounds (see Sampler.stats).
+        Raises:
+            RuntimeError: If no sampler runs.
+        """
+        windows = {}
+        if self.profiler is not None:
+            sampler = self.profiler
+        elif self.rolling is not None:
+            sampler = self.rolling.sampler
+            for name in self.rolling.spans:
+                with self.rolling.window(name) as tree:
+                    windows[name] = tree.tree_stats
+        else:
+            raise RuntimeError("neither profile nor continuous profiling started")
+        stats = {
+            "sampling_times": sampler.sampling_times,
+            "sampling_interval": sampler.sampling_interval,
+            "acc_sampling_time": sampler.acc_sampling_time,
+            "tree": sampler.tree_stats,
+        }
+        if windows:
+            stats["windows"] = windows
+        if sampler.phase_stats:
+            stats["phases"] = sampler.stats()
+        return stats
+
+    def _rolling(self) -> RollingProfile:
+        if self.rolling is None:
+            raise RuntimeError("continuous profiling not started")
+        return self.rolling
+
+    @locked
     def finish_profiling(
         self,
         filename: str | None = None,
@@ -116,23 +314,57 @@ class TeleXSystem:
         if not self.profiling or self.profiler is None:  # pragma: no cover
             raise RuntimeError("Profiling not started or profiler is None")
 
-        lines = self.profiler.dumps().splitlines()
+        fg = self._flamegraph(title, inverted=inverted)
+        if filename.endswith(".html"):
+            fg.save_html(filename, source=self.profiler)
+        else:
+            fg.save(filename, source=self.profiler)
+        folded_filename = folded_filename or f"{filename}.folded"
+        if save_folded:
+            with open(folded_filename, "w") as f:
+                f.write(self.profiler.dumps())
+        return os.path.abspath(filename), os.path.abspath(folded_filename)
+
+    @locked
+    def html_snapshot(self, chunk_url: str, *, inverted: bool = False) -> bytes:
+        """
+        Render the running profile as a lazily loading html flame graph.
+        Only the first chunk is embedded in the page, the others are kept
+        until the next snapshot and fetched through ``chunk``.
+        Args:
+            chunk_url (str): Prefix of the url chunk ``i`` is served at, it
+                gets ``snapshot=<n>&id=<i>`` appended.
+        Returns:
+            The html page.
+        Raises:
+            RuntimeError: If profiling is not started or profiler is None.
+        """
+        if not self.profiling or self.profiler is None:
+            raise RuntimeError("profiler not started or profiler is None")
+        fg = self._flamegraph(TITLE, inverted=inverted)
+        self.chunks = fg.html_chunks(source=self.profiler)
+        self.snapshot += 1
+        buf = io.BytesIO()
+        fg.write_html(
+            buf, self.chunks, chunk_url=f"{chunk_url}snapshot={self.snapshot}&id="
+        )
+        return buf.getvalue()
 
+    @locked
+    def chunk(self, snapshot: int, idx: int) -> bytes | None:
+        """Chunk ``idx`` of the last html snapshot, None if it is gone."""
+        if snapshot != self.snapshot or not 0 <= idx < len(self.chunks):
+            return None
+        return self.chunks[idx]
+
+    @staticmethod
+    def _flamegraph(title: str, *, inverted: bool = False) -> FlameGraph:
         site_path = site.getsitepackages()[0]
-        fg = FlameGraph(
-            lines,
+        return FlameGraph(
+            [],
             title=title,
             command=" ".join([sys.executable, *sys.argv]),
             package_path=os.path.dirname(site_path),
             work_dir=os.getcwd(),
             inverted=inverted,
         )
-        fg.parse_input()
-        svg = fg.generate_svg()
-        with open(filename, "w") as f:
-            f.write(svg)
-        folded_filename = folded_filename or f"{filename}.folded"
-        if save_folded:
-            with open(folded_filename, "w") as f:
-                f.write("\n".join(lines))
-        return os.path.abspath(filename), os.path.abspath(folded_filename)
@@ -0,0 +1,800 @@
+#include "chrome_trace.h"
+#include "tree_impl.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace {
+
+// A complete event, its times already in units of 1/scale microseconds
+struct Event {
+    int64_t start;
+    int64_t end;
+    uint32_t name;  // index of "cat::name"
+};
+
+
+// Parse a plain decimal such as "375415652783.585" without strtod. With at
+// most 15 digits both the digits and the power of ten are exact doubles, so
+// the division rounds the same as strtod does.
+bool
+ParseDecimal(const std::string& s, double& value) {
+    static const double kPowers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5,
+                                     1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15};
+    size_t i = s[0] == '-' ? 1 : 0;
+    uint64_t digits = 0;
+    int count = 0, decimals = -1;
+    for (; i < s.size(); ++i) {
+        char c = s[i];
+        if (c >= '0' && c <= '9') {
+            digits = digits * 10 + (uint64_t)(c - '0');
+            if (++count > 15) {
+                return false;
+            }
+            if (decimals >= 0) {
+                decimals++;
+            }
+        } else if (c == '.' && decimals < 0) {
+            decimals = 0;
+        } else {
+            return false;
+        }
+    }
+    if (count == 0) {
+        return false;
+    }
+    value = (double)digits / kPowers[decimals > 0 ? decimals : 0];
+    if (s[0] == '-') {
+        value = -value;
+    }
+    return true;
+}
+
+
+// The file is read in 1MiB blocks, never as a whole
+class Reader {
+  public:
+    explicit Reader(FILE* file) : file_(file), buf_(1 << 20) {}
+
+    // the next byte, -1 at the end of the file
+    int Peek() {
+        if (pos_ == end_ && !Fill()) {
+            return -1;
+        }
+        return (unsigned char)buf_[pos_];
+    }
+
+    int Get() {
+        int c = Peek();
+        if (c >= 0) {
+            pos_++;
+        }
+        return c;
+    }
+
+    void SkipSpace() {
+        for (;;) {
+            int c = Peek();
+            if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+                return;
+            }
+            pos_++;
+        }
+    }
+
+    // Append the bytes up to the next '"' or '\\' to `out` (when it is not
+    // NULL), a whole block at a time.
+    void ReadPlain(std::string* out) {
+        for (;;) {
+            if (pos_ == end_ && !Fill()) {
+                return;
+            }
+            size_t stop = pos_;
+            while (stop < end_ && buf_[stop] != '"' && buf_[stop] != '\\') {
+                stop++;
+            }
+            if (out != nullptr) {
+                out->append(&buf_[pos_], stop - pos_);
+            }
+            pos_ = stop;
+            if (stop < end_) {
+                return;
+            }
+        }
+    }
+
+    // Append the bytes up to the next delimiter or space to `out`
+    void ReadLiteral(std::string& out) {
+        for (;;) {
+            if (pos_ == end_ && !Fill()) {
+                return;
+            }
+            size_t stop = pos_;
+            while (stop < end_) {
+                char c = buf_[stop];
+                if (c == ',' || c == '}' || c == ']' || c == ' ' ||
+                    c == '\n' || c == '\r' || c == '\t') {
+                    break;
+                }
+                stop++;
+            }
+            out.append(&buf_[pos_], stop - pos_);
+            pos_ = stop;
+            if (stop < end_) {
+                return;
+            }
+        }
+    }
+
+    // Skip the object or array starting at the current byte, scanning a
+    // whole block at a time. returns false if the file ends before it does
+    bool SkipNested() {
+        int depth = 0;
+        bool in_string = false, escaped = false;
+        for (;;) {
+            if (pos_ == end_ && !Fill()) {
+                return false;
+            }
+            for (size_t i = pos_; i < end_; ++i) {
+                char c = buf_[i];
+                if (in_string) {
+                    if (escaped) {
+                        escaped = false;
+                    } else if (c == '\\') {
+                        escaped = true;
+                    } else if (c == '"') {
+                        in_string = false;
+                    }
+                } else if (c == '"') {
+                    in_string = true;
+                } else if (c == '{' || c == '[') {
+                    depth++;
+                } else if ((c == '}' || c == ']') && --depth == 0) {
+                    pos_ = i + 1;
+                    return true;
+                }
+            }
+            pos_ = end_;
+        }
+    }
+
+    long long offset() const { return consumed_ + (long long)pos_; }
+
+    bool failed() const { return failed_; }
+
+  private:
+    bool Fill() {
+        consumed_ += (long long)end_;
+        pos_ = 0;
+        end_ = fread(buf_.data(), 1, buf_.size(), file_);
+        if (end_ == 0 && ferror(file_)) {
+            failed_ = true;
+        }
+        return end_ > 0;
+    }
+
+    FILE* file_;
+    std::vector<char> buf_;
+    size_t pos_ = 0;
+    size_t end_ = 0;
+    long long consumed_ = 0;
+    bool failed_ = false;
+};
+
+
+void
+AppendUtf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+        out += (char)code;
+    } else if (code < 0x800) {
+        out += (char)(0xc0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+        out += (char)(0xe0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3f));
+        out += (char)(0x80 | (code & 0x3f));
+    } else {
+        out += (char)(0xf0 | (code >> 18));
+        out += (char)(0x80 | ((code >> 12) & 0x3f));
+        out += (char)(0x80 | ((code >> 6) & 0x3f));
+        out += (char)(0x80 | (code & 0x3f));
+    }
+}
+
+
+class TraceParser {
+  public:
+    TraceParser(FILE* file, double scale) : in_(file), scale_(scale) {}
+
+    bool Parse() {
+        in_.SkipSpace();
+        int c = in_.Peek();
+        if (c == '[') {
+            return ParseEvents();
+        }
+        if (!Expect('{')) {
+            return false;
+        }
+        std::string key;
+        in_.SkipSpace();
+        if (in_.Peek() == '}') {
+            in_.Get();
+            return true;
+        }
+        for (;;) {
+            in_.SkipSpace();
+            if (!ParseString(&key) || !ExpectAfterSpace(':')) {
+                return false;
+            }
+            in_.SkipSpace();
+            bool ok = key == "traceEvents" && in_.Peek() == '['
+                          ? ParseEvents()
+                          : SkipValue();
+            if (!ok) {
+                return false;
+            }
+            in_.SkipSpace();
+            c = in_.Get();
+            if (c == '}') {
+                return true;
+            }
+            if (c != ',') {
+                return Fail("expected ',' or '}'");
+            }
+        }
+    }
+
+    bool io_failed() const { return in_.failed(); }
+
+    const std::string& error() const { return error_; }
+
+    // the events of each thread, in the order of the file
+    std::vector<std::vector<Event>>& events() { return events_; }
+
+    const std::vector<std::string>& names() const { return names_; }
+
+    const std::vector<std::string>& threads() const { return threads_; }
+
+  private:
+    bool Fail(const char* message) {
+        if (error_.empty()) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), " at byte %lld", in_.offset());
+            error_ = message;
+            error_ += buf;
+        }
+        return false;
+    }
+
+    bool Expect(int expected) {
+        if (in_.Get() != expected) {
+            char message[32];
+            snprintf(message, sizeof(message), "expected '%c'", expected);
+            return Fail(message);
+        }
+        return true;
+    }
+
+    bool ExpectAfterSpace(int expected) {
+        in_.SkipSpace();
+        return Expect(expected);
+    }
+
+    int HexDigit() {
+        int c = in_.Get();
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    bool ParseHex(uint32_t& code) {
+        code = 0;
+        for (int i = 0; i < 4; ++i) {
+            int digit = HexDigit();
+            if (digit < 0) {
+                return Fail("invalid \\u escape");
+            }
+            code = (code << 4) | (uint32_t)digit;
+        }
+        return true;
+    }
+
+    // a string, unescaped into `out` unless it is NULL
+    bool ParseString(std::string* out) {
+        if (!Expect('"')) {
+            return false;
+        }
+        if (out != nullptr) {
+            out->clear();
+        }
+        for (;;) {
+            in_.ReadPlain(out);
+            int c = in_.Get();
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                return Fail("unterminated string");
+            }
+            c = in_.Get();
+            char plain = 0;
+            switch (c) {
+                case '"':
+                case '\\':
+                case '/':
+                    plain = (char)c;
+                    break;
+                case 'b':
+                    plain = '\b';
+                    break;
+                case 'f':
+                    plain = '\f';
+                    break;
+                case 'n':
+                    plain = '\n';
+                    break;
+                case 'r':
+                    plain = '\r';
+                    break;
+                case 't':
+                    plain = '\t';
+                    break;
+                case 'u': {
+                    uint32_t code;
+                    if (!ParseHex(code)) {
+                        return false;
+                    }
+                    // a surrogate pair encodes a code point above U+FFFF
+                    if (code >= 0xd800 && code < 0xdc00 &&
+                        in_.Peek() == '\\') {
+                        in_.Get();
+                        uint32_t low;
+                        if (in_.Get() != 'u' || !ParseHex(low) ||
+                            low < 0xdc00 || low >= 0xe000) {
+                            return Fail("invalid surrogate pair");
+                        }
+                        code = 0x10000 + ((code - 0xd800) << 10) +
+                               (low - 0xdc00);
+                    }
+                    if (out != nullptr) {
+                        AppendUtf8(*out, code);
+                    }
+                    continue;
+                }
+                default:
+                    return Fail("invalid escape");
+            }
+            if (out != nullptr) {
+                *out += plain;
+            }
+        }
+    }
+
+    // a number or true, false and null, as written
+    bool ParseLiteral(std::string& out) {
+        out.clear();
+        in_.ReadLiteral(out);
+        if (out.empty()) {
+            return Fail("expected a value");
+        }
+        return true;
+    }
+
+    bool ParseNumber(double& value) {
+        if (!ParseLiteral(literal_)) {
+            return false;
+        }
+        if (ParseDecimal(literal_, value)) {
+            return true;
+        }
+        char* end = nullptr;
+        value = strtod(literal_.c_str(), &end);
+        if (end != literal_.c_str() + literal_.size()) {
+            return Fail("expected a number");
+        }
+        return true;
+    }
+
+    // skip a value of any type
+    bool SkipValue() {
+        int c = in_.Peek();
+        if (c == '"') {
+            return ParseString(nullptr);
+        }
+        if (c != '{' && c != '[') {
+            return ParseLiteral(literal_);
+        }
+        if (!in_.SkipNested()) {
+            return Fail("unexpected end of file");
+        }
+        return true;
+    }
+
+    // pid and tid are numbers or strings, either is shown as written
+    bool ParseId(std::string& out) {
+        if (in_.Peek() == '"') {
+            return ParseString(&out);
+        }
+        return ParseLiteral(out);
+    }
+
+    bool ParseEvents() {
+        if (!Expect('[')) {
+            return false;
+        }
+        in_.SkipSpace();
+        if (in_.Peek() == ']') {
+            in_.Get();
+            return true;
+        }
+        for (;;) {
+            in_.SkipSpace();
+            bool ok = in_.Peek() == '{' ? ParseEvent() : SkipValue();
+            if (!ok) {
+                return false;
+            }
+            in_.SkipSpace();
+            int c = in_.Get();
+            if (c == ']') {
+                return true;
+            }
+            if (c != ',') {
+                return Fail("expected ',' or ']'");
+            }
+        }
+    }
+
+    bool ParseEvent() {
+        in_.Get();  // '{'
+        bool complete = false, has_name = false, has_dur = false;
+        double ts = 0, dur = 0;
+        name_.clear();
+        cat_.clear();
+        pid_ = "0";
+        tid_ = "0";
+        in_.SkipSpace();
+        if (in_.Peek() == '}') {
+            in_.Get();
+            return true;
+        }
+        for (;;) {
+            in_.SkipSpace();
+            if (!ParseString(&key_) || !ExpectAfterSpace(':')) {
+                return false;
+            }
+            in_.SkipSpace();
+            bool ok;
+            bool string = in_.Peek() == '"';
+            if (key_ == "ph" && string) {
+                ok = ParseString(&value_);
+                complete = value_ == "X";
+            } else if (key_ == "name" && string) {
+                ok = has_name = ParseString(&name_);
+            } else if (key_ == "cat" && string) {
+                ok = ParseString(&cat_);
+            } else if (key_ == "pid") {
+                ok = ParseId(pid_);
+            } else if (key_ == "tid") {
+                ok = ParseId(tid_);
+            } else if (key_ == "ts" && !string) {
+                ok = ParseNumber(ts);
+            } else if (key_ == "dur" && !string) {
+                ok = has_dur = ParseNumber(dur);
+            } else {
+                ok = SkipValue();
+            }
+            if (!ok) {
+                return false;
+            }
+            in_.SkipSpace();
+            int c = in_.Get();
+            if (c == '}') {
+                break;
+            }
+            if (c != ',') {
+                return Fail("expected ',' or '}'");
+            }
+        }
+        if (!complete || !has_name || !has_dur) {
+            return true;
+        }
+        // rounded half to even as python's round() does
+        Event event;
+        event.start = (int64_t)std::nearbyint(ts * scale_);
+        event.end = event.start + (int64_t)std::nearbyint(dur * scale_);
+        if (event.end <= event.start) {
+            return true;
+        }
+        if (!cat_.empty()) {
+            cat_ += "::";
+            cat_ += name_;
+            name_.swap(cat_);
+        }
+        event.name = Intern(name_, name_ids_, names_);
+        // events of a thread mostly come in runs
+        if (events_.empty() || pid_ != last_pid_ || tid_ != last_tid_) {
+            key_ = "Process(" + pid_ + ");Thread(" + tid_ + ")";
+            thread_ = Intern(key_, thread_ids_, threads_);
+            if (thread_ == events_.size()) {
+                events_.emplace_back();
+            }
+            last_pid_ = pid_;
+            last_tid_ = tid_;
+        }
+        events_[thread_].push_back(event);
+        return true;
+    }
+
+    static uint32_t Intern(const std::string& s,
+                           std::unordered_map<std::string, uint32_t>& ids,
+                           std::vector<std::string>& values) {
+        auto it = ids.emplace(s, (uint32_t)values.size());
+        if (it.second) {
+            values.push_back(s);
+        }
+        return it.first->second;
+    }
+
+    Reader in_;
+    double scale_;
+    std::string error_;
+    std::vector<std::vector<Event>> events_;
+    std::unordered_map<std::string, uint32_t> name_ids_;
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, uint32_t> thread_ids_;
+    std::vector<std::string> threads_;
+    // the thread of the last event
+    std::string last_pid_, last_tid_;
+    uint32_t thread_ = 0;
+    // reused by every event
+    std::string key_, value_, name_, cat_, pid_, tid_, literal_;
+};
+
+
+// Finds the child of a node by name in O(1), in an open addressing table
+// keyed by the parent and the interned name. New children are put first,
+// ReverseChildren restores the order they were seen in once all are added.
+class TreeBuilder {
+  public:
+    explicit TreeBuilder(StackTree* tree) : tree_(tree), slots_(1 << 10) {}
+
+    // a child of `parent`, which is at `depth` - 1
+    Node* Child(Node* parent,
+                uint32_t id,
+                const std::string& name,
+                size_t depth) {
+        size_t mask = slots_.size() - 1;
+        uint64_t hash = Hash(parent, id);
+        for (size_t i = (size_t)(hash >> 20) & mask;; i = (i + 1) & mask) {
+            Slot& slot = slots_[i];
+            if (slot.child == nullptr) {
+                break;
+            }
+            if (slot.parent == parent && slot.id == id) {
+                return slot.child;
+            }
+        }
+        Node* node = tree_->NewNode(parent, name.data(), name.size(), depth);
+        node->sibling = parent->child;
+        parent->child = node;
+        Insert(Slot{parent, id, node}, hash);
+        return node;
+    }
+
+    Node* root() const { return tree_->root; }
+
+  private:
+    struct Slot {
+        Node* parent;
+        uint32_t id;
+        Node* child;  // NULL for an empty slot
+    };
+
+    static uint64_t Hash(Node* parent, uint32_t id) {
+        return ((uint64_t)(uintptr_t)parent ^ ((uint64_t)id << 40)) *
+               0x9e3779b97f4a7c15ULL;
+    }
+
+    void Insert(const Slot& slot, uint64_t hash) {
+        // keep the table at most half full
+        if (++used_ * 2 > slots_.size()) {
+            std::vector<Slot> old(slots_.size() * 2);
+            old.swap(slots_);
+            for (const Slot& each : old) {
+                if (each.child != nullptr) {
+                    Place(each, Hash(each.parent, each.id));
+                }
+            }
+        }
+        Place(slot, hash);
+    }
+
+    void Place(const Slot& slot, uint64_t hash) {
+        size_t mask = slots_.size() - 1;
+        size_t i = (size_t)(hash >> 20) & mask;
+        while (slots_[i].child != nullptr) {
+            i = (i + 1) & mask;
+        }
+        slots_[i] = slot;
+    }
+
+    StackTree* tree_;
+    std::vector<Slot> slots_;
+    size_t used_ = 0;
+};
+
+
+void
+ReverseChildren(Node* root) {
+    std::vector<Node*> todo{root};
+    while (!todo.empty()) {
+        Node* node = todo.back();
+        todo.pop_back();
+        Node* reversed = nullptr;
+        Node* child = node->child;
+        while (child != nullptr) {
+            Node* next = child->sibling;
+            child->sibling = reversed;
+            reversed = child;
+            todo.push_back(child);
+            child = next;
+        }
+        node->child = reversed;
+    }
+}
+
+
+// an event whose children are being swept
+struct Open {
+    int64_t start;
+    int64_t end;  // clipped to the end of its parent
+    int64_t children;
+    Node* node;
+};
+
+
+void
+Sweep(TraceParser& parser, StackTree* tree, ChromeTraceStats* stats) {
+    const std::vector<std::string>& names = parser.names();
+    const std::vector<std::string>& threads = parser.threads();
+    TreeBuilder builder(tree);
+    // the Process and Thread frames are numbered after the event names
+    std::unordered_map<std::string, uint32_t> prefix_ids;
+    auto prefix = [&](Node* parent, const std::string& name, size_t depth) {
+        auto it = prefix_ids.emplace(
+            name, (uint32_t)(names.size() + prefix_ids.size()));
+        return builder.Child(parent, it.first->second, name, depth);
+    };
+    std::vector<Open> stack;
+    int64_t thread_time = 0;
+
+    // charge an event's self time, its inclusive time goes to its parent
+    auto close = [&]() {
+        Open& open = stack.back();
+        int64_t total = open.end - open.start;
+        open.node->cnt += (uint64_t)(total - open.children);
+        open.node->acc_cnt += (uint64_t)total;
+        stack.pop_back();
+        if (!stack.empty()) {
+            stack.back().children += total;
+        } else {
+            thread_time += total;
+        }
+    };
+    auto before = [](const Event& a, const Event& b) {
+        return a.start < b.start || (a.start == b.start && a.end > b.end);
+    };
+
+    for (size_t t = 0; t < threads.size(); ++t) {
+        std::vector<Event>& events = parser.events()[t];
+        // traces are mostly written in order already
+        if (!std::is_sorted(events.begin(), events.end(), before)) {
+            std::stable_sort(events.begin(), events.end(), before);
+        }
+        size_t split = threads[t].find(';');
+        Node* process =
+            prefix(builder.root(), threads[t].substr(0, split), 1);
+        Node* thread = prefix(process, threads[t].substr(split + 1), 2);
+        thread_time = 0;
+        for (const Event& event : events) {
+            while (!stack.empty() && stack.back().end <= event.start) {
+                close();
+            }
+            Node* parent = stack.empty() ? thread : stack.back().node;
+            int64_t end = event.end;
+            if (!stack.empty() && stack.back().end < end) {
+                end = stack.back().end;
+            }
+            Node* node = builder.Child(
+                parent, event.name, names[event.name], stack.size() + 3);
+            stack.push_back(Open{event.start, end, 0, node});
+        }
+        while (!stack.empty()) {
+            close();
+        }
+        // the time of a thread counts for the frames above its events too
+        builder.root()->acc_cnt += (uint64_t)thread_time;
+        process->acc_cnt += (uint64_t)thread_time;
+        thread->acc_cnt += (uint64_t)thread_time;
+        stats->events += (long long)events.size();
+        stats->threads++;
+        std::vector<Event>().swap(events);
+    }
+    ReverseChildren(builder.root());
+}
+
+
+// count the lines the tree dumps to, as Save would write them
+void
+CountStacks(StackTree* tree, ChromeTraceStats* stats) {
+    std::vector<std::pair<Node*, long long>> todo;
+    if (tree->root->child != nullptr) {
+        todo.emplace_back(tree->root->child, 1);
+    }
+    while (!todo.empty()) {
+        Node* node = todo.back().first;
+        long long depth = todo.back().second;
+        todo.pop_back();
+        if (node->sibling != nullptr) {
+            todo.emplace_back(node->sibling, depth);
+        }
+        if (node->child != nullptr) {
+            todo.emplace_back(node->child, depth + 1);
+        }
+        if (node->cnt > 0) {
+            stats->stacks++;
+            stats->samples += (long long)node->cnt;
+            stats->max_depth = std::max(stats->max_depth, depth);
+        }
+    }
+}
+
+}  // namespace
+
+
+int
+ChromeTraceToTree(const char* filename,
+                  double scale,
+                  struct StackTree* tree,
+                  struct ChromeTraceStats* stats,
+                  char* error,
+                  size_t error_size) {
+    memset(stats, 0, sizeof(*stats));
+    FILE* file = fopen(filename, "rb");
+    if (file == nullptr) {
+        return -1;
+    }
+    TraceParser parser(file, scale);
+    bool ok = parser.Parse();
+    int saved = errno;
+    bool io_failed = parser.io_failed();
+    fclose(file);
+    if (io_failed) {
+        errno = saved;
+        return -1;
+    }
+    if (!ok) {
+        snprintf(error, error_size, "%s", parser.error().c_str());
+        return -2;
+    }
+    Sweep(parser, tree, stats);
+    CountStacks(tree, stats);
+    return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef TELE_CHROME_TRACE_H
+#define TELE_CHROME_TRACE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct StackTree;
+
+struct ChromeTraceStats {
+    long long events;     // complete events added to the tree
+    long long threads;    // distinct (pid, tid) pairs among them
+    long long stacks;     // lines of the folded output
+    long long samples;    // the sum of their counts
+    long long max_depth;  // frames of the deepest line, Process and Thread too
+};
+
+// Add the complete ("X") events of a Chrome trace, an object holding
+// "traceEvents" or a bare array of events, to `tree`. The file is parsed as
+// it is read, only the time range, name and thread of each event are kept.
+// Events are sorted per (pid, tid) and nested by a single sweep, each one is
+// charged its self time, its duration minus the ones of its children, in
+// units of 1/scale microseconds, under "Process(pid);Thread(tid)".
+// returns 0 on success, -1 and sets errno if the file can not be read, -2 if
+// it is not valid JSON, which is described in `error`. `tree` should be new,
+// children it already has may change order
+int
+ChromeTraceToTree(const char* filename,
+                  double scale,
+                  struct StackTree* tree,
+                  struct ChromeTraceStats* stats,
+                  char* error,
+                  size_t error_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,302 @@
+#include "compress.h"
+#include "tree_impl.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#if !defined(_WIN32)
+#define TELEX_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+
+namespace {
+
+// uncompressed bytes per gzip member
+const size_t kBlockSize = 1 << 20;
+
+// the gzip header zlib writes with an extra field and nothing else: magic,
+// method, flags, mtime, xfl, os, xlen, then the "TX" subfield
+const size_t kHeaderSize = 10;
+const size_t kSizeOffset = kHeaderSize + 2 + 4;
+const unsigned char kFlagExtra = 4;
+
+
+#ifdef TELEX_HAVE_ZLIB
+
+// Compress `text` into a gzip member that records its own size.
+// returns an empty string on failure
+std::string
+CompressBlock(const std::string& text, int level) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 16 + MAX_WBITS: a gzip header instead of a zlib one
+    if (deflateInit2(&stream,
+                     level,
+                     Z_DEFLATED,
+                     16 + MAX_WBITS,
+                     8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return std::string();
+    }
+    // the size is not known yet, it is patched in below
+    unsigned char extra[8] = {'T', 'X', 4, 0, 0, 0, 0, 0};
+    gz_header header;
+    memset(&header, 0, sizeof(header));
+    header.extra = extra;
+    header.extra_len = sizeof(extra);
+    header.os = 255;  // unknown, the output does not depend on the host
+    std::string out;
+    if (deflateSetHeader(&stream, &header) == Z_OK) {
+        out.resize(deflateBound(&stream, (uLong)text.size()) + 64);
+        stream.next_in = (unsigned char*)text.data();
+        stream.avail_in = (uInt)text.size();
+        stream.next_out = (unsigned char*)&out[0];
+        stream.avail_out = (uInt)out.size();
+        if (deflate(&stream, Z_FINISH) == Z_STREAM_END) {
+            out.resize(out.size() - stream.avail_out);
+        } else {
+            out.clear();
+        }
+    }
+    deflateEnd(&stream);
+    if (out.size() < kSizeOffset + 4 || out.size() > UINT32_MAX) {
+        return std::string();
+    }
+    uint32_t size = (uint32_t)out.size();
+    for (int i = 0; i < 4; ++i) {
+        out[kSizeOffset + i] = (char)(size >> (8 * i));
+    }
+    return out;
+}
+
+
+// Collects the text Save writes into blocks of whole lines and hands them
+// to threads that compress them, the members are written in order.
+class GzipBuf : public std::streambuf {
+  public:
+    GzipBuf(FILE* file, int level, size_t threads)
+        : file_(file), level_(level), threads_(threads), ok_(true) {
+        block_.resize(kBlockSize);
+        setp(&block_[0], &block_[0] + block_.size());
+    }
+
+    // returns false if anything could not be written
+    bool Finish() {
+        Submit(true);
+        while (!pending_.empty()) {
+            Write();
+        }
+        return ok_;
+    }
+
+  protected:
+    int_type overflow(int_type c) override {
+        Submit(false);
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+  private:
+    // Send the block up to its last newline, the rest starts the next one.
+    // A block without any newline grows until the line ends.
+    void Submit(bool last) {
+        size_t used = (size_t)(pptr() - pbase());
+        size_t cut = used;
+        if (!last) {
+            while (cut > 0 && block_[cut - 1] != '\n') {
+                cut--;
+            }
+        }
+        if (cut == 0 && !last) {
+            block_.resize(block_.size() * 2);
+        } else {
+            if (cut > 0) {
+                Compress(block_.substr(0, cut));
+            }
+            block_.erase(0, cut);
+            used -= cut;
+            block_.resize(std::max(kBlockSize, used * 2));
+        }
+        setp(&block_[0], &block_[0] + block_.size());
+        pbump((int)used);
+    }
+
+    void Compress(std::string text) {
+        while (pending_.size() >= 2 * threads_) {
+            Write();
+        }
+        // shared with the task, so that the block is still here when no
+        // thread can be started for it
+        auto block = std::make_shared<std::string>(std::move(text));
+        if (threads_ > 1) {
+            int level = level_;
+            try {
+                pending_.push_back(
+                    std::async(std::launch::async, [block, level]() {
+                        return CompressBlock(*block, level);
+                    }));
+                return;
+            } catch (const std::system_error&) {
+                // out of threads, compressed here
+            }
+        }
+        std::promise<std::string> done;
+        done.set_value(CompressBlock(*block, level_));
+        pending_.push_back(done.get_future());
+    }
+
+    void Write() {
+        std::string member = pending_.front().get();
+        pending_.pop_front();
+        if (member.empty()) {
+            ok_ = false;
+        }
+        if (ok_ &&
+            fwrite(member.data(), 1, member.size(), file_) != member.size()) {
+            ok_ = false;
+        }
+    }
+
+    FILE* file_;
+    int level_;
+    size_t threads_;
+    bool ok_;
+    std::string block_;
+    std::deque<std::future<std::string>> pending_;
+};
+
+#endif  // TELEX_HAVE_ZLIB
+
+}  // namespace
+
+
+int
+DumpGzip(StackTree* tree, const char* filename, int level, int threads) {
+#ifdef TELEX_HAVE_ZLIB
+    FILE* file = fopen(filename, "wb");
+    if (file == nullptr) {
+        return -1;
+    }
+    size_t n = threads > 0 ? (size_t)threads
+                           : (size_t)std::thread::hardware_concurrency();
+    errno = 0;
+    bool ok;
+    {
+        GzipBuf buf(file, level, std::max<size_t>(1, n));
+        std::ostream out(&buf);
+        tree->Save(out);
+        ok = buf.Finish();
+    }
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok && errno == 0) {
+        errno = EIO;
+    }
+    return ok ? 0 : -1;
+#else
+    (void)tree;
+    (void)filename;
+    (void)level;
+    (void)threads;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+int
+GzipAvailable(void) {
+#ifdef TELEX_HAVE_ZLIB
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int
+DumpFolded(StackTree* tree, const char* filename) {
+    size_t len = strlen(filename);
+    if (len > 3 && strcmp(filename + len - 3, ".gz") == 0) {
+        return DumpGzip(tree, filename, -1, 0);
+    }
+    return Dump(tree, filename);
+}
+
+size_t
+FramedMemberSize(const char* data, size_t size) {
+    const unsigned char* p = (const unsigned char*)data;
+    if (size < kSizeOffset + 4 || !IsGzip(data, size) ||
+        !(p[3] & kFlagExtra) || p[kHeaderSize + 2] != 'T' ||
+        p[kHeaderSize + 3] != 'X' || p[kHeaderSize + 4] != 4 ||
+        p[kHeaderSize + 5] != 0) {
+        return 0;
+    }
+    uint32_t member = 0;
+    for (int i = 3; i >= 0; --i) {
+        member = (member << 8) | p[kSizeOffset + i];
+    }
+    return member;
+}
+
+bool
+IsGzip(const char* data, size_t size) {
+    return size >= 2 && (unsigned char)data[0] == 0x1f &&
+           (unsigned char)data[1] == 0x8b;
+}
+
+bool
+Gunzip(const char* data, size_t size, std::string& out) {
+#ifdef TELEX_HAVE_ZLIB
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        return false;
+    }
+    stream.next_in = (unsigned char*)data;
+    char chunk[1 << 16];
+    int ret = Z_OK;
+    for (;;) {
+        // avail_in is 32 bits wide, larger inputs are fed in parts
+        if (stream.avail_in == 0) {
+            size_t left = size - (size_t)((const char*)stream.next_in - data);
+            stream.avail_in = (uInt)std::min<size_t>(left, UINT32_MAX);
+        }
+        stream.next_out = (unsigned char*)chunk;
+        stream.avail_out = sizeof(chunk);
+        ret = inflate(&stream, Z_NO_FLUSH);
+        out.append(chunk, sizeof(chunk) - stream.avail_out);
+        if (ret == Z_STREAM_END) {
+            // gzip files may hold several members, one after the other
+            if ((const char*)stream.next_in == data + size) {
+                break;
+            }
+            ret = inflateReset(&stream);
+        }
+        if (ret != Z_OK) {
+            break;
+        }
+    }
+    inflateEnd(&stream);
+    return ret == Z_STREAM_END;
+#else
+    (void)data;
+    (void)size;
+    (void)out;
+    return false;
+#endif
+}
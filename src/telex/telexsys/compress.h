@@ -0,0 +1,56 @@
+#ifndef TELE_COMPRESS_H
+#define TELE_COMPRESS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct StackTree;
+
+// The stacks of `tree` as written by Dump, gzipped while the tree is walked.
+// The text is cut into blocks of whole lines, each block is compressed into
+// a gzip member of its own and the members are concatenated, which gzip,
+// zcat and python's gzip module read as a single stream. Every member holds
+// its size in a "TX" subfield of the gzip extra field (as BGZF does), so a
+// reader can find the members without inflating them and parse them in
+// parallel, see LoadFolded. Blocks are compressed by `threads` threads, one
+// per CPU if it is <= 0, and at most two blocks per thread are held in
+// memory. `level` is a zlib compression level, -1 for its default.
+// returns 0 on success, -1 and sets errno if the file can not be written
+// (ENOSYS where zlib is not available)
+int
+DumpGzip(struct StackTree* tree,
+         const char* filename,
+         int level,
+         int threads);
+
+// Dump or DumpGzip, depending on whether `filename` ends with ".gz"
+int
+DumpFolded(struct StackTree* tree, const char* filename);
+
+// 1 if the extension was built with zlib, 0 where gzip is left to python
+int
+GzipAvailable(void);
+
+#ifdef __cplusplus
+}
+
+#include <string>
+
+// the size of a gzip member from its header, 0 if it has no "TX" subfield
+size_t
+FramedMemberSize(const char* data, size_t size);
+
+// true if `data` starts with the gzip magic bytes
+bool
+IsGzip(const char* data, size_t size);
+
+// Append the text of the gzip members in `data` to `out`.
+// returns false if the data is not valid gzip or zlib is not available
+bool
+Gunzip(const char* data, size_t size, std::string& out);
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef TELE_ENCODE_H
+#define TELE_ENCODE_H
+
+// Small encoders shared by the native writers.
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+
+// an unsigned LEB128 varint, as protobuf writes them
+inline void
+PutVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+// a JSON string literal, with '<' escaped too so that the text can be
+// embedded in a <script> element
+inline void
+AppendJsonString(std::string& out, const std::string& s) {
+    out += '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += (char)c;
+        } else if (c == '<') {
+            out += "\\u003c";
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += (char)c;
+        }
+    }
+    out += '"';
+}
+
+inline void
+AppendInt(std::string& out, long long v) {
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%lld", v);
+    out.append(buf, n);
+}
+
+#endif
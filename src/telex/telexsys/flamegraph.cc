@@ -0,0 +1,1304 @@
+#include "flamegraph.h"
+#include "encode.h"
+#include "folded_line.h"
+#include "tree_impl.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+// ---------------------------------------------------------------------------
+// md5, only used to pick a stable colour for a frame name so that the native
+// renderer paints exactly the same colours as flamegraph.py
+// ---------------------------------------------------------------------------
+
+namespace {
+
+const uint32_t kMD5Shift[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+const uint32_t kMD5Table[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+    0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+    0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+    0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+    0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+inline uint32_t
+RotateLeft(uint32_t x, uint32_t c) {
+    return (x << c) | (x >> (32 - c));
+}
+
+void
+MD5Block(uint32_t state[4], const unsigned char* block) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; ++i) {
+        m[i] = (uint32_t)block[i * 4] | ((uint32_t)block[i * 4 + 1] << 8) |
+               ((uint32_t)block[i * 4 + 2] << 16) |
+               ((uint32_t)block[i * 4 + 3] << 24);
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t f;
+        int g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+        uint32_t tmp = d;
+        d = c;
+        c = b;
+        b = b + RotateLeft(a + f + kMD5Table[i] + m[g], kMD5Shift[i]);
+        a = tmp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+// returns the first 4 bytes of the md5 digest as a big endian integer, which
+// is what int(hashlib.md5(s).hexdigest()[:8], 16) computes in python
+uint32_t
+MD5Prefix(const std::string& s) {
+    uint32_t state[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+    size_t len = s.size();
+    const unsigned char* data = (const unsigned char*)s.data();
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        MD5Block(state, data + i);
+    }
+    unsigned char tail[128];
+    size_t rest = len - i;
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, data + i, rest);
+    tail[rest] = 0x80;
+    size_t tail_len = rest + 9 <= 64 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int k = 0; k < 8; ++k) {
+        tail[tail_len - 8 + k] = (unsigned char)(bits >> (8 * k));
+    }
+    MD5Block(state, tail);
+    if (tail_len == 128) {
+        MD5Block(state, tail + 64);
+    }
+    uint32_t a = state[0];
+    return ((a & 0xff) << 24) | ((a & 0xff00) << 8) | ((a >> 8) & 0xff00) |
+           (a >> 24);
+}
+
+
+// ---------------------------------------------------------------------------
+// python number semantics
+// ---------------------------------------------------------------------------
+
+// flamegraph.py mixes ints and floats in its layout (a clamped frame gets the
+// integer boundary), and repr() prints them differently ("10" vs "10.0").
+// Num tracks which of the two python would hold so the output is identical.
+struct Num {
+    double v;
+    bool integral;
+};
+
+inline Num
+Int(long long v) {
+    Num n = {(double)v, true};
+    return n;
+}
+
+inline Num
+Float(double v) {
+    Num n = {v, false};
+    return n;
+}
+
+inline Num
+Add(Num a, Num b) {
+    Num n = {a.v + b.v, a.integral && b.integral};
+    return n;
+}
+
+inline Num
+Sub(Num a, Num b) {
+    Num n = {a.v - b.v, a.integral && b.integral};
+    return n;
+}
+
+// Shortest round-trip digits for 2^-6 <= v < 2^52, generated exactly on 64
+// bit integers. This is what python's repr() prints, but an order of
+// magnitude faster than probing snprintf + strtod. Returns false when v is
+// out of range or two shortest candidates are equally near, the caller then
+// falls back to the printf based search.
+bool
+AppendShortest(std::string& out, double v) {
+    int exp;
+    double frac = frexp(v, &exp);  // v = frac * 2^exp, 0.5 <= frac < 1
+    if (!(v > 0) || exp > 52 || exp < -5) {
+        return false;
+    }
+    uint64_t m = (uint64_t)ldexp(frac, 53);  // 2^52 <= m < 2^53, exact
+    int k = 53 - exp;                        // v = m * 2^-k, 1 <= k <= 58
+
+    // everything below is in units of 2^-(k+2): v is 4m and the values
+    // rounding to v lie within hi_gap above and lo_gap below it
+    uint64_t D = (uint64_t)1 << (k + 2);
+    uint64_t V = m << 2;
+    uint64_t hi_gap = 2;
+    uint64_t lo_gap = m == ((uint64_t)1 << 52) ? 1 : 2;
+    bool inclusive = (m & 1) == 0;  // strtod rounds half to even
+
+    uint64_t digits = V / D;
+    uint64_t rem = V % D;
+    int fraction = 0;
+    while (true) {
+        uint64_t up = D - rem;
+        bool low_ok = inclusive ? rem <= lo_gap : rem < lo_gap;
+        bool high_ok = inclusive ? up <= hi_gap : up < hi_gap;
+        if (low_ok && high_ok) {
+            if (rem == up) {
+                return false;
+            }
+            if (up < rem) {
+                digits++;
+            }
+            break;
+        } else if (low_ok) {
+            break;
+        } else if (high_ok) {
+            digits++;
+            break;
+        }
+        if (fraction == 18) {
+            return false;
+        }
+        rem *= 10;
+        lo_gap *= 10;
+        hi_gap *= 10;
+        digits = digits * 10 + rem / D;
+        rem %= D;
+        fraction++;
+    }
+
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%llu", (unsigned long long)digits);
+    if (fraction == 0) {
+        out.append(buf, n);
+        out += ".0";
+        return true;
+    }
+    while (fraction > 1 && buf[n - 1] == '0') {
+        n--;
+        fraction--;
+    }
+    if (n <= fraction) {
+        out += "0.";
+        out.append(fraction - n, '0');
+        out.append(buf, n);
+    } else {
+        out.append(buf, n - fraction);
+        out += '.';
+        out.append(buf + n - fraction, fraction);
+    }
+    return true;
+}
+
+// python's repr(float)
+void
+AppendFloat(std::string& out, double v) {
+    size_t mark = out.size();
+    if (v < 0) {
+        out += '-';
+    }
+    if (AppendShortest(out, fabs(v))) {
+        return;
+    }
+    out.resize(mark);
+    if (std::isnan(v)) {
+        out += "nan";
+        return;
+    } else if (std::isinf(v)) {
+        out += v < 0 ? "-inf" : "inf";
+        return;
+    } else if (v == 0) {
+        out += std::signbit(v) ? "-0.0" : "0.0";
+        return;
+    }
+
+    // shortest precision that round-trips, then lay the digits out the way
+    // repr() does: positional for 1e-4 <= |v| < 1e16, scientific otherwise
+    if (v < 0) {
+        out += '-';
+        v = -v;
+    }
+    char buf[48];
+    std::string digits;
+    int exponent = 0;
+    for (int prec = 0; prec < 17; ++prec) {
+        snprintf(buf, sizeof(buf), "%.*e", prec, v);
+        bool found = strtod(buf, nullptr) == v;
+        digits.clear();
+        const char* p = buf;
+        for (; *p != 'e'; ++p) {
+            if (*p != '.') {
+                digits += *p;
+            }
+        }
+        exponent = atoi(p + 1);
+        if (found) {
+            break;
+        }
+        // below a power of two the rounding interval is half as wide, the
+        // correctly rounded digits may miss it while the next ones up hit
+        size_t i = digits.size();
+        while (i > 0 && digits[i - 1] == '9') {
+            digits[--i] = '0';
+        }
+        if (i == 0) {
+            digits.insert(digits.begin(), '1');
+            digits.pop_back();
+            exponent++;
+        } else {
+            digits[i - 1]++;
+        }
+        snprintf(buf,
+                 sizeof(buf),
+                 "%c.%se%d",
+                 digits[0],
+                 digits.c_str() + 1,
+                 exponent);
+        if (strtod(buf, nullptr) == v) {
+            break;
+        }
+    }
+    while (digits.size() > 1 && digits.back() == '0') {
+        digits.pop_back();
+    }
+    int ndigits = (int)digits.size();
+    if (exponent >= -4 && exponent < 16) {
+        int point = exponent + 1;
+        if (point <= 0) {
+            out += "0.";
+            out.append(-point, '0');
+            out += digits;
+        } else if (point >= ndigits) {
+            out += digits;
+            out.append(point - ndigits, '0');
+            out += ".0";
+        } else {
+            out.append(digits, 0, point);
+            out += '.';
+            out.append(digits, point, std::string::npos);
+        }
+    } else {
+        out += digits[0];
+        if (ndigits > 1) {
+            out += '.';
+            out.append(digits, 1, std::string::npos);
+        }
+        char exp_buf[8];
+        snprintf(exp_buf, sizeof(exp_buf), "e%+03d", exponent);
+        out += exp_buf;
+    }
+}
+
+void
+AppendNum(std::string& out, Num n) {
+    if (n.integral) {
+        AppendInt(out, (long long)n.v);
+    } else {
+        AppendFloat(out, n.v);
+    }
+}
+
+// html.escape(s, quote=True)
+void
+AppendEscaped(std::string& out, const char* s, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        switch (s[i]) {
+        case '&':
+            out += "&amp;";
+            break;
+        case '<':
+            out += "&lt;";
+            break;
+        case '>':
+            out += "&gt;";
+            break;
+        case '"':
+            out += "&quot;";
+            break;
+        case '\'':
+            out += "&#x27;";
+            break;
+        default:
+            out += s[i];
+        }
+    }
+}
+
+void
+AppendEscaped(std::string& out, const std::string& s) {
+    AppendEscaped(out, s.data(), s.size());
+}
+
+// number of code points of an utf-8 string, python's len()
+size_t
+CodePoints(const std::string& s) {
+    size_t n = 0;
+    for (unsigned char c : s) {
+        if ((c & 0xc0) != 0x80) {
+            n++;
+        }
+    }
+    return n;
+}
+
+// byte offset of the n-th code point
+size_t
+CodePointOffset(const std::string& s, size_t n) {
+    size_t seen = 0;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (((unsigned char)s[i] & 0xc0) != 0x80) {
+            if (seen == n) {
+                return i;
+            }
+            seen++;
+        }
+    }
+    return s.size();
+}
+
+
+class SvgWriter {
+  public:
+    explicit SvgWriter(FILE* fp) : fp_(fp), ok_(true) {
+        buf_.reserve(kFlushSize + 4096);
+    }
+
+    std::string& buf() { return buf_; }
+
+    // finish the current element, elements are joined with "\n"
+    void EndLine() {
+        buf_ += '\n';
+        if (buf_.size() >= kFlushSize) {
+            Flush();
+        }
+    }
+
+    bool Flush() {
+        if (!buf_.empty() &&
+            fwrite(buf_.data(), 1, buf_.size(), fp_) != buf_.size()) {
+            ok_ = false;
+        }
+        buf_.clear();
+        return ok_;
+    }
+
+  private:
+    static const size_t kFlushSize = 1 << 20;
+    FILE* fp_;
+    bool ok_;
+    std::string buf_;
+};
+
+}  // namespace
+
+
+struct FlameNode {
+    uint32_t name;
+    uint32_t first_child;
+    uint32_t last_child;
+    uint32_t next_sibling;
+    long long total;
+    long long base;  // the total in the baseline of a differential graph
+};
+
+#define FLAME_NONE 0xffffffffu
+
+
+// The render tree keeps children in first-seen order, which is the order
+// flamegraph.py builds its dict based tree in, and never reorders siblings
+// (StackTree does, to speed up inserts).
+struct FlameTree {
+    std::vector<FlameNode> nodes;
+    std::vector<const std::string*> names;
+    std::unordered_map<std::string, uint32_t> name_ids;
+    std::unordered_map<uint64_t, uint32_t> children;
+    std::string scratch;
+    std::vector<std::string> strip_prefixes;
+    std::unordered_map<std::string, uint32_t> symbols;  // raw name -> name
+    bool baseline;  // stacks added count toward FlameNode::base
+
+    FlameTree() : baseline(false) {
+        nodes.push_back(FlameNode{Intern("root", 4),
+                                  FLAME_NONE,
+                                  FLAME_NONE,
+                                  FLAME_NONE,
+                                  0,
+                                  0});
+    }
+
+    long long& Count(uint32_t node) {
+        return baseline ? nodes[node].base : nodes[node].total;
+    }
+
+    uint32_t Intern(const char* s, size_t len) {
+        scratch.assign(s, len);
+        auto it = name_ids.find(scratch);
+        if (it != name_ids.end()) {
+            return it->second;
+        }
+        uint32_t id = (uint32_t)names.size();
+        auto res = name_ids.emplace(scratch, id);
+        names.push_back(&res.first->first);
+        return id;
+    }
+
+    // Intern with the strip prefixes applied, cached per raw name
+    uint32_t Symbol(const char* s, size_t len) {
+        if (strip_prefixes.empty()) {
+            return Intern(s, len);
+        }
+        std::string raw(s, len);
+        auto it = symbols.find(raw);
+        if (it != symbols.end()) {
+            return it->second;
+        }
+        for (const std::string& prefix : strip_prefixes) {
+            if (len >= prefix.size() &&
+                memcmp(s, prefix.data(), prefix.size()) == 0) {
+                s += prefix.size();
+                len -= prefix.size();
+            }
+        }
+        uint32_t id = Intern(s, len);
+        symbols.emplace(std::move(raw), id);
+        return id;
+    }
+
+    uint32_t Child(uint32_t parent, uint32_t name) {
+        uint64_t key = ((uint64_t)parent << 32) | name;
+        auto it = children.find(key);
+        if (it != children.end()) {
+            return it->second;
+        }
+        uint32_t id = (uint32_t)nodes.size();
+        nodes.push_back(
+            FlameNode{name, FLAME_NONE, FLAME_NONE, FLAME_NONE, 0, 0});
+        FlameNode& p = nodes[parent];
+        if (p.last_child == FLAME_NONE) {
+            p.first_child = id;
+        } else {
+            nodes[p.last_child].next_sibling = id;
+        }
+        p.last_child = id;
+        children.emplace(key, id);
+        return id;
+    }
+
+    void AddStack(const FoldedLine& line) {
+        uint32_t node = 0;
+        Count(0) += line.count;
+        ForEachFrame(line, [&](const char* frame, size_t size) {
+            node = Child(node, Symbol(frame, size));
+            Count(node) += line.count;
+        });
+    }
+};
+
+
+struct FlameTree*
+NewFlameTree(void) {
+    return new FlameTree();
+}
+
+void
+FreeFlameTree(struct FlameTree* tree) {
+    delete tree;
+}
+
+int
+FlameTreeAddFolded(struct FlameTree* tree, const char* line, size_t len) {
+    FoldedLine folded;
+    int parsed = ParseFoldedLine(line, len, &folded);
+    if (parsed > 0) {
+        tree->AddStack(folded);
+    }
+    return parsed < 0 ? -1 : 0;
+}
+
+void
+FlameTreeSetStripPrefixes(struct FlameTree* tree,
+                          const char* const* prefixes,
+                          size_t count) {
+    tree->strip_prefixes.assign(prefixes, prefixes + count);
+    tree->symbols.clear();
+}
+
+void
+FlameTreeAddStackTree(struct FlameTree* tree, struct StackTree* stack_tree) {
+    // Preorder walk, children before siblings: the order Dumps writes the
+    // stacks in, so the render tree ends up exactly as if it had been parsed
+    // from the dumped text. acc_cnt already holds the total of a subtree.
+    struct Pending {
+        const Node* node;
+        uint32_t parent;
+    };
+    std::vector<Pending> pending;
+    if (stack_tree->root->child != nullptr) {
+        pending.push_back(Pending{stack_tree->root->child, 0});
+    }
+    while (!pending.empty()) {
+        Pending p = pending.back();
+        pending.pop_back();
+        if (p.node->sibling != nullptr) {
+            pending.push_back(Pending{p.node->sibling, p.parent});
+        }
+        const std::string& name = p.node->name;
+        uint32_t symbol = tree->Symbol(name.data(), name.size());
+        uint32_t id = tree->Child(p.parent, symbol);
+        tree->Count(id) += (long long)p.node->acc_cnt;
+        if (p.parent == 0) {
+            tree->Count(0) += (long long)p.node->acc_cnt;
+        }
+        if (p.node->child != nullptr) {
+            pending.push_back(Pending{p.node->child, id});
+        }
+    }
+}
+
+long long
+FlameTreeTotal(struct FlameTree* tree) {
+    return tree->nodes[0].total;
+}
+
+void
+FlameTreeSetBaseline(struct FlameTree* tree, int baseline) {
+    tree->baseline = baseline != 0;
+}
+
+long long
+FlameTreeBaselineTotal(struct FlameTree* tree) {
+    return tree->nodes[0].base;
+}
+
+
+namespace {
+
+struct Placed {
+    uint32_t node;       // the parent of the frames for a coalesced box
+    uint32_t coalesced;  // number of frames a coalesced box stands for
+    long long total;
+    long long base;  // total in the baseline, for differential graphs
+    Num arg;  // the x passed to _layout_tree, children start from it
+    Num x;
+    Num width;
+};
+
+// FlameGraph._layout_tree for a single node
+Placed
+Layout(uint32_t node, long long total, double scale, Num arg, Num L, Num R) {
+    Placed p;
+    p.node = node;
+    p.coalesced = 0;
+    p.total = total;
+    p.base = 0;
+    p.arg = arg;
+    p.width = Float((double)total * scale);
+    p.x = Sub(arg, p.width);
+    if (p.x.v < L.v) {
+        p.x = L;
+    }
+    if (p.x.v + p.width.v > R.v) {
+        p.width = Sub(R, p.x);
+    }
+    return p;
+}
+
+struct NameCache {
+    std::string color;
+    size_t code_points;
+    bool ready;
+};
+
+const char kCoalescedColor[] = "hsl(0, 0%, 80%)";
+
+// The change of a frame's share of all samples, from the baseline to the
+// new profile, in percentage points
+double
+DiffDelta(long long total,
+          long long base,
+          double total_samples,
+          double base_samples) {
+    double before = base_samples > 0 ? (double)base / base_samples : 0;
+    return ((double)total / total_samples - before) * 100;
+}
+
+// Red for frames that grew, blue for frames that shrank, the more saturated
+// the closer the change is to the largest one drawn. Unchanged frames are
+// white.
+std::string
+DiffColor(double delta, double max_delta) {
+    int c = max_delta > 0 ? (int)lround(210 * fabs(delta) / max_delta) : 0;
+    char buf[64];
+    if (delta > 0) {
+        snprintf(buf, sizeof(buf), "rgb(255, %d, %d)", 255 - c, 255 - c);
+    } else {
+        snprintf(buf, sizeof(buf), "rgb(%d, %d, 255)", 255 - c, 255 - c);
+    }
+    return buf;
+}
+
+void
+WriteFrame(std::string& out,
+           const std::string& name,
+           size_t code_points,
+           const std::string& color,
+           const Placed& p,
+           long long rect_y,
+           double total_samples,
+           double delta,
+           const FlameGraphOptions& opts) {
+    out += "<g>\n<title>";
+    AppendEscaped(out, name);
+    out += " (";
+    AppendInt(out, p.total);
+    out += ' ';
+    out += opts.countname;
+    char pct[64];
+    snprintf(
+        pct, sizeof(pct), ", %.2f%%", (double)p.total / total_samples * 100);
+    out += pct;
+    if (opts.differential) {
+        snprintf(pct, sizeof(pct), ", %+.2f%%", delta);
+        out += pct;
+    }
+    out += ")</title>\n";
+
+    out += "<rect x=\"";
+    AppendNum(out, p.x);
+    out += "\" y=\"";
+    AppendInt(out, rect_y);
+    out += "\" width=\"";
+    AppendNum(out, p.width);
+    out += "\" height=\"";
+    AppendInt(out, opts.frame_height);
+    out += "\" fill=\"";
+    out += color;
+    out += "\" rx=\"2\" ry=\"2\" />\n";
+
+    out += "<text x=\"";
+    AppendNum(out, Add(p.x, Int(5)));
+    out += "\" y=\"";
+    AppendFloat(out, (double)(rect_y + opts.frame_height) - 4.5);
+    out += "\">";
+    // FlameGraph._trim_text
+    double width = p.width.v;
+    if (width / 6.5 < 3) {
+        // empty label
+    } else if ((double)code_points * 6.5 <= width) {
+        AppendEscaped(out, name);
+    } else {
+        long long max_chars = (long long)(width / 6.5) - 2;
+        size_t cut = max_chars > 0 ? CodePointOffset(name, max_chars) : 0;
+        AppendEscaped(out, name.data(), cut);
+        out += "..";
+    }
+    out += "</text>\n</g>";
+}
+
+// Lay the children of `p` out from right to left, appending them to `next`
+// in their left to right order. Children narrower than minwidth are never
+// visited, they become a single coalesced box left of their siblings.
+void
+LayoutChildren(const FlameTree& tree,
+               const Placed& p,
+               double scale,
+               double minwidth,
+               std::vector<uint32_t>& kids,
+               std::vector<Placed>& next) {
+    kids.clear();
+    for (uint32_t c = tree.nodes[p.node].first_child; c != FLAME_NONE;
+         c = tree.nodes[c].next_sibling) {
+        kids.push_back(c);
+    }
+    size_t base = next.size();
+    Num current = p.arg;
+    Num L = p.x;
+    Num R = Add(p.x, p.width);
+    uint32_t coalesced = 0;
+    long long coalesced_total = 0;
+    long long coalesced_base = 0;
+    for (size_t i = kids.size(); i > 0; --i) {
+        uint32_t c = kids[i - 1];
+        const FlameNode& kid = tree.nodes[c];
+        if (kid.total == 0 && kid.base != 0) {
+            continue;  // only in the baseline of a differential graph
+        }
+        if ((double)kid.total * scale < minwidth) {
+            coalesced++;
+            coalesced_total += kid.total;
+            coalesced_base += kid.base;
+            continue;
+        }
+        Placed child = Layout(c, kid.total, scale, current, L, R);
+        child.base = kid.base;
+        next.push_back(child);
+        current = Sub(current, child.width);
+    }
+    std::reverse(next.begin() + base, next.end());
+    if (coalesced > 0 && (double)coalesced_total * scale >= minwidth) {
+        Placed box = Layout(p.node, coalesced_total, scale, current, L, R);
+        box.coalesced = coalesced;
+        box.base = coalesced_base;
+        next.insert(next.begin() + base, box);
+    }
+}
+
+// Breadth first, level by level: this is both the order the python renderer
+// emits frames in and enough to lay children out, since a child's position
+// only depends on its parent and its right siblings. Calls visit(depth,
+// level) for every level, depth 1 for the root. Only the level being
+// visited and the next one are held, at most about width / minwidth frames
+// each.
+template <typename Visit>
+void
+WalkLevels(const FlameTree& tree,
+           const FlameGraphOptions& opts,
+           long long root_total,
+           double scale,
+           Visit visit) {
+    std::vector<Placed> level;
+    std::vector<Placed> next;
+    std::vector<uint32_t> kids;
+    level.push_back(Layout(0,
+                           root_total,
+                           scale,
+                           Int(opts.width - 10),
+                           Int(10),
+                           Int(opts.width - 10)));
+    level.back().base = tree.nodes[0].base;
+    for (size_t depth = 1; !level.empty(); ++depth) {
+        visit(depth, level);
+        next.clear();
+        for (const Placed& p : level) {
+            // a frame below minwidth is not drawn, nor is anything below it
+            if (p.coalesced > 0 || p.width.v < opts.minwidth) {
+                continue;
+            }
+            LayoutChildren(tree, p, scale, opts.minwidth, kids, next);
+        }
+        level.swap(next);
+    }
+}
+
+}  // namespace
+
+
+int
+RenderFlameGraph(struct FlameTree* tree,
+                 const char* filename,
+                 const struct FlameGraphOptions* options) {
+    const FlameGraphOptions& opts = *options;
+    long long total = tree->nodes[0].total;
+    // an empty profile still draws a root frame of one sample
+    long long root_total = total > 1 ? total : 1;
+    double total_samples = (double)root_total;
+    double scale = (double)(opts.width - 20) / (double)root_total;
+
+    // The tree is laid out twice, and frames are written as the second
+    // walk places them. The first walk finds what the header needs: the svg
+    // height depends on the deepest level that survives pruning, and the
+    // colours of a differential graph are relative to the largest change
+    // among the frames that are drawn.
+    double base_samples = (double)tree->nodes[0].base;
+    double max_delta = 0;
+    size_t max_depth = 0;
+    auto measure = [&](size_t depth, const std::vector<Placed>& level) {
+        max_depth = depth;
+        if (!opts.differential) {
+            return;
+        }
+        for (const Placed& p : level) {
+            if (p.coalesced == 0 && p.width.v >= opts.minwidth) {
+                double delta =
+                    DiffDelta(p.total, p.base, total_samples, base_samples);
+                max_delta = std::max(max_delta, fabs(delta));
+            }
+        }
+    };
+    WalkLevels(*tree, opts, root_total, scale, measure);
+
+    FILE* fp = fopen(filename, "wb");
+    if (fp == nullptr) {
+        return -1;
+    }
+    SvgWriter w(fp);
+    std::string& out = w.buf();
+
+    const long long header_line_height = 18;
+    long long extra_lines =
+        opts.header_count > 3 ? (long long)opts.header_count - 3 : 0;
+    long long top_margin = 120 + extra_lines * header_line_height;
+    long long bottom_margin = 50;
+    long long svg_height = (long long)max_depth * opts.frame_height +
+                           top_margin + bottom_margin;
+    const char* orientation = opts.inverted ? "inverted" : "standard";
+
+    out += "<?xml version=\"1.0\" standalone=\"no\"?>\n"
+           "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" "
+           "\"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n"
+           "<svg version=\"1.1\" width=\"";
+    AppendInt(out, opts.width);
+    out += "\" height=\"";
+    AppendInt(out, svg_height);
+    out += "\" data-orientation=\"";
+    out += orientation;
+    out += "\"\nonload=\"init(evt)\" viewBox=\"0 0 ";
+    AppendInt(out, opts.width);
+    out += ' ';
+    AppendInt(out, svg_height);
+    out += "\"\n"
+           "xmlns=\"http://www.w3.org/2000/svg\" "
+           "xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n"
+           "<!-- Flame graph stack visualization. See "
+           "https://github.com/brendangregg/FlameGraph for latest version, "
+           "and http://www.brendangregg.com/flamegraphs.html for examples. "
+           "-->\n"
+           "<!-- NOTES:  -->\n"
+           "<defs>\n"
+           "<linearGradient id=\"background\" y1=\"0\" y2=\"1\" x1=\"0\" "
+           "x2=\"0\">\n"
+           "<stop stop-color=\"#eeeeee\" offset=\"5%\" />\n"
+           "<stop stop-color=\"#eeeeb0\" offset=\"95%\" />\n"
+           "</linearGradient>\n"
+           "</defs>\n"
+           "<style type=\"text/css\">\n"
+           "text { font-family: Source Serif Pro, Palatino, gentium plus, "
+           "Arial, sans-serif; font-size: 11px; fill: rgb(0, 0, 0);}\n"
+           "#search, #ignorecase { opacity: 0.9; cursor: pointer; }\n"
+           "#search:hover, #search.show, #ignorecase:hover, "
+           "#ignorecase.show { opacity: 1; }\n"
+           "#subtitle { text-anchor: middle; font-color: rgb(160, 160, "
+           "160);}\n"
+           "#title { text-anchor: middle; font-size: 17px }\n"
+           "#under_title { text-anchor: middle; font-size: 13px }\n"
+           "#unzoom { cursor: pointer; }\n"
+           "#frames > *:hover { stroke: black; stroke-width: 0.5; cursor: "
+           "pointer; }\n"
+           ".hide { display: none; }\n"
+           ".parent { opacity: 0.5; }\n"
+           "</style>\n"
+           "<script type=\"text/ecmascript\">\n<![CDATA[\n";
+    out += opts.script ? opts.script : "";
+    out += "\n]]>\n</script>\n<rect x=\"0\" y=\"0\" width=\"";
+    AppendInt(out, opts.width);
+    out += "\" height=\"";
+    AppendInt(out, svg_height);
+    out += "\" fill=\"url(#background)\" rx=\"2\" ry=\"2\" />\n"
+           "<text id=\"title\" x=\"";
+    AppendInt(out, opts.width / 2);
+    out += "\" y=\"24\">";
+    AppendEscaped(out, opts.title, strlen(opts.title));
+    out += "</text>";
+    w.EndLine();
+
+    long long current_y = 44;
+    for (size_t i = 0; i < opts.header_count; ++i) {
+        out += "<text id=\"under_title\" x=\"";
+        AppendInt(out, opts.width / 2);
+        out += "\" y=\"";
+        AppendInt(out, current_y);
+        out += "\">";
+        AppendEscaped(out, opts.header_lines[i], strlen(opts.header_lines[i]));
+        out += "</text>";
+        w.EndLine();
+        current_y += header_line_height;
+    }
+
+    out += "<text id=\"details\" x=\"10\" y=\"";
+    AppendInt(out, svg_height - 10);
+    out += "\"> </text>\n"
+           "<text id=\"unzoom\" x=\"10\" y=\"24\" class=\"hide\">Reset "
+           "Zoom</text>\n"
+           "<text id=\"search\" x=\"";
+    AppendInt(out, opts.width - 110);
+    out += "\" y=\"24\">Search</text>\n<text id=\"ignorecase\" x=\"";
+    AppendInt(out, opts.width - 30);
+    out += "\" y=\"24\">ic</text>\n<text id=\"matched\" x=\"";
+    AppendInt(out, opts.width - 110);
+    out += "\" y=\"";
+    AppendInt(out, svg_height - 10);
+    out += "\"> </text>\n<g id=\"frames\" data-orientation=\"";
+    out += orientation;
+    out += "\">";
+    w.EndLine();
+
+    std::vector<NameCache> cache(tree->names.size());
+    for (auto& c : cache) {
+        c.ready = false;
+    }
+    std::string label;
+    std::string coalesced_color = kCoalescedColor;
+    auto draw = [&](size_t depth, const std::vector<Placed>& level) {
+        long long rect_y =
+            opts.inverted
+                ? top_margin + (long long)(depth - 1) * opts.frame_height
+                : svg_height - bottom_margin -
+                      (long long)depth * opts.frame_height;
+        for (const Placed& p : level) {
+            if (p.width.v < opts.minwidth) {
+                continue;
+            }
+            double delta =
+                opts.differential
+                    ? DiffDelta(p.total, p.base, total_samples, base_samples)
+                    : 0;
+            if (p.coalesced > 0) {
+                label = "[";
+                AppendInt(label, p.coalesced);
+                label += " frames]";
+                WriteFrame(out,
+                           label,
+                           label.size(),
+                           coalesced_color,
+                           p,
+                           rect_y,
+                           total_samples,
+                           delta,
+                           opts);
+            } else {
+                uint32_t name_id = tree->nodes[p.node].name;
+                const std::string& name = *tree->names[name_id];
+                NameCache& nc = cache[name_id];
+                if (!nc.ready) {
+                    uint32_t hash = MD5Prefix(name);
+                    char buf[64];
+                    snprintf(buf,
+                             sizeof(buf),
+                             "hsl(%u, %u%%, %u%%)",
+                             hash % 360,
+                             35 + hash % 30,
+                             65 + hash % 10);
+                    nc.color = buf;
+                    nc.code_points = CodePoints(name);
+                    nc.ready = true;
+                }
+                WriteFrame(out,
+                           name,
+                           nc.code_points,
+                           opts.differential ? DiffColor(delta, max_delta)
+                                             : nc.color,
+                           p,
+                           rect_y,
+                           total_samples,
+                           delta,
+                           opts);
+            }
+            w.EndLine();
+        }
+    };
+    WalkLevels(*tree, opts, root_total, scale, draw);
+
+    out += "</g>\n</svg>";
+    bool ok = w.Flush();
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    return ok ? 0 : -1;
+}
+
+
+// ---------------------------------------------------------------------------
+// chunks for the lazy html viewer
+//
+// A chunk is {"names": [...], "hashes": [...], "parts": [...], "nodes":
+// [...], "groups": [...]}. "nodes" holds subtrees in preorder, five numbers
+// per frame: name index, total, position among all of its siblings, number
+// of children kept in this chunk and the index of its group or -1. The
+// first parts[0] subtrees are the first part, and so on. A part is the
+// children some frame lost to this chunk, the group [chunk, part, count,
+// total, max] of that frame says where they are and is enough for the
+// viewer to draw them as one coalesced box until it zooms in far enough to
+// need them.
+// ---------------------------------------------------------------------------
+
+struct FlameChunks {
+    std::vector<std::string> data;
+};
+
+namespace {
+
+// frames this far below the roots of a part are moved to a later chunk,
+// which also bounds the nesting the viewer rebuilds per chunk
+const size_t kMaxChunkDepth = 64;
+
+class ChunkBuilder {
+  public:
+    ChunkBuilder(const FlameTree& tree, double min_fraction, size_t max_nodes)
+        : tree_(tree),
+          min_fraction_(min_fraction),
+          max_nodes_(max_nodes > 0 ? max_nodes : 1),
+          building_(0),
+          open_roots_(0),
+          kept_(tree.nodes.size(), 0),
+          local_(tree.names.size(), FLAME_NONE),
+          hashes_(tree.names.size(), 0),
+          hashed_(tree.names.size(), false),
+          group_count_(0) {}
+
+    void Build(std::vector<std::string>& out) {
+        AddPart(std::vector<Entry>{Entry{0, 0}});
+        for (building_ = 0; building_ < chunks_.size(); ++building_) {
+            out.push_back(std::string());
+            BuildChunk(out.back());
+        }
+    }
+
+  private:
+    struct Entry {
+        uint32_t node;
+        uint32_t ord;  // position among all children of its parent
+    };
+
+    struct Pending {
+        uint32_t node;
+        uint32_t part;  // index of the part in the chunk
+        size_t depth;
+    };
+
+    // Parts are packed in the order they are found into chunks of about
+    // max_nodes roots, so that a level of many narrow frames, each with a
+    // few narrower children, does not end up as a chunk per frame.
+    // Returns the chunk and the index of the part in it.
+    std::pair<size_t, size_t> AddPart(std::vector<Entry> roots) {
+        if (chunks_.empty() || chunks_.size() - 1 <= building_ ||
+            open_roots_ + roots.size() > max_nodes_) {
+            chunks_.push_back(std::vector<std::vector<Entry>>());
+            open_roots_ = 0;
+        }
+        open_roots_ += roots.size();
+        chunks_.back().push_back(std::move(roots));
+        return std::make_pair(chunks_.size() - 1, chunks_.back().size() - 1);
+    }
+
+    // Breadth first over all parts at once, so that the widest and
+    // shallowest frames are the ones that stay when the chunk runs out of
+    // room. A frame stays if it is at least min_fraction of its part wide.
+    void Select(uint32_t mark, const std::vector<std::vector<Entry>>& parts) {
+        thresholds_.clear();
+        queue_.clear();
+        size_t count = 0;
+        for (size_t p = 0; p < parts.size(); ++p) {
+            long long base = 0;
+            for (const Entry& e : parts[p]) {
+                base += tree_.nodes[e.node].total;
+                kept_[e.node] = mark;
+                queue_.push_back(Pending{e.node, (uint32_t)p, 0});
+            }
+            thresholds_.push_back((double)base * min_fraction_);
+            count += parts[p].size();
+        }
+        for (size_t i = 0; i < queue_.size(); ++i) {
+            Pending q = queue_[i];
+            if (q.depth + 1 >= kMaxChunkDepth) {
+                continue;
+            }
+            for (uint32_t c = tree_.nodes[q.node].first_child; c != FLAME_NONE;
+                 c = tree_.nodes[c].next_sibling) {
+                if (count < max_nodes_ &&
+                    (double)tree_.nodes[c].total >= thresholds_[q.part]) {
+                    kept_[c] = mark;
+                    queue_.push_back(Pending{c, q.part, q.depth + 1});
+                    count++;
+                }
+            }
+        }
+    }
+
+    uint32_t LocalName(uint32_t name) {
+        if (local_[name] == FLAME_NONE) {
+            local_[name] = (uint32_t)used_.size();
+            used_.push_back(name);
+            if (!hashed_[name]) {
+                hashes_[name] = MD5Prefix(*tree_.names[name]);
+                hashed_[name] = true;
+            }
+        }
+        return local_[name];
+    }
+
+    void WriteNode(const Entry& e, uint32_t mark, std::string& nodes) {
+        const FlameNode& n = tree_.nodes[e.node];
+        kids_.clear();
+        std::vector<Entry> lost;
+        long long lost_total = 0;
+        long long lost_max = 0;
+        uint32_t ord = 0;
+        for (uint32_t c = n.first_child; c != FLAME_NONE;
+             c = tree_.nodes[c].next_sibling, ++ord) {
+            if (kept_[c] == mark) {
+                kids_.push_back(Entry{c, ord});
+            } else {
+                lost.push_back(Entry{c, ord});
+                lost_total += tree_.nodes[c].total;
+                lost_max = std::max(lost_max, tree_.nodes[c].total);
+            }
+        }
+
+        if (!nodes.empty()) {
+            nodes += ',';
+        }
+        AppendInt(nodes, LocalName(n.name));
+        nodes += ',';
+        AppendInt(nodes, n.total);
+        nodes += ',';
+        AppendInt(nodes, e.ord);
+        nodes += ',';
+        AppendInt(nodes, (long long)kids_.size());
+        nodes += ',';
+        if (lost.empty()) {
+            nodes += "-1";
+        } else {
+            AppendInt(nodes, (long long)group_count_);
+            if (group_count_++ > 0) {
+                groups_ += ',';
+            }
+            size_t count = lost.size();
+            std::pair<size_t, size_t> where = AddPart(std::move(lost));
+            groups_ += '[';
+            AppendInt(groups_, (long long)where.first);
+            groups_ += ',';
+            AppendInt(groups_, (long long)where.second);
+            groups_ += ',';
+            AppendInt(groups_, (long long)count);
+            groups_ += ',';
+            AppendInt(groups_, lost_total);
+            groups_ += ',';
+            AppendInt(groups_, lost_max);
+            groups_ += ']';
+        }
+        stack_.insert(stack_.end(), kids_.rbegin(), kids_.rend());
+    }
+
+    void BuildChunk(std::string& out) {
+        std::vector<std::vector<Entry>> parts;
+        parts.swap(chunks_[building_]);
+        uint32_t mark = (uint32_t)building_ + 1;
+        Select(mark, parts);
+
+        std::string nodes;
+        groups_.clear();
+        group_count_ = 0;
+        for (const std::vector<Entry>& roots : parts) {
+            stack_.assign(roots.rbegin(), roots.rend());
+            while (!stack_.empty()) {
+                Entry e = stack_.back();
+                stack_.pop_back();
+                WriteNode(e, mark, nodes);
+            }
+        }
+
+        out += "{\"names\":[";
+        for (size_t i = 0; i < used_.size(); ++i) {
+            if (i > 0) {
+                out += ',';
+            }
+            AppendJsonString(out, *tree_.names[used_[i]]);
+        }
+        out += "],\"hashes\":[";
+        for (size_t i = 0; i < used_.size(); ++i) {
+            if (i > 0) {
+                out += ',';
+            }
+            AppendInt(out, hashes_[used_[i]]);
+            local_[used_[i]] = FLAME_NONE;
+        }
+        used_.clear();
+        out += "],\"parts\":[";
+        for (size_t p = 0; p < parts.size(); ++p) {
+            if (p > 0) {
+                out += ',';
+            }
+            AppendInt(out, (long long)parts[p].size());
+        }
+        out += "],\"nodes\":[";
+        out += nodes;
+        out += "],\"groups\":[";
+        out += groups_;
+        out += "]}";
+    }
+
+    const FlameTree& tree_;
+    double min_fraction_;
+    size_t max_nodes_;
+    size_t building_;    // the chunk being written
+    size_t open_roots_;  // roots in the last chunk so far
+    std::vector<std::vector<std::vector<Entry>>> chunks_;  // parts by chunk
+    std::vector<uint32_t> kept_;  // id + 1 of the chunk a frame is kept in
+    std::vector<uint32_t> local_;
+    std::vector<uint32_t> used_;
+    std::vector<uint32_t> hashes_;
+    std::vector<bool> hashed_;
+    std::vector<double> thresholds_;
+    std::vector<Pending> queue_;
+    std::vector<Entry> stack_;
+    std::vector<Entry> kids_;
+    std::string groups_;
+    size_t group_count_;
+};
+
+}  // namespace
+
+
+struct FlameChunks*
+BuildFlameChunks(struct FlameTree* tree,
+                 double min_fraction,
+                 size_t max_nodes) {
+    FlameChunks* chunks = new FlameChunks();
+    ChunkBuilder(*tree, min_fraction, max_nodes).Build(chunks->data);
+    return chunks;
+}
+
+size_t
+FlameChunksCount(const struct FlameChunks* chunks) {
+    return chunks->data.size();
+}
+
+const char*
+FlameChunksData(const struct FlameChunks* chunks, size_t index, size_t* len) {
+    *len = chunks->data[index].size();
+    return chunks->data[index].data();
+}
+
+void
+FreeFlameChunks(struct FlameChunks* chunks) {
+    delete chunks;
+}
@@ -0,0 +1,94 @@
+#ifndef TELE_FLAMEGRAPH_H
+#define TELE_FLAMEGRAPH_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct FlameTree;
+struct StackTree;
+
+struct FlameGraphOptions {
+    int width;         // svg width in pixels
+    int frame_height;  // height of a single frame in pixels
+    double minwidth;   // narrower frames (pixels) are coalesced into one box
+    int inverted;      // render the root frame at the top
+    int differential;  // colour frames by their change against the baseline
+    const char* title;
+    const char* countname;
+    const char* const* header_lines;  // already wrapped header lines
+    size_t header_count;
+    const char* script;  // content of script.js
+};
+
+struct FlameTree*
+NewFlameTree(void);
+
+void
+FreeFlameTree(struct FlameTree* tree);
+
+// parse a folded line such as "a;b;c 10".
+// returns 0 on success (empty lines are skipped), -1 if the line is invalid
+int
+FlameTreeAddFolded(struct FlameTree* tree, const char* line, size_t len);
+
+// strip these prefixes, in order, from every frame name added afterwards.
+// names are shortened once per distinct symbol, not once per stack
+void
+FlameTreeSetStripPrefixes(struct FlameTree* tree,
+                          const char* const* prefixes,
+                          size_t count);
+
+// merge every stack of a sampler's StackTree, without dumping it to text
+void
+FlameTreeAddStackTree(struct FlameTree* tree, struct StackTree* stack_tree);
+
+long long
+FlameTreeTotal(struct FlameTree* tree);
+
+// While `baseline` is set, the stacks added count toward the old profile of
+// a differential flamegraph. Both profiles share the tree, so every frame
+// knows its old total. The new profile is added first: frames keep its
+// order and width, and frames that only the old profile has are not drawn.
+void
+FlameTreeSetBaseline(struct FlameTree* tree, int baseline);
+
+long long
+FlameTreeBaselineTotal(struct FlameTree* tree);
+
+// Frames are written level by level as the layout reaches them; the tree is
+// laid out twice so that the svg height and the differential colours are
+// known first. Returns 0 on success, -1 if the file can not be written.
+int
+RenderFlameGraph(struct FlameTree* tree,
+                 const char* filename,
+                 const struct FlameGraphOptions* options);
+
+// The call tree split into JSON chunks for the lazy html viewer
+// (viewer.js), chunk 0 holds the root frame.
+struct FlameChunks;
+
+// A chunk keeps the frames at least `min_fraction` of its own samples wide,
+// up to `max_nodes` of them and 64 levels below its roots. The children a
+// frame loses that way are moved together into a later chunk.
+struct FlameChunks*
+BuildFlameChunks(struct FlameTree* tree,
+                 double min_fraction,
+                 size_t max_nodes);
+
+size_t
+FlameChunksCount(const struct FlameChunks* chunks);
+
+const char*
+FlameChunksData(const struct FlameChunks* chunks, size_t index, size_t* len);
+
+void
+FreeFlameChunks(struct FlameChunks* chunks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
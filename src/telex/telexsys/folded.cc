@@ -0,0 +1,754 @@
+#include "folded.h"
+#include "compress.h"
+#include "folded_line.h"
+#include "tree_impl.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TELEX_HAVE_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+
+namespace {
+
+// inputs smaller than this per thread are not worth splitting
+const size_t kMinThreadBytes = 1 << 20;
+
+
+// A whole file, mapped where mmap is available, read otherwise. Gzipped
+// files are inflated, except the framed ones written by DumpGzip whose
+// members are inflated one at a time as they are parsed.
+class InputFile {
+  public:
+    InputFile() : data_(nullptr), size_(0), text_size_(0), mapped_(false) {}
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    ~InputFile() { Unmap(); }
+
+    // returns false and sets errno if the file can not be read
+    bool Open(const char* filename) {
+        if (!Read(filename)) {
+            return false;
+        }
+        text_size_ = size_;
+        if (!IsGzip(data_, size_) || FindMembers()) {
+            return true;
+        }
+        std::string text;
+        if (!Gunzip(data_, size_, text)) {
+            errno = GzipAvailable() ? EBADMSG : ENOSYS;
+            return false;
+        }
+        Unmap();
+        buffer_.swap(text);
+        data_ = buffer_.data();
+        size_ = text_size_ = buffer_.size();
+        return true;
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    // the size of the text, larger than size() for framed files
+    size_t text_size() const { return text_size_; }
+    bool framed() const { return !members_.empty(); }
+    // the offsets of the members of a framed file, then its size
+    const std::vector<size_t>& members() const { return members_; }
+
+  private:
+    // Walk the members by the sizes in their headers, a file that is not
+    // framed all the way through is inflated as a whole.
+    bool FindMembers() {
+        size_t offset = 0, text = 0;
+        while (offset < size_) {
+            size_t member = FramedMemberSize(data_ + offset, size_ - offset);
+            if (member < 8 || member > size_ - offset) {
+                members_.clear();
+                return false;
+            }
+            members_.push_back(offset);
+            offset += member;
+            // ISIZE, the last field of a member
+            const unsigned char* isize = (const unsigned char*)data_ + offset;
+            text += (size_t)isize[-4] | (size_t)isize[-3] << 8 |
+                    (size_t)isize[-2] << 16 | (size_t)isize[-1] << 24;
+        }
+        members_.push_back(size_);
+        text_size_ = text;
+        return true;
+    }
+
+    void Unmap() {
+#if !defined(_WIN32)
+        if (mapped_) {
+            munmap((void*)data_, size_);
+            mapped_ = false;
+        }
+#endif
+    }
+
+    bool Read(const char* filename) {
+#if !defined(_WIN32)
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return false;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            close(fd);
+            errno = EISDIR;
+            return false;
+        }
+        if (S_ISREG(st.st_mode)) {
+            size_ = (size_t)st.st_size;
+            if (size_ > 0) {
+                void* data =
+                    mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED) {
+                    int saved = errno;
+                    close(fd);
+                    errno = saved;
+                    return false;
+                }
+                data_ = (const char*)data;
+                mapped_ = true;
+            }
+            close(fd);
+            return true;
+        }
+        close(fd);
+#endif
+        // pipes and the like have no size to map
+        FILE* file = fopen(filename, "rb");
+        if (file == nullptr) {
+            return false;
+        }
+        char chunk[1 << 16];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            buffer_.append(chunk, n);
+        }
+        bool failed = ferror(file) != 0;
+        fclose(file);
+        if (failed) {
+            errno = EIO;
+            return false;
+        }
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+        return true;
+    }
+
+    const char* data_;
+    size_t size_;
+    size_t text_size_;
+    bool mapped_;
+    std::string buffer_;
+    std::vector<size_t> members_;
+};
+
+
+inline uint32_t
+HashBytes(const char* data, size_t size) {
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ size;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        hash = (hash ^ word) * 0xbf58476d1ce4e5b9ULL;
+        hash ^= hash >> 29;
+    }
+    uint64_t word = 0;
+    memcpy(&word, data, size);
+    hash = (hash ^ word) * 0x94d049bb133111ebULL;
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+inline uint64_t
+HashChild(uint32_t parent, uint32_t name) {
+    return (((uint64_t)parent << 32) | name) * 0x9e3779b97f4a7c15ULL;
+}
+
+
+// A frame name, it points into the input or into the names a trie keeps
+struct Name {
+    const char* data;
+    uint32_t size;
+    uint32_t hash;
+};
+
+struct TrieNode {
+    uint32_t parent;  // a node is always created after its parent
+    uint32_t name;
+    uint32_t child;    // the last child created, 0 for none
+    uint32_t sibling;  // the child of the parent created before this one
+    uint32_t children;
+    uint64_t cnt;
+};
+
+// children of wider nodes are found in a hash table instead of their list
+const uint32_t kWideNode = 16;
+
+// names copied by a trie are kept in blocks of this size
+const size_t kNameBlock = 1 << 16;
+
+
+// The stacks of one range of the input, node 0 is the root. Names are
+// interned, the few children of most nodes are linked in a list.
+class Trie {
+  public:
+    Trie()
+        : name_slots_(1 << 10, 0),
+          child_slots_(1 << 6),
+          wide_used_(0),
+          block_next_(nullptr),
+          block_left_(0) {
+        nodes_.push_back(TrieNode{0, 0, 0, 0, 0, 0});
+    }
+
+    // `copy` new names of a text that is overwritten before the trie is done
+    uint32_t Intern(const char* data,
+                    uint32_t size,
+                    uint32_t hash,
+                    bool copy = false) {
+        size_t mask = name_slots_.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            uint32_t slot = name_slots_[i];
+            if (slot == 0) {
+                break;
+            }
+            const Name& name = names_[slot - 1];
+            if (name.hash == hash && name.size == size &&
+                memcmp(name.data, data, size) == 0) {
+                return slot - 1;
+            }
+        }
+        uint32_t id = (uint32_t)names_.size();
+        names_.push_back(Name{copy ? Keep(data, size) : data, size, hash});
+        // keep the table at most half full
+        if (names_.size() * 2 > name_slots_.size()) {
+            std::vector<uint32_t> old(name_slots_.size() * 2, 0);
+            old.swap(name_slots_);
+            for (uint32_t each = 0; each < names_.size(); ++each) {
+                PlaceName(each);
+            }
+        } else {
+            PlaceName(id);
+        }
+        return id;
+    }
+
+    uint32_t Child(uint32_t parent, uint32_t name) {
+        if (nodes_[parent].children <= kWideNode) {
+            for (uint32_t child = nodes_[parent].child; child != 0;
+                 child = nodes_[child].sibling) {
+                if (nodes_[child].name == name) {
+                    return child;
+                }
+            }
+        } else {
+            size_t mask = child_slots_.size() - 1;
+            uint64_t hash = HashChild(parent, name);
+            for (size_t i = (size_t)(hash >> 32) & mask;;
+                 i = (i + 1) & mask) {
+                const ChildSlot& slot = child_slots_[i];
+                if (slot.node == 0) {
+                    break;
+                }
+                if (slot.parent == parent && slot.name == name) {
+                    return slot.node;
+                }
+            }
+        }
+        uint32_t id = (uint32_t)nodes_.size();
+        uint32_t sibling = nodes_[parent].child;
+        nodes_.push_back(TrieNode{parent, name, 0, sibling, 0, 0});
+        TrieNode& node = nodes_[parent];
+        node.child = id;
+        if (++node.children == kWideNode + 1) {
+            for (uint32_t child = id; child != 0;
+                 child = nodes_[child].sibling) {
+                AddWideChild(child);
+            }
+        } else if (node.children > kWideNode) {
+            AddWideChild(id);
+        }
+        return id;
+    }
+
+    void AddCount(uint32_t node, uint64_t count) { nodes_[node].cnt += count; }
+
+    // Add the stacks of `other`, whose names must outlive this trie, see
+    // Adopt. New children follow the existing ones, as if `other` was parsed
+    // after.
+    void Merge(const Trie& other) {
+        std::vector<uint32_t> names(other.names_.size(), UINT32_MAX);
+        std::vector<uint32_t> ids(other.nodes_.size(), 0);
+        for (size_t id = 1; id < other.nodes_.size(); ++id) {
+            const TrieNode& node = other.nodes_[id];
+            if (names[node.name] == UINT32_MAX) {
+                const Name& name = other.names_[node.name];
+                names[node.name] = Intern(name.data, name.size, name.hash);
+            }
+            ids[id] = Child(ids[node.parent], names[node.name]);
+            nodes_[ids[id]].cnt += node.cnt;
+        }
+    }
+
+    // take the names `other` copied, before it is freed
+    void Adopt(Trie& other) {
+        for (std::unique_ptr<char[]>& block : other.blocks_) {
+            blocks_.push_back(std::move(block));
+        }
+        other.blocks_.clear();
+    }
+
+    // Copy the stacks into `tree`, after the children it already has
+    void AddTo(StackTree* tree) const {
+        size_t n = nodes_.size();
+        std::vector<uint64_t> acc(n, 0);
+        for (size_t id = n - 1; id > 0; --id) {
+            acc[id] += nodes_[id].cnt;
+            acc[nodes_[id].parent] += acc[id];
+        }
+        // the last child of every node, and the last one it had before, up
+        // to which an existing child with the same name is looked for
+        std::vector<Node*> out(n, nullptr);
+        std::vector<Node*> last(n, nullptr);
+        std::vector<Node*> old_last(n, nullptr);
+        std::vector<uint32_t> depth(n, 0);
+        out[0] = tree->root;
+        for (Node* child = tree->root->child; child; child = child->sibling) {
+            old_last[0] = last[0] = child;
+        }
+        for (size_t id = 1; id < n; ++id) {
+            uint32_t parent = nodes_[id].parent;
+            const Name& name = names_[nodes_[id].name];
+            depth[id] = depth[parent] + 1;
+            Node* node = nullptr;
+            for (Node* child = old_last[parent] ? out[parent]->child : nullptr;
+                 child != nullptr;
+                 child = child->sibling) {
+                if (child->name.size() == name.size &&
+                    memcmp(child->name.data(), name.data, name.size) == 0) {
+                    node = child;
+                    break;
+                }
+                if (child == old_last[parent]) {
+                    break;
+                }
+            }
+            if (node != nullptr) {
+                for (Node* each = node->child; each; each = each->sibling) {
+                    old_last[id] = last[id] = each;
+                }
+            } else {
+                node = tree->NewNode(out[parent], name.data, name.size,
+                                     depth[id]);
+                if (last[parent] != nullptr) {
+                    last[parent]->sibling = node;
+                } else {
+                    out[parent]->child = node;
+                }
+                last[parent] = node;
+            }
+            node->cnt += nodes_[id].cnt;
+            node->acc_cnt += acc[id];
+            out[id] = node;
+        }
+        tree->root->acc_cnt += acc[0];
+    }
+
+  private:
+    const char* Keep(const char* data, uint32_t size) {
+        if (size > block_left_) {
+            size_t block = std::max<size_t>(kNameBlock, size);
+            blocks_.emplace_back(new char[block]);
+            block_next_ = blocks_.back().get();
+            block_left_ = block;
+        }
+        char* kept = block_next_;
+        memcpy(kept, data, size);
+        block_next_ += size;
+        block_left_ -= size;
+        return kept;
+    }
+
+    void PlaceName(uint32_t id) {
+        size_t mask = name_slots_.size() - 1;
+        size_t i = names_[id].hash & mask;
+        while (name_slots_[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        name_slots_[i] = id + 1;
+    }
+
+    void AddWideChild(uint32_t id) {
+        // keep the table at most half full
+        if (++wide_used_ * 2 > child_slots_.size()) {
+            std::vector<ChildSlot> old(child_slots_.size() * 2);
+            old.swap(child_slots_);
+            for (const ChildSlot& slot : old) {
+                if (slot.node != 0) {
+                    PlaceChild(slot);
+                }
+            }
+        }
+        const TrieNode& node = nodes_[id];
+        PlaceChild(ChildSlot{node.parent, node.name, id});
+    }
+
+    // the key is kept in the slot, a probe touches no node
+    struct ChildSlot {
+        uint32_t parent;
+        uint32_t name;
+        uint32_t node;  // 0 (the root) when empty
+    };
+
+    void PlaceChild(const ChildSlot& slot) {
+        size_t mask = child_slots_.size() - 1;
+        uint64_t hash = HashChild(slot.parent, slot.name);
+        size_t i = (size_t)(hash >> 32) & mask;
+        while (child_slots_[i].node != 0) {
+            i = (i + 1) & mask;
+        }
+        child_slots_[i] = slot;
+    }
+
+    std::vector<Name> names_;
+    std::vector<TrieNode> nodes_;
+    std::vector<uint32_t> name_slots_;   // name id + 1, 0 when empty
+    std::vector<ChildSlot> child_slots_;  // children of wide nodes
+    size_t wide_used_;
+    std::vector<std::unique_ptr<char[]>> blocks_;  // copied names
+    char* block_next_;
+    size_t block_left_;
+};
+
+
+#if defined(TELEX_HAVE_SSE2)
+inline int
+CountTrailingZeros(unsigned mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+
+struct Range {
+    const char* begin;
+    const char* end;
+    size_t file;  // the index of the file the range is part of
+    bool framed;  // whole gzip members of a framed file instead of text
+};
+
+
+// Parse whole lines into a trie. The input is scanned for '\n' 16 bytes at
+// a time, every line is split by ParseFoldedLine.
+class Parser {
+  public:
+    explicit Parser(Trie& trie) : trie_(trie), stats_(), transient_(false) {}
+
+    // `transient` text is overwritten once it is parsed, see Forget
+    void Parse(const char* begin, const char* end, bool transient = false) {
+        transient_ = transient;
+        const char* line = begin;
+        const char* p = begin;
+#if defined(TELEX_HAVE_SSE2)
+        const __m128i newline = _mm_set1_epi8('\n');
+        for (; end - p >= 16; p += 16) {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+            unsigned mask =
+                (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline));
+            for (; mask != 0; mask &= mask - 1) {
+                const char* stop = p + CountTrailingZeros(mask);
+                AddLine(line, stop);
+                line = stop + 1;
+            }
+        }
+#endif
+        for (; p < end; ++p) {
+            if (*p == '\n') {
+                AddLine(line, p);
+                line = p + 1;
+            }
+        }
+        if (line < end) {
+            AddLine(line, end);
+        }
+    }
+
+    const FoldedStats& stats() const { return stats_; }
+
+    // called before the text parsed so far is overwritten
+    void Forget() { path_.clear(); }
+
+  private:
+    struct Frame {
+        const char* data;
+        uint32_t size;
+        uint32_t node;  // only set in path_
+    };
+
+    // the tree keeps no negative counts, such lines are invalid
+    void AddLine(const char* begin, const char* end) {
+        FoldedLine line;
+        int parsed = ParseFoldedLine(begin, end - begin, &line);
+        if (parsed == 0) {
+            return;
+        }
+        if (parsed < 0 || line.count < 0) {
+            stats_.invalid++;
+            return;
+        }
+        frames_.clear();
+        ForEachFrame(line, [this](const char* frame, size_t size) {
+            frames_.push_back(Frame{frame, (uint32_t)size, 0});
+        });
+        AddStack((unsigned long long)line.count);
+        stats_.lines++;
+        stats_.samples += line.count;
+    }
+
+    // consecutive lines mostly share a prefix, it is compared with the
+    // previous line before any lookup
+    void AddStack(unsigned long long count) {
+        uint32_t node = 0;
+        bool same = true;
+        for (size_t depth = 0; depth < frames_.size(); ++depth) {
+            const Frame& frame = frames_[depth];
+            if (same && depth < path_.size() &&
+                path_[depth].size == frame.size &&
+                memcmp(path_[depth].data, frame.data, frame.size) == 0) {
+                node = path_[depth].node;
+                continue;
+            }
+            if (same) {
+                same = false;
+                path_.resize(depth);
+            }
+            uint32_t name = trie_.Intern(frame.data,
+                                         frame.size,
+                                         HashBytes(frame.data, frame.size),
+                                         transient_);
+            node = trie_.Child(node, name);
+            path_.push_back(Frame{frame.data, frame.size, node});
+        }
+        trie_.AddCount(node, count);
+    }
+
+    Trie& trie_;
+    FoldedStats stats_;
+    bool transient_;
+    std::vector<Frame> frames_;
+    std::vector<Frame> path_;  // the frames of the last line added
+};
+
+
+// Split the files into `n` runs of whole lines of about the same size
+std::vector<std::vector<Range>>
+SplitRanges(const std::vector<InputFile>& files, size_t total, size_t n) {
+    std::vector<std::vector<Range>> ranges(n);
+    size_t file = 0, offset = 0, done = 0;
+    for (size_t k = 0; k < n; ++k) {
+        size_t target = k + 1 == n ? total : total / n * (k + 1);
+        while (done < target && file < files.size()) {
+            const char* data = files[file].data();
+            size_t size = files[file].size();
+            size_t stop = offset + std::min(size - offset, target - done);
+            if (files[file].framed()) {
+                // members are not split, they are inflated whole
+                const std::vector<size_t>& members = files[file].members();
+                stop = *std::lower_bound(members.begin(), members.end(), stop);
+            } else if (stop < size) {
+                const void* newline = memchr(data + stop, '\n', size - stop);
+                stop = newline ? (size_t)((const char*)newline - data) + 1
+                               : size;
+            }
+            if (stop > offset) {
+                ranges[k].push_back(Range{
+                    data + offset, data + stop, file, files[file].framed()});
+            }
+            done += stop - offset;
+            offset = stop;
+            if (offset == size) {
+                file++;
+                offset = 0;
+            }
+        }
+    }
+    return ranges;
+}
+
+// returns false and stores the index of the file in `failed` if a gzip
+// member can not be inflated
+bool
+ParseRanges(const std::vector<Range>& ranges,
+            Trie& trie,
+            FoldedStats& stats,
+            size_t& failed) {
+    Parser parser(trie);
+    std::string text;
+    for (const Range& range : ranges) {
+        if (!range.framed) {
+            parser.Parse(range.begin, range.end);
+            continue;
+        }
+        for (const char* p = range.begin; p < range.end;) {
+            size_t member = FramedMemberSize(p, (size_t)(range.end - p));
+            text.clear();
+            if (!Gunzip(p, member, text)) {
+                failed = range.file;
+                return false;
+            }
+            parser.Parse(text.data(), text.data() + text.size(), true);
+            parser.Forget();
+            p += member;
+        }
+    }
+    stats = parser.stats();
+    return true;
+}
+
+}  // namespace
+
+
+int
+LoadFolded(const char* const* filenames,
+           size_t count,
+           int threads,
+           StackTree* tree,
+           FoldedStats* stats,
+           size_t* failed) {
+    std::vector<InputFile> files(count);
+    size_t total = 0, text = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!files[i].Open(filenames[i])) {
+            *failed = i;
+            return -1;
+        }
+        total += files[i].size();
+        text += files[i].text_size();
+    }
+
+    size_t n = threads > 0 ? (size_t)threads
+                           : (size_t)std::thread::hardware_concurrency();
+    n = std::max<size_t>(1, std::min(n, text / kMinThreadBytes));
+    std::vector<std::vector<Range>> ranges = SplitRanges(files, total, n);
+    std::vector<Trie> tries(n);
+    std::vector<FoldedStats> parsed(n);
+    std::vector<size_t> failures(n, count);
+    std::vector<std::thread> workers;
+    size_t started = 1;
+    for (; started < n; ++started) {
+        try {
+            workers.emplace_back(ParseRanges,
+                                 std::cref(ranges[started]),
+                                 std::ref(tries[started]),
+                                 std::ref(parsed[started]),
+                                 std::ref(failures[started]));
+        } catch (const std::system_error&) {
+            break;  // out of threads, the rest is parsed here
+        }
+    }
+    ParseRanges(ranges[0], tries[0], parsed[0], failures[0]);
+    for (size_t k = started; k < n; ++k) {
+        ParseRanges(ranges[k], tries[k], parsed[k], failures[k]);
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (size_t k = 0; k < n; ++k) {
+        if (failures[k] != count) {
+            *failed = failures[k];
+            errno = GzipAvailable() ? EBADMSG : ENOSYS;
+            return -1;
+        }
+    }
+
+    // in input order, the first range's trie collects the others
+    for (size_t k = 1; k < n; ++k) {
+        tries[0].Merge(tries[k]);
+        tries[0].Adopt(tries[k]);
+        tries[k] = Trie();
+    }
+    tries[0].AddTo(tree);
+
+    stats->bytes += (long long)total;
+    for (const FoldedStats& each : parsed) {
+        stats->lines += each.lines;
+        stats->invalid += each.invalid;
+        stats->samples += each.samples;
+    }
+    stats->threads = (int)n;
+    return 0;
+}
+
+
+int
+AddFolded(StackTree* tree, const char* line, size_t size, long long* added) {
+    FoldedLine folded;
+    int parsed = ParseFoldedLine(line, size, &folded);
+    if (parsed <= 0 || folded.count < 0) {
+        return parsed == 0 ? 0 : -1;
+    }
+    uint64_t count = (uint64_t)folded.count;
+    Node* node = tree->root;
+    node->acc_cnt += count;
+    size_t depth = 0;
+    ForEachFrame(folded, [&](const char* frame, size_t len) {
+        depth++;
+        Node* last = nullptr;
+        Node* child = node->child;
+        for (; child != nullptr; last = child, child = child->sibling) {
+            if (child->name.size() == len &&
+                memcmp(child->name.data(), frame, len) == 0) {
+                break;
+            }
+        }
+        if (child == nullptr) {
+            child = tree->NewNode(node, frame, len, depth);
+            if (last != nullptr) {
+                last->sibling = child;
+            } else {
+                node->child = child;
+            }
+        }
+        node = child;
+        node->acc_cnt += count;
+    });
+    node->cnt += count;
+    *added = folded.count;
+    return 1;
+}
@@ -0,0 +1,51 @@
+#ifndef TELE_FOLDED_H
+#define TELE_FOLDED_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct StackTree;
+
+struct FoldedStats {
+    long long bytes;    // size of the input, compressed or not
+    long long lines;    // stack lines added, empty lines are not counted
+    long long invalid;  // lines without a count, which are skipped
+    long long samples;  // the sum of the counts
+    int threads;        // parser threads used by the last load
+};
+
+// Add the stacks of folded files such as "a;b;c 10" to `tree`. The files are
+// mapped and split into line aligned ranges, one per thread, every range is
+// parsed into a trie of its own and the tries are merged in input order, so
+// the result does not depend on the number of threads. `threads` <= 0 uses
+// one per CPU, small inputs use fewer. Gzipped files are detected by their
+// magic bytes, the ones written by DumpGzip are split between threads by
+// their members.
+// returns 0 on success, -1 and sets errno if a file can not be read (EBADMSG
+// if it is not valid gzip, ENOSYS for gzip where zlib is not available), its
+// index is stored in `failed`
+int
+LoadFolded(const char* const* filenames,
+           size_t count,
+           int threads,
+           struct StackTree* tree,
+           struct FoldedStats* stats,
+           size_t* failed);
+
+// add a single folded line to `tree`.
+// returns 1 and stores the count of the line in `count` if it is added, 0 if
+// it is empty, -1 if it is invalid or its count is negative
+int
+AddFolded(struct StackTree* tree,
+          const char* line,
+          size_t size,
+          long long* count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef TELE_FOLDED_LINE_H
+#define TELE_FOLDED_LINE_H
+
+// The rules of a line of folded stacks, "frame;frame;...;frame count",
+// shared by every native reader of them: the flamegraph, the pprof writer
+// and the folded loader.
+
+#include <climits>
+#include <cstddef>
+#include <cstring>
+
+
+// the characters str.strip() removes from a line, in the C locale
+inline bool
+IsFoldedSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+           c == '\f';
+}
+
+struct FoldedLine {
+    const char* stack;  // the frames, separated by ';'
+    size_t size;
+    long long count;
+};
+
+// line.strip().rsplit(" ", 1): the stack, and the count after the last
+// space, an integer with an optional sign. Returns 0 for a blank line, -1
+// when there is no count or it does not fit a long long, 1 otherwise.
+inline int
+ParseFoldedLine(const char* line, size_t len, FoldedLine* out) {
+    while (len > 0 && IsFoldedSpace(line[0])) {
+        line++;
+        len--;
+    }
+    while (len > 0 && IsFoldedSpace(line[len - 1])) {
+        len--;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    const char* space = line + len - 1;
+    while (space > line && *space != ' ') {
+        space--;
+    }
+    if (*space != ' ') {
+        return -1;
+    }
+    const char* p = space + 1;
+    const char* end = line + len;
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        p++;
+    }
+    if (p == end) {
+        return -1;
+    }
+    long long count = 0;
+    for (; p < end; ++p) {
+        if (*p < '0' || *p > '9' || count > (LLONG_MAX - (*p - '0')) / 10) {
+            return -1;
+        }
+        count = count * 10 + (*p - '0');
+    }
+    out->stack = line;
+    out->size = (size_t)(space - line);
+    out->count = negative ? -count : count;
+    return 1;
+}
+
+// call `visit(frame, size)` for every frame of the stack of `line`, the
+// outermost first
+template <typename Visit>
+inline void
+ForEachFrame(const FoldedLine& line, Visit visit) {
+    const char* frame = line.stack;
+    const char* end = line.stack + line.size;
+    for (;;) {
+        const char* stop = (const char*)memchr(frame, ';', end - frame);
+        if (stop == nullptr) {
+            visit(frame, (size_t)(end - frame));
+            return;
+        }
+        visit(frame, (size_t)(stop - frame));
+        frame = stop + 1;
+    }
+}
+
+#endif
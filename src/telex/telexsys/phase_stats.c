@@ -0,0 +1,68 @@
+#include "phase_stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+const char* const PhaseNames[PHASE_COUNT] = {
+    "round",
+    "current_frames",
+    "threads",
+    "thread_name",
+    "frame_walk",
+    "filter",
+    "format",
+    "add",
+};
+
+struct PhaseStats*
+NewPhaseStats(void) {
+    return (struct PhaseStats*)calloc(1, sizeof(struct PhaseStats));
+}
+
+void
+FreePhaseStats(struct PhaseStats* stats) {
+    free(stats);
+}
+
+void
+ClearPhaseStats(struct PhaseStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+void
+PhaseStatsAdd(struct PhaseStats* stats,
+              enum SamplerPhase phase,
+              unsigned long long ns) {
+    struct PhaseHistogram* h = &stats->phases[phase];
+    int bucket = 0;
+    for (unsigned long long n = ns; n > 1 && bucket < PHASE_BUCKETS - 1;
+         n >>= 1) {
+        ++bucket;
+    }
+    h->count++;
+    h->total_ns += ns;
+    if (ns > h->max_ns) {
+        h->max_ns = ns;
+    }
+    h->buckets[bucket]++;
+}
+
+unsigned long long
+PhaseStatsQuantile(const struct PhaseStats* stats,
+                   enum SamplerPhase phase,
+                   double q) {
+    const struct PhaseHistogram* h = &stats->phases[phase];
+    if (h->count == 0) {
+        return 0;
+    }
+    unsigned long long rank = (unsigned long long)(q * (double)h->count);
+    unsigned long long seen = 0;
+    for (int i = 0; i < PHASE_BUCKETS; ++i) {
+        seen += h->buckets[i];
+        if (seen > rank) {
+            unsigned long long upper = 2ull << i;
+            return upper < h->max_ns ? upper : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
@@ -0,0 +1,76 @@
+#ifndef TELE_PHASE_STATS_H
+#define TELE_PHASE_STATS_H
+
+// clock_gettime() and CLOCK_MONOTONIC on Windows, Python.h comes first
+#include "compat.h"
+
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The time a sampler spends in each phase of a sampling round, kept when
+// its phase_stats option is set. Every phase keeps a histogram with log2
+// buckets of nanoseconds: bucket i counts durations in [2^i, 2^(i+1)).
+enum SamplerPhase {
+    PHASE_ROUND,           // the whole round, every thread included
+    PHASE_CURRENT_FRAMES,  // _PyThread_CurrentFrames()
+    PHASE_THREADS,         // the list of threading.Thread objects
+    PHASE_THREAD_NAME,     // the name of a thread, get_thread_name()
+    PHASE_FRAME_WALK,      // collecting the frames of a thread
+    PHASE_FILTER,          // the filters of all the frames of a thread
+    PHASE_FORMAT,          // snprintf of all the frames of a thread
+    PHASE_ADD,             // AddCallStack, the sample log and the ring
+    PHASE_COUNT,
+};
+
+#define PHASE_BUCKETS 40
+
+struct PhaseHistogram {
+    unsigned long long count;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+    unsigned long long buckets[PHASE_BUCKETS];
+};
+
+struct PhaseStats {
+    struct PhaseHistogram phases[PHASE_COUNT];
+};
+
+extern const char* const PhaseNames[PHASE_COUNT];
+
+struct PhaseStats*
+NewPhaseStats(void);
+
+void
+FreePhaseStats(struct PhaseStats* stats);
+
+void
+ClearPhaseStats(struct PhaseStats* stats);
+
+void
+PhaseStatsAdd(struct PhaseStats* stats,
+              enum SamplerPhase phase,
+              unsigned long long ns);
+
+// the upper bound in nanoseconds of the bucket holding the q-quantile of
+// `phase`, 0 if nothing was recorded
+unsigned long long
+PhaseStatsQuantile(const struct PhaseStats* stats,
+                   enum SamplerPhase phase,
+                   double q);
+
+static inline unsigned long long
+PhaseNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull +
+           (unsigned long long)ts.tv_nsec;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
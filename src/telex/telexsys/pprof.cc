@@ -0,0 +1,402 @@
+#include "pprof.h"
+#include "encode.h"
+#include "folded_line.h"
+#include "tree_impl.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#define TELEX_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+
+// ---------------------------------------------------------------------------
+// profile.proto, see
+// https://github.com/google/pprof/blob/main/proto/profile.proto
+//
+// Every field of Profile is either a scalar or a repeated message, and the
+// fields may come in any order, so the message is written front to back
+// without knowing its size: samples as the stacks are walked, then the
+// location, function and string tables collected on the way.
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// Profile
+const int kSampleType = 1;
+const int kSample = 2;
+const int kLocation = 4;
+const int kFunction = 5;
+const int kStringTable = 6;
+const int kTimeNanos = 9;
+const int kDurationNanos = 10;
+const int kPeriodType = 11;
+const int kPeriod = 12;
+// ValueType
+const int kValueTypeType = 1;
+const int kValueTypeUnit = 2;
+// Sample
+const int kSampleLocationId = 1;
+const int kSampleValue = 2;
+// Location
+const int kLocationId = 1;
+const int kLocationLine = 4;
+// Line
+const int kLineFunctionId = 1;
+const int kLineLine = 2;
+// Function
+const int kFunctionId = 1;
+const int kFunctionName = 2;
+const int kFunctionSystemName = 3;
+const int kFunctionFilename = 4;
+
+const int kVarint = 0;
+const int kLengthDelimited = 2;
+
+void
+PutTag(std::string& out, int field, int wire_type) {
+    PutVarint(out, ((uint64_t)field << 3) | (uint64_t)wire_type);
+}
+
+void
+PutInt(std::string& out, int field, uint64_t value) {
+    PutTag(out, field, kVarint);
+    PutVarint(out, value);
+}
+
+void
+PutBytes(std::string& out, int field, const char* data, size_t len) {
+    PutTag(out, field, kLengthDelimited);
+    PutVarint(out, len);
+    out.append(data, len);
+}
+
+void
+PutPacked(std::string& out, int field, const std::vector<uint64_t>& values) {
+    size_t len = 0;
+    for (uint64_t value : values) {
+        do {
+            len++;
+            value >>= 7;
+        } while (value != 0);
+    }
+    PutTag(out, field, kLengthDelimited);
+    PutVarint(out, len);
+    for (uint64_t value : values) {
+        PutVarint(out, value);
+    }
+}
+
+
+// The file, gzipped unless asked otherwise. Small writes are gathered so
+// that deflate and fwrite see large blocks.
+class Output {
+  public:
+    explicit Output(FILE* file, bool compress) : file_(file), ok_(true) {
+#ifdef TELEX_HAVE_ZLIB
+        compress_ = compress;
+        if (compress_) {
+            memset(&stream_, 0, sizeof(stream_));
+            // 16 + MAX_WBITS: a gzip header instead of a zlib one
+            ok_ = deflateInit2(&stream_,
+                               Z_DEFAULT_COMPRESSION,
+                               Z_DEFLATED,
+                               16 + MAX_WBITS,
+                               8,
+                               Z_DEFAULT_STRATEGY) == Z_OK;
+        }
+#else
+        (void)compress;
+#endif
+        buffer_.reserve(kBlockSize);
+    }
+
+    ~Output() {
+#ifdef TELEX_HAVE_ZLIB
+        if (compress_) {
+            deflateEnd(&stream_);
+        }
+#endif
+    }
+
+    // the caller builds a message in `buffer()` and writes it out here
+    std::string& buffer() { return buffer_; }
+
+    void MaybeFlush() {
+        if (buffer_.size() >= kBlockSize) {
+            Flush(false);
+        }
+    }
+
+    // returns false if anything could not be written
+    bool Finish() {
+        Flush(true);
+        return ok_;
+    }
+
+  private:
+    static const size_t kBlockSize = 1 << 16;
+
+    void Flush(bool last) {
+        if (!ok_) {
+            buffer_.clear();
+            return;
+        }
+#ifdef TELEX_HAVE_ZLIB
+        if (compress_) {
+            unsigned char out[kBlockSize];
+            stream_.next_in = (unsigned char*)buffer_.data();
+            stream_.avail_in = (uInt)buffer_.size();
+            int ret;
+            do {
+                stream_.next_out = out;
+                stream_.avail_out = sizeof(out);
+                ret = deflate(&stream_, last ? Z_FINISH : Z_NO_FLUSH);
+                if (ret == Z_STREAM_ERROR) {
+                    ok_ = false;
+                    break;
+                }
+                size_t n = sizeof(out) - stream_.avail_out;
+                if (fwrite(out, 1, n, file_) != n) {
+                    ok_ = false;
+                    break;
+                }
+            } while (stream_.avail_out == 0 || (last && ret != Z_STREAM_END));
+            buffer_.clear();
+            return;
+        }
+#else
+        (void)last;
+#endif
+        if (fwrite(buffer_.data(), 1, buffer_.size(), file_) !=
+            buffer_.size()) {
+            ok_ = false;
+        }
+        buffer_.clear();
+    }
+
+    FILE* file_;
+    bool ok_;
+    std::string buffer_;
+#ifdef TELEX_HAVE_ZLIB
+    bool compress_;
+    z_stream stream_;
+#endif
+};
+
+}  // namespace
+
+
+struct PprofWriter {
+    FILE* file;
+    Output out;
+    bool period;  // whether samples carry a second value
+    long long period_ns;
+    long long total;
+
+    std::unordered_map<std::string, uint64_t> strings;
+    std::vector<const std::string*> string_table;
+    // "file:function:line" frame name -> location id
+    std::unordered_map<std::string, uint64_t> locations;
+    // the frame name of each location, in id order
+    std::vector<const std::string*> location_names;
+    // "file:function" -> function id
+    std::unordered_map<std::string, uint64_t> functions;
+
+    std::string message;  // scratch space for nested messages
+    std::vector<uint64_t> values;
+
+    PprofWriter(FILE* f, const PprofOptions* options)
+        : file(f),
+          out(f, options->compress != 0),
+          period(options->period > 0),
+          period_ns(options->period),
+          total(0) {
+        String("");  // string_table[0] must be ""
+        std::string& buf = out.buffer();
+        message.clear();
+        PutInt(message, kValueTypeType, String("samples"));
+        PutInt(message, kValueTypeUnit, String("count"));
+        PutBytes(buf, kSampleType, message.data(), message.size());
+        if (period) {
+            message.clear();
+            PutInt(message, kValueTypeType, String(options->sample_type));
+            PutInt(message, kValueTypeUnit, String("nanoseconds"));
+            PutBytes(buf, kSampleType, message.data(), message.size());
+            PutBytes(buf, kPeriodType, message.data(), message.size());
+            PutInt(buf, kPeriod, (uint64_t)options->period);
+        }
+        if (options->time_nanos > 0) {
+            PutInt(buf, kTimeNanos, (uint64_t)options->time_nanos);
+        }
+        if (options->duration_nanos > 0) {
+            PutInt(buf, kDurationNanos, (uint64_t)options->duration_nanos);
+        }
+    }
+
+    uint64_t String(const std::string& s) {
+        auto it = strings.emplace(s, (uint64_t)string_table.size());
+        if (it.second) {
+            string_table.push_back(&it.first->first);
+        }
+        return it.first->second;
+    }
+
+    uint64_t Location(const char* name, size_t len) {
+        auto it = locations.emplace(std::string(name, len),
+                                    (uint64_t)location_names.size() + 1);
+        if (it.second) {
+            location_names.push_back(&it.first->first);
+        }
+        return it.first->second;
+    }
+
+    // stack holds location ids from the root frame to the leaf
+    void AddSample(const std::vector<uint64_t>& stack, long long count) {
+        total += count;
+        if (stack.empty()) {
+            return;
+        }
+        message.clear();
+        values.assign(stack.rbegin(), stack.rend());  // leaf first
+        PutPacked(message, kSampleLocationId, values);
+        values.clear();
+        values.push_back((uint64_t)count);
+        if (period) {
+            values.push_back((uint64_t)(count * period_ns));
+        }
+        PutPacked(message, kSampleValue, values);
+        PutBytes(out.buffer(), kSample, message.data(), message.size());
+        out.MaybeFlush();
+    }
+
+    void WriteTables();
+};
+
+void
+PprofWriter::WriteTables() {
+    std::string& buf = out.buffer();
+    std::string line;
+    for (size_t i = 0; i < location_names.size(); ++i) {
+        Frame frame = SplitFrame(*location_names[i]);
+        std::string key = frame.filename + ':' + frame.function;
+        auto it = functions.emplace(key, (uint64_t)functions.size() + 1);
+        uint64_t function_id = it.first->second;
+        if (it.second) {
+            uint64_t name = String(frame.function);
+            message.clear();
+            PutInt(message, kFunctionId, function_id);
+            PutInt(message, kFunctionName, name);
+            PutInt(message, kFunctionSystemName, name);
+            PutInt(message, kFunctionFilename, String(frame.filename));
+            PutBytes(buf, kFunction, message.data(), message.size());
+        }
+        line.clear();
+        PutInt(line, kLineFunctionId, function_id);
+        if (frame.line > 0) {
+            PutInt(line, kLineLine, frame.line);
+        }
+        message.clear();
+        PutInt(message, kLocationId, i + 1);
+        PutBytes(message, kLocationLine, line.data(), line.size());
+        PutBytes(buf, kLocation, message.data(), message.size());
+        out.MaybeFlush();
+    }
+    // functions may add strings, so the table goes last
+    for (const std::string* s : string_table) {
+        PutBytes(buf, kStringTable, s->data(), s->size());
+        out.MaybeFlush();
+    }
+}
+
+
+struct PprofWriter*
+NewPprofWriter(const char* filename, const struct PprofOptions* options) {
+#ifndef TELEX_HAVE_ZLIB
+    // rather than a file named for gzip that is not
+    if (options->compress) {
+        errno = ENOSYS;
+        return nullptr;
+    }
+#endif
+    FILE* file = fopen(filename, "wb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+    return new PprofWriter(file, options);
+}
+
+void
+PprofWriterAddStackTree(struct PprofWriter* writer, struct StackTree* tree) {
+    // Preorder walk as in FlameTreeAddStackTree, `stack` holds the location
+    // ids of the frames above the node being visited.
+    struct Pending {
+        const Node* node;
+        size_t depth;
+    };
+    std::vector<Pending> pending;
+    std::vector<uint64_t> stack;
+    if (tree->root->child != nullptr) {
+        pending.push_back(Pending{tree->root->child, 0});
+    }
+    while (!pending.empty()) {
+        Pending p = pending.back();
+        pending.pop_back();
+        if (p.node->sibling != nullptr) {
+            pending.push_back(Pending{p.node->sibling, p.depth});
+        }
+        const std::string& name = p.node->name;
+        stack.resize(p.depth);
+        stack.push_back(writer->Location(name.data(), name.size()));
+        if (p.node->cnt > 0) {
+            writer->AddSample(stack, (long long)p.node->cnt);
+        }
+        if (p.node->child != nullptr) {
+            pending.push_back(Pending{p.node->child, p.depth + 1});
+        }
+    }
+}
+
+int
+PprofWriterAddFolded(struct PprofWriter* writer,
+                     const char* line,
+                     size_t len) {
+    FoldedLine folded;
+    int parsed = ParseFoldedLine(line, len, &folded);
+    if (parsed <= 0) {
+        return parsed;
+    }
+    std::vector<uint64_t> stack;
+    ForEachFrame(folded, [&](const char* frame, size_t size) {
+        stack.push_back(writer->Location(frame, size));
+    });
+    writer->AddSample(stack, folded.count);
+    return 0;
+}
+
+long long
+PprofWriterTotal(const struct PprofWriter* writer) {
+    return writer->total;
+}
+
+int
+ClosePprofWriter(struct PprofWriter* writer) {
+    writer->WriteTables();
+    bool ok = writer->out.Finish();
+    FILE* file = writer->file;
+    delete writer;
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok && errno == 0) {
+        errno = EIO;
+    }
+    return ok ? 0 : -1;
+}
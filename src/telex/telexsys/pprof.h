@@ -0,0 +1,52 @@
+#ifndef TELE_PPROF_H
+#define TELE_PPROF_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct PprofWriter;
+struct StackTree;
+
+struct PprofOptions {
+    // the second sample type, e.g. "cpu" or "wall", measured in nanoseconds.
+    // it is only written when `period` is set
+    const char* sample_type;
+    long long period;          // nanoseconds between two samples
+    long long time_nanos;      // when the profile was started
+    long long duration_nanos;  // how long it was collected for
+    int compress;              // gzip the output, as `go tool pprof` expects
+};
+
+// Write a profile.proto message to `filename` while the stacks are added:
+// samples go out as soon as they are seen and only the string, function and
+// location tables are kept until the end.
+// returns NULL and sets errno if the file can not be created, ENOSYS if it
+// is to be compressed where zlib is not available
+struct PprofWriter*
+NewPprofWriter(const char* filename, const struct PprofOptions* options);
+
+// add every stack of a sampler's StackTree, one sample per leaf node
+void
+PprofWriterAddStackTree(struct PprofWriter* writer, struct StackTree* tree);
+
+// parse a folded line such as "a;b;c 10".
+// returns 0 on success (empty lines are skipped), -1 if the line is invalid
+int
+PprofWriterAddFolded(struct PprofWriter* writer, const char* line, size_t len);
+
+long long
+PprofWriterTotal(const struct PprofWriter* writer);
+
+// write the tables and free the writer.
+// returns 0 on success, -1 and sets errno if the file can not be written
+int
+ClosePprofWriter(struct PprofWriter* writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
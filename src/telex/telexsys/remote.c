@@ -0,0 +1,630 @@
+// The interpreter structs are read the way this Python lays them out, which
+// needs the internal headers.
+#define Py_BUILD_CORE 1
+#include <Python.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "remote.h"
+
+#if defined(__linux__) && PY_VERSION_HEX >= 0x030B0000 && \
+    PY_VERSION_HEX < 0x030D0000
+#define REMOTE_SUPPORTED
+#endif
+
+#ifdef REMOTE_SUPPORTED
+
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "internal/pycore_runtime.h"
+#include "internal/pycore_interp.h"
+#include "internal/pycore_frame.h"
+#include "internal/pycore_code.h"
+
+// bounds on what is read, a target changing under the reader may link its
+// structs into loops or point at garbage
+#define REMOTE_MAX_INTERPRETERS 64
+#define REMOTE_MAX_THREADS 4096
+#define REMOTE_MAX_DEPTH 1024
+#define REMOTE_MAX_NAME 4096
+
+#if defined(__LP64__)
+#define REMOTE_ELF_CLASS ELFCLASS64
+#else
+#define REMOTE_ELF_CLASS ELFCLASS32
+#endif
+
+// a code object seen before, with the fields its frame name is made of so
+// that a code object freed and another allocated at its address is noticed
+struct CodeEntry {
+    uintptr_t code;  // 0 for an empty slot
+    uintptr_t filename;
+    uintptr_t qualname;
+    int firstlineno;
+    char* frame;  // "file:qualname:firstlineno"
+};
+
+struct RemoteFrame {
+    uintptr_t code;
+    uintptr_t filename;
+    uintptr_t qualname;
+    int firstlineno;
+};
+
+struct RemoteProcess {
+    pid_t pid;
+    uintptr_t runtime;  // the address of _PyRuntime in the process
+    struct CodeEntry* codes;
+    size_t codes_size;  // a power of two
+    size_t codes_used;
+    struct RemoteFrame frames[REMOTE_MAX_DEPTH];
+    char* stack;
+    size_t stack_size;
+};
+
+static int
+ReadRemote(pid_t pid, uintptr_t addr, void* dst, size_t size) {
+    struct iovec local = {dst, size};
+    struct iovec remote = {(void*)addr, size};
+    ssize_t n = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+    if (n == (ssize_t)size) {
+        return 0;
+    }
+    if (n >= 0) {
+        errno = EFAULT;
+    }
+    return -1;
+}
+
+static int
+ReadPointer(pid_t pid, uintptr_t addr, uintptr_t* out) {
+    void* ptr;
+    if (ReadRemote(pid, addr, &ptr, sizeof(ptr)) < 0) {
+        return -1;
+    }
+    *out = (uintptr_t)ptr;
+    return 0;
+}
+
+struct ElfSymbols {
+    uintptr_t runtime;   // _PyRuntime, 0 if not defined
+    uintptr_t version;   // Py_Version, 0 if not defined
+    uintptr_t vaddr;     // the address the start of the file is loaded at
+};
+
+static void
+FindInTable(const char* image,
+            size_t image_size,
+            const ElfW(Shdr) * table,
+            const ElfW(Shdr) * strings,
+            struct ElfSymbols* out) {
+    if (table->sh_offset > image_size ||
+        table->sh_size > image_size - table->sh_offset ||
+        strings->sh_offset > image_size ||
+        strings->sh_size > image_size - strings->sh_offset ||
+        table->sh_entsize != sizeof(ElfW(Sym))) {
+        return;
+    }
+    const ElfW(Sym)* symbols = (const ElfW(Sym)*)(image + table->sh_offset);
+    const char* names = image + strings->sh_offset;
+    size_t count = table->sh_size / sizeof(ElfW(Sym));
+    for (size_t i = 0; i < count; i++) {
+        const ElfW(Sym)* symbol = &symbols[i];
+        if (symbol->st_shndx == SHN_UNDEF ||
+            symbol->st_name >= strings->sh_size) {
+            continue;
+        }
+        const char* name = names + symbol->st_name;
+        if (memchr(name, '\0', strings->sh_size - symbol->st_name) == NULL) {
+            continue;
+        }
+        if (strcmp(name, "_PyRuntime") == 0) {
+            out->runtime = symbol->st_value;
+        } else if (strcmp(name, "Py_Version") == 0) {
+            out->version = symbol->st_value;
+        }
+    }
+}
+
+// returns 0 if `path` defines _PyRuntime, -1 and sets errno otherwise
+static int
+FindSymbols(const char* path, struct ElfSymbols* out) {
+    memset(out, 0, sizeof(*out));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(ElfW(Ehdr))) {
+        close(fd);
+        errno = ENOEXEC;
+        return -1;
+    }
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    const char* image = (const char*)map;
+    const ElfW(Ehdr)* header = (const ElfW(Ehdr)*)map;
+    int found = 0;
+    if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 ||
+        header->e_ident[EI_CLASS] != REMOTE_ELF_CLASS ||
+        header->e_phentsize != sizeof(ElfW(Phdr)) ||
+        header->e_shentsize != sizeof(ElfW(Shdr)) ||
+        header->e_phoff > size ||
+        header->e_phnum > (size - header->e_phoff) / sizeof(ElfW(Phdr)) ||
+        header->e_shoff > size ||
+        header->e_shnum > (size - header->e_shoff) / sizeof(ElfW(Shdr))) {
+        goto done;
+    }
+    const ElfW(Phdr)* programs = (const ElfW(Phdr)*)(image + header->e_phoff);
+    for (size_t i = 0; i < header->e_phnum; i++) {
+        if (programs[i].p_type == PT_LOAD && programs[i].p_offset == 0) {
+            out->vaddr = programs[i].p_vaddr;
+            found = 1;
+            break;
+        }
+    }
+    if (!found) {
+        goto done;
+    }
+    const ElfW(Shdr)* sections = (const ElfW(Shdr)*)(image + header->e_shoff);
+    // the dynamic symbols first, a stripped file has no others
+    const unsigned types[] = {SHT_DYNSYM, SHT_SYMTAB};
+    for (size_t t = 0; t < 2 && out->runtime == 0; t++) {
+        for (size_t i = 0; i < header->e_shnum; i++) {
+            if (sections[i].sh_type == types[t] &&
+                sections[i].sh_link < header->e_shnum) {
+                FindInTable(image, size, &sections[i],
+                            &sections[sections[i].sh_link], out);
+            }
+        }
+    }
+done:
+    munmap(map, size);
+    if (out->runtime == 0) {
+        errno = ENOEXEC;
+        return -1;
+    }
+    return 0;
+}
+
+// Look for _PyRuntime in the files mapped by `pid` which may define it.
+// returns 0 and sets the runtime and Py_Version addresses on success
+static int
+LocateRuntime(pid_t pid, uintptr_t* runtime, uintptr_t* version) {
+    char path[64];
+    char exe[PATH_MAX];
+    snprintf(path, sizeof(path), "/proc/%d/exe", (int)pid);
+    ssize_t n = readlink(path, exe, sizeof(exe) - 1);
+    exe[n < 0 ? 0 : n] = '\0';
+    snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+    FILE* maps = fopen(path, "r");
+    if (maps == NULL) {
+        if (errno == ENOENT) {
+            errno = ESRCH;
+        }
+        return -1;
+    }
+    char line[PATH_MAX + 128];
+    int ret = -1;
+    while (fgets(line, sizeof(line), maps) != NULL) {
+        unsigned long start, end, offset;
+        int pos = 0;
+        if (sscanf(line, "%lx-%lx %*s %lx %*s %*s %n", &start, &end, &offset,
+                   &pos) < 3 ||
+            pos == 0 || offset != 0 || line[pos] != '/') {
+            continue;
+        }
+        char* file = line + pos;
+        file[strcspn(file, "\n")] = '\0';
+        const char* base = strrchr(file, '/') + 1;
+        if (strncmp(base, "libpython", 9) != 0 && strcmp(file, exe) != 0) {
+            continue;
+        }
+        struct ElfSymbols symbols;
+        if (FindSymbols(file, &symbols) < 0) {
+            continue;
+        }
+        uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+        uintptr_t bias = start - (symbols.vaddr & ~(page - 1));
+        *runtime = bias + symbols.runtime;
+        *version = symbols.version ? bias + symbols.version : 0;
+        ret = 0;
+        break;
+    }
+    fclose(maps);
+    if (ret < 0) {
+        errno = ENOEXEC;
+    }
+    return ret;
+}
+
+struct RemoteProcess*
+RemoteAttach(int pid) {
+    uintptr_t runtime, version_addr;
+    if (pid <= 0) {
+        errno = ESRCH;
+        return NULL;
+    }
+    if (LocateRuntime(pid, &runtime, &version_addr) < 0) {
+        return NULL;
+    }
+    // Py_Version is there since 3.11, the oldest version supported
+    unsigned long version;
+    if (version_addr == 0) {
+        errno = ENOEXEC;
+        return NULL;
+    }
+    if (ReadRemote(pid, version_addr, &version, sizeof(version)) < 0) {
+        return NULL;
+    }
+    if ((version >> 16) != ((unsigned long)PY_VERSION_HEX >> 16)) {
+        errno = ENOEXEC;
+        return NULL;
+    }
+    struct RemoteProcess* remote = calloc(1, sizeof(struct RemoteProcess));
+    if (remote == NULL) {
+        return NULL;
+    }
+    remote->pid = pid;
+    remote->runtime = runtime;
+    remote->codes_size = 256;
+    remote->codes = calloc(remote->codes_size, sizeof(struct CodeEntry));
+    remote->stack_size = 4096;
+    remote->stack = malloc(remote->stack_size);
+    if (remote->codes == NULL || remote->stack == NULL) {
+        RemoteDetach(remote);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return remote;
+}
+
+void
+RemoteDetach(struct RemoteProcess* remote) {
+    if (remote == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < remote->codes_size && remote->codes; i++) {
+        free(remote->codes[i].frame);
+    }
+    free(remote->codes);
+    free(remote->stack);
+    free(remote);
+}
+
+int
+RemotePid(const struct RemoteProcess* remote) {
+    return (int)remote->pid;
+}
+
+static size_t
+EncodeUtf8(Py_UCS4 ch, char* out) {
+    if (ch < 0x80) {
+        out[0] = (char)ch;
+        return 1;
+    }
+    if (ch < 0x800) {
+        out[0] = (char)(0xc0 | (ch >> 6));
+        out[1] = (char)(0x80 | (ch & 0x3f));
+        return 2;
+    }
+    if (ch < 0x10000) {
+        out[0] = (char)(0xe0 | (ch >> 12));
+        out[1] = (char)(0x80 | ((ch >> 6) & 0x3f));
+        out[2] = (char)(0x80 | (ch & 0x3f));
+        return 3;
+    }
+    out[0] = (char)(0xf0 | ((ch >> 18) & 0x07));
+    out[1] = (char)(0x80 | ((ch >> 12) & 0x3f));
+    out[2] = (char)(0x80 | ((ch >> 6) & 0x3f));
+    out[3] = (char)(0x80 | (ch & 0x3f));
+    return 4;
+}
+
+// returns the str object at `addr` as a malloc'd UTF-8 string, or NULL and
+// sets errno
+static char*
+ReadString(pid_t pid, uintptr_t addr) {
+    PyASCIIObject header;
+    if (ReadRemote(pid, addr, &header, sizeof(header)) < 0) {
+        return NULL;
+    }
+    Py_ssize_t length = header.length;
+    unsigned int kind = header.state.kind;
+    if (length < 0 || length > REMOTE_MAX_NAME ||
+        (kind != PyUnicode_1BYTE_KIND && kind != PyUnicode_2BYTE_KIND &&
+         kind != PyUnicode_4BYTE_KIND)) {
+        errno = EFAULT;
+        return NULL;
+    }
+    uintptr_t data;
+    if (header.state.compact && header.state.ascii) {
+        data = addr + sizeof(PyASCIIObject);
+    } else if (header.state.compact) {
+        data = addr + sizeof(PyCompactUnicodeObject);
+    } else if (ReadPointer(pid, addr + offsetof(PyUnicodeObject, data), &data) <
+                   0 ||
+               data == 0) {
+        errno = EFAULT;
+        return NULL;
+    }
+    size_t size = (size_t)length * kind;
+    unsigned char* raw = malloc(size + 1);
+    char* out = malloc((size_t)length * 4 + 1);
+    if (raw == NULL || out == NULL || ReadRemote(pid, data, raw, size) < 0) {
+        free(raw);
+        free(out);
+        return NULL;
+    }
+    size_t pos = 0;
+    for (Py_ssize_t i = 0; i < length; i++) {
+        Py_UCS4 ch = kind == PyUnicode_1BYTE_KIND   ? raw[i]
+                     : kind == PyUnicode_2BYTE_KIND ? ((Py_UCS2*)raw)[i]
+                                                    : ((Py_UCS4*)raw)[i];
+        pos += EncodeUtf8(ch, out + pos);
+    }
+    out[pos] = '\0';
+    free(raw);
+    return out;
+}
+
+static int
+GrowCodes(struct RemoteProcess* remote) {
+    size_t size = remote->codes_size * 2;
+    struct CodeEntry* codes = calloc(size, sizeof(struct CodeEntry));
+    if (codes == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < remote->codes_size; i++) {
+        struct CodeEntry* entry = &remote->codes[i];
+        if (entry->code == 0) {
+            continue;
+        }
+        size_t slot = (entry->code >> 4) & (size - 1);
+        while (codes[slot].code != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        codes[slot] = *entry;
+    }
+    free(remote->codes);
+    remote->codes = codes;
+    remote->codes_size = size;
+    return 0;
+}
+
+// returns the name of `frame`, owned by the cache, or NULL and sets errno
+static const char*
+FrameName(struct RemoteProcess* remote, const struct RemoteFrame* frame) {
+    size_t mask = remote->codes_size - 1;
+    size_t slot = (frame->code >> 4) & mask;
+    while (remote->codes[slot].code != 0 &&
+           remote->codes[slot].code != frame->code) {
+        slot = (slot + 1) & mask;
+    }
+    struct CodeEntry* entry = &remote->codes[slot];
+    if (entry->code == frame->code && entry->filename == frame->filename &&
+        entry->qualname == frame->qualname &&
+        entry->firstlineno == frame->firstlineno) {
+        return entry->frame;
+    }
+    char* filename = ReadString(remote->pid, frame->filename);
+    char* qualname = filename ? ReadString(remote->pid, frame->qualname) : NULL;
+    char* name = NULL;
+    if (qualname != NULL) {
+        int n = snprintf(NULL, 0, "%s:%s:%d", filename, qualname,
+                         frame->firstlineno);
+        name = malloc((size_t)n + 1);
+        if (name != NULL) {
+            snprintf(name, (size_t)n + 1, "%s:%s:%d", filename, qualname,
+                     frame->firstlineno);
+        }
+    }
+    free(filename);
+    free(qualname);
+    if (name == NULL) {
+        return NULL;
+    }
+    if (entry->code == 0) {
+        remote->codes_used++;
+    }
+    free(entry->frame);
+    entry->code = frame->code;
+    entry->filename = frame->filename;
+    entry->qualname = frame->qualname;
+    entry->firstlineno = frame->firstlineno;
+    entry->frame = name;
+    if (remote->codes_used * 2 > remote->codes_size && GrowCodes(remote) < 0) {
+        return NULL;
+    }
+    return name;
+}
+
+static int
+Append(struct RemoteProcess* remote, size_t* pos, const char* s) {
+    size_t len = strlen(s);
+    if (*pos + len + 2 > remote->stack_size) {
+        size_t size = remote->stack_size;
+        while (*pos + len + 2 > size) {
+            size *= 2;
+        }
+        char* stack = realloc(remote->stack, size);
+        if (stack == NULL) {
+            return -1;
+        }
+        remote->stack = stack;
+        remote->stack_size = size;
+    }
+    if (*pos > 0) {
+        remote->stack[(*pos)++] = ';';
+    }
+    memcpy(remote->stack + *pos, s, len + 1);
+    *pos += len;
+    return 0;
+}
+
+// Read the frames of thread `tstate`, innermost first.
+// returns the number read, or -1 and sets errno
+static int
+ReadFrames(struct RemoteProcess* remote, const PyThreadState* tstate) {
+    pid_t pid = remote->pid;
+    uintptr_t addr;
+    if (tstate->cframe == NULL ||
+        ReadPointer(pid,
+                    (uintptr_t)tstate->cframe +
+                        offsetof(_PyCFrame, current_frame),
+                    &addr) < 0) {
+        return -1;
+    }
+    int depth = 0;
+    while (addr != 0 && depth < REMOTE_MAX_DEPTH) {
+        _PyInterpreterFrame frame;
+        PyCodeObject code;
+        if (ReadRemote(pid, addr, &frame, sizeof(frame)) < 0) {
+            return -1;
+        }
+        addr = (uintptr_t)frame.previous;
+#if PY_VERSION_HEX >= 0x030C0000
+        if (frame.owner == FRAME_OWNED_BY_CSTACK) {
+            continue;
+        }
+#endif
+        if (frame.f_code == NULL ||
+            ReadRemote(pid, (uintptr_t)frame.f_code, &code,
+                       offsetof(PyCodeObject, co_code_adaptive)) < 0) {
+            return -1;
+        }
+        struct RemoteFrame* out = &remote->frames[depth++];
+        out->code = (uintptr_t)frame.f_code;
+        out->filename = (uintptr_t)code.co_filename;
+        out->qualname = (uintptr_t)code.co_qualname;
+        out->firstlineno = code.co_firstlineno;
+    }
+    return depth;
+}
+
+// Add the stack of one thread to `tree`.
+// returns 1 if added, 0 if the thread has no frames, -1 and sets errno
+static int
+SampleThread(struct RemoteProcess* remote,
+             const PyThreadState* tstate,
+             struct StackTree* tree,
+             const char* prefix) {
+    int depth = ReadFrames(remote, tstate);
+    if (depth <= 0) {
+        return depth;
+    }
+    // the threading module is not read, threads are named by their id
+    char thread[32];
+    if (tstate->native_thread_id == (unsigned long)remote->pid) {
+        snprintf(thread, sizeof(thread), "MainThread");
+    } else {
+        snprintf(thread, sizeof(thread), "Thread-%lu",
+                 tstate->native_thread_id);
+    }
+    size_t pos = 0;
+    if ((prefix != NULL && Append(remote, &pos, prefix) < 0) ||
+        Append(remote, &pos, thread) < 0) {
+        return -1;
+    }
+    for (int i = depth - 1; i >= 0; i--) {
+        const char* name = FrameName(remote, &remote->frames[i]);
+        if (name == NULL || Append(remote, &pos, name) < 0) {
+            return -1;
+        }
+    }
+    AddCallStack(tree, remote->stack);
+    return 1;
+}
+
+int
+RemoteSample(struct RemoteProcess* remote,
+             struct StackTree* tree,
+             const char* prefix) {
+    pid_t pid = remote->pid;
+    uintptr_t interp;
+    if (ReadPointer(pid,
+                    remote->runtime +
+                        offsetof(_PyRuntimeState, interpreters.head),
+                    &interp) < 0) {
+        return -1;
+    }
+    int added = 0;
+    for (int i = 0; interp != 0 && i < REMOTE_MAX_INTERPRETERS; i++) {
+        uintptr_t addr;
+        if (ReadPointer(pid,
+                        interp + offsetof(PyInterpreterState, threads.head),
+                        &addr) < 0) {
+            return errno == ESRCH ? -1 : added;
+        }
+        for (int t = 0; addr != 0 && t < REMOTE_MAX_THREADS; t++) {
+            PyThreadState tstate;
+            if (ReadRemote(pid, addr, &tstate, sizeof(tstate)) < 0) {
+                return errno == ESRCH ? -1 : added;
+            }
+            int ret = SampleThread(remote, &tstate, tree, prefix);
+            if (ret < 0 && (errno == ESRCH || errno == ENOMEM)) {
+                return -1;
+            }
+            added += ret > 0;
+            addr = (uintptr_t)tstate.next;
+        }
+        if (ReadPointer(pid, interp + offsetof(PyInterpreterState, next),
+                        &interp) < 0) {
+            return errno == ESRCH ? -1 : added;
+        }
+    }
+    return added;
+}
+
+#else  // REMOTE_SUPPORTED
+
+struct RemoteProcess*
+RemoteAttach(int pid) {
+    (void)pid;
+    errno = ENOSYS;
+    return NULL;
+}
+
+void
+RemoteDetach(struct RemoteProcess* remote) {
+    (void)remote;
+}
+
+int
+RemotePid(const struct RemoteProcess* remote) {
+    (void)remote;
+    return 0;
+}
+
+int
+RemoteSample(struct RemoteProcess* remote,
+             struct StackTree* tree,
+             const char* prefix) {
+    (void)remote;
+    (void)tree;
+    (void)prefix;
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif  // REMOTE_SUPPORTED
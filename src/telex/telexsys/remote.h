@@ -0,0 +1,46 @@
+#ifndef TELE_REMOTE_H
+#define TELE_REMOTE_H
+
+#include "tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Sampling another local CPython process without running anything in it:
+// its interpreter state and frame chains are read with process_vm_readv.
+// The target must run the same major.minor version as this interpreter,
+// whose struct layouts are used to read it. Only Linux with Python 3.11 and
+// 3.12 are supported.
+struct RemoteProcess;
+
+// Find `_PyRuntime` of process `pid` through the ELF symbols of the
+// libpython or executable it maps.
+// returns NULL and sets errno on failure: ENOSYS if remote sampling is not
+// supported here, ENOEXEC if the process does not run this Python version,
+// ESRCH, EPERM or EACCES if it can not be read
+struct RemoteProcess*
+RemoteAttach(int pid);
+
+void
+RemoteDetach(struct RemoteProcess* remote);
+
+int
+RemotePid(const struct RemoteProcess* remote);
+
+// Add the stack of every thread of the process to `tree`, each as
+// "prefix;ThreadName;file:qualname:firstlineno;...", without the prefix
+// part when `prefix` is NULL. Threads that change while they are read are
+// skipped.
+// returns the number of stacks added, or -1 and sets errno if the process
+// can not be read any more, ESRCH once it exited
+int
+RemoteSample(struct RemoteProcess* remote,
+             struct StackTree* tree,
+             const char* prefix);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
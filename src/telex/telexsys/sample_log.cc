@@ -0,0 +1,362 @@
+#include "sample_log.h"
+#include "encode.h"
+#include "tree_impl.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace {
+
+struct ThreadLog {
+    unsigned long tid;
+    std::string name;  // the first frame of its first stack
+    unsigned long long first;
+    unsigned long long last;
+    size_t count;
+    std::string data;  // (time delta, stack id) varint pairs
+};
+
+uint64_t
+GetVarint(const std::string& in, size_t& pos) {
+    uint64_t value = 0;
+    int shift = 0;
+    while (pos < in.size()) {
+        unsigned char byte = (unsigned char)in[pos++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            break;
+        }
+        shift += 7;
+    }
+    return value;
+}
+
+
+// JSON is built in a buffer that goes to the file every 64KiB
+class JsonFile {
+  public:
+    explicit JsonFile(const char* filename)
+        : file_(fopen(filename, "wb")), ok_(file_ != nullptr) {}
+
+    ~JsonFile() {
+        if (file_ != nullptr) {
+            fclose(file_);
+        }
+    }
+
+    bool ok() const { return ok_; }
+
+    std::string& out() { return out_; }
+
+    void MaybeFlush() {
+        if (out_.size() >= (1 << 16)) {
+            Flush();
+        }
+    }
+
+    bool Close() {
+        Flush();
+        if (file_ != nullptr && fclose(file_) != 0) {
+            ok_ = false;
+        }
+        file_ = nullptr;
+        return ok_;
+    }
+
+  private:
+    void Flush() {
+        if (ok_ && fwrite(out_.data(), 1, out_.size(), file_) != out_.size()) {
+            ok_ = false;
+        }
+        out_.clear();
+    }
+
+    FILE* file_;
+    bool ok_;
+    std::string out_;
+};
+
+}  // namespace
+
+
+struct SampleLog {
+    std::unordered_map<std::string, uint32_t> stack_ids;
+    std::vector<const std::string*> stacks;
+    std::unordered_map<unsigned long, size_t> thread_index;
+    std::vector<ThreadLog> threads;
+    size_t count = 0;
+    size_t bytes = 0;
+
+    // Frames of the stack table, shared by every thread. A stack drops its
+    // first frame, the thread name, which the thread is named after instead.
+    std::vector<Frame> frames;
+    std::vector<std::vector<uint32_t>> stack_frames;
+
+    void SplitStacks() {
+        std::unordered_map<std::string, uint32_t> frame_ids;
+        frames.clear();
+        stack_frames.assign(stacks.size(), std::vector<uint32_t>());
+        for (size_t i = 0; i < stacks.size(); ++i) {
+            const std::string& stack = *stacks[i];
+            size_t begin = stack.find(';');
+            while (begin != std::string::npos) {
+                size_t end = stack.find(';', begin + 1);
+                std::string name = stack.substr(
+                    begin + 1,
+                    end == std::string::npos ? end : end - begin - 1);
+                auto it = frame_ids.emplace(name, (uint32_t)frames.size());
+                if (it.second) {
+                    frames.push_back(SplitFrame(name));
+                }
+                stack_frames[i].push_back(it.first->second);
+                begin = end;
+            }
+        }
+    }
+
+    // the earliest sample of all threads, the exports count time from it
+    unsigned long long Start() const {
+        unsigned long long start = 0;
+        for (size_t i = 0; i < threads.size(); ++i) {
+            if (i == 0 || threads[i].first < start) {
+                start = threads[i].first;
+            }
+        }
+        return start;
+    }
+};
+
+
+struct SampleLog*
+NewSampleLog(void) {
+    return new SampleLog();
+}
+
+void
+FreeSampleLog(struct SampleLog* log) {
+    delete log;
+}
+
+void
+SampleLogAdd(struct SampleLog* log,
+             unsigned long tid,
+             unsigned long long time,
+             const char* callstack) {
+    std::string stack(callstack);
+    auto it = log->stack_ids.emplace(stack, (uint32_t)log->stacks.size());
+    if (it.second) {
+        log->stacks.push_back(&it.first->first);
+        log->bytes += stack.size() + sizeof(std::string);
+    }
+    auto index = log->thread_index.emplace(tid, log->threads.size());
+    if (index.second) {
+        ThreadLog thread;
+        thread.tid = tid;
+        thread.name = stack.substr(0, stack.find(';'));
+        thread.first = time;
+        thread.last = time;
+        thread.count = 0;
+        log->threads.push_back(std::move(thread));
+    }
+    ThreadLog& thread = log->threads[index.first->second];
+    size_t before = thread.data.size();
+    // the clock is monotonic, but the threads are not sampled in order
+    PutVarint(thread.data, time > thread.last ? time - thread.last : 0);
+    PutVarint(thread.data, it.first->second);
+    log->bytes += thread.data.size() - before;
+    if (time > thread.last) {
+        thread.last = time;
+    }
+    thread.count++;
+    log->count++;
+}
+
+size_t
+SampleLogCount(const struct SampleLog* log) {
+    return log->count;
+}
+
+size_t
+SampleLogBytes(const struct SampleLog* log) {
+    return log->bytes;
+}
+
+int
+SampleLogWriteSpeedscope(struct SampleLog* log,
+                         const char* filename,
+                         const char* name,
+                         long long interval) {
+    JsonFile file(filename);
+    if (!file.ok()) {
+        return -1;
+    }
+    log->SplitStacks();
+    std::string& out = file.out();
+    out += "{\"$schema\":"
+           "\"https://www.speedscope.app/file-format-schema.json\","
+           "\"exporter\":\"telex\",\"name\":";
+    AppendJsonString(out, name);
+    out += ",\"activeProfileIndex\":0,\"shared\":{\"frames\":[";
+    for (size_t i = 0; i < log->frames.size(); ++i) {
+        const Frame& frame = log->frames[i];
+        out += i > 0 ? ",{\"name\":" : "{\"name\":";
+        AppendJsonString(out, frame.function);
+        if (!frame.filename.empty()) {
+            out += ",\"file\":";
+            AppendJsonString(out, frame.filename);
+            out += ",\"line\":";
+            AppendInt(out, (long long)frame.line);
+        }
+        out += '}';
+        file.MaybeFlush();
+    }
+    out += "]},\"profiles\":[";
+    unsigned long long start = log->Start();
+    std::vector<uint64_t> ids, weights;
+    for (size_t t = 0; t < log->threads.size(); ++t) {
+        const ThreadLog& thread = log->threads[t];
+        // a sample weighs the time until the next one
+        ids.clear();
+        weights.clear();
+        ids.reserve(thread.count);
+        weights.reserve(thread.count);
+        size_t pos = 0;
+        while (pos < thread.data.size()) {
+            uint64_t delta = GetVarint(thread.data, pos);
+            ids.push_back(GetVarint(thread.data, pos));
+            if (!weights.empty()) {
+                weights.back() = delta;
+            }
+            weights.push_back((uint64_t)interval);
+        }
+        long long begin = (long long)(thread.first - start);
+        long long end = begin;
+        for (uint64_t weight : weights) {
+            end += (long long)weight;
+        }
+        out += t > 0 ? ",{" : "{";
+        out += "\"type\":\"sampled\",\"name\":";
+        AppendJsonString(out, thread.name);
+        out += ",\"unit\":\"microseconds\",\"startValue\":";
+        AppendInt(out, begin);
+        out += ",\"endValue\":";
+        AppendInt(out, end);
+        out += ",\"samples\":[";
+        for (size_t i = 0; i < ids.size(); ++i) {
+            out += i > 0 ? ",[" : "[";
+            const std::vector<uint32_t>& frames = log->stack_frames[ids[i]];
+            for (size_t j = 0; j < frames.size(); ++j) {
+                if (j > 0) {
+                    out += ',';
+                }
+                AppendInt(out, frames[j]);
+            }
+            out += ']';
+            file.MaybeFlush();
+        }
+        out += "],\"weights\":[";
+        for (size_t i = 0; i < weights.size(); ++i) {
+            if (i > 0) {
+                out += ',';
+            }
+            AppendInt(out, (long long)weights[i]);
+            file.MaybeFlush();
+        }
+        out += "]}";
+    }
+    out += "]}";
+    return file.Close() ? 0 : -1;
+}
+
+int
+SampleLogWriteChromeTrace(struct SampleLog* log,
+                          const char* filename,
+                          long long pid,
+                          long long interval) {
+    JsonFile file(filename);
+    if (!file.ok()) {
+        return -1;
+    }
+    log->SplitStacks();
+    // the name and args of every frame's B event
+    std::vector<std::string> begins(log->frames.size());
+    for (size_t i = 0; i < log->frames.size(); ++i) {
+        const Frame& frame = log->frames[i];
+        std::string& begin = begins[i];
+        begin = "\"name\":";
+        AppendJsonString(begin, frame.function);
+        if (!frame.filename.empty()) {
+            begin += ",\"args\":{\"file\":";
+            AppendJsonString(begin, frame.filename);
+            begin += ",\"line\":";
+            AppendInt(begin, (long long)frame.line);
+            begin += '}';
+        }
+    }
+
+    std::string& out = file.out();
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    std::string head;  // "pid":..,"tid":.. of the thread
+    auto event = [&](const char* phase, long long ts) {
+        out += first ? "{\"ph\":\"" : ",\n{\"ph\":\"";
+        first = false;
+        out += phase;
+        out += "\",";
+        out += head;
+        out += ",\"ts\":";
+        AppendInt(out, ts);
+    };
+    unsigned long long start = log->Start();
+    std::vector<uint32_t> open;
+    for (const ThreadLog& thread : log->threads) {
+        head = "\"pid\":";
+        AppendInt(head, pid);
+        head += ",\"tid\":";
+        AppendInt(head, (long long)thread.tid);
+        event("M", 0);
+        out += ",\"name\":\"thread_name\",\"args\":{\"name\":";
+        AppendJsonString(out, thread.name);
+        out += "}}";
+
+        open.clear();
+        long long ts = (long long)(thread.first - start);
+        size_t pos = 0;
+        while (pos < thread.data.size()) {
+            ts += (long long)GetVarint(thread.data, pos);
+            const std::vector<uint32_t>& frames =
+                log->stack_frames[GetVarint(thread.data, pos)];
+            size_t common = 0;
+            while (common < open.size() && common < frames.size() &&
+                   open[common] == frames[common]) {
+                common++;
+            }
+            while (open.size() > common) {
+                event("E", ts);
+                out += '}';
+                open.pop_back();
+            }
+            for (size_t i = common; i < frames.size(); ++i) {
+                event("B", ts);
+                out += ',';
+                out += begins[frames[i]];
+                out += '}';
+                open.push_back(frames[i]);
+            }
+            file.MaybeFlush();
+        }
+        ts += interval;
+        while (!open.empty()) {
+            event("E", ts);
+            out += '}';
+            open.pop_back();
+        }
+    }
+    out += "]}";
+    return file.Close() ? 0 : -1;
+}
@@ -0,0 +1,60 @@
+#ifndef TELE_SAMPLE_LOG_H
+#define TELE_SAMPLE_LOG_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The samples in the order they were taken, which the StackTree forgets.
+// Every thread keeps a byte string of (time delta, stack id) varint pairs,
+// the ids index a table holding every distinct call stack once, so a sample
+// costs a few bytes.
+struct SampleLog;
+
+struct SampleLog*
+NewSampleLog(void);
+
+void
+FreeSampleLog(struct SampleLog* log);
+
+// `callstack` is the line given to AddCallStack, starting with the thread
+// name. `time` is in microseconds.
+void
+SampleLogAdd(struct SampleLog* log,
+             unsigned long tid,
+             unsigned long long time,
+             const char* callstack);
+
+size_t
+SampleLogCount(const struct SampleLog* log);
+
+// the number of bytes held, the stack table included
+size_t
+SampleLogBytes(const struct SampleLog* log);
+
+// Write speedscope's file format with a "sampled" profile per thread. A
+// sample weighs the time until the thread's next one, the last one weighs
+// `interval` microseconds.
+// returns 0 on success, -1 if the file can not be written
+int
+SampleLogWriteSpeedscope(struct SampleLog* log,
+                         const char* filename,
+                         const char* name,
+                         long long interval);
+
+// Write Chrome trace events: a frame opens (B) at the first sample it shows
+// up in and closes (E) at the first one it is gone from.
+// returns 0 on success, -1 if the file can not be written
+int
+SampleLogWriteChromeTrace(struct SampleLog* log,
+                          const char* filename,
+                          long long pid,
+                          long long interval);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,356 @@
+#include "shm_ring.h"
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+const char kMagic[8] = {'T', 'E', 'L', 'E', 'X', 'S', 'H', 'M'};
+const uint32_t kVersion = 2;
+const size_t kHeaderBytes = 128;
+
+// The layout shared with readers, every field is 8 byte aligned. The
+// counters are only touched with atomic builtins.
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_bytes;
+    uint64_t slots;         // a power of two
+    uint64_t symbol_bytes;  // size of the stack table
+    uint64_t pid;
+    uint64_t head;        // samples written
+    uint64_t symbol_end;  // bytes of the stack table in use
+    uint64_t dropped;     // samples dropped for a full stack table
+    // when the ring was created, tells apart the rings made at one path
+    uint64_t generation;
+};
+
+// seq is the sample's sequence number plus one, 0 while it is written
+struct Slot {
+    uint64_t seq;
+    uint64_t time;
+    uint64_t tid;
+    uint64_t stack;
+};
+
+static_assert(sizeof(Header) <= kHeaderBytes, "the header outgrew its room");
+
+size_t
+MappedBytes(uint64_t slots, uint64_t symbol_bytes) {
+    return kHeaderBytes + slots * sizeof(Slot) + symbol_bytes;
+}
+
+Slot*
+Slots(char* base) {
+    return reinterpret_cast<Slot*>(base + kHeaderBytes);
+}
+
+char*
+Symbols(char* base, uint64_t slots) {
+    return base + kHeaderBytes + slots * sizeof(Slot);
+}
+
+}  // namespace
+
+
+struct ShmRing {
+    std::string path;
+    char* base = nullptr;
+    size_t size = 0;
+    uint64_t written = 0;
+    long pid = 0;
+    std::unordered_map<std::string, uint32_t> stack_ids;
+
+    Header* header() { return reinterpret_cast<Header*>(base); }
+};
+
+
+#ifdef _WIN32
+
+struct ShmRing*
+NewShmRing(const char*, size_t, size_t) {
+    errno = ENOSYS;
+    return nullptr;
+}
+
+void
+FreeShmRing(struct ShmRing* ring) {
+    delete ring;
+}
+
+const char*
+ShmRingPath(const struct ShmRing* ring) {
+    return ring->path.c_str();
+}
+
+void
+ShmRingAdd(struct ShmRing*, unsigned long, unsigned long long, const char*) {}
+
+int
+ShmRingRead(const char*,
+            struct ShmRingCursor*,
+            ShmRingSampleFn,
+            ShmRingStackFn,
+            void*) {
+    errno = ENOSYS;
+    return -1;
+}
+
+#else
+
+struct ShmRing*
+NewShmRing(const char* path, size_t slots, size_t symbol_bytes) {
+    size_t n = 1;
+    while (n < slots) {
+        n <<= 1;
+    }
+    // a stale ring is replaced rather than truncated, and a symlink left at
+    // the path is neither followed nor raced with
+    if (unlink(path) < 0 && errno != ENOENT) {
+        return nullptr;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+    if (fd < 0) {
+        return nullptr;
+    }
+    size_t size = MappedBytes(n, symbol_bytes);
+    // the file is sparse, pages are only backed once written
+    if (ftruncate(fd, (off_t)size) < 0) {
+        int err = errno;
+        close(fd);
+        unlink(path);
+        errno = err;
+        return nullptr;
+    }
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        int err = errno;
+        unlink(path);
+        errno = err;
+        return nullptr;
+    }
+    ShmRing* ring = new ShmRing();
+    ring->path = path;
+    ring->base = static_cast<char*>(base);
+    ring->size = size;
+    ring->pid = (long)getpid();
+    Header* header = ring->header();
+    header->version = kVersion;
+    header->slot_bytes = sizeof(Slot);
+    header->slots = n;
+    header->symbol_bytes = symbol_bytes;
+    header->pid = (uint64_t)ring->pid;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    header->generation =
+        ((uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec) | 1;
+    // readers check the magic last
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, kMagic, sizeof(kMagic));
+    return ring;
+}
+
+void
+FreeShmRing(struct ShmRing* ring) {
+    if (ring->base != nullptr) {
+        munmap(ring->base, ring->size);
+        // a forked child must not remove its parent's ring
+        if ((long)getpid() == ring->pid) {
+            unlink(ring->path.c_str());
+        }
+    }
+    delete ring;
+}
+
+const char*
+ShmRingPath(const struct ShmRing* ring) {
+    return ring->path.c_str();
+}
+
+void
+ShmRingAdd(struct ShmRing* ring,
+           unsigned long tid,
+           unsigned long long time,
+           const char* callstack) {
+    if ((long)getpid() != ring->pid) {
+        return;
+    }
+    Header* header = ring->header();
+    std::string stack(callstack);
+    auto it = ring->stack_ids.find(stack);
+    if (it == ring->stack_ids.end()) {
+        uint64_t end = header->symbol_end;
+        uint32_t size = (uint32_t)stack.size();
+        if (end + sizeof(size) + size > header->symbol_bytes) {
+            __atomic_store_n(&header->dropped, header->dropped + 1,
+                             __ATOMIC_RELAXED);
+            return;
+        }
+        char* symbols = Symbols(ring->base, header->slots);
+        memcpy(symbols + end, &size, sizeof(size));
+        memcpy(symbols + end + sizeof(size), stack.data(), size);
+        // publish the stack before any slot refers to it
+        __atomic_store_n(&header->symbol_end, end + sizeof(size) + size,
+                         __ATOMIC_RELEASE);
+        it = ring->stack_ids
+                 .emplace(std::move(stack), (uint32_t)ring->stack_ids.size())
+                 .first;
+    }
+    uint64_t n = ring->written++;
+    Slot* slot = &Slots(ring->base)[n & (header->slots - 1)];
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->time, (uint64_t)time, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->tid, (uint64_t)tid, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->stack, (uint64_t)it->second, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, n + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&header->head, n + 1, __ATOMIC_RELEASE);
+}
+
+namespace {
+
+// a read only mapping of somebody else's ring
+class Mapping {
+  public:
+    explicit Mapping(const char* path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            if ((size_t)st.st_size < kHeaderBytes) {
+                errno = EINVAL;
+            } else {
+                void* base = mmap(
+                    nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                if (base != MAP_FAILED) {
+                    base_ = static_cast<char*>(base);
+                    size_ = (size_t)st.st_size;
+                }
+            }
+        }
+        int err = errno;
+        close(fd);
+        errno = err;
+    }
+
+    ~Mapping() {
+        if (base_ != nullptr) {
+            munmap(base_, size_);
+        }
+    }
+
+    // whether the file is a complete ring of a known version
+    bool ok() const {
+        if (base_ == nullptr) {
+            return false;
+        }
+        const Header* h = header();
+        if (memcmp(h->magic, kMagic, sizeof(kMagic)) != 0 ||
+            h->version != kVersion || h->slot_bytes != sizeof(Slot) ||
+            h->slots == 0 || (h->slots & (h->slots - 1)) != 0 ||
+            MappedBytes(h->slots, h->symbol_bytes) > size_) {
+            errno = EINVAL;
+            return false;
+        }
+        return true;
+    }
+
+    Header* header() const { return reinterpret_cast<Header*>(base_); }
+
+    char* base() const { return base_; }
+
+  private:
+    char* base_ = nullptr;
+    size_t size_ = 0;
+};
+
+}  // namespace
+
+int
+ShmRingRead(const char* path,
+            struct ShmRingCursor* cursor,
+            ShmRingSampleFn on_sample,
+            ShmRingStackFn on_stack,
+            void* arg) {
+    errno = 0;
+    Mapping mapping(path);
+    if (!mapping.ok()) {
+        return -1;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    Header* header = mapping.header();
+    uint64_t slots = header->slots;
+    uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    if (cursor->generation != header->generation) {
+        // a new ring under the same name, its stacks are read from the start
+        cursor->next = 0;
+        cursor->symbol_offset = 0;
+        cursor->generation = header->generation;
+    }
+    uint64_t next = cursor->next;
+    if (head - next > slots) {
+        cursor->lost += head - slots - next;
+        next = head - slots;
+    }
+    Slot* ring = Slots(mapping.base());
+    for (; next < head; ++next) {
+        Slot* slot = &ring[next & (slots - 1)];
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        uint64_t time = __atomic_load_n(&slot->time, __ATOMIC_RELAXED);
+        uint64_t tid = __atomic_load_n(&slot->tid, __ATOMIC_RELAXED);
+        uint64_t stack = __atomic_load_n(&slot->stack, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (seq != next + 1 ||
+            __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+            cursor->lost++;  // the writer lapped us
+            continue;
+        }
+        int ret = on_sample(arg, time, (unsigned long)tid, (uint32_t)stack);
+        if (ret != 0) {
+            cursor->next = next;
+            return ret;
+        }
+    }
+    cursor->next = next;
+
+    // the samples read refer to stacks published before them
+    uint64_t end = __atomic_load_n(&header->symbol_end, __ATOMIC_ACQUIRE);
+    if (end > header->symbol_bytes) {
+        errno = EINVAL;
+        return -1;
+    }
+    const char* symbols = Symbols(mapping.base(), slots);
+    uint64_t offset = cursor->symbol_offset;
+    while (offset + sizeof(uint32_t) <= end) {
+        uint32_t size;
+        memcpy(&size, symbols + offset, sizeof(size));
+        if (offset + sizeof(size) + size > end) {
+            errno = EINVAL;
+            return -1;
+        }
+        int ret = on_stack(arg, symbols + offset + sizeof(size), size);
+        offset += sizeof(size) + size;
+        if (ret != 0) {
+            cursor->symbol_offset = offset;
+            return ret;
+        }
+    }
+    cursor->symbol_offset = offset;
+    cursor->dropped = __atomic_load_n(&header->dropped, __ATOMIC_RELAXED);
+    return 0;
+}
+
+#endif
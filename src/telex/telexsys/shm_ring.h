@@ -0,0 +1,80 @@
+#ifndef TELE_SHM_RING_H
+#define TELE_SHM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Samples exported through a file mapped by another process, usually in
+// /dev/shm, so that a reader can follow a profile without running anything
+// in the target's interpreter.
+//
+// The file holds a header, a ring of fixed size slots (time, tid, stack id)
+// and an append-only table of the distinct call stacks. The sampler is the
+// only writer, every slot carries the sequence number of the sample in it,
+// which a reader checks before and after copying the slot so overwritten or
+// half written slots are counted as lost instead of being misread.
+struct ShmRing;
+
+#define SHM_RING_SLOTS (1 << 16)
+#define SHM_RING_SYMBOL_BYTES (16 << 20)
+
+// Create the file and map it, a file already at `path` is replaced, never
+// written through. `slots` is rounded up to a power of two.
+// returns NULL and sets errno on failure
+struct ShmRing*
+NewShmRing(const char* path, size_t slots, size_t symbol_bytes);
+
+// Unmap the ring and remove its file.
+void
+FreeShmRing(struct ShmRing* ring);
+
+const char*
+ShmRingPath(const struct ShmRing* ring);
+
+// `callstack` is the line given to AddCallStack. Samples taken in a forked
+// child are ignored, the ring belongs to the process that created it.
+void
+ShmRingAdd(struct ShmRing* ring,
+           unsigned long tid,
+           unsigned long long time,
+           const char* callstack);
+
+struct ShmRingCursor {
+    unsigned long long next;           // sequence number of the next sample
+    unsigned long long symbol_offset;  // bytes of the stack table read
+    unsigned long long lost;     // samples overwritten before they were read
+    unsigned long long dropped;  // samples dropped for a full stack table
+    // the ring read, a new ring at the path restarts the cursor and its
+    // stack ids
+    unsigned long long generation;
+};
+
+// return non zero to stop reading
+typedef int (*ShmRingSampleFn)(void* arg,
+                               unsigned long long time,
+                               unsigned long tid,
+                               uint32_t stack);
+typedef int (*ShmRingStackFn)(void* arg, const char* stack, size_t size);
+
+// Read the samples after `cursor` and then the stacks added to the table
+// since, stack ids count the stacks in the order they are reported. A zero
+// cursor starts at the oldest sample still in the ring, as does the cursor
+// of an older ring at the same path: its generation changes.
+// returns 0 on success, -1 with errno set if the file can not be read or is
+// not a ring, or the non zero value a callback returned
+int
+ShmRingRead(const char* path,
+            struct ShmRingCursor* cursor,
+            ShmRingSampleFn on_sample,
+            ShmRingStackFn on_stack,
+            void* arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -8,9 +8,13 @@
 #include <sched.h>
 #endif
 
+#include "chrome_trace.h"
 #include "compat.h"
+#include "flamegraph.h"
 #include "inject.h"
 #include "object.h"
+#include "pprof.h"
+#include "remote.h"
 #include "telexsys.h"
 #include "tree.h"
 #include "tupleobject.h"
@@ -22,6 +26,17 @@
 static Telex_time
 unix_micro_time(void);
 
+// the start of a phase, the clock is only read if phase_stats is enabled.
+// The end is only recorded for a phase that was timed from its start:
+// phase_stats can be switched on while Python code of the round runs.
+#define PHASE_START(s) ((s)->phase_stats ? PhaseNow() : 0)
+#define PHASE_END(s, phase, start)                                            \
+    do {                                                                      \
+        if ((start) != 0 && (s)->phase_stats) {                               \
+            PhaseStatsAdd((s)->phase_stats, (phase), PhaseNow() - (start));   \
+        }                                                                     \
+    } while (0)
+
 
 static PyObject*
 Sampler_start(SamplerObject* self, PyObject* Py_UNUSED(ignored)) {
@@ -283,6 +298,33 @@ matches_regex_patterns(PyObject* filename, PyObject* regex_patterns) {
 }
 
 
+// 1 if the frame is left out of the stack by the filters of the sampler
+static inline int
+skip_frame(SamplerObject* self, PyObject* filename, PyObject* name) {
+    // Apply focus_mode filtering
+    if (FOCUS_MODE_ENABLED(self) && is_stdlib_or_third_party(self, filename)) {
+        return 1;
+    }
+
+    // Apply regex pattern filtering
+    if (!matches_regex_patterns(name, self->regex_patterns) &&
+        !matches_regex_patterns(filename, self->regex_patterns)) {
+        return 1;
+    }
+
+    // Support both Unix (/) and Windows (\) path separators for ignore_self
+    if (IGNORE_SELF_ENABLED(self) &&
+        (PyUnicode_Contain(filename, "/site-packages/telex") ||
+         PyUnicode_Contain(filename, "\\site-packages\\telex") ||
+         PyUnicode_Contain(filename, "/bin/telex") ||
+         PyUnicode_Contain(filename, "\\bin\\telex"))) {
+        return 1;
+    }
+    return IGNORE_FROZEN_ENABLED(self) &&
+           PyUnicode_start_with(filename, "<frozen");
+}
+
+
 // return 0 on success, other on failure and set python error
 static int
 call_stack(SamplerObject* self,
@@ -298,6 +340,7 @@ call_stack(SamplerObject* self,
     }
 
     size_t pos = 0;
+    unsigned long long walk = PHASE_START(self);
     Py_INCREF(frame);
     PyObject* list = PyList_New(0);
     if (list == NULL) {
@@ -315,9 +358,14 @@ call_stack(SamplerObject* self,
         PyList_Append(list, (PyObject*)frame);
         frame = PyFrame_GetBack(frame);  // return a new reference
     }
+    PHASE_END(self, PHASE_FRAME_WALK, walk);
     int overflow = 0;
+    unsigned long long filter_ns = 0;
+    unsigned long long format_ns = 0;
+    int timed = self->phase_stats != NULL;
     Py_ssize_t len = PyList_Size(list);
     for (Py_ssize_t i = len - 1; i >= 0; --i) {
+        unsigned long long mark = timed ? PhaseNow() : 0;
         PyFrameObject* frame =
             (PyFrameObject*)PyList_GetItem(list, i);  // Borrowed reference
         PyCodeObject* code = PyFrame_GetCode(frame);  // New reference
@@ -327,35 +375,22 @@ call_stack(SamplerObject* self,
 #if PY_VERSION_HEX >= 0x030B00F0
         name = code->co_qualname;
 #endif
-        // Apply focus_mode filtering
-        if (FOCUS_MODE_ENABLED(self) &&
-            is_stdlib_or_third_party(self, filename)) {
-            Py_DECREF(code);
-            continue;
-        }
-
-        // Apply regex pattern filtering
-        if (!matches_regex_patterns(name, self->regex_patterns) &&
-            !matches_regex_patterns(filename, self->regex_patterns)) {
-            Py_DECREF(code);
-            continue;
-        }
-
-        // Support both Unix (/) and Windows (\) path separators for ignore_self
-        if (IGNORE_SELF_ENABLED(self) &&
-            (PyUnicode_Contain(filename, "/site-packages/telex") ||
-             PyUnicode_Contain(filename, "\\site-packages\\telex") ||
-             PyUnicode_Contain(filename, "/bin/telex") ||
-             PyUnicode_Contain(filename, "\\bin\\telex"))) {
-            Py_DECREF(code);
-            continue;
-        }
         if (filename == NULL || name == NULL) {
             PyErr_Format(PyExc_RuntimeError,
                          "telexsys: failed to get filename or name");
             Py_DECREF(code);
             goto error;
         }
+        int skip = skip_frame(self, filename, name);
+        if (timed) {
+            unsigned long long now = PhaseNow();
+            filter_ns += now - mark;
+            mark = now;
+        }
+        if (skip) {
+            Py_DECREF(code);
+            continue;
+        }
 
         int lineno = code->co_firstlineno;
         if (TREE_MODE_ENABLED(self))
@@ -367,25 +402,29 @@ call_stack(SamplerObject* self,
         } else {
             format = "%s:%s:%d";
         }
-        if (!(IGNORE_FROZEN_ENABLED(self) &&
-              PyUnicode_start_with(filename, "<frozen"))) {
-            ret = snprintf(buf + pos,
-                           buf_size - pos,
-                           format,
-                           PyUnicode_AsUTF8(filename),
-                           PyUnicode_AsUTF8(name),
-                           lineno);
-            if (ret >= (int)buf_size - pos) {
-                overflow = 1;
-                PyErr_Format(PyExc_RuntimeError,
-                             "telexsys: buffer overflow, call stack too deep");
-                Py_DECREF(code);
-                goto error;
-            }
-            pos += ret;
+        ret = snprintf(buf + pos,
+                       buf_size - pos,
+                       format,
+                       PyUnicode_AsUTF8(filename),
+                       PyUnicode_AsUTF8(name),
+                       lineno);
+        if (ret >= (int)buf_size - pos) {
+            overflow = 1;
+            PyErr_Format(PyExc_RuntimeError,
+                         "telexsys: buffer overflow, call stack too deep");
+            Py_DECREF(code);
+            goto error;
+        }
+        pos += ret;
+        if (timed) {
+            format_ns += PhaseNow() - mark;
         }
         Py_DECREF(code);
     }
+    if (timed && self->phase_stats) {
+        PhaseStatsAdd(self->phase_stats, PHASE_FILTER, filter_ns);
+        PhaseStatsAdd(self->phase_stats, PHASE_FORMAT, format_ns);
+    }
 
     Py_DECREF(list);
     return overflow;
@@ -426,6 +465,23 @@ unix_micro_time(void) {
     return (Telex_time)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
+// add a sampled call stack of thread `tid` to the tree and the sample log
+static inline void
+add_sample(SamplerObject* self,
+           unsigned long tid,
+           Telex_time time,
+           const char* callstack) {
+    unsigned long long start = PHASE_START(self);
+    AddCallStack(self->tree, callstack);
+    if (self->sample_log != NULL) {
+        SampleLogAdd(self->sample_log, tid, time, callstack);
+    }
+    if (self->shm_ring != NULL) {
+        ShmRingAdd(self->shm_ring, tid, time, callstack);
+    }
+    PHASE_END(self, PHASE_ADD, start);
+}
+
 static PyObject*
 _sampling_routine(SamplerObject* self, PyObject* Py_UNUSED(ignore)) {
     PyObject* threading = PyImport_ImportModule("threading");
@@ -437,27 +493,32 @@ _sampling_routine(SamplerObject* self, PyObject* Py_UNUSED(ignore)) {
     const size_t buf_size = BUF_SIZE;
     char* buf = (char*)malloc(buf_size);
     Telex_time sampling_start = unix_micro_time();
-    long nsec = (long)PyLong_AsLong(self->sampling_interval) * 1000;
     while (Sample_Enabled(self)) {
         self->sampling_times++;
+        // read every round to allow dynamic updates of the sampling interval
+        long usec = PyLong_AsLong(self->sampling_interval);
         Py_BEGIN_ALLOW_THREADS;
-        // allow dynamic updates of the sampling interval
-        struct timespec req = {.tv_sec = 0, .tv_nsec = nsec};
+        struct timespec req = {.tv_sec = usec / 1000000,
+                               .tv_nsec = (usec % 1000000) * 1000};
         int ret = nanosleep(&req, NULL);
         if (ret != 0) {
             perror("telexsys: nanosleep error");
         }
         Py_END_ALLOW_THREADS;
         Telex_time sampler_start = unix_micro_time();
+        unsigned long long round = PHASE_START(self);
         PyObject* frames = _PyThread_CurrentFrames();  // New reference
         if (frames == NULL) {
             PyErr_Format(PyExc_RuntimeError,
                          "telexsys: _PyThread_CurrentFrames() failed");
             return NULL;
         }
+        PHASE_END(self, PHASE_CURRENT_FRAMES, round);
+        unsigned long long phase = PHASE_START(self);
         PyObject* threads = PyObject_CallMethod(threading,
                                                 "enumerate",
                                                 NULL);  // New reference
+        PHASE_END(self, PHASE_THREADS, phase);
         if (threads == NULL) {
             PyErr_SetString(PyExc_RuntimeError,
                             "telexsys: threading.enumerate() failed");
@@ -481,7 +542,9 @@ _sampling_routine(SamplerObject* self, PyObject* Py_UNUSED(ignore)) {
             if (tid == self->sampling_tid) {
                 continue;
             }
+            phase = PHASE_START(self);
             PyObject* name = get_thread_name(threads, key);
+            PHASE_END(self, PHASE_THREAD_NAME, phase);
             if (name == NULL) {
                 // Error occurred in get_thread_name
                 Py_DECREF(frames);
@@ -499,11 +562,12 @@ _sampling_routine(SamplerObject* self, PyObject* Py_UNUSED(ignore)) {
                 goto error;
             }
             if (has_content_after_thread_name(buf, size)) {
-                AddCallStack(self->tree, buf);
+                add_sample(self, tid, sampler_start, buf);
             }
         }
         Py_DECREF(frames);
         Py_DECREF(threads);
+        PHASE_END(self, PHASE_ROUND, round);
         Telex_time sampler_end = unix_micro_time();
         self->acc_sampling_time += sampler_end - sampler_start;
         if (CHECK_FALG(self, VERBOSE)) {
@@ -542,6 +606,13 @@ Sampler_clear_tree(SamplerObject* self, PyObject* Py_UNUSED(ignore)) {
             return NULL;
         }
     }
+    if (self->sample_log) {
+        FreeSampleLog(self->sample_log);
+        self->sample_log = NewSampleLog();
+    }
+    if (self->phase_stats) {
+        ClearPhaseStats(self->phase_stats);
+    }
     self->acc_sampling_time = 0;
     self->sampling_times = 0;
     Py_RETURN_NONE;
@@ -551,12 +622,22 @@ static PyObject*
 Sampler_save(SamplerObject* self, PyObject* const* args, Py_ssize_t nargs) {
     if (nargs != 1) {
         PyErr_SetString(PyExc_TypeError, "save() takes exactly one argument");
+        return NULL;
     }
     PyObject* filename = args[0];
     if (!PyUnicode_Check(filename)) {
         PyErr_SetString(PyExc_TypeError, "filename must be a string");
+        return NULL;
+    }
+    const char* path = PyUnicode_AsUTF8(filename);
+    if (path == NULL) {
+        return NULL;
+    }
+    // the sampling thread adds to the tree, the GIL is kept
+    errno = 0;
+    if (DumpFolded(self->tree, path) != 0) {
+        return PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, filename);
     }
-    Dump(self->tree, PyUnicode_AsUTF8(filename));
     Py_RETURN_NONE;
 }
 
@@ -569,6 +650,155 @@ Sampler_dumps(SamplerObject* self, PyObject* Py_UNUSED(ignore)) {
     return result;
 }
 
+static int
+check_sample_log(SamplerObject* self) {
+    if (self->sample_log == NULL) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "sample_log is not enabled, set it before start()");
+        return -1;
+    }
+    return 0;
+}
+
+
+PyDoc_STRVAR(Sampler_save_speedscope_doc,
+             "save_speedscope(filename, name='telex')\n"
+             "--\n\n"
+             "Save the sample log in speedscope's file format, a sampled "
+             "profile per thread.");
+
+static PyObject*
+Sampler_save_speedscope(SamplerObject* self,
+                        PyObject* args,
+                        PyObject* kwargs) {
+    static char* kwlist[] = {"filename", "name", NULL};
+    const char* filename = NULL;
+    const char* name = "telex";
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwargs, "s|s:save_speedscope", kwlist, &filename, &name)) {
+        return NULL;
+    }
+    if (check_sample_log(self) < 0) {
+        return NULL;
+    }
+    long interval = PyLong_AsLong(self->sampling_interval);
+    if (interval == -1 && PyErr_Occurred()) {
+        return NULL;
+    }
+    if (SampleLogWriteSpeedscope(self->sample_log, filename, name, interval) <
+        0) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    }
+    return PyLong_FromSize_t(SampleLogCount(self->sample_log));
+}
+
+
+PyDoc_STRVAR(Sampler_save_chrome_trace_doc,
+             "save_chrome_trace(filename, pid=0)\n"
+             "--\n\n"
+             "Save the sample log as Chrome trace events, frames open and "
+             "close as they show up in and leave the samples.");
+
+static PyObject*
+Sampler_save_chrome_trace(SamplerObject* self,
+                          PyObject* args,
+                          PyObject* kwargs) {
+    static char* kwlist[] = {"filename", "pid", NULL};
+    const char* filename = NULL;
+    long long pid = 0;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwargs, "s|L:save_chrome_trace", kwlist, &filename, &pid)) {
+        return NULL;
+    }
+    if (check_sample_log(self) < 0) {
+        return NULL;
+    }
+    long interval = PyLong_AsLong(self->sampling_interval);
+    if (interval == -1 && PyErr_Occurred()) {
+        return NULL;
+    }
+    if (SampleLogWriteChromeTrace(self->sample_log, filename, pid, interval) <
+        0) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    }
+    return PyLong_FromSize_t(SampleLogCount(self->sample_log));
+}
+
+
+PyDoc_STRVAR(
+    Sampler_stats_doc,
+    "stats()\n\n"
+    "The time spent in every phase of the sampling rounds, as a dict of\n"
+    "phase name to count, total_ns, mean_ns, max_ns, p50_ns, p99_ns and\n"
+    "histogram, the counts of the log2 buckets of nanoseconds by the\n"
+    "lower bound of the bucket. Quantiles are the upper bound of their\n"
+    "bucket. The filter and format phases add up all the frames of a\n"
+    "thread. Raises RuntimeError unless phase_stats is enabled.");
+
+static PyObject*
+Sampler_stats(SamplerObject* self, PyObject* Py_UNUSED(ignore)) {
+    const struct PhaseStats* stats = self->phase_stats;
+    if (stats == NULL) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "phase_stats is not enabled, set it before start()");
+        return NULL;
+    }
+    PyObject* result = PyDict_New();
+    if (result == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        const struct PhaseHistogram* h = &stats->phases[i];
+        PyObject* histogram = PyDict_New();
+        if (histogram == NULL) {
+            goto error;
+        }
+        for (int b = 0; b < PHASE_BUCKETS; ++b) {
+            if (h->buckets[b] == 0) {
+                continue;
+            }
+            PyObject* lower = PyLong_FromUnsignedLongLong(b ? 1ull << b : 0);
+            PyObject* count = PyLong_FromUnsignedLongLong(h->buckets[b]);
+            int ret = lower && count ? PyDict_SetItem(histogram, lower, count)
+                                     : -1;
+            Py_XDECREF(lower);
+            Py_XDECREF(count);
+            if (ret < 0) {
+                Py_DECREF(histogram);
+                goto error;
+            }
+        }
+        PyObject* phase = Py_BuildValue(
+            "{sKsKsKsKsKsKsN}",
+            "count",
+            h->count,
+            "total_ns",
+            h->total_ns,
+            "mean_ns",
+            h->count ? h->total_ns / h->count : 0ull,
+            "max_ns",
+            h->max_ns,
+            "p50_ns",
+            PhaseStatsQuantile(stats, (enum SamplerPhase)i, 0.5),
+            "p99_ns",
+            PhaseStatsQuantile(stats, (enum SamplerPhase)i, 0.99),
+            "histogram",
+            histogram);
+        if (phase == NULL ||
+            PyDict_SetItemString(result, PhaseNames[i], phase) < 0) {
+            Py_XDECREF(phase);
+            goto error;
+        }
+        Py_DECREF(phase);
+    }
+    return result;
+
+error:
+    Py_DECREF(result);
+    return NULL;
+}
+
+
 static PyObject*
 Sampler_get_enabled(SamplerObject* self, void* Py_UNUSED(closure)) {
     if (CHECK_FALG(self, ENABLED)) {
@@ -614,7 +844,8 @@ static PyMethodDef Sampler_methods[] = {
         "save",
         _PyCFunction_CAST(Sampler_save),
         METH_FASTCALL,
-        "Save the stack tree to a file",
+        "Save the stack tree to a folded file, gzipped if its name ends "
+        "with .gz",
     },
     {
         "dumps",
@@ -622,6 +853,24 @@ static PyMethodDef Sampler_methods[] = {
         METH_NOARGS,
         "Dumps the stack tree to a string",
     },
+    {
+        "save_speedscope",
+        _PyCFunction_CAST(Sampler_save_speedscope),
+        METH_VARARGS | METH_KEYWORDS,
+        Sampler_save_speedscope_doc,
+    },
+    {
+        "save_chrome_trace",
+        _PyCFunction_CAST(Sampler_save_chrome_trace),
+        METH_VARARGS | METH_KEYWORDS,
+        Sampler_save_chrome_trace_doc,
+    },
+    {
+        "stats",
+        (PyCFunction)Sampler_stats,
+        METH_NOARGS,
+        Sampler_stats_doc,
+    },
     {
         "enabled",
         (PyCFunction)Sampler_get_enabled,
@@ -730,6 +979,33 @@ Sampler_get_sampling_times(SamplerObject* self, void* Py_UNUSED(closure)) {
 }
 
 
+// the TreeStats of `tree` as a dict
+static PyObject*
+tree_stats(struct StackTree* tree) {
+    struct TreeStats stats;
+    TreeGetStats(tree, &stats);
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K}",
+                         "nodes",
+                         stats.nodes,
+                         "leaves",
+                         stats.leaves,
+                         "max_depth",
+                         stats.max_depth,
+                         "total_depth",
+                         stats.total_depth,
+                         "name_bytes",
+                         stats.name_bytes,
+                         "heap_bytes",
+                         stats.heap_bytes);
+}
+
+
+static PyObject*
+Sampler_get_tree_stats(SamplerObject* self, void* Py_UNUSED(closure)) {
+    return tree_stats(self->tree);
+}
+
+
 static PyObject*
 Sampler_get_ignore_frozen(SamplerObject* self, void* Py_UNUSED(closure)) {
     if (DEBUG_ENABLED(self)) {
@@ -833,6 +1109,108 @@ Sampler_set_focus_mode(SamplerObject* self,
 }
 
 
+static PyObject*
+Sampler_get_sample_log(SamplerObject* self, void* Py_UNUSED(closure)) {
+    if (self->sample_log != NULL) {
+        Py_RETURN_TRUE;
+    }
+    Py_RETURN_FALSE;
+}
+
+
+static int
+Sampler_set_sample_log(SamplerObject* self,
+                       PyObject* value,
+                       void* Py_UNUSED(closure)) {
+    if (!PyBool_Check(value)) {
+        PyErr_Format(PyExc_TypeError, "sample_log must be a bool");
+        return -1;
+    }
+    if (Py_IsTrue(value)) {
+        if (self->sample_log == NULL) {
+            self->sample_log = NewSampleLog();
+        }
+    } else if (self->sample_log != NULL) {
+        FreeSampleLog(self->sample_log);
+        self->sample_log = NULL;
+    }
+    return 0;
+}
+
+
+static PyObject*
+Sampler_get_phase_stats(SamplerObject* self, void* Py_UNUSED(closure)) {
+    if (self->phase_stats != NULL) {
+        Py_RETURN_TRUE;
+    }
+    Py_RETURN_FALSE;
+}
+
+
+static int
+Sampler_set_phase_stats(SamplerObject* self,
+                        PyObject* value,
+                        void* Py_UNUSED(closure)) {
+    if (!PyBool_Check(value)) {
+        PyErr_Format(PyExc_TypeError, "phase_stats must be a bool");
+        return -1;
+    }
+    if (Py_IsTrue(value)) {
+        if (self->phase_stats == NULL) {
+            self->phase_stats = NewPhaseStats();
+            if (self->phase_stats == NULL) {
+                PyErr_NoMemory();
+                return -1;
+            }
+        }
+    } else if (self->phase_stats != NULL) {
+        FreePhaseStats(self->phase_stats);
+        self->phase_stats = NULL;
+    }
+    return 0;
+}
+
+
+static PyObject*
+Sampler_get_shm_ring(SamplerObject* self, void* Py_UNUSED(closure)) {
+    if (self->shm_ring == NULL) {
+        Py_RETURN_NONE;
+    }
+    return PyUnicode_DecodeFSDefault(ShmRingPath(self->shm_ring));
+}
+
+
+static int
+Sampler_set_shm_ring(SamplerObject* self,
+                     PyObject* value,
+                     void* Py_UNUSED(closure)) {
+    if (value != NULL && value != Py_None && !PyUnicode_Check(value)) {
+        PyErr_Format(PyExc_TypeError, "shm_ring must be a str or None");
+        return -1;
+    }
+    struct ShmRing* ring = NULL;
+    if (value != NULL && value != Py_None) {
+        PyObject* path = PyUnicode_EncodeFSDefault(value);
+        if (path == NULL) {
+            return -1;
+        }
+        ring = NewShmRing(
+            PyBytes_AS_STRING(path), SHM_RING_SLOTS, SHM_RING_SYMBOL_BYTES);
+        if (ring == NULL) {
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, value);
+            Py_DECREF(path);
+            return -1;
+        }
+        Py_DECREF(path);
+    }
+    if (self->shm_ring != NULL) {
+        FreeShmRing(self->shm_ring);
+    }
+    self->shm_ring = ring;
+    return 0;
+}
+
+
 static PyObject*
 Sampler_get_regex_patterns(SamplerObject* self, void* Py_UNUSED(closure)) {
     if (self->regex_patterns == NULL) {
@@ -938,6 +1316,27 @@ static PyGetSetDef Sampler_getset[] = {
         "focus mode - ignore stdlib and third-party libraries",
         NULL,
     },
+    {
+        "sample_log",
+        (getter)Sampler_get_sample_log,
+        (setter)Sampler_set_sample_log,
+        "keep every sample in order, for the timeline exports",
+        NULL,
+    },
+    {
+        "phase_stats",
+        (getter)Sampler_get_phase_stats,
+        (setter)Sampler_set_phase_stats,
+        "time every phase of a sampling round, see stats",
+        NULL,
+    },
+    {
+        "shm_ring",
+        (getter)Sampler_get_shm_ring,
+        (setter)Sampler_set_shm_ring,
+        "path of the file samples are exported to, see shm_ring_read",
+        NULL,
+    },
     {
         "regex_patterns",
         (getter)Sampler_get_regex_patterns,
@@ -952,6 +1351,13 @@ static PyGetSetDef Sampler_getset[] = {
         "sampling times of the sampler",
         NULL,
     },
+    {
+        "tree_stats",
+        (getter)Sampler_get_tree_stats,
+        NULL,
+        "the frames, leaves, depths and bytes of the stack tree",
+        NULL,
+    },
     {NULL, NULL, NULL, NULL, NULL}  // Sentinel
 };
 
@@ -977,6 +1383,13 @@ Sampler_dealloc(SamplerObject* self) {
     if (self->tree) {
         FreeTree(self->tree);
     }
+    if (self->sample_log) {
+        FreeSampleLog(self->sample_log);
+    }
+    if (self->shm_ring) {
+        FreeShmRing(self->shm_ring);
+    }
+    FreePhaseStats(self->phase_stats);
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -994,6 +1407,16 @@ Sampler_clear(SamplerObject* self) {
         FreeTree(self->tree);
         self->tree = NULL;
     }
+    if (self->sample_log) {
+        FreeSampleLog(self->sample_log);
+        self->sample_log = NULL;
+    }
+    if (self->shm_ring) {
+        FreeShmRing(self->shm_ring);
+        self->shm_ring = NULL;
+    }
+    FreePhaseStats(self->phase_stats);
+    self->phase_stats = NULL;
     self->sampling_times = 0;
     self->acc_sampling_time = 0;
     return 0;
@@ -1010,6 +1433,9 @@ Sampler_new(PyTypeObject* type,
         self->sampling_thread = NULL;
         self->regex_patterns = NULL;
         self->std_path = NULL;
+        self->sample_log = NULL;
+        self->shm_ring = NULL;
+        self->phase_stats = NULL;
         self->sampling_interval = PyLong_FromLong(10000);  // 10ms
         if (!self->sampling_interval) {
             Py_DECREF(self);
@@ -1172,6 +1598,27 @@ static PyGetSetDef AsyncSampler_getset[] = {
         "focus mode - ignore stdlib and third-party libraries",
         NULL,
     },
+    {
+        "sample_log",
+        (getter)Sampler_get_sample_log,
+        (setter)Sampler_set_sample_log,
+        "keep every sample in order, for the timeline exports",
+        NULL,
+    },
+    {
+        "phase_stats",
+        (getter)Sampler_get_phase_stats,
+        (setter)Sampler_set_phase_stats,
+        "time every phase of a sampling round, see stats",
+        NULL,
+    },
+    {
+        "shm_ring",
+        (getter)Sampler_get_shm_ring,
+        (setter)Sampler_set_shm_ring,
+        "path of the file samples are exported to, see shm_ring_read",
+        NULL,
+    },
     {
         "regex_patterns",
         (getter)Sampler_get_regex_patterns,  // share it
@@ -1186,6 +1633,13 @@ static PyGetSetDef AsyncSampler_getset[] = {
         "sampling times of the sampler",
         NULL,
     },
+    {
+        "tree_stats",
+        (getter)Sampler_get_tree_stats,  // share it
+        NULL,
+        "the frames, leaves, depths and bytes of the stack tree",
+        NULL,
+    },
     {
         NULL,
         NULL,
@@ -1310,6 +1764,7 @@ AsyncSampler_async_routine(AsyncSamplerObject* self,
     char* buf = self->buf;
 
     Telex_time sampling_start = unix_micro_time();
+    unsigned long long round = PHASE_START(base);
 
     // Check again before accessing frames - sampler might have been stopped
     if (!Sample_Enabled(base)) {
@@ -1324,6 +1779,7 @@ AsyncSampler_async_routine(AsyncSamplerObject* self,
                      "telexsys: _PyThread_CurrentFrames() failed");
         return NULL;
     }
+    PHASE_END(base, PHASE_CURRENT_FRAMES, round);
 
     // Check again after _PyThread_CurrentFrames
     if (!Sample_Enabled(base)) {
@@ -1341,10 +1797,13 @@ AsyncSampler_async_routine(AsyncSamplerObject* self,
             return NULL;
         }
         if (has_content_after_thread_name(buf, size)) {
-            AddCallStack(base->tree, buf);
+            // the signal handler runs in the main thread
+            add_sample(base, PyThread_get_thread_ident(), sampling_start, buf);
         }
     }
+    unsigned long long phase = PHASE_START(base);
     PyObject* threads = get_all_threads(threading);  // New reference
+    PHASE_END(base, PHASE_THREADS, phase);
     if (threads == NULL || PyErr_Occurred()) {
         PyErr_Format(PyExc_RuntimeError, "telexsys: get_all_threads() failed");
         Py_DECREF(frames);
@@ -1374,7 +1833,9 @@ AsyncSampler_async_routine(AsyncSamplerObject* self,
         if (tid == base->sampling_tid) {
             continue;
         }
+        phase = PHASE_START(base);
         PyObject* name = get_thread_name(threads, key);
+        PHASE_END(base, PHASE_THREAD_NAME, phase);
         if (name == NULL) {
             // Error occurred in get_thread_name
             goto error;
@@ -1404,7 +1865,7 @@ AsyncSampler_async_routine(AsyncSamplerObject* self,
             goto error;
         }
         if (has_content_after_thread_name(buf, size)) {
-            AddCallStack(base->tree, buf);
+            add_sample(base, tid, sampling_start, buf);
         }
     }
 
@@ -1423,6 +1884,7 @@ AsyncSampler_async_routine(AsyncSamplerObject* self,
     // }
     // =======================================================================
 
+    PHASE_END(base, PHASE_ROUND, round);
     Telex_time sampling_end = unix_micro_time();
     base->acc_sampling_time += sampling_end - sampling_start;
     base->sampling_times++;
@@ -1478,7 +1940,8 @@ static PyMethodDef AsyncSampler_methods[] = {
         "save",
         _PyCFunction_CAST(Sampler_save),  // share it
         METH_FASTCALL,
-        "Save the stack tree to a file",
+        "Save the stack tree to a folded file, gzipped if its name ends "
+        "with .gz",
     },
     {
         "clear",
@@ -1492,6 +1955,24 @@ static PyMethodDef AsyncSampler_methods[] = {
         METH_NOARGS,
         "Dumps the stack tree to a string",
     },
+    {
+        "save_speedscope",
+        _PyCFunction_CAST(Sampler_save_speedscope),  // share it
+        METH_VARARGS | METH_KEYWORDS,
+        Sampler_save_speedscope_doc,
+    },
+    {
+        "save_chrome_trace",
+        _PyCFunction_CAST(Sampler_save_chrome_trace),  // share it
+        METH_VARARGS | METH_KEYWORDS,
+        Sampler_save_chrome_trace_doc,
+    },
+    {
+        "stats",
+        (PyCFunction)Sampler_stats,  // share it
+        METH_NOARGS,
+        Sampler_stats_doc,
+    },
     {
         "enabled",
         (PyCFunction)Sampler_get_enabled,  // share it
@@ -1515,6 +1996,16 @@ AsyncSampler_clear(AsyncSamplerObject* self) {
         FreeTree(self->base.tree);
         self->base.tree = NULL;
     }
+    if (self->base.sample_log) {
+        FreeSampleLog(self->base.sample_log);
+        self->base.sample_log = NULL;
+    }
+    if (self->base.shm_ring) {
+        FreeShmRing(self->base.shm_ring);
+        self->base.shm_ring = NULL;
+    }
+    FreePhaseStats(self->base.phase_stats);
+    self->base.phase_stats = NULL;
     if (self->buf) {
         free(self->buf);
         self->buf = NULL;
@@ -1539,6 +2030,9 @@ AsyncSampler_new(PyTypeObject* type,
         self->base.sampling_tid = 0;
         self->base.regex_patterns = NULL;
         self->base.std_path = NULL;
+        self->base.sample_log = NULL;
+        self->base.shm_ring = NULL;
+        self->base.phase_stats = NULL;
         self->base.sampling_interval = PyLong_FromLong(10000);  // 10ms
         if (!self->base.sampling_interval) {
             Py_DECREF(self);
@@ -1599,26 +2093,677 @@ static PyType_Spec async_sampler_spec = {
 };
 
 
-PyDoc_STRVAR(telexsys_doc, "An utility module for telexsys");
-
-PyDoc_STRVAR(
-    telexsys_current_frames_doc,
-    "Returns a dictionary where keys are thread IDs and values are "
-    "stack frames, including all threads in all Python interpreters.");
+// StackTree, folded stacks loaded from files or added line by line
 
-static PyObject*
-telexsys_current_frames(PyObject* Py_UNUSED(module),
-                        PyObject* Py_UNUSED(args)) {
-    return _PyThread_CurrentFrames();
+static int
+StackTree_check_idle(StackTreeObject* self) {
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "StackTree is being loaded");
+        return -1;
+    }
+    return 0;
 }
 
-PyDoc_STRVAR(telexsys_unix_microtime_doc,
-             "Returns the current time in microseconds since the epoch.");
+static int
+stack_tree_load(StackTreeObject* self, PyObject* filenames, int threads) {
+    if (StackTree_check_idle(self) < 0) {
+        return -1;
+    }
+    PyObject* fast;
+    if (PyUnicode_Check(filenames) || PyBytes_Check(filenames)) {
+        fast = PyTuple_Pack(1, filenames);  // a single file
+    } else {
+        fast = PySequence_Fast(filenames,
+                               "filenames must be a path or a sequence of "
+                               "paths");
+    }
+    if (fast == NULL) {
+        return -1;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(fast);
+    PyObject** encoded = PyMem_Calloc(n > 0 ? n : 1, sizeof(PyObject*));
+    const char** names = PyMem_Malloc(sizeof(char*) * (n > 0 ? n : 1));
+    int ret = -1;
+    if (encoded == NULL || names == NULL) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        if (!PyUnicode_FSConverter(PySequence_Fast_GET_ITEM(fast, i),
+                                   &encoded[i])) {
+            goto done;
+        }
+        names[i] = PyBytes_AS_STRING(encoded[i]);
+    }
 
-static PyObject*
-telexsys_unix_microtime(PyObject* Py_UNUSED(module),
-                        PyObject* Py_UNUSED(args)) {
-    return PyLong_FromLongLong((long long)unix_micro_time());
+    size_t failed = 0;
+    int saved;
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS;
+    errno = 0;
+    ret = LoadFolded(
+        names, (size_t)n, threads, self->tree, &self->stats, &failed);
+    saved = errno;
+    Py_END_ALLOW_THREADS;
+    self->busy = 0;
+    if (ret != 0) {
+        errno = saved;
+        PyErr_SetFromErrnoWithFilenameObject(
+            PyExc_OSError, PySequence_Fast_GET_ITEM(fast, failed));
+    }
+
+done:
+    if (encoded != NULL) {
+        for (Py_ssize_t i = 0; i < n; ++i) {
+            Py_XDECREF(encoded[i]);
+        }
+    }
+    PyMem_Free(encoded);
+    PyMem_Free(names);
+    Py_DECREF(fast);
+    return ret;
+}
+
+PyDoc_STRVAR(StackTree_load_doc,
+             "load(filenames, threads=0)\n\n"
+             "Add the stacks of folded files, see load_folded.");
+
+static PyObject*
+StackTree_load(StackTreeObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"filenames", "threads", NULL};
+    PyObject* filenames = NULL;
+    int threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O|i:load", kwlist, &filenames, &threads)) {
+        return NULL;
+    }
+    if (stack_tree_load(self, filenames, threads) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(StackTree_add_lines_doc,
+             "add_lines(lines)\n\n"
+             "Add folded stack lines such as 'a;b;c 10', invalid lines are "
+             "reported to stderr and ignored.");
+
+static PyObject*
+StackTree_add_lines(StackTreeObject* self, PyObject* lines) {
+    if (StackTree_check_idle(self) < 0) {
+        return NULL;
+    }
+    PyObject* iter = PyObject_GetIter(lines);
+    if (iter == NULL) {
+        return NULL;
+    }
+    PyObject* item;
+    while ((item = PyIter_Next(iter)) != NULL) {
+        Py_ssize_t size;
+        const char* line = PyUnicode_AsUTF8AndSize(item, &size);
+        if (line == NULL) {
+            Py_DECREF(item);
+            Py_DECREF(iter);
+            return NULL;
+        }
+        long long count = 0;
+        int ret = AddFolded(self->tree, line, (size_t)size, &count);
+        if (ret > 0) {
+            self->stats.bytes += size;
+            self->stats.lines++;
+            self->stats.samples += count;
+        } else if (ret < 0) {
+            self->stats.invalid++;
+            PyObject* stripped = PyObject_CallMethod(item, "strip", NULL);
+            if (stripped == NULL) {
+                Py_DECREF(item);
+                Py_DECREF(iter);
+                return NULL;
+            }
+            PySys_FormatStderr("Invalid line(ignored): %U\n", stripped);
+            Py_DECREF(stripped);
+        }
+        Py_DECREF(item);
+    }
+    Py_DECREF(iter);
+    if (PyErr_Occurred()) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+StackTree_dumps(StackTreeObject* self, PyObject* Py_UNUSED(ignore)) {
+    if (StackTree_check_idle(self) < 0) {
+        return NULL;
+    }
+    char* buf = Dumps(self->tree);
+    PyObject* result = PyUnicode_FromString(buf);
+    free(buf);
+    return result;
+}
+
+static PyObject*
+StackTree_save(StackTreeObject* self, PyObject* filename) {
+    if (StackTree_check_idle(self) < 0) {
+        return NULL;
+    }
+    PyObject* encoded = NULL;
+    if (!PyUnicode_FSConverter(filename, &encoded)) {
+        return NULL;
+    }
+    int ret;
+    Py_BEGIN_ALLOW_THREADS;
+    errno = 0;
+    ret = DumpFolded(self->tree, PyBytes_AS_STRING(encoded));
+    Py_END_ALLOW_THREADS;
+    Py_DECREF(encoded);
+    if (ret != 0) {
+        return PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, filename);
+    }
+    Py_RETURN_NONE;
+}
+
+// the other operand of merge and subtract
+static StackTreeObject*
+stack_tree_operand(StackTreeObject* self, PyObject* other) {
+    if (Py_TYPE(other) != Py_TYPE(self)) {
+        PyErr_SetString(PyExc_TypeError, "other must be a StackTree");
+        return NULL;
+    }
+    StackTreeObject* tree = (StackTreeObject*)other;
+    if (StackTree_check_idle(self) < 0 || StackTree_check_idle(tree) < 0) {
+        return NULL;
+    }
+    return tree;
+}
+
+PyDoc_STRVAR(StackTree_merge_doc,
+             "merge(other)\n\n"
+             "Add the stacks of another StackTree.");
+
+static PyObject*
+StackTree_merge(StackTreeObject* self, PyObject* other) {
+    StackTreeObject* tree = stack_tree_operand(self, other);
+    if (tree == NULL) {
+        return NULL;
+    }
+    self->busy = tree->busy = 1;
+    Py_BEGIN_ALLOW_THREADS;
+    MergeTree(self->tree, tree->tree);
+    Py_END_ALLOW_THREADS;
+    self->busy = tree->busy = 0;
+    self->stats.samples += tree->stats.samples;
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(StackTree_subtract_doc,
+             "subtract(other)\n\n"
+             "Take the stacks of a StackTree merged before out again, frames "
+             "left without samples are removed.");
+
+static PyObject*
+StackTree_subtract(StackTreeObject* self, PyObject* other) {
+    StackTreeObject* tree = stack_tree_operand(self, other);
+    if (tree == NULL) {
+        return NULL;
+    }
+    self->busy = tree->busy = 1;
+    Py_BEGIN_ALLOW_THREADS;
+    SubtractTree(self->tree, tree->tree);
+    Py_END_ALLOW_THREADS;
+    self->busy = tree->busy = 0;
+    self->stats.samples -= tree->stats.samples;
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(StackTree_pack_doc,
+             "pack()\n\n"
+             "The stacks in a compact binary form for merge_packed, every "
+             "distinct frame name is stored once.");
+
+static PyObject*
+StackTree_pack(StackTreeObject* self, PyObject* Py_UNUSED(ignore)) {
+    if (StackTree_check_idle(self) < 0) {
+        return NULL;
+    }
+    size_t size = 0;
+    char* buf;
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS;
+    buf = PackTree(self->tree, &size);
+    Py_END_ALLOW_THREADS;
+    self->busy = 0;
+    if (buf == NULL) {
+        return PyErr_NoMemory();
+    }
+    PyObject* result = PyBytes_FromStringAndSize(buf, (Py_ssize_t)size);
+    free(buf);
+    return result;
+}
+
+PyDoc_STRVAR(StackTree_merge_packed_doc,
+             "merge_packed(data)\n\n"
+             "Add the stacks of a tree packed by pack(), possibly in another "
+             "process. Raises ValueError, adding nothing, if data is not a "
+             "packed tree.");
+
+static PyObject*
+StackTree_merge_packed(StackTreeObject* self, PyObject* data) {
+    if (StackTree_check_idle(self) < 0) {
+        return NULL;
+    }
+    Py_buffer view;
+    if (PyObject_GetBuffer(data, &view, PyBUF_SIMPLE) < 0) {
+        return NULL;
+    }
+    unsigned long long before = TreeSamples(self->tree);
+    int ret;
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS;
+    ret = MergePacked(self->tree, view.buf, (size_t)view.len);
+    Py_END_ALLOW_THREADS;
+    self->busy = 0;
+    PyBuffer_Release(&view);
+    if (ret != 0) {
+        PyErr_SetString(PyExc_ValueError, "not a packed StackTree");
+        return NULL;
+    }
+    self->stats.samples += (long long)(TreeSamples(self->tree) - before);
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(StackTree_top_doc,
+             "top(k=10)\n\n"
+             "The k frames with the most self samples, as (frame, self, total) "
+             "tuples. total counts the samples a frame is on the stack in, "
+             "recursive calls once.");
+
+static PyObject*
+StackTree_top(StackTreeObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"k", NULL};
+    Py_ssize_t k = 10;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|n:top", kwlist, &k)) {
+        return NULL;
+    }
+    if (k < 0) {
+        PyErr_SetString(PyExc_ValueError, "k must not be negative");
+        return NULL;
+    }
+    if (StackTree_check_idle(self) < 0) {
+        return NULL;
+    }
+    struct FrameCount* frames =
+        PyMem_Malloc(sizeof(struct FrameCount) * (k > 0 ? k : 1));
+    if (frames == NULL) {
+        return PyErr_NoMemory();
+    }
+    size_t n = TopFrames(self->tree, (size_t)k, frames);
+    PyObject* result = PyList_New((Py_ssize_t)n);
+    for (size_t i = 0; result != NULL && i < n; ++i) {
+        PyObject* item = Py_BuildValue(
+            "(sKK)", frames[i].name, frames[i].self, frames[i].total);
+        if (item == NULL) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, (Py_ssize_t)i, item);
+    }
+    PyMem_Free(frames);
+    return result;
+}
+
+static PyMethodDef StackTree_methods[] = {
+    {
+        "load",
+        _PyCFunction_CAST(StackTree_load),
+        METH_VARARGS | METH_KEYWORDS,
+        StackTree_load_doc,
+    },
+    {
+        "add_lines",
+        (PyCFunction)StackTree_add_lines,
+        METH_O,
+        StackTree_add_lines_doc,
+    },
+    {
+        "dumps",
+        (PyCFunction)StackTree_dumps,
+        METH_NOARGS,
+        "Return the stacks as folded lines.",
+    },
+    {
+        "save",
+        (PyCFunction)StackTree_save,
+        METH_O,
+        "Save the stacks to a folded file, gzipped if its name ends with "
+        ".gz.",
+    },
+    {
+        "merge",
+        (PyCFunction)StackTree_merge,
+        METH_O,
+        StackTree_merge_doc,
+    },
+    {
+        "subtract",
+        (PyCFunction)StackTree_subtract,
+        METH_O,
+        StackTree_subtract_doc,
+    },
+    {
+        "pack",
+        (PyCFunction)StackTree_pack,
+        METH_NOARGS,
+        StackTree_pack_doc,
+    },
+    {
+        "merge_packed",
+        (PyCFunction)StackTree_merge_packed,
+        METH_O,
+        StackTree_merge_packed_doc,
+    },
+    {
+        "top",
+        _PyCFunction_CAST(StackTree_top),
+        METH_VARARGS | METH_KEYWORDS,
+        StackTree_top_doc,
+    },
+    {
+        NULL,
+        NULL,
+        0,
+        NULL,
+    },
+};
+
+static PyObject*
+StackTree_get_samples(StackTreeObject* self, void* Py_UNUSED(closure)) {
+    return PyLong_FromLongLong(self->stats.samples);
+}
+
+static PyObject*
+StackTree_get_stats(StackTreeObject* self, void* Py_UNUSED(closure)) {
+    return Py_BuildValue("{s:L,s:L,s:L,s:L,s:i}",
+                         "bytes",
+                         self->stats.bytes,
+                         "lines",
+                         self->stats.lines,
+                         "invalid",
+                         self->stats.invalid,
+                         "samples",
+                         self->stats.samples,
+                         "threads",
+                         self->stats.threads);
+}
+
+static PyObject*
+StackTree_get_tree_stats(StackTreeObject* self, void* Py_UNUSED(closure)) {
+    return tree_stats(self->tree);
+}
+
+static PyGetSetDef StackTree_getset[] = {
+    {
+        "samples",
+        (getter)StackTree_get_samples,
+        NULL,
+        "The sum of the counts of every line added",
+        NULL,
+    },
+    {
+        "stats",
+        (getter)StackTree_get_stats,
+        NULL,
+        "bytes, lines, invalid lines and samples added, and the threads "
+        "used by the last load",
+        NULL,
+    },
+    {
+        "tree_stats",
+        (getter)StackTree_get_tree_stats,
+        NULL,
+        "the frames, leaves, depths and bytes of the tree",
+        NULL,
+    },
+    {NULL, NULL, NULL, NULL, NULL},
+};
+
+static PyObject*
+StackTree_new(PyTypeObject* type, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, ":StackTree", kwlist)) {
+        return NULL;
+    }
+    StackTreeObject* self = (StackTreeObject*)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        return NULL;
+    }
+    self->tree = NewTree();
+    if (!self->tree) {
+        Py_DECREF(self);
+        PyErr_SetString(PyExc_RuntimeError, "Failed to create StackTree");
+        return NULL;
+    }
+    return (PyObject*)self;
+}
+
+static void
+StackTree_dealloc(StackTreeObject* self) {
+    PyTypeObject* type = Py_TYPE(self);
+    if (self->tree) {
+        FreeTree(self->tree);
+    }
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+static PyType_Slot StackTree_slots[] = {
+    {Py_tp_dealloc, StackTree_dealloc},
+    {Py_tp_methods, StackTree_methods},
+    {Py_tp_getset, StackTree_getset},
+    {Py_tp_new, StackTree_new},
+    {Py_tp_doc,
+     (void*)"StackTree()\n--\n\nFolded stacks merged in a tree, as a "
+            "sampler keeps them. It is accepted wherever a sampler's stack "
+            "tree is."},
+    {0, NULL},
+};
+
+static PyType_Spec stack_tree_spec = {
+    .name = "_telexsys.StackTree",
+    .basicsize = sizeof(StackTreeObject),
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = StackTree_slots,
+};
+
+static PyObject*
+RemoteProcess_new(PyTypeObject* type, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"pid", NULL};
+    int pid;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwargs, "i:RemoteProcess", kwlist, &pid)) {
+        return NULL;
+    }
+    struct RemoteProcess* remote;
+    Py_BEGIN_ALLOW_THREADS;
+    remote = RemoteAttach(pid);
+    Py_END_ALLOW_THREADS;
+    if (remote == NULL) {
+        if (errno == ENOSYS) {
+            PyErr_SetString(PyExc_NotImplementedError,
+                            "remote sampling needs Linux and Python 3.11 "
+                            "or 3.12");
+        } else if (errno == ENOEXEC) {
+            PyErr_Format(PyExc_ValueError,
+                         "process %d does not run Python %d.%d",
+                         pid,
+                         PY_MAJOR_VERSION,
+                         PY_MINOR_VERSION);
+        } else {
+            PyErr_SetFromErrno(PyExc_OSError);
+        }
+        return NULL;
+    }
+    RemoteProcessObject* self = (RemoteProcessObject*)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        RemoteDetach(remote);
+        return NULL;
+    }
+    self->remote = remote;
+    return (PyObject*)self;
+}
+
+static int
+RemoteProcess_check_open(RemoteProcessObject* self) {
+    if (self->remote == NULL) {
+        PyErr_SetString(PyExc_ValueError, "RemoteProcess is closed");
+        return -1;
+    }
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "RemoteProcess is sampling");
+        return -1;
+    }
+    return 0;
+}
+
+PyDoc_STRVAR(RemoteProcess_sample_doc,
+             "sample(tree, prefix=None)\n\n"
+             "Add the stack of every thread of the process to a StackTree, "
+             "after prefix when given, and return the number of stacks "
+             "added. Raises ProcessLookupError once the process exited.");
+
+static PyObject*
+RemoteProcess_sample(RemoteProcessObject* self,
+                     PyObject* args,
+                     PyObject* kwargs) {
+    static char* kwlist[] = {"tree", "prefix", NULL};
+    PyObject* tree_obj;
+    const char* prefix = NULL;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O|z:sample", kwlist, &tree_obj, &prefix)) {
+        return NULL;
+    }
+    // StackTree is not reachable from here, its type is known by its dealloc
+    if (Py_TYPE(tree_obj)->tp_dealloc != (destructor)StackTree_dealloc) {
+        PyErr_SetString(PyExc_TypeError, "tree must be a StackTree");
+        return NULL;
+    }
+    StackTreeObject* tree = (StackTreeObject*)tree_obj;
+    if (RemoteProcess_check_open(self) < 0 ||
+        StackTree_check_idle(tree) < 0) {
+        return NULL;
+    }
+    int added;
+    self->busy = tree->busy = 1;
+    Py_BEGIN_ALLOW_THREADS;
+    added = RemoteSample(self->remote, tree->tree, prefix);
+    Py_END_ALLOW_THREADS;
+    self->busy = tree->busy = 0;
+    if (added < 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    tree->stats.samples += (unsigned long long)added;
+    return PyLong_FromLong(added);
+}
+
+PyDoc_STRVAR(RemoteProcess_close_doc,
+             "close()\n\n"
+             "Forget the process, sample can not be called afterwards.");
+
+static PyObject*
+RemoteProcess_close(RemoteProcessObject* self, PyObject* Py_UNUSED(ignore)) {
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "RemoteProcess is sampling");
+        return NULL;
+    }
+    RemoteDetach(self->remote);
+    self->remote = NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+RemoteProcess_get_pid(RemoteProcessObject* self, void* Py_UNUSED(closure)) {
+    if (RemoteProcess_check_open(self) < 0) {
+        return NULL;
+    }
+    return PyLong_FromLong(RemotePid(self->remote));
+}
+
+static PyMethodDef RemoteProcess_methods[] = {
+    {
+        "sample",
+        _PyCFunction_CAST(RemoteProcess_sample),
+        METH_VARARGS | METH_KEYWORDS,
+        RemoteProcess_sample_doc,
+    },
+    {
+        "close",
+        (PyCFunction)RemoteProcess_close,
+        METH_NOARGS,
+        RemoteProcess_close_doc,
+    },
+    {NULL, NULL, 0, NULL},
+};
+
+static PyGetSetDef RemoteProcess_getset[] = {
+    {
+        "pid",
+        (getter)RemoteProcess_get_pid,
+        NULL,
+        "The process read",
+        NULL,
+    },
+    {NULL, NULL, NULL, NULL, NULL},
+};
+
+static void
+RemoteProcess_dealloc(RemoteProcessObject* self) {
+    PyTypeObject* type = Py_TYPE(self);
+    RemoteDetach(self->remote);
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+static PyType_Slot RemoteProcess_slots[] = {
+    {Py_tp_dealloc, RemoteProcess_dealloc},
+    {Py_tp_methods, RemoteProcess_methods},
+    {Py_tp_getset, RemoteProcess_getset},
+    {Py_tp_new, RemoteProcess_new},
+    {Py_tp_doc,
+     (void*)"RemoteProcess(pid)\n--\n\nAnother local process running this "
+            "Python version, sampled by reading its memory without running "
+            "anything in it. Linux only."},
+    {0, NULL},
+};
+
+static PyType_Spec remote_process_spec = {
+    .name = "_telexsys.RemoteProcess",
+    .basicsize = sizeof(RemoteProcessObject),
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = RemoteProcess_slots,
+};
+
+
+PyDoc_STRVAR(telexsys_doc, "An utility module for telexsys");
+
+PyDoc_STRVAR(
+    telexsys_current_frames_doc,
+    "Returns a dictionary where keys are thread IDs and values are "
+    "stack frames, including all threads in all Python interpreters.");
+
+static PyObject*
+telexsys_current_frames(PyObject* Py_UNUSED(module),
+                        PyObject* Py_UNUSED(args)) {
+    return _PyThread_CurrentFrames();
+}
+
+PyDoc_STRVAR(telexsys_unix_microtime_doc,
+             "Returns the current time in microseconds since the epoch.");
+
+static PyObject*
+telexsys_unix_microtime(PyObject* Py_UNUSED(module),
+                        PyObject* Py_UNUSED(args)) {
+    return PyLong_FromLongLong((long long)unix_micro_time());
 }
 
 static PyObject*
@@ -1669,6 +2814,83 @@ telexsys_yield(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args)) {
 
 PyDoc_STRVAR(telexsys_yield_doc, "Yield the current thread to other threads.");
 
+// The frame `level` calls below the top frame of thread `tid_obj`, a new
+// reference. NULL without an error if the thread is gone or the stack is not
+// that deep.
+static PyObject*
+frame_at_level(PyObject* frames_dict, PyObject* tid_obj, long level) {
+    // PyDict_GetItem returns a borrowed reference
+    PyObject* frame = PyDict_GetItem(frames_dict, tid_obj);
+    if (frame == NULL) {
+        return NULL;
+    }
+    Py_INCREF(frame);
+    // level=0 means top frame (current frame), level=1 means f_back, etc.
+    for (long i = 0; i < level && frame != NULL; i++) {
+        PyObject* back = (PyObject*)PyFrame_GetBack((PyFrameObject*)frame);
+        Py_DECREF(frame);
+        frame = back;
+    }
+    return frame;
+}
+
+// The (f_locals, f_globals) of a frame, None for a namespace that can not be
+// read. Reading f_locals gathers the fast locals every time, so the tuple is
+// kept in `cache` for the next variable of the same frame when it is given.
+// returns a new reference
+static PyObject*
+frame_namespaces(PyObject* frame, PyObject* cache) {
+    if (cache != NULL) {
+        PyObject* cached = PyDict_GetItem(cache, frame);
+        if (cached != NULL) {
+            return Py_NewRef(cached);
+        }
+    }
+    PyObject* locals = PyObject_GetAttrString(frame, "f_locals");
+    if (locals == NULL) {
+        PyErr_Clear();
+        locals = Py_NewRef(Py_None);
+    }
+    PyObject* globals = PyObject_GetAttrString(frame, "f_globals");
+    if (globals == NULL) {
+        PyErr_Clear();
+        globals = Py_NewRef(Py_None);
+    }
+    PyObject* namespaces = PyTuple_Pack(2, locals, globals);
+    Py_DECREF(locals);
+    Py_DECREF(globals);
+    if (namespaces != NULL && cache != NULL &&
+        PyDict_SetItem(cache, frame, namespaces) < 0) {
+        Py_CLEAR(namespaces);
+    }
+    return namespaces;
+}
+
+// Look `name_obj` up in the locals, then the globals of `frame`. returns a
+// new reference, NULL without an error if the variable is not found
+static PyObject*
+frame_lookup(PyObject* frame, PyObject* name_obj, PyObject* cache) {
+    PyObject* namespaces = frame_namespaces(frame, cache);
+    if (namespaces == NULL) {
+        return NULL;
+    }
+    PyObject* value = NULL;
+    for (Py_ssize_t i = 0; i < 2 && value == NULL; ++i) {
+        PyObject* ns = PyTuple_GET_ITEM(namespaces, i);
+        if (ns == Py_None) {
+            continue;
+        }
+        // a dict, or the write-through proxy of f_locals since 3.13
+        value = PyObject_GetItem(ns, name_obj);
+        if (value == NULL) {
+            // variable not found is not an error condition
+            PyErr_Clear();
+        }
+    }
+    Py_DECREF(namespaces);
+    return value;
+}
+
 PyDoc_STRVAR(telexsys_vm_read_doc,
              "Read a variable from the specified thread's frame.\n\n"
              "Args:\n"
@@ -1712,10 +2934,6 @@ telexsys_vm_read(PyObject* Py_UNUSED(module),
             "vm_read() argument 2 must be a string (variable name)");
         return NULL;
     }
-    const char* name = PyUnicode_AsUTF8(name_obj);
-    if (name == NULL) {
-        return NULL;
-    }
 
     // Third argument: level (optional, default 0)
     long level = 0;
@@ -1744,116 +2962,107 @@ telexsys_vm_read(PyObject* Py_UNUSED(module),
     if (frames_dict == NULL) {
         return NULL;
     }
-
-    // Get the frame for this tid - PyDict_GetItem returns a borrowed reference
-    PyObject* frame = PyDict_GetItem(frames_dict, tid_obj);
-
+    PyObject* frame = frame_at_level(frames_dict, tid_obj, level);
+    Py_DECREF(frames_dict);
     if (frame == NULL) {
-        // Thread not found
-        Py_DECREF(frames_dict);
+        // Thread not found or level is too deep
         Py_RETURN_NONE;
     }
-
-    // frame is a borrowed reference, so we need to incref it before releasing
-    // frames_dict
-    Py_INCREF(frame);
-    Py_DECREF(frames_dict);  // Done with frames_dict
-
-    // Navigate to the specified frame level
-    // level=0 means top frame (current frame), level=1 means f_back, etc.
-    for (long i = 0; i < level; i++) {
-        PyObject* back_frame = PyObject_GetAttrString(frame, "f_back");
-        Py_DECREF(frame);
-
-        if (back_frame == NULL || back_frame == Py_None) {
-            // Level is too deep, reached end of stack
-            Py_XDECREF(back_frame);
-            PyErr_Clear();  // Clear any attribute error
-            Py_RETURN_NONE;
-        }
-
-        frame = back_frame;  // Move to the previous frame
-    }
-
-    PyObject* result = NULL;
-
-    // Try to get locals - PyObject_GetAttrString returns a new reference
-    PyObject* locals = PyObject_GetAttrString(frame, "f_locals");
-    if (locals != NULL) {
-#if PY_VERSION_HEX >= 0x030D0000  // Python 3.13+
-        // Convert name to PyObject
-        PyObject* name_obj = PyUnicode_FromString(name);
-        if (name_obj == NULL) {
-            Py_DECREF(locals);
-            Py_DECREF(frame);
-            return NULL;
-        }
-        // PyObject_GetItem returns a new reference, sets KeyError if not found
-        PyObject* value = PyObject_GetItem(locals, name_obj);
-        Py_DECREF(name_obj);
-        if (value == NULL) {
-            // Clear the KeyError - variable not found is not an error condition
-            PyErr_Clear();
-        }
-#else
-        // PyDict_GetItemString returns a borrowed reference, NULL if not found (no exception)
-        PyObject* value = PyDict_GetItemString(locals, name);
-        if (value != NULL) {
-            Py_INCREF(value);  // Convert borrowed reference to new reference
-        }
-#endif
-        if (value != NULL) {
-            result = value;
-            Py_DECREF(locals);
-            Py_DECREF(frame);
-            return result;
-        }
-        Py_DECREF(locals);
-    } else {
-        // Clear the error if f_locals doesn't exist
-        PyErr_Clear();
+    PyObject* result = frame_lookup(frame, name_obj, NULL);
+    Py_DECREF(frame);
+    if (result == NULL && !PyErr_Occurred()) {
+        // Variable not found in either locals or globals
+        Py_RETURN_NONE;
     }
+    return result;
+}
 
-    // Try to get globals - PyObject_GetAttrString returns a new reference
-    PyObject* globals = PyObject_GetAttrString(frame, "f_globals");
-    if (globals != NULL) {
-#if PY_VERSION_HEX >= 0x030D0000  // Python 3.13+
-        // Convert name to PyObject
-        PyObject* name_obj = PyUnicode_FromString(name);
-        if (name_obj == NULL) {
-            Py_DECREF(globals);
-            Py_DECREF(frame);
-            return NULL;
+PyDoc_STRVAR(
+    telexsys_vm_read_many_doc,
+    "Read many variables from the frames of many threads at once.\n\n"
+    "All threads are resolved from one snapshot of their frames and the "
+    "locals of a frame are only gathered once however many of its variables "
+    "are read.\n\n"
+    "Args:\n"
+    "    requests: An iterable of (tid, name) or (tid, name, level) tuples, "
+    "as the arguments of vm_read\n\n"
+    "Returns:\n"
+    "    list: The value of every request in order, None where vm_read "
+    "would return None");
+
+static PyObject*
+telexsys_vm_read_many(PyObject* Py_UNUSED(module), PyObject* requests) {
+    PyObject* fast =
+        PySequence_Fast(requests, "vm_read_many() argument must be iterable");
+    if (fast == NULL) {
+        return NULL;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(fast);
+    PyObject* result = PyList_New(n);
+    PyObject* frames_dict = _PyThread_CurrentFrames();
+    // frame -> (f_locals, f_globals), shared by the requests of a frame
+    PyObject* namespaces = PyDict_New();
+    if (result == NULL || frames_dict == NULL || namespaces == NULL) {
+        goto error;
+    }
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        PyObject* request = PySequence_Fast_GET_ITEM(fast, i);
+        Py_ssize_t size = PyTuple_Check(request) ? PyTuple_GET_SIZE(request) : 0;
+        if (size != 2 && size != 3) {
+            PyErr_Format(PyExc_TypeError,
+                         "vm_read_many() request %zd must be a (tid, name) or "
+                         "(tid, name, level) tuple",
+                         i);
+            goto error;
         }
-        // PyObject_GetItem returns a new reference, sets KeyError if not found
-        PyObject* value = PyObject_GetItem(globals, name_obj);
-        Py_DECREF(name_obj);
-        if (value == NULL) {
-            // Clear the KeyError - variable not found is not an error condition
-            PyErr_Clear();
+        PyObject* tid_obj = PyTuple_GET_ITEM(request, 0);
+        PyObject* name_obj = PyTuple_GET_ITEM(request, 1);
+        long level = 0;
+        if (!PyLong_Check(tid_obj) || !PyUnicode_Check(name_obj) ||
+            (size == 3 && !PyLong_Check(PyTuple_GET_ITEM(request, 2)))) {
+            PyErr_Format(PyExc_TypeError,
+                         "vm_read_many() request %zd must hold an integer tid, "
+                         "a string name and an integer level",
+                         i);
+            goto error;
         }
-#else
-        // PyDict_GetItemString returns a borrowed reference, NULL if not found (no exception)
-        PyObject* value = PyDict_GetItemString(globals, name);
-        if (value != NULL) {
-            Py_INCREF(value);  // Convert borrowed reference to new reference
+        if (size == 3) {
+            level = PyLong_AsLong(PyTuple_GET_ITEM(request, 2));
+            if (level == -1 && PyErr_Occurred()) {
+                goto error;
+            }
+            if (level < 0) {
+                PyErr_Format(PyExc_ValueError,
+                             "vm_read_many() request %zd: level must be "
+                             "non-negative",
+                             i);
+                goto error;
+            }
         }
-#endif
-        if (value != NULL) {
-            result = value;
-            Py_DECREF(globals);
+        PyObject* value = NULL;
+        PyObject* frame = frame_at_level(frames_dict, tid_obj, level);
+        if (frame != NULL) {
+            value = frame_lookup(frame, name_obj, namespaces);
             Py_DECREF(frame);
-            return result;
         }
-        Py_DECREF(globals);
-    } else {
-        // Clear the error if f_globals doesn't exist
-        PyErr_Clear();
+        if (value == NULL) {
+            if (PyErr_Occurred()) {
+                goto error;
+            }
+            value = Py_NewRef(Py_None);
+        }
+        PyList_SET_ITEM(result, i, value);  // steals the reference
     }
-
-    // Variable not found in either locals or globals
-    Py_DECREF(frame);
-    Py_RETURN_NONE;
+    Py_DECREF(namespaces);
+    Py_DECREF(frames_dict);
+    Py_DECREF(fast);
+    return result;
+error:
+    Py_XDECREF(namespaces);
+    Py_XDECREF(frames_dict);
+    Py_XDECREF(result);
+    Py_DECREF(fast);
+    return NULL;
 }
 
 PyDoc_STRVAR(telexsys_vm_write_doc,
@@ -1982,136 +3191,1032 @@ telexsys_vm_write(PyObject* Py_UNUSED(module),
                 return NULL;  // Error occurred
             }
         }
-#endif
-        Py_DECREF(globals);
-    } else {
-        // Clear the error if f_globals doesn't exist
-        PyErr_Clear();
+#endif
+        Py_DECREF(globals);
+    } else {
+        // Clear the error if f_globals doesn't exist
+        PyErr_Clear();
+    }
+
+    // Variable not found in globals
+    Py_DECREF(frame);
+    Py_RETURN_FALSE;
+}
+
+PyDoc_STRVAR(
+    telexsys_top_namespace_doc,
+    "Get the top frame's namespace (locals or globals) for a thread.\n\n"
+    "Args:\n"
+    "    tid: Thread ID\n"
+    "    flag: 0 for locals, 1 for globals, 2 for both\n\n"
+    "Returns:\n"
+    "    dict: The namespace dictionary when flag is 0 or 1\n"
+    "    tuple: A tuple of (locals, globals) when flag is 2\n"
+    "    None: If thread not found");
+
+static PyObject*
+telexsys_top_namespace(PyObject* Py_UNUSED(module),
+                       PyObject* const* args,
+                       Py_ssize_t nargs) {
+    // Check argument count
+    if (nargs != 2) {
+        PyErr_Format(PyExc_TypeError,
+                     "top_namespace() takes exactly 2 arguments (%zd given)",
+                     nargs);
+        return NULL;
+    }
+
+    // First argument: tid (should be an integer)
+    PyObject* tid_obj = args[0];
+    if (!PyLong_Check(tid_obj)) {
+        PyErr_SetString(
+            PyExc_TypeError,
+            "top_namespace() argument 1 must be an integer (thread ID)");
+        return NULL;
+    }
+
+    // Second argument: flag (should be an integer, 0, 1, or 2)
+    PyObject* flag_obj = args[1];
+    if (!PyLong_Check(flag_obj)) {
+        PyErr_SetString(
+            PyExc_TypeError,
+            "top_namespace() argument 2 must be an integer (0, 1, or 2)");
+        return NULL;
+    }
+    long flag = PyLong_AsLong(flag_obj);
+    if (flag != 0 && flag != 1 && flag != 2) {
+        PyErr_SetString(PyExc_ValueError,
+                        "top_namespace() argument 2 must be 0 (locals), 1 "
+                        "(globals), or 2 (both)");
+        return NULL;
+    }
+
+    // Get all thread frames - _PyThread_CurrentFrames() returns a new reference
+    PyObject* frames_dict = _PyThread_CurrentFrames();
+    if (frames_dict == NULL) {
+        return NULL;
+    }
+
+    // Get the frame for this tid - PyDict_GetItem returns a borrowed reference
+    PyObject* frame = PyDict_GetItem(frames_dict, tid_obj);
+
+    if (frame == NULL) {
+        // Thread not found
+        Py_DECREF(frames_dict);
+        Py_RETURN_NONE;
+    }
+
+    // frame is a borrowed reference, so we need to incref it before releasing
+    // frames_dict
+    Py_INCREF(frame);
+    Py_DECREF(frames_dict);  // Done with frames_dict
+
+    PyObject* result = NULL;
+
+    if (flag == 0) {
+        // Return f_locals - PyObject_GetAttrString returns a new reference
+        result = PyObject_GetAttrString(frame, "f_locals");
+        Py_DECREF(frame);
+        if (result == NULL) {
+            // Clear the error if attribute doesn't exist
+            PyErr_Clear();
+            Py_RETURN_NONE;
+        }
+        return result;  // result is already a new reference
+    } else if (flag == 1) {
+        // Return f_globals - PyObject_GetAttrString returns a new reference
+        result = PyObject_GetAttrString(frame, "f_globals");
+        Py_DECREF(frame);
+        if (result == NULL) {
+            // Clear the error if attribute doesn't exist
+            PyErr_Clear();
+            Py_RETURN_NONE;
+        }
+        return result;  // result is already a new reference
+    } else {
+        // flag == 2: Return both locals and globals as a tuple
+        PyObject* locals = PyObject_GetAttrString(frame, "f_locals");
+        PyObject* globals = PyObject_GetAttrString(frame, "f_globals");
+        Py_DECREF(frame);
+
+        if (locals == NULL || globals == NULL) {
+            // Clear the error if attribute doesn't exist
+            PyErr_Clear();
+            Py_XDECREF(locals);
+            Py_XDECREF(globals);
+            Py_RETURN_NONE;
+        }
+
+        // Create a tuple containing (locals, globals)
+        result = PyTuple_Pack(2, locals, globals);
+        Py_DECREF(locals);
+        Py_DECREF(globals);
+
+        if (result == NULL) {
+            return NULL;
+        }
+
+        return result;
+    }
+}
+
+// Borrow the utf-8 buffers of a sequence of str, the returned array must be
+// released with PyMem_Free and is only valid while `*fast` is alive.
+static const char**
+utf8_array(PyObject* seq, const char* errmsg, PyObject** fast, size_t* size) {
+    *fast = PySequence_Fast(seq, errmsg);
+    if (*fast == NULL) {
+        return NULL;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(*fast);
+    const char** res = PyMem_Malloc(sizeof(char*) * (n > 0 ? n : 1));
+    if (res == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        res[i] = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(*fast, i));
+        if (res[i] == NULL) {
+            PyMem_Free(res);
+            return NULL;
+        }
+    }
+    *size = (size_t)n;
+    return res;
+}
+
+static int
+flame_tree_add_lines(struct FlameTree* tree, PyObject* lines) {
+    PyObject* iter = PyObject_GetIter(lines);
+    if (iter == NULL) {
+        return -1;
+    }
+    PyObject* item;
+    while ((item = PyIter_Next(iter)) != NULL) {
+        Py_ssize_t size;
+        const char* line = PyUnicode_AsUTF8AndSize(item, &size);
+        if (line == NULL) {
+            Py_DECREF(item);
+            Py_DECREF(iter);
+            return -1;
+        }
+        if (FlameTreeAddFolded(tree, line, (size_t)size) != 0) {
+            PyObject* stripped = PyObject_CallMethod(item, "strip", NULL);
+            if (stripped == NULL) {
+                Py_DECREF(item);
+                Py_DECREF(iter);
+                return -1;
+            }
+            PySys_FormatStderr("Invalid line(ignored): %U\n", stripped);
+            Py_DECREF(stripped);
+        }
+        Py_DECREF(item);
+    }
+    Py_DECREF(iter);
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+// The stack tree of a Sampler, AsyncSampler or StackTree, NULL for other
+// sources. returns -1 if the tree is being loaded
+static int
+source_stack_tree(PyObject* module,
+                  PyObject* source,
+                  struct StackTree** tree) {
+    TeleXSysState* state = PyModule_GetState(module);
+    *tree = NULL;
+    if (PyObject_TypeCheck(source, state->sampler_type) ||
+        PyObject_TypeCheck(source, state->async_sampler_type)) {
+        // the sampler only touches its tree while holding the GIL
+        *tree = ((SamplerObject*)source)->tree;
+    } else if (PyObject_TypeCheck(source, state->stack_tree_type)) {
+        if (StackTree_check_idle((StackTreeObject*)source) < 0) {
+            return -1;
+        }
+        *tree = ((StackTreeObject*)source)->tree;
+    }
+    return 0;
+}
+
+// a stack tree, see source_stack_tree, or an iterable of folded lines
+static int
+flame_tree_add_source(PyObject* module,
+                      struct FlameTree* tree,
+                      PyObject* source) {
+    struct StackTree* stack_tree;
+    if (source_stack_tree(module, source, &stack_tree) < 0) {
+        return -1;
+    }
+    if (stack_tree != NULL) {
+        FlameTreeAddStackTree(tree, stack_tree);
+        return 0;
+    }
+    return flame_tree_add_lines(tree, source);
+}
+
+PyDoc_STRVAR(
+    telexsys_render_flamegraph_doc,
+    "render_flamegraph(source, filename, width=1200, height=15, minwidth=0.1, "
+    "title='TeleX Flame Graph', countname='samples', header_lines=(), "
+    "script='', inverted=False, strip_prefixes=(), baseline=None)\n\n"
+    "Render a flamegraph svg file, the output is the same as "
+    "FlameGraph.generate_svg().\n\n"
+    "Args:\n"
+    "    source: A Sampler/AsyncSampler or StackTree, whose stack tree is "
+    "rendered directly, or an iterable of folded stack lines.\n"
+    "    strip_prefixes: Prefixes removed in order from every frame name.\n"
+    "    baseline: An older profile, of the same kinds as source. Frames are "
+    "then coloured red or blue by how much their share of the samples grew "
+    "or shrank since it.\n\n"
+    "Returns:\n"
+    "    int: The total number of samples");
+
+static PyObject*
+telexsys_render_flamegraph(PyObject* module,
+                           PyObject* args,
+                           PyObject* kwargs) {
+    static char* kwlist[] = {"source",
+                             "filename",
+                             "width",
+                             "height",
+                             "minwidth",
+                             "title",
+                             "countname",
+                             "header_lines",
+                             "script",
+                             "inverted",
+                             "strip_prefixes",
+                             "baseline",
+                             NULL};
+    PyObject* source = NULL;
+    PyObject* header_lines = NULL;
+    PyObject* strip_prefixes = NULL;
+    PyObject* baseline = Py_None;
+    const char* filename = NULL;
+    struct FlameGraphOptions options = {
+        .width = 1200,
+        .frame_height = 15,
+        .minwidth = 0.1,
+        .inverted = 0,
+        .differential = 0,
+        .title = "TeleX Flame Graph",
+        .countname = "samples",
+        .header_lines = NULL,
+        .header_count = 0,
+        .script = "",
+    };
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "Os|iidssOspOO:render_flamegraph",
+                                     kwlist,
+                                     &source,
+                                     &filename,
+                                     &options.width,
+                                     &options.frame_height,
+                                     &options.minwidth,
+                                     &options.title,
+                                     &options.countname,
+                                     &header_lines,
+                                     &options.script,
+                                     &options.inverted,
+                                     &strip_prefixes,
+                                     &baseline)) {
+        return NULL;
+    }
+
+    PyObject* result = NULL;
+    PyObject* headers = NULL;
+    PyObject* prefixes = NULL;
+    const char** header_ptrs = NULL;
+    const char** prefix_ptrs = NULL;
+    size_t prefix_count = 0;
+    struct FlameTree* tree = NewFlameTree();
+    if (header_lines != NULL) {
+        header_ptrs = utf8_array(header_lines,
+                                 "header_lines must be a sequence of str",
+                                 &headers,
+                                 &options.header_count);
+        if (header_ptrs == NULL) {
+            goto done;
+        }
+        options.header_lines = header_ptrs;
+    }
+    if (strip_prefixes != NULL) {
+        prefix_ptrs = utf8_array(strip_prefixes,
+                                 "strip_prefixes must be a sequence of str",
+                                 &prefixes,
+                                 &prefix_count);
+        if (prefix_ptrs == NULL) {
+            goto done;
+        }
+        FlameTreeSetStripPrefixes(tree, prefix_ptrs, prefix_count);
+    }
+
+    if (flame_tree_add_source(module, tree, source) < 0) {
+        goto done;
+    }
+    if (baseline != Py_None) {
+        // after the new profile, whose order the children keep, the frames
+        // it shares are annotated with their old totals
+        FlameTreeSetBaseline(tree, 1);
+        int added = flame_tree_add_source(module, tree, baseline);
+        FlameTreeSetBaseline(tree, 0);
+        if (added < 0) {
+            goto done;
+        }
+        options.differential = 1;
+    }
+
+    int ret;
+    Py_BEGIN_ALLOW_THREADS;
+    ret = RenderFlameGraph(tree, filename, &options);
+    Py_END_ALLOW_THREADS;
+    if (ret != 0) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+        goto done;
+    }
+    result = PyLong_FromLongLong(FlameTreeTotal(tree));
+
+done:
+    FreeFlameTree(tree);
+    PyMem_Free(header_ptrs);
+    PyMem_Free(prefix_ptrs);
+    Py_XDECREF(headers);
+    Py_XDECREF(prefixes);
+    return result;
+}
+
+PyDoc_STRVAR(
+    telexsys_flamegraph_chunks_doc,
+    "flamegraph_chunks(source, min_fraction=0.0, max_nodes=4096, "
+    "strip_prefixes=())\n\n"
+    "Split a profile into the json chunks the lazy html viewer loads, "
+    "chunk 0 holds the root frame.\n\n"
+    "Args:\n"
+    "    source: A Sampler/AsyncSampler or StackTree, or an iterable of "
+    "folded stack lines.\n"
+    "    min_fraction: Frames narrower than this fraction of a chunk's "
+    "samples are moved to a later chunk.\n"
+    "    max_nodes: The maximum number of frames in a chunk.\n"
+    "    strip_prefixes: Prefixes removed in order from every frame name.\n\n"
+    "Returns:\n"
+    "    tuple[int, list[bytes]]: The total number of samples and the "
+    "chunks");
+
+static PyObject*
+telexsys_flamegraph_chunks(PyObject* module,
+                           PyObject* args,
+                           PyObject* kwargs) {
+    static char* kwlist[] = {
+        "source", "min_fraction", "max_nodes", "strip_prefixes", NULL};
+    PyObject* source = NULL;
+    PyObject* strip_prefixes = NULL;
+    double min_fraction = 0.0;
+    Py_ssize_t max_nodes = 4096;
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "O|dnO:flamegraph_chunks",
+                                     kwlist,
+                                     &source,
+                                     &min_fraction,
+                                     &max_nodes,
+                                     &strip_prefixes)) {
+        return NULL;
+    }
+    if (max_nodes <= 0) {
+        PyErr_SetString(PyExc_ValueError, "max_nodes must be positive");
+        return NULL;
+    }
+
+    PyObject* result = NULL;
+    PyObject* list = NULL;
+    PyObject* prefixes = NULL;
+    const char** prefix_ptrs = NULL;
+    size_t prefix_count = 0;
+    struct FlameChunks* chunks = NULL;
+    struct FlameTree* tree = NewFlameTree();
+    if (strip_prefixes != NULL) {
+        prefix_ptrs = utf8_array(strip_prefixes,
+                                 "strip_prefixes must be a sequence of str",
+                                 &prefixes,
+                                 &prefix_count);
+        if (prefix_ptrs == NULL) {
+            goto done;
+        }
+        FlameTreeSetStripPrefixes(tree, prefix_ptrs, prefix_count);
+    }
+    if (flame_tree_add_source(module, tree, source) < 0) {
+        goto done;
+    }
+
+    Py_BEGIN_ALLOW_THREADS;
+    chunks = BuildFlameChunks(tree, min_fraction, (size_t)max_nodes);
+    Py_END_ALLOW_THREADS;
+    size_t count = FlameChunksCount(chunks);
+    list = PyList_New((Py_ssize_t)count);
+    if (list == NULL) {
+        goto done;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        size_t len;
+        const char* data = FlameChunksData(chunks, i, &len);
+        PyObject* chunk = PyBytes_FromStringAndSize(data, (Py_ssize_t)len);
+        if (chunk == NULL) {
+            goto done;
+        }
+        PyList_SET_ITEM(list, (Py_ssize_t)i, chunk);
+    }
+    result = Py_BuildValue("LO", FlameTreeTotal(tree), list);
+
+done:
+    if (chunks != NULL) {
+        FreeFlameChunks(chunks);
+    }
+    FreeFlameTree(tree);
+    PyMem_Free(prefix_ptrs);
+    Py_XDECREF(prefixes);
+    Py_XDECREF(list);
+    return result;
+}
+
+static int
+pprof_add_lines(struct PprofWriter* writer, PyObject* lines) {
+    PyObject* iter = PyObject_GetIter(lines);
+    if (iter == NULL) {
+        return -1;
+    }
+    PyObject* item;
+    while ((item = PyIter_Next(iter)) != NULL) {
+        Py_ssize_t size;
+        const char* line = PyUnicode_AsUTF8AndSize(item, &size);
+        if (line == NULL) {
+            Py_DECREF(item);
+            Py_DECREF(iter);
+            return -1;
+        }
+        if (PprofWriterAddFolded(writer, line, (size_t)size) != 0) {
+            PyObject* stripped = PyObject_CallMethod(item, "strip", NULL);
+            if (stripped == NULL) {
+                Py_DECREF(item);
+                Py_DECREF(iter);
+                return -1;
+            }
+            PySys_FormatStderr("Invalid line(ignored): %U\n", stripped);
+            Py_DECREF(stripped);
+        }
+        Py_DECREF(item);
     }
-
-    // Variable not found in globals
-    Py_DECREF(frame);
-    Py_RETURN_FALSE;
+    Py_DECREF(iter);
+    return PyErr_Occurred() ? -1 : 0;
 }
 
 PyDoc_STRVAR(
-    telexsys_top_namespace_doc,
-    "Get the top frame's namespace (locals or globals) for a thread.\n\n"
+    telexsys_write_pprof_doc,
+    "write_pprof(source, filename, period=0, sample_type='cpu', "
+    "time_nanos=0, duration_nanos=0, compress=True)\n\n"
+    "Write a profile in the pprof format (profile.proto), gzipped unless "
+    "compress is False.\n\n"
     "Args:\n"
-    "    tid: Thread ID\n"
-    "    flag: 0 for locals, 1 for globals, 2 for both\n\n"
+    "    source: A Sampler/AsyncSampler or StackTree, whose stack tree is "
+    "written directly, or an iterable of folded stack lines.\n"
+    "    period: Nanoseconds between two samples. When set, every sample "
+    "also carries its time as the `sample_type` value.\n"
+    "    time_nanos: When the profile was started, since the epoch.\n"
+    "    duration_nanos: How long the profile was collected for.\n\n"
     "Returns:\n"
-    "    dict: The namespace dictionary when flag is 0 or 1\n"
-    "    tuple: A tuple of (locals, globals) when flag is 2\n"
-    "    None: If thread not found");
+    "    int: The total number of samples");
 
 static PyObject*
-telexsys_top_namespace(PyObject* Py_UNUSED(module),
-                       PyObject* const* args,
-                       Py_ssize_t nargs) {
-    // Check argument count
-    if (nargs != 2) {
-        PyErr_Format(PyExc_TypeError,
-                     "top_namespace() takes exactly 2 arguments (%zd given)",
-                     nargs);
+telexsys_write_pprof(PyObject* module, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"source",
+                             "filename",
+                             "period",
+                             "sample_type",
+                             "time_nanos",
+                             "duration_nanos",
+                             "compress",
+                             NULL};
+    PyObject* source = NULL;
+    const char* filename = NULL;
+    struct PprofOptions options = {
+        .sample_type = "cpu",
+        .period = 0,
+        .time_nanos = 0,
+        .duration_nanos = 0,
+        .compress = 1,
+    };
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "Os|LsLLp:write_pprof",
+                                     kwlist,
+                                     &source,
+                                     &filename,
+                                     &options.period,
+                                     &options.sample_type,
+                                     &options.time_nanos,
+                                     &options.duration_nanos,
+                                     &options.compress)) {
         return NULL;
     }
 
-    // First argument: tid (should be an integer)
-    PyObject* tid_obj = args[0];
-    if (!PyLong_Check(tid_obj)) {
-        PyErr_SetString(
-            PyExc_TypeError,
-            "top_namespace() argument 1 must be an integer (thread ID)");
+    struct StackTree* stack_tree;
+    if (source_stack_tree(module, source, &stack_tree) < 0) {
+        return NULL;
+    }
+    errno = 0;
+    struct PprofWriter* writer = NewPprofWriter(filename, &options);
+    if (writer == NULL) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    }
+    int failed = 0;
+    if (stack_tree != NULL) {
+        PprofWriterAddStackTree(writer, stack_tree);
+    } else {
+        failed = pprof_add_lines(writer, source) < 0;
+    }
+    long long total = PprofWriterTotal(writer);
+    errno = 0;
+    int ret;
+    Py_BEGIN_ALLOW_THREADS;
+    ret = ClosePprofWriter(writer);
+    Py_END_ALLOW_THREADS;
+    if (failed) {
         return NULL;
     }
+    if (ret != 0) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    }
+    return PyLong_FromLongLong(total);
+}
 
-    // Second argument: flag (should be an integer, 0, 1, or 2)
-    PyObject* flag_obj = args[1];
-    if (!PyLong_Check(flag_obj)) {
-        PyErr_SetString(
-            PyExc_TypeError,
-            "top_namespace() argument 2 must be an integer (0, 1, or 2)");
+PyDoc_STRVAR(
+    telexsys_chrome_trace_to_folded_doc,
+    "chrome_trace_to_folded(trace_file, output_file, scale=100.0)\n\n"
+    "Convert the complete events of a Chrome trace to folded stack lines.\n\n"
+    "The trace is parsed as it is read and every event is charged its self "
+    "time, in units of 1/scale microseconds, under Process(pid);Thread(tid). "
+    "The output is gzipped if its name ends with .gz.\n\n"
+    "Returns:\n"
+    "    dict: events, threads, stacks, samples and max_depth of the "
+    "output\n\n"
+    "Raises:\n"
+    "    OSError: if a file can not be read or written.\n"
+    "    ValueError: if the trace is not valid JSON.");
+
+static PyObject*
+telexsys_chrome_trace_to_folded(PyObject* Py_UNUSED(module),
+                                PyObject* args,
+                                PyObject* kwargs) {
+    static char* kwlist[] = {"trace_file", "output_file", "scale", NULL};
+    const char* trace_file = NULL;
+    const char* output_file = NULL;
+    double scale = 100.0;
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "ss|d:chrome_trace_to_folded",
+                                     kwlist,
+                                     &trace_file,
+                                     &output_file,
+                                     &scale)) {
         return NULL;
     }
-    long flag = PyLong_AsLong(flag_obj);
-    if (flag != 0 && flag != 1 && flag != 2) {
-        PyErr_SetString(PyExc_ValueError,
-                        "top_namespace() argument 2 must be 0 (locals), 1 "
-                        "(globals), or 2 (both)");
+    if (!(scale > 0)) {
+        PyErr_SetString(PyExc_ValueError, "scale must be positive");
+        return NULL;
+    }
+    struct StackTree* tree = NewTree();
+    if (tree == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to create StackTree");
         return NULL;
     }
+    struct ChromeTraceStats stats;
+    char error[128] = "";
+    int ret, dumped = 0, saved = 0;
+    Py_BEGIN_ALLOW_THREADS;
+    errno = 0;
+    ret = ChromeTraceToTree(
+        trace_file, scale, tree, &stats, error, sizeof(error));
+    if (ret == 0) {
+        errno = 0;
+        dumped = DumpFolded(tree, output_file);
+    }
+    saved = errno;
+    FreeTree(tree);
+    Py_END_ALLOW_THREADS;
+    errno = saved;
+    if (ret == -1) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, trace_file);
+    }
+    if (ret == -2) {
+        PyErr_Format(PyExc_ValueError, "%s: %s", trace_file, error);
+        return NULL;
+    }
+    if (dumped != 0) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, output_file);
+    }
+    return Py_BuildValue("{s:L,s:L,s:L,s:L,s:L}",
+                         "events",
+                         stats.events,
+                         "threads",
+                         stats.threads,
+                         "stacks",
+                         stats.stacks,
+                         "samples",
+                         stats.samples,
+                         "max_depth",
+                         stats.max_depth);
+}
 
-    // Get all thread frames - _PyThread_CurrentFrames() returns a new reference
-    PyObject* frames_dict = _PyThread_CurrentFrames();
-    if (frames_dict == NULL) {
+PyDoc_STRVAR(
+    telexsys_load_folded_doc,
+    "load_folded(filenames, threads=0)\n\n"
+    "Load folded stack files into a StackTree, parsed by several threads.\n\n"
+    "The files are mapped and split into ranges of whole lines, one per "
+    "thread, whose stacks are merged in input order. Gzipped files are "
+    "inflated, the members of the ones saved with a .gz name are split "
+    "between the threads.\n\n"
+    "Args:\n"
+    "    filenames: A path or a sequence of paths.\n"
+    "    threads: The number of parser threads, 0 for one per CPU. Small "
+    "inputs use fewer.\n\n"
+    "Returns:\n"
+    "    StackTree: The merged stacks, lines without a count are skipped "
+    "and counted in its stats.\n\n"
+    "Raises:\n"
+    "    OSError: if a file can not be read.");
+
+static PyObject*
+telexsys_load_folded(PyObject* module, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"filenames", "threads", NULL};
+    PyObject* filenames = NULL;
+    int threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O|i:load_folded", kwlist, &filenames, &threads)) {
         return NULL;
     }
+    TeleXSysState* state = PyModule_GetState(module);
+    PyObject* tree = PyObject_CallObject((PyObject*)state->stack_tree_type,
+                                         NULL);
+    if (tree == NULL) {
+        return NULL;
+    }
+    if (stack_tree_load((StackTreeObject*)tree, filenames, threads) < 0) {
+        Py_DECREF(tree);
+        return NULL;
+    }
+    return tree;
+}
 
-    // Get the frame for this tid - PyDict_GetItem returns a borrowed reference
-    PyObject* frame = PyDict_GetItem(frames_dict, tid_obj);
+PyDoc_STRVAR(
+    telexsys_take_stacks_doc,
+    "take_stacks(sampler)\n\n"
+    "Move the stacks a sampler has collected so far into a new StackTree.\n\n"
+    "The sampler keeps sampling into an empty tree, no sample is lost or "
+    "counted twice since both only touch the tree with the GIL held.\n\n"
+    "Returns:\n"
+    "    StackTree: The stacks taken, see StackTree.merge.");
 
-    if (frame == NULL) {
-        // Thread not found
-        Py_DECREF(frames_dict);
-        Py_RETURN_NONE;
+static PyObject*
+telexsys_take_stacks(PyObject* module, PyObject* sampler) {
+    TeleXSysState* state = PyModule_GetState(module);
+    if (!PyObject_TypeCheck(sampler, state->sampler_type) &&
+        !PyObject_TypeCheck(sampler, state->async_sampler_type)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "sampler must be a Sampler or AsyncSampler");
+        return NULL;
+    }
+    PyObject* result = PyObject_CallObject((PyObject*)state->stack_tree_type,
+                                           NULL);
+    if (result == NULL) {
+        return NULL;
     }
+    // swap, the empty tree of the new object goes to the sampler
+    SamplerObject* self = (SamplerObject*)sampler;
+    StackTreeObject* taken = (StackTreeObject*)result;
+    struct StackTree* tree = self->tree;
+    self->tree = taken->tree;
+    taken->tree = tree;
+    taken->stats.samples = (long long)TreeSamples(tree);
+    return result;
+}
 
-    // frame is a borrowed reference, so we need to incref it before releasing
-    // frames_dict
-    Py_INCREF(frame);
-    Py_DECREF(frames_dict);  // Done with frames_dict
+PyDoc_STRVAR(
+    telexsys_snapshot_stacks_doc,
+    "snapshot_stacks(sampler)\n\n"
+    "Copy the stacks a sampler has collected so far into a new StackTree, "
+    "the sampler keeps its own. The copy is made with the GIL held, it costs "
+    "one pass over the tree and no folding of the stacks.\n\n"
+    "Returns:\n"
+    "    StackTree: The stacks copied.");
 
-    PyObject* result = NULL;
+static PyObject*
+telexsys_snapshot_stacks(PyObject* module, PyObject* sampler) {
+    TeleXSysState* state = PyModule_GetState(module);
+    if (!PyObject_TypeCheck(sampler, state->sampler_type) &&
+        !PyObject_TypeCheck(sampler, state->async_sampler_type)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "sampler must be a Sampler or AsyncSampler");
+        return NULL;
+    }
+    PyObject* result = PyObject_CallObject((PyObject*)state->stack_tree_type,
+                                           NULL);
+    if (result == NULL) {
+        return NULL;
+    }
+    // the GIL is kept, the sampling thread adds to the tree with it held
+    SamplerObject* self = (SamplerObject*)sampler;
+    StackTreeObject* copy = (StackTreeObject*)result;
+    MergeTree(copy->tree, self->tree);
+    copy->stats.samples = (long long)TreeSamples(copy->tree);
+    return result;
+}
 
-    if (flag == 0) {
-        // Return f_locals - PyObject_GetAttrString returns a new reference
-        result = PyObject_GetAttrString(frame, "f_locals");
-        Py_DECREF(frame);
-        if (result == NULL) {
-            // Clear the error if attribute doesn't exist
-            PyErr_Clear();
-            Py_RETURN_NONE;
+// a growable utf-8 buffer for thread_stacks
+struct TextBuffer {
+    char* data;
+    size_t size;
+    size_t capacity;
+};
+
+static int
+text_append(struct TextBuffer* buf, const char* s, size_t n) {
+    if (buf->size + n > buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity : 4096;
+        while (buf->size + n > capacity) {
+            capacity *= 2;
         }
-        return result;  // result is already a new reference
-    } else if (flag == 1) {
-        // Return f_globals - PyObject_GetAttrString returns a new reference
-        result = PyObject_GetAttrString(frame, "f_globals");
-        Py_DECREF(frame);
-        if (result == NULL) {
-            // Clear the error if attribute doesn't exist
-            PyErr_Clear();
-            Py_RETURN_NONE;
+        char* data = PyMem_Realloc(buf->data, capacity);
+        if (data == NULL) {
+            PyErr_NoMemory();
+            return -1;
         }
-        return result;  // result is already a new reference
-    } else {
-        // flag == 2: Return both locals and globals as a tuple
-        PyObject* locals = PyObject_GetAttrString(frame, "f_locals");
-        PyObject* globals = PyObject_GetAttrString(frame, "f_globals");
-        Py_DECREF(frame);
+        buf->data = data;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->size, s, n);
+    buf->size += n;
+    return 0;
+}
 
-        if (locals == NULL || globals == NULL) {
-            // Clear the error if attribute doesn't exist
+// strip the first matching prefix and the separators following it
+static const char*
+strip_prefixes(const char* path, const char** prefixes, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        size_t len = strlen(prefixes[i]);
+        if (len > 0 && strncmp(path, prefixes[i], len) == 0) {
+            path += len;
+            while (*path == '/') {
+                ++path;
+            }
+            return path;
+        }
+    }
+    return path;
+}
+
+// append the frames of one thread, innermost first, one per line
+static int
+format_thread_stack(struct TextBuffer* buf,
+                    PyFrameObject* frame,
+                    const char** prefixes,
+                    size_t n_prefixes,
+                    const char* indent) {
+    char lineno[32];
+    size_t indent_len = strlen(indent);
+    Py_XINCREF(frame);
+    while (frame != NULL) {
+        PyCodeObject* code = PyFrame_GetCode(frame);  // New reference
+        PyObject* name = code->co_name;
+#if PY_VERSION_HEX >= 0x030B00F0
+        name = code->co_qualname;
+#endif
+        const char* filename = PyUnicode_AsUTF8(code->co_filename);
+        const char* qualname = filename ? PyUnicode_AsUTF8(name) : NULL;
+        if (qualname == NULL) {
+            // undecodable names, keep the rest of the snapshot
             PyErr_Clear();
-            Py_XDECREF(locals);
-            Py_XDECREF(globals);
-            Py_RETURN_NONE;
+            filename = filename ? filename : "<unknown>";
+            qualname = "<unknown>";
+        }
+        filename = strip_prefixes(filename, prefixes, n_prefixes);
+        int n = snprintf(
+            lineno, sizeof(lineno), ":%d ", PyFrame_GetLineNumber(frame));
+        if ((buf->size > 0 && text_append(buf, "\n", 1) < 0) ||
+            text_append(buf, indent, indent_len) < 0 ||
+            text_append(buf, filename, strlen(filename)) < 0 ||
+            text_append(buf, lineno, (size_t)n) < 0 ||
+            text_append(buf, qualname, strlen(qualname)) < 0) {
+            Py_DECREF(code);
+            Py_DECREF(frame);
+            return -1;
         }
+        Py_DECREF(code);
+        PyFrameObject* back = PyFrame_GetBack(frame);  // New reference
+        Py_DECREF(frame);
+        frame = back;
+    }
+    return 0;
+}
 
-        // Create a tuple containing (locals, globals)
-        result = PyTuple_Pack(2, locals, globals);
-        Py_DECREF(locals);
-        Py_DECREF(globals);
+// collects what ShmRingRead reports into python lists
+struct ShmRingLists {
+    PyObject* samples;
+    PyObject* stacks;
+};
 
-        if (result == NULL) {
+static int
+shm_ring_on_sample(void* arg,
+                   unsigned long long time,
+                   unsigned long tid,
+                   uint32_t stack) {
+    struct ShmRingLists* lists = arg;
+    PyObject* sample = Py_BuildValue("(KkI)", time, tid, stack);
+    if (sample == NULL) {
+        return 1;
+    }
+    int ret = PyList_Append(lists->samples, sample);
+    Py_DECREF(sample);
+    return ret < 0;
+}
+
+static int
+shm_ring_on_stack(void* arg, const char* stack, size_t size) {
+    struct ShmRingLists* lists = arg;
+    PyObject* str = PyUnicode_DecodeUTF8(stack, (Py_ssize_t)size, "replace");
+    if (str == NULL) {
+        return 1;
+    }
+    int ret = PyList_Append(lists->stacks, str);
+    Py_DECREF(str);
+    return ret < 0;
+}
+
+PyDoc_STRVAR(
+    telexsys_shm_ring_read_doc,
+    "shm_ring_read(path, cursor=(0, 0, 0, 0, 0))\n\n"
+    "Read the samples another process's sampler exported to `path`, see "
+    "Sampler.shm_ring, without any help from that process.\n\n"
+    "Args:\n"
+    "    path: The ring file.\n"
+    "    cursor: Where the last read stopped, (next sample, stack table "
+    "offset, lost, dropped, generation).\n\n"
+    "Returns:\n"
+    "    tuple: The new cursor, the new samples as (time, tid, stack id) and "
+    "the stacks added since, the n-th stack ever read has id n. lost counts "
+    "the samples overwritten before they were read, dropped the ones the "
+    "writer had no room for in its stack table. The generation changes when "
+    "the ring is created again at the same path, the stack ids then start "
+    "over.");
+
+static PyObject*
+telexsys_shm_ring_read(PyObject* Py_UNUSED(module),
+                       PyObject* args,
+                       PyObject* kwargs) {
+    static char* kwlist[] = {"path", "cursor", NULL};
+    PyObject* path = NULL;
+    struct ShmRingCursor cursor = {0, 0, 0, 0, 0};
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "O&|(KKKKK):shm_ring_read",
+                                     kwlist,
+                                     PyUnicode_FSConverter,
+                                     &path,
+                                     &cursor.next,
+                                     &cursor.symbol_offset,
+                                     &cursor.lost,
+                                     &cursor.dropped,
+                                     &cursor.generation)) {
+        return NULL;
+    }
+    PyObject* result = NULL;
+    struct ShmRingLists lists = {PyList_New(0), PyList_New(0)};
+    if (lists.samples == NULL || lists.stacks == NULL) {
+        goto done;
+    }
+    int ret = ShmRingRead(PyBytes_AS_STRING(path),
+                          &cursor,
+                          shm_ring_on_sample,
+                          shm_ring_on_stack,
+                          &lists);
+    if (ret < 0) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, PyBytes_AS_STRING(path));
+        goto done;
+    }
+    if (ret > 0) {  // a python error from a callback
+        goto done;
+    }
+    result = Py_BuildValue("((KKKKK)OO)",
+                           cursor.next,
+                           cursor.symbol_offset,
+                           cursor.lost,
+                           cursor.dropped,
+                           cursor.generation,
+                           lists.samples,
+                           lists.stacks);
+done:
+    Py_XDECREF(lists.samples);
+    Py_XDECREF(lists.stacks);
+    Py_DECREF(path);
+    return result;
+}
+
+PyDoc_STRVAR(
+    telexsys_thread_stacks_doc,
+    "thread_stacks(strip=(), indent='')\n\n"
+    "Format the stack of every thread in one pass, without creating a "
+    "string per frame.\n\n"
+    "Args:\n"
+    "    strip: Path prefixes removed from filenames, the first match wins.\n"
+    "    indent: Prepended to every frame line.\n\n"
+    "Returns:\n"
+    "    dict[int, str]: Thread id to its frames, innermost first, one "
+    "\"path:lineno qualname\" per line.");
+
+static PyObject*
+telexsys_thread_stacks(PyObject* Py_UNUSED(module),
+                       PyObject* args,
+                       PyObject* kwargs) {
+    static char* kwlist[] = {"strip", "indent", NULL};
+    PyObject* strip = NULL;
+    const char* indent = "";
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwargs, "|Os:thread_stacks", kwlist, &strip, &indent)) {
+        return NULL;
+    }
+    PyObject* fast = NULL;
+    const char** prefixes = NULL;
+    size_t n_prefixes = 0;
+    if (strip != NULL) {
+        prefixes = utf8_array(
+            strip, "strip must be a sequence of str", &fast, &n_prefixes);
+        if (prefixes == NULL) {
+            Py_XDECREF(fast);
             return NULL;
         }
-
-        return result;
     }
+    PyObject* result = NULL;
+    struct TextBuffer buf = {NULL, 0, 0};
+    PyObject* frames = _PyThread_CurrentFrames();
+    if (frames == NULL) {
+        goto done;
+    }
+    result = PyDict_New();
+    if (result == NULL) {
+        goto done;
+    }
+    PyObject *tid, *frame;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(frames, &pos, &tid, &frame)) {
+        buf.size = 0;
+        if (format_thread_stack(&buf,
+                                (PyFrameObject*)frame,
+                                prefixes,
+                                n_prefixes,
+                                indent) < 0) {
+            Py_CLEAR(result);
+            goto done;
+        }
+        PyObject* stack = PyUnicode_DecodeUTF8(
+            buf.size ? buf.data : "", (Py_ssize_t)buf.size, "surrogateescape");
+        if (stack == NULL || PyDict_SetItem(result, tid, stack) < 0) {
+            Py_XDECREF(stack);
+            Py_CLEAR(result);
+            goto done;
+        }
+        Py_DECREF(stack);
+    }
+done:
+    PyMem_Free(buf.data);
+    Py_XDECREF(frames);
+    PyMem_Free(prefixes);
+    Py_XDECREF(fast);
+    return result;
 }
 
 static PyMethodDef telexsys_methods[] = {
+    {
+        "take_stacks",
+        (PyCFunction)telexsys_take_stacks,
+        METH_O,
+        telexsys_take_stacks_doc,
+    },
+    {
+        "snapshot_stacks",
+        (PyCFunction)telexsys_snapshot_stacks,
+        METH_O,
+        telexsys_snapshot_stacks_doc,
+    },
+    {
+        "shm_ring_read",
+        _PyCFunction_CAST(telexsys_shm_ring_read),
+        METH_VARARGS | METH_KEYWORDS,
+        telexsys_shm_ring_read_doc,
+    },
+    {
+        "thread_stacks",
+        _PyCFunction_CAST(telexsys_thread_stacks),
+        METH_VARARGS | METH_KEYWORDS,
+        telexsys_thread_stacks_doc,
+    },
     {
         "current_frames",
         (PyCFunction)telexsys_current_frames,
@@ -2142,6 +4247,12 @@ static PyMethodDef telexsys_methods[] = {
         METH_FASTCALL,
         telexsys_vm_read_doc,
     },
+    {
+        "vm_read_many",
+        (PyCFunction)telexsys_vm_read_many,
+        METH_O,
+        telexsys_vm_read_many_doc,
+    },
     {
         "vm_write",
         _PyCFunction_CAST(telexsys_vm_write),
@@ -2154,6 +4265,36 @@ static PyMethodDef telexsys_methods[] = {
         METH_FASTCALL,
         telexsys_top_namespace_doc,
     },
+    {
+        "render_flamegraph",
+        _PyCFunction_CAST(telexsys_render_flamegraph),
+        METH_VARARGS | METH_KEYWORDS,
+        telexsys_render_flamegraph_doc,
+    },
+    {
+        "flamegraph_chunks",
+        _PyCFunction_CAST(telexsys_flamegraph_chunks),
+        METH_VARARGS | METH_KEYWORDS,
+        telexsys_flamegraph_chunks_doc,
+    },
+    {
+        "write_pprof",
+        _PyCFunction_CAST(telexsys_write_pprof),
+        METH_VARARGS | METH_KEYWORDS,
+        telexsys_write_pprof_doc,
+    },
+    {
+        "chrome_trace_to_folded",
+        _PyCFunction_CAST(telexsys_chrome_trace_to_folded),
+        METH_VARARGS | METH_KEYWORDS,
+        telexsys_chrome_trace_to_folded_doc,
+    },
+    {
+        "load_folded",
+        _PyCFunction_CAST(telexsys_load_folded),
+        METH_VARARGS | METH_KEYWORDS,
+        telexsys_load_folded_doc,
+    },
     {
         NULL,
         NULL,
@@ -2167,6 +4308,10 @@ telexsys_exec(PyObject* m) {
     if (PyModule_AddStringConstant(m, "__version__", TELEXSYS_VERSION)) {
         return -1;
     }
+    if (PyModule_AddObjectRef(
+            m, "HAVE_ZLIB", GzipAvailable() ? Py_True : Py_False) < 0) {
+        return -1;
+    }
     TeleXSysState* state = PyModule_GetState(m);
     PyObject* sampler_type = PyType_FromSpec(&sampler_spec);
     if (sampler_type == NULL) {
@@ -2188,6 +4333,22 @@ telexsys_exec(PyObject* m) {
         Py_DECREF(async_sampler_type);
         return -1;
     }
+    PyObject* stack_tree_type = PyType_FromSpec(&stack_tree_spec);
+    if (stack_tree_type == NULL) {
+        return -1;
+    }
+    state->stack_tree_type = (PyTypeObject*)stack_tree_type;
+    if (PyModule_AddObjectRef(m, "StackTree", stack_tree_type) < 0) {
+        return -1;
+    }
+    PyObject* remote_process_type = PyType_FromSpec(&remote_process_spec);
+    if (remote_process_type == NULL) {
+        return -1;
+    }
+    state->remote_process_type = (PyTypeObject*)remote_process_type;
+    if (PyModule_AddObjectRef(m, "RemoteProcess", remote_process_type) < 0) {
+        return -1;
+    }
     return 0;
 }
 
@@ -2196,6 +4357,8 @@ telexsys_clear(PyObject* module) {
     TeleXSysState* state = PyModule_GetState(module);
     Py_CLEAR(state->sampler_type);
     Py_CLEAR(state->async_sampler_type);
+    Py_CLEAR(state->stack_tree_type);
+    Py_CLEAR(state->remote_process_type);
     return 0;
 }
 
@@ -2204,6 +4367,8 @@ telexsys_traverse(PyObject* module, visitproc visit, void* arg) {
     TeleXSysState* state = PyModule_GetState(module);
     Py_VISIT(state->sampler_type);
     Py_VISIT(state->async_sampler_type);
+    Py_VISIT(state->stack_tree_type);
+    Py_VISIT(state->remote_process_type);
     return 0;
 }
 
@@ -2,6 +2,11 @@
 #ifndef TelexSys_h
 #define TelexSys_h
 
+#include "compress.h"
+#include "folded.h"
+#include "phase_stats.h"
+#include "sample_log.h"
+#include "shm_ring.h"
 #include "tree.h"
 #include <Python.h>
 #include <stdint.h>
@@ -26,6 +31,8 @@ typedef unsigned long long Telex_time;
 typedef struct TeleXSysState {
     PyTypeObject* sampler_type;
     PyTypeObject* async_sampler_type;
+    PyTypeObject* stack_tree_type;
+    PyTypeObject* remote_process_type;
 } TeleXSysState;
 
 #define BIT_SET(x, n) (x |= (1 << n))
@@ -75,6 +82,12 @@ typedef struct SamplerObject {
     PyObject* sampling_interval;  // in microseconds
 
     struct StackTree* tree;
+    // the samples in order, NULL unless sample_log is enabled
+    struct SampleLog* sample_log;
+    // the samples exported to another process, NULL unless shm_ring is set
+    struct ShmRing* shm_ring;
+    // the time of every phase of a round, NULL unless phase_stats is enabled
+    struct PhaseStats* phase_stats;
     unsigned long sampling_tid;  // thread id of the sampling thread
     //  number of times the sampling thread has run
     unsigned long sampling_times;
@@ -103,6 +116,18 @@ typedef struct AsyncSamplerObject {
     Py_ssize_t buf_size;
 } AsyncSamplerObject;
 
+// Folded stacks loaded or added from python, see load_folded
+typedef struct StackTreeObject {
+    PyObject_HEAD struct StackTree* tree;
+    struct FoldedStats stats;
+    int busy;  // set while the tree is filled without the GIL
+} StackTreeObject;
+
+typedef struct RemoteProcessObject {
+    PyObject_HEAD struct RemoteProcess* remote;  // NULL once closed
+    int busy;  // set while sampling without the GIL
+} RemoteProcessObject;
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,5 +1,7 @@
 
-#include "tree.h"
+#include "encode.h"
+#include "tree_impl.h"
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
@@ -8,25 +10,11 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 
-struct Node {
-    std::string name;
-    unsigned long cnt;      // called count
-    unsigned long acc_cnt;  // accumulated count
-    Node* child;
-    Node* sibling;
-
-    // no virtual destructor to save memory
-    ~Node() {
-        delete child;
-        delete sibling;
-    }
-};
-
-
 void
 split(const char* s, char delim, std::vector<std::string>& elems) {
     std::stringstream ss(s);
@@ -37,110 +25,311 @@ split(const char* s, char delim, std::vector<std::string>& elems) {
 }
 
 
-struct StackTree {
-    Node* root;
 #define NAME "root"
 #define DLIM ';'
 
-    StackTree() {
-        root = new Node();
-        root->child = nullptr;
-        root->sibling = nullptr;
-        root->name = NAME;
-    }
-
-    // callstack exmplae: main.py:hello:world
-    void AddCallStack(const char* callstack) {
-        std::vector<std::string> names;
-        split(callstack, DLIM, names);
-        auto node = root;
-        for (const auto& s : names) {
-            assert(node != nullptr);
-            node->acc_cnt++;
-            if (node->child != nullptr) {
-                Node* next = node->child;
-                Node* prev = nullptr;
-                while (next != nullptr && next->name != s) {
-                    // optimize for most common case
-                    if (prev != nullptr && prev->acc_cnt < next->acc_cnt) {
-                        std::swap(prev->name, next->name);
-                        std::swap(prev->cnt, next->cnt);
-                        std::swap(prev->acc_cnt, next->acc_cnt);
-                        std::swap(prev->child, next->child);
-                    }
-                    prev = next;
-                    next = next->sibling;
-                }
-                if (next != nullptr) {
-                    node = next;
-                } else {
-                    assert(prev != nullptr);
-                    Node* new_node = new Node();
-                    prev->sibling = new_node;
-                    node = new_node;
-                    node->name = s;
+StackTree::StackTree() : stats(), depths(1, 0) {
+    root = new Node();
+    root->child = nullptr;
+    root->sibling = nullptr;
+    root->name = NAME;
+}
+
+Node*
+StackTree::NewNode(const Node* parent,
+                   const char* name,
+                   size_t size,
+                   size_t depth) {
+    Node* node = new Node();
+    node->name.assign(name, size);
+    stats.nodes++;
+    stats.name_bytes += size;
+    stats.heap_bytes += NodeBytes(node);
+    if (parent != root && parent->child == nullptr) {
+        stats.total_depth++;  // the leaf moves one frame down
+    } else {
+        stats.leaves++;
+        stats.total_depth += depth;
+    }
+    if (depths.size() <= depth) {
+        depths.resize(depth + 1, 0);
+        stats.max_depth = depth;
+    }
+    depths[depth]++;
+    return node;
+}
+
+void
+StackTree::Forget(const Node* parent, const Node* node, size_t depth) {
+    std::vector<std::pair<const Node*, size_t>> pending{{node, depth}};
+    while (!pending.empty()) {
+        const Node* n = pending.back().first;
+        size_t d = pending.back().second;
+        pending.pop_back();
+        stats.nodes--;
+        stats.name_bytes -= n->name.size();
+        stats.heap_bytes -= NodeBytes(n);
+        depths[d]--;
+        if (n->child == nullptr) {
+            stats.leaves--;
+            stats.total_depth -= d;
+        }
+        for (const Node* c = n->child; c; c = c->sibling) {
+            pending.emplace_back(c, d + 1);
+        }
+    }
+    if (parent != root && parent->child == nullptr) {
+        stats.leaves++;
+        stats.total_depth += depth - 1;
+    }
+    while (depths.size() > 1 && depths.back() == 0) {
+        depths.pop_back();
+    }
+    stats.max_depth = depths.size() - 1;
+}
+
+void
+StackTree::AddCallStack(const char* callstack) {
+    std::vector<std::string> names;
+    split(callstack, DLIM, names);
+    auto node = root;
+    size_t depth = 0;
+    for (const auto& s : names) {
+        assert(node != nullptr);
+        node->acc_cnt++;
+        depth++;
+        if (node->child != nullptr) {
+            Node* next = node->child;
+            Node* prev = nullptr;
+            while (next != nullptr && next->name != s) {
+                // optimize for most common case
+                if (prev != nullptr && prev->acc_cnt < next->acc_cnt) {
+                    std::swap(prev->name, next->name);
+                    std::swap(prev->cnt, next->cnt);
+                    std::swap(prev->acc_cnt, next->acc_cnt);
+                    std::swap(prev->child, next->child);
                 }
+                prev = next;
+                next = next->sibling;
+            }
+            if (next != nullptr) {
+                node = next;
             } else {
-                Node* new_node = new Node();
-                node->child = new_node;
+                assert(prev != nullptr);
+                Node* new_node = NewNode(node, s.data(), s.size(), depth);
+                prev->sibling = new_node;
                 node = new_node;
-                node->name = s;
             }
+        } else {
+            Node* new_node = NewNode(node, s.data(), s.size(), depth);
+            node->child = new_node;
+            node = new_node;
         }
-        node->cnt++;  // only leaf node can increment count
-        node->acc_cnt++;
     }
+    node->cnt++;  // only leaf node can increment count
+    node->acc_cnt++;
+}
 
-    void Save(std::ostream& out) {
-        std::vector<std::string> res;
-        bool first_output = true;
+void
+StackTree::Save(std::ostream& out) {
+    std::vector<std::string> res;
+    bool first_output = true;
 
-        std::function<void(Node*)> f = [&](Node* node) {
-            if (node == nullptr) {
-                return;
-            }
+    std::function<void(Node*)> f = [&](Node* node) {
+        if (node == nullptr) {
+            return;
+        }
 
-            // ignore root
-            if (node->name != NAME) {
-                res.emplace_back(node->name);
-            }
+        // ignore root
+        if (node->name != NAME) {
+            res.emplace_back(node->name);
+        }
 
-            f(node->child);
+        f(node->child);
 
-            if (node->cnt > 0) {
-                // Add newline before output if this is not the first line
-                if (!first_output) {
-                    out << '\n';
-                }
-                first_output = false;
+        if (node->cnt > 0) {
+            // Add newline before output if this is not the first line
+            if (!first_output) {
+                out << '\n';
+            }
+            first_output = false;
 
-                for (size_t i = 0; i < res.size(); ++i) {
-                    out << res[i];
-                    if (i + 1 < res.size()) {
-                        out << DLIM;
-                    }
+            for (size_t i = 0; i < res.size(); ++i) {
+                out << res[i];
+                if (i + 1 < res.size()) {
+                    out << DLIM;
                 }
-                out << ' ' << node->cnt;
             }
+            out << ' ' << node->cnt;
+        }
 
-            if (node->name != NAME) {
-                res.pop_back();
+        if (node->name != NAME) {
+            res.pop_back();
+        }
+
+        f(node->sibling);
+    };
+    f(root);
+}
+
+namespace {
+
+struct NameHash {
+    size_t operator()(const std::string* name) const {
+        return std::hash<std::string>()(*name);
+    }
+};
+
+struct NameEqual {
+    bool operator()(const std::string* a, const std::string* b) const {
+        return *a == *b;
+    }
+};
+
+// children of wider nodes are looked up in a hash table while merging
+const size_t kWideNode = 16;
+
+// Finds the children of a node by name, the node is at `depth` in `tree`
+class Children {
+  public:
+    Children(StackTree* tree, Node* parent, size_t depth)
+        : tree_(tree), parent_(parent), last_(nullptr), depth_(depth) {
+        size_t n = 0;
+        for (Node* child = parent->child; child; child = child->sibling) {
+            last_ = child;
+            n++;
+        }
+        if (n > kWideNode) {
+            for (Node* child = parent->child; child; child = child->sibling) {
+                index_.emplace(&child->name, child);
             }
+        }
+    }
 
-            f(node->sibling);
-        };
-        f(root);
+    Node* Find(const std::string& name) const {
+        if (!index_.empty()) {
+            auto it = index_.find(&name);
+            return it == index_.end() ? nullptr : it->second;
+        }
+        for (Node* child = parent_->child; child; child = child->sibling) {
+            if (child->name == name) {
+                return child;
+            }
+        }
+        return nullptr;
     }
 
-    virtual ~StackTree() {
-        // Use iterative deletion to avoid stack overflow
-        if (root != nullptr) {
-            delete root;
-            root = nullptr;
+    // a new last child, it is not indexed: the names added are distinct
+    Node* Append(const std::string& name) {
+        Node* node =
+            tree_->NewNode(parent_, name.data(), name.size(), depth_ + 1);
+        if (last_ == nullptr) {
+            parent_->child = node;
+        } else {
+            last_->sibling = node;
         }
+        last_ = node;
+        return node;
     }
+
+  private:
+    StackTree* tree_;
+    Node* parent_;
+    Node* last_;
+    size_t depth_;
+    std::unordered_map<const std::string*, Node*, NameHash, NameEqual> index_;
 };
 
+// a node of the tree being changed, the node of the other tree at the same
+// place and their depth
+struct Pair {
+    Node* mine;
+    const Node* theirs;
+    size_t depth;
+};
+
+}  // namespace
+
+void
+StackTree::Merge(const StackTree& other) {
+    std::vector<Pair> pending;
+    root->cnt += other.root->cnt;
+    root->acc_cnt += other.root->acc_cnt;
+    pending.push_back(Pair{root, other.root, 0});
+    while (!pending.empty()) {
+        Pair pair = pending.back();
+        pending.pop_back();
+        if (pair.theirs->child == nullptr) {
+            continue;
+        }
+        Children children(this, pair.mine, pair.depth);
+        for (const Node* c = pair.theirs->child; c; c = c->sibling) {
+            Node* node = children.Find(c->name);
+            if (node == nullptr) {
+                node = children.Append(c->name);
+            }
+            node->cnt += c->cnt;
+            node->acc_cnt += c->acc_cnt;
+            pending.push_back(Pair{node, c, pair.depth + 1});
+        }
+    }
+}
+
+void
+StackTree::Subtract(const StackTree& other) {
+    std::vector<Pair> pending;
+    root->cnt -= std::min(root->cnt, other.root->cnt);
+    root->acc_cnt -= std::min(root->acc_cnt, other.root->acc_cnt);
+    pending.push_back(Pair{root, other.root, 0});
+    while (!pending.empty()) {
+        Pair pair = pending.back();
+        Node* mine = pair.mine;
+        pending.pop_back();
+        if (pair.theirs->child == nullptr) {
+            continue;
+        }
+        Children children(this, mine, pair.depth);
+        bool emptied = false;
+        for (const Node* c = pair.theirs->child; c; c = c->sibling) {
+            Node* node = children.Find(c->name);
+            if (node == nullptr) {
+                continue;  // never merged
+            }
+            node->cnt -= std::min(node->cnt, c->cnt);
+            node->acc_cnt -= std::min(node->acc_cnt, c->acc_cnt);
+            if (node->acc_cnt == 0) {
+                emptied = true;  // freed below with all of its subtree
+            } else {
+                pending.push_back(Pair{node, c, pair.depth + 1});
+            }
+        }
+        if (!emptied) {
+            continue;
+        }
+        Node** link = &mine->child;
+        while (*link != nullptr) {
+            Node* node = *link;
+            if (node->acc_cnt == 0) {
+                *link = node->sibling;
+                node->sibling = nullptr;
+                Forget(mine, node, pair.depth + 1);
+                delete node;
+            } else {
+                link = &node->sibling;
+            }
+        }
+    }
+}
+
+StackTree::~StackTree() {
+    // Use iterative deletion to avoid stack overflow
+    if (root != nullptr) {
+        delete root;
+        root = nullptr;
+    }
+}
+
+
 StackTree*
 NewTree() {
     return new StackTree();
@@ -155,11 +344,15 @@ FreeTree(StackTree* tree) {
     }
 }
 
-void
+int
 Dump(StackTree* tree, const char* filename) {
     std::ofstream out(filename);
+    if (!out) {
+        return -1;
+    }
     tree->Save(out);
     out.close();
+    return out.fail() ? -1 : 0;
 }
 
 char*
@@ -177,6 +370,265 @@ AddCallStack(StackTree* tree, const char* callstack) {
     tree->AddCallStack(callstack);
 }
 
+unsigned long long
+TreeSamples(StackTree* tree) {
+    return tree->root->acc_cnt;
+}
+
+void
+TreeGetStats(const StackTree* tree, TreeStats* stats) {
+    *stats = tree->stats;
+}
+
+void
+MergeTree(StackTree* tree, const StackTree* other) {
+    tree->Merge(*other);
+}
+
+void
+SubtractTree(StackTree* tree, const StackTree* other) {
+    tree->Subtract(*other);
+}
+
+namespace {
+
+const char kPackMagic[4] = {'T', 'X', 'P', '1'};
+
+class PackReader {
+  public:
+    PackReader(const char* data, size_t size)
+        : p_((const unsigned char*)data), end_(p_ + size) {}
+
+    bool Varint(uint64_t* v) {
+        *v = 0;
+        for (int shift = 0; shift < 64 && p_ < end_; shift += 7) {
+            uint64_t byte = *p_++;
+            *v |= (byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Bytes(size_t n, std::string* s) {
+        if ((size_t)(end_ - p_) < n) {
+            return false;
+        }
+        s->assign((const char*)p_, n);
+        p_ += n;
+        return true;
+    }
+
+    bool Done() const { return p_ == end_; }
+
+  private:
+    const unsigned char* p_;
+    const unsigned char* end_;
+};
+
+// a node as packed: its counts and how many children follow it
+void
+PackNode(std::string& out, const Node* node) {
+    size_t children = 0;
+    for (const Node* c = node->child; c; c = c->sibling) {
+        children++;
+    }
+    PutVarint(out, node->cnt);
+    PutVarint(out, node->acc_cnt);
+    PutVarint(out, children);
+}
+
+bool
+UnpackNode(PackReader& in, uint64_t* cnt, uint64_t* acc_cnt, uint64_t* children) {
+    return in.Varint(cnt) && in.Varint(acc_cnt) && in.Varint(children);
+}
+
+}  // namespace
+
+char*
+PackTree(StackTree* tree, size_t* size) {
+    std::unordered_map<const std::string*, uint64_t, NameHash, NameEqual> ids;
+    std::vector<const std::string*> names;
+    std::string nodes;
+    PackNode(nodes, tree->root);
+    // preorder, the children of a node in sibling order
+    std::vector<const Node*> pending;
+    for (const Node* c = tree->root->child; c; c = c->sibling) {
+        pending.push_back(c);
+    }
+    std::reverse(pending.begin(), pending.end());
+    while (!pending.empty()) {
+        const Node* node = pending.back();
+        pending.pop_back();
+        auto it = ids.find(&node->name);
+        if (it == ids.end()) {
+            it = ids.emplace(&node->name, names.size()).first;
+            names.push_back(&node->name);
+        }
+        PutVarint(nodes, it->second);
+        PackNode(nodes, node);
+        size_t first = pending.size();
+        for (const Node* c = node->child; c; c = c->sibling) {
+            pending.push_back(c);
+        }
+        std::reverse(pending.begin() + first, pending.end());
+    }
+    std::string out(kPackMagic, sizeof(kPackMagic));
+    PutVarint(out, names.size());
+    for (const std::string* name : names) {
+        PutVarint(out, name->size());
+        out.append(*name);
+    }
+    out.append(nodes);
+    char* res = (char*)malloc(out.size());
+    if (res == nullptr) {
+        return nullptr;
+    }
+    memcpy(res, out.data(), out.size());
+    *size = out.size();
+    return res;
+}
+
+int
+MergePacked(StackTree* tree, const char* data, size_t size) {
+    if (size < sizeof(kPackMagic) ||
+        memcmp(data, kPackMagic, sizeof(kPackMagic)) != 0) {
+        return -1;
+    }
+    PackReader in(data + sizeof(kPackMagic), size - sizeof(kPackMagic));
+    uint64_t count;
+    if (!in.Varint(&count)) {
+        return -1;
+    }
+    std::vector<std::string> names;
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t n;
+        names.emplace_back();
+        if (!in.Varint(&n) || !in.Bytes(n, &names.back())) {
+            return -1;
+        }
+    }
+    uint64_t cnt, acc_cnt, children, id;
+    // checked to the end first, so that a bad tree adds nothing
+    PackReader check = in;
+    std::vector<uint64_t> left;
+    if (!UnpackNode(check, &cnt, &acc_cnt, &children)) {
+        return -1;
+    }
+    left.push_back(children);
+    while (!left.empty()) {
+        if (left.back() == 0) {
+            left.pop_back();
+            continue;
+        }
+        left.back()--;
+        if (!check.Varint(&id) || id >= names.size() ||
+            !UnpackNode(check, &cnt, &acc_cnt, &children)) {
+            return -1;
+        }
+        if (children > 0) {
+            left.push_back(children);
+        }
+    }
+    if (!check.Done()) {
+        return -1;
+    }
+    // then merged like StackTree::Merge, a level per node being unpacked
+    struct Level {
+        Children children;
+        uint64_t left;
+    };
+    std::vector<Level> levels;
+    UnpackNode(in, &cnt, &acc_cnt, &children);
+    tree->root->cnt += cnt;
+    tree->root->acc_cnt += acc_cnt;
+    levels.push_back(Level{Children(tree, tree->root, 0), children});
+    while (!levels.empty()) {
+        Level& level = levels.back();
+        if (level.left == 0) {
+            levels.pop_back();
+            continue;
+        }
+        level.left--;
+        in.Varint(&id);
+        UnpackNode(in, &cnt, &acc_cnt, &children);
+        Node* node = level.children.Find(names[id]);
+        if (node == nullptr) {
+            node = level.children.Append(names[id]);
+        }
+        node->cnt += cnt;
+        node->acc_cnt += acc_cnt;
+        if (children > 0) {
+            levels.push_back(
+                Level{Children(tree, node, levels.size()), children});
+        }
+    }
+    return 0;
+}
+
+size_t
+TopFrames(StackTree* tree, size_t k, FrameCount* out) {
+    struct Frame {
+        const std::string* name;
+        unsigned long long self;
+        unsigned long long total;
+        size_t on_stack;  // a recursive frame only counts its outermost call
+    };
+    std::vector<Frame> frames;
+    std::unordered_map<const std::string*, size_t, NameHash, NameEqual> ids;
+    // a node is pushed again, with `leave` set, to pop it off the stack
+    struct Visit {
+        const Node* node;
+        size_t id;
+        bool leave;
+    };
+    std::vector<Visit> pending;
+    for (const Node* c = tree->root->child; c; c = c->sibling) {
+        pending.push_back(Visit{c, 0, false});
+    }
+    while (!pending.empty()) {
+        Visit v = pending.back();
+        pending.pop_back();
+        if (v.leave) {
+            frames[v.id].on_stack--;
+            continue;
+        }
+        auto it = ids.find(&v.node->name);
+        if (it == ids.end()) {
+            it = ids.emplace(&v.node->name, frames.size()).first;
+            frames.push_back(Frame{&v.node->name, 0, 0, 0});
+        }
+        Frame& frame = frames[it->second];
+        frame.self += v.node->cnt;
+        if (frame.on_stack++ == 0) {
+            frame.total += v.node->acc_cnt;
+        }
+        pending.push_back(Visit{v.node, it->second, true});
+        for (const Node* c = v.node->child; c; c = c->sibling) {
+            pending.push_back(Visit{c, 0, false});
+        }
+    }
+    k = std::min(k, frames.size());
+    std::partial_sort(frames.begin(),
+                      frames.begin() + k,
+                      frames.end(),
+                      [](const Frame& a, const Frame& b) {
+                          if (a.self != b.self) {
+                              return a.self > b.self;
+                          }
+                          if (a.total != b.total) {
+                              return a.total > b.total;
+                          }
+                          return *a.name < *b.name;
+                      });
+    for (size_t i = 0; i < k; ++i) {
+        out[i] = FrameCount{frames[i].name->c_str(), frames[i].self,
+                            frames[i].total};
+    }
+    return k;
+}
+
 
 #ifdef TELEX_TEST
 
@@ -274,11 +726,139 @@ TestCaseComplicated() {
 }
 
 
+void
+TestCaseMergeSubtract() {
+    auto tree = new StackTree();
+    tree->AddCallStack("main.py;hello;world");
+    auto other = new StackTree();
+    other->AddCallStack("main.py;hello;world");
+    other->AddCallStack("main.py;hello;x");
+    other->AddCallStack("main.py;a;main.py");
+    tree->Merge(*other);
+    std::ostringstream s;
+    tree->Save(s);
+    std::string res = "main.py;hello;world 2\n";
+    res += "main.py;hello;x 1\n";
+    res += "main.py;a;main.py 1";
+    assert(s.str() == res);
+
+    FrameCount top[8];
+    size_t n = TopFrames(tree, 8, top);
+    assert(n == 5);
+    assert(strcmp(top[0].name, "world") == 0 && top[0].self == 2);
+    // recursion is counted once
+    assert(strcmp(top[1].name, "main.py") == 0 && top[1].self == 1);
+    assert(top[1].total == 4);
+
+    tree->Subtract(*other);
+    s.str("");
+    tree->Save(s);
+    assert(s.str() == "main.py;hello;world 1");
+    assert(tree->root->acc_cnt == 1);
+    assert(tree->root->child->child->sibling == nullptr);
+    std::cout << SuccessMessage("Test case merge and subtract passed")
+              << std::endl;
+    delete other;
+    delete tree;
+}
+
+
+void
+TestCasePack() {
+    auto tree = new StackTree();
+    tree->AddCallStack("main.py;hello;world");
+    tree->AddCallStack("main.py;hello;world");
+    tree->AddCallStack("main.py;hello");
+    tree->AddCallStack("main.py;x;hello");
+    size_t size = 0;
+    char* packed = PackTree(tree, &size);
+    assert(packed != nullptr);
+
+    auto other = new StackTree();
+    other->AddCallStack("main.py;x;hello");
+    assert(MergePacked(other, packed, size) == 0);
+    std::ostringstream s;
+    other->Save(s);
+    std::string res = "main.py;x;hello 2\n";
+    res += "main.py;hello;world 2\n";
+    res += "main.py;hello 1";
+    assert(s.str() == res);
+    assert(other->root->acc_cnt == 5);
+
+    // truncated or trailing data adds nothing
+    assert(MergePacked(other, packed, size - 1) == -1);
+    std::string longer(packed, size);
+    longer.push_back('\0');
+    assert(MergePacked(other, longer.data(), longer.size()) == -1);
+    assert(other->root->acc_cnt == 5);
+    std::cout << SuccessMessage("Test case pack passed") << std::endl;
+    free(packed);
+    delete other;
+    delete tree;
+}
+
+
+void
+TestCaseStats() {
+    auto tree = new StackTree();
+    tree->AddCallStack("T;a;b");
+    tree->AddCallStack("T;a;c");
+    tree->AddCallStack("T;d");
+    TreeStats stats;
+    TreeGetStats(tree, &stats);
+    assert(stats.nodes == 5 && stats.leaves == 3);
+    assert(stats.max_depth == 3 && stats.total_depth == 8);
+    assert(stats.name_bytes == 5);
+    assert(stats.heap_bytes == 5 * sizeof(Node));
+
+    // a leaf grows, a name too long to be kept in the node
+    std::string name(100, 'x');
+    tree->AddCallStack(("T;a;b;" + name).c_str());
+    TreeGetStats(tree, &stats);
+    assert(stats.nodes == 6 && stats.leaves == 3);
+    assert(stats.max_depth == 4 && stats.total_depth == 9);
+    assert(stats.name_bytes == 105);
+    assert(stats.heap_bytes > 6 * sizeof(Node) + 100);
+
+    // merging into an empty tree and packing build the same tree
+    auto copy = new StackTree();
+    copy->Merge(*tree);
+    TreeStats merged;
+    TreeGetStats(copy, &merged);
+    assert(memcmp(&merged, &stats, sizeof(stats)) == 0);
+    size_t size = 0;
+    char* packed = PackTree(tree, &size);
+    auto unpacked = new StackTree();
+    assert(MergePacked(unpacked, packed, size) == 0);
+    TreeGetStats(unpacked, &merged);
+    assert(merged.nodes == 6 && merged.max_depth == 4);
+    assert(merged.total_depth == 9 && merged.leaves == 3);
+    free(packed);
+
+    auto other = new StackTree();
+    other->AddCallStack(("T;a;b;" + name).c_str());
+    other->AddCallStack("T;d");
+    tree->Subtract(*other);
+    TreeGetStats(tree, &stats);
+    assert(stats.nodes == 4 && stats.leaves == 2);
+    assert(stats.max_depth == 3 && stats.total_depth == 6);
+    assert(stats.name_bytes == 4 && stats.heap_bytes == 4 * sizeof(Node));
+    std::cout << SuccessMessage("Test case stats passed") << std::endl;
+    delete other;
+    delete unpacked;
+    delete copy;
+    delete tree;
+}
+
+
 int
 main() {
     TestCaseSingle();
     TestCaseMultiply();
     TestCaseOrderExchange();
     TestCaseComplicated();
+    TestCaseMergeSubtract();
+    TestCasePack();
+    TestCaseStats();
 }
 #endif
\ No newline at end of file
@@ -2,6 +2,8 @@
 #ifndef TELE_TREE_H
 #define TELE_TREE_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -17,13 +19,69 @@ FreeTree(struct StackTree* tree);
 void
 AddCallStack(struct StackTree* tree, const char* callstack);
 
-void
+// returns 0 on success, -1 if the file can not be written
+int
 Dump(struct StackTree* tree, const char* filename);
 
 // returns a string that should be freed by caller (ownership returned )
 char*
 Dumps(struct StackTree* tree);
 
+// the number of stacks added to `tree`
+unsigned long long
+TreeSamples(struct StackTree* tree);
+
+// What a tree holds, kept up to date as frames are added and freed. The
+// root is not a frame, the depth of a frame is the number of frames from
+// the root to it, the thread name included.
+struct TreeStats {
+    unsigned long long nodes;        // frames
+    unsigned long long leaves;       // frames without children
+    unsigned long long max_depth;    // depth of the deepest frame
+    unsigned long long total_depth;  // sum of the depths of the leaves
+    unsigned long long name_bytes;   // the characters of the frame names
+    // the nodes and the name buffers they allocate, without the overhead of
+    // the allocator
+    unsigned long long heap_bytes;
+};
+
+void
+TreeGetStats(const struct StackTree* tree, struct TreeStats* stats);
+
+// add the counts of every stack of `other` to `tree`
+void
+MergeTree(struct StackTree* tree, const struct StackTree* other);
+
+// Take the counts of every stack of `other`, which were merged into `tree`
+// before, out of `tree` again. Frames left without samples are freed.
+void
+SubtractTree(struct StackTree* tree, const struct StackTree* other);
+
+// Serialize `tree` compactly for another process: every distinct frame name
+// once, then the nodes in preorder as varints referring to the names.
+// returns a malloc'd buffer of `*size` bytes to be freed by the caller, or
+// NULL when out of memory
+char*
+PackTree(struct StackTree* tree, size_t* size);
+
+// Add the stacks of a tree packed by PackTree to `tree`, nothing is added
+// unless all of `data` is read.
+// returns 0 on success, -1 if `data` is not a packed tree
+int
+MergePacked(struct StackTree* tree, const char* data, size_t size);
+
+struct FrameCount {
+    const char* name;          // valid until the tree is changed
+    unsigned long long self;   // samples with the frame at the top
+    unsigned long long total;  // samples with the frame anywhere, once
+};
+
+// The `k` frames with the most self samples, then the most total samples,
+// frames of the same name are counted together.
+// returns the number of frames stored in `out`
+size_t
+TopFrames(struct StackTree* tree, size_t k, struct FrameCount* out);
+
 #ifdef __cplusplus
 }
 #endif
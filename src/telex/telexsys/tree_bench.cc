@@ -0,0 +1,329 @@
+// Throughput of the StackTree: inserting stacks, dumping them and freeing the
+// tree, on synthetic workloads generated from a seed and on recorded folded
+// files. Results are printed as JSON so that runs can be compared.
+//
+//   make bench
+//   ./tree_bench [--inserts N] [--repeat R] [--seed S]
+//                [--workload deep_narrow|wide_shallow|zipf ...]
+//                [--replay FILE ...]
+//
+// Times are the best of the repeats. bytes_per_node is the heap_bytes of
+// TreeGetStats per frame: the nodes and the heap buffers of their names, not
+// the allocator's overhead.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "encode.h"
+#include "tree_impl.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double
+Seconds(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// xorshift64*, the same sequence on every platform unlike <random>'s
+// distributions
+struct Rng {
+    uint64_t state;
+
+    explicit Rng(uint64_t seed) : state(seed * 2654435761u + 1) {}
+
+    uint64_t Next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1Dull;
+    }
+
+    size_t Below(size_t n) { return (size_t)(Next() % n); }
+
+    double Unit() { return (double)(Next() >> 11) / (double)(1ull << 53); }
+};
+
+std::string
+FrameName(size_t i) {
+    return "/srv/app/pkg/module_" + std::to_string(i % 97) +
+           ".py:function_" + std::to_string(i) + ":" +
+           std::to_string(i * 7 % 1000 + 1);
+}
+
+struct Workload {
+    std::string name;
+    std::vector<std::string> stacks;  // the distinct stacks
+    std::vector<uint32_t> order;      // the stack of every insert
+};
+
+// a few very deep stacks, as in recursive code: every insert walks far
+// down one child per level
+Workload
+DeepNarrow(size_t inserts, Rng& rng) {
+    Workload w{"deep_narrow", {}, {}};
+    std::string prefix = "MainThread";
+    for (size_t i = 0; i < 240; ++i) {
+        prefix += ";" + FrameName(i % 12);
+    }
+    for (size_t i = 0; i < 8; ++i) {
+        std::string stack = prefix;
+        for (size_t j = 0; j < 16; ++j) {
+            stack += ";" + FrameName(1000 + i * 16 + j);
+        }
+        w.stacks.push_back(stack);
+    }
+    for (size_t i = 0; i < inserts; ++i) {
+        w.order.push_back((uint32_t)rng.Below(w.stacks.size()));
+    }
+    return w;
+}
+
+// many short stacks below a few frames: long sibling lists
+Workload
+WideShallow(size_t inserts, Rng& rng) {
+    Workload w{"wide_shallow", {}, {}};
+    for (size_t i = 0; i < 64; ++i) {
+        for (size_t j = 0; j < 256; ++j) {
+            w.stacks.push_back("MainThread;" + FrameName(i) + ";" +
+                               FrameName(100 + i * 256 + j));
+        }
+    }
+    for (size_t i = 0; i < inserts; ++i) {
+        w.order.push_back((uint32_t)rng.Below(w.stacks.size()));
+    }
+    return w;
+}
+
+// random walks down a call graph, like the stacks of an application, drawn
+// with Zipf frequencies: a few hot paths and a long tail
+Workload
+Zipf(size_t inserts, Rng& rng) {
+    Workload w{"zipf", {}, {}};
+    const size_t names = 4000;
+    std::vector<std::vector<size_t>> callees(names);
+    for (auto& c : callees) {
+        size_t n = 1 + rng.Below(4);
+        for (size_t i = 0; i < n; ++i) {
+            c.push_back(rng.Below(names));
+        }
+    }
+    const char* threads[] = {"MainThread", "Thread-1", "Thread-2", "worker"};
+    for (size_t i = 0; i < 20000; ++i) {
+        std::string stack = threads[rng.Below(4)];
+        size_t frame = rng.Below(16);
+        size_t depth = 5 + rng.Below(56);
+        for (size_t d = 0; d < depth; ++d) {
+            stack += ";" + FrameName(frame);
+            frame = callees[frame][rng.Below(callees[frame].size())];
+        }
+        w.stacks.push_back(stack);
+    }
+    std::vector<double> cdf(w.stacks.size());
+    double sum = 0;
+    for (size_t i = 0; i < cdf.size(); ++i) {
+        sum += 1.0 / std::pow((double)(i + 1), 1.1);
+        cdf[i] = sum;
+    }
+    for (size_t i = 0; i < inserts; ++i) {
+        double x = rng.Unit() * sum;
+        size_t k = std::lower_bound(cdf.begin(), cdf.end(), x) - cdf.begin();
+        w.order.push_back((uint32_t)std::min(k, cdf.size() - 1));
+    }
+    return w;
+}
+
+// every sample of a folded file, its lines in order and each as many times
+// as counted
+bool
+Replay(const char* path, Workload* w) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    w->name = std::string("replay:") + path;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t space = line.rfind(' ');
+        if (space == std::string::npos || space == 0) {
+            continue;
+        }
+        unsigned long count =
+            std::strtoul(line.c_str() + space + 1, nullptr, 10);
+        w->stacks.push_back(line.substr(0, space));
+        for (unsigned long i = 0; i < count; ++i) {
+            w->order.push_back((uint32_t)(w->stacks.size() - 1));
+        }
+    }
+    return true;
+}
+
+struct Result {
+    double insert = 1e300;
+    double dumps = 1e300;
+    double save = 1e300;
+    double teardown = 1e300;
+    size_t nodes = 0;
+    size_t bytes = 0;
+    size_t dump_bytes = 0;
+    unsigned long long samples = 0;
+};
+
+Result
+Run(const Workload& w, int repeat, const std::string& path) {
+    Result r;
+    for (int i = 0; i < repeat; ++i) {
+        struct StackTree* tree = NewTree();
+        auto start = Clock::now();
+        for (uint32_t k : w.order) {
+            AddCallStack(tree, w.stacks[k].c_str());
+        }
+        r.insert = std::min(r.insert, Seconds(start));
+
+        start = Clock::now();
+        char* text = Dumps(tree);
+        r.dumps = std::min(r.dumps, Seconds(start));
+        r.dump_bytes = std::strlen(text);
+        free(text);
+
+        start = Clock::now();
+        if (Dump(tree, path.c_str()) != 0) {
+            std::perror(path.c_str());
+            std::exit(1);
+        }
+        r.save = std::min(r.save, Seconds(start));
+
+        TreeStats stats;
+        TreeGetStats(tree, &stats);
+        r.nodes = stats.nodes;
+        r.bytes = stats.heap_bytes;
+        r.samples = TreeSamples(tree);
+
+        start = Clock::now();
+        FreeTree(tree);
+        r.teardown = std::min(r.teardown, Seconds(start));
+    }
+    return r;
+}
+
+// 0 rather than the inf or nan JSON has no literal for, such as for an
+// empty replay
+double
+Ratio(double n, double d) {
+    return d > 0 ? n / d : 0;
+}
+
+void
+Print(const Workload& w, const Result& r, bool last) {
+    double mb = (double)r.dump_bytes / (1 << 20);
+    std::string name;
+    AppendJsonString(name, w.name);
+    std::printf(
+        "    {\"workload\": %s, \"inserts\": %zu, \"distinct_stacks\": "
+        "%zu, \"samples\": %llu, \"nodes\": %zu, \"insert_seconds\": %.6f, "
+        "\"inserts_per_s\": %.0f, \"bytes\": %zu, \"bytes_per_node\": %.1f, "
+        "\"dump_bytes\": %zu, \"dumps_mb_per_s\": %.1f, \"save_mb_per_s\": "
+        "%.1f, \"teardown_seconds\": %.6f}%s\n",
+        name.c_str(), w.order.size(), w.stacks.size(), r.samples, r.nodes,
+        r.insert, Ratio((double)w.order.size(), r.insert), r.bytes,
+        Ratio((double)r.bytes, (double)r.nodes), r.dump_bytes,
+        Ratio(mb, r.dumps), Ratio(mb, r.save), r.teardown, last ? "" : ",");
+}
+
+int
+Usage(const char* program) {
+    std::fprintf(stderr,
+                 "usage: %s [--inserts N] [--repeat R] [--seed S] "
+                 "[--workload deep_narrow|wide_shallow|zipf ...] "
+                 "[--replay FILE ...]\n",
+                 program);
+    return 2;
+}
+
+}  // namespace
+
+int
+main(int argc, char** argv) {
+    size_t inserts = 100000;
+    int repeat = 3;
+    uint64_t seed = 0;
+    std::vector<std::string> names;
+    std::vector<std::string> replays;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return Usage(argv[0]);
+        }
+        if (arg == "--inserts") {
+            inserts = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--repeat") {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--seed") {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--workload") {
+            names.push_back(argv[++i]);
+        } else if (arg == "--replay") {
+            replays.push_back(argv[++i]);
+        } else {
+            return Usage(argv[0]);
+        }
+    }
+    if (names.empty() && replays.empty()) {
+        names = {"deep_narrow", "wide_shallow", "zipf"};
+    }
+
+    std::vector<Workload> workloads;
+    for (const auto& name : names) {
+        // every workload draws from its own sequence of the seed
+        if (name == "deep_narrow") {
+            Rng rng(seed * 3);
+            workloads.push_back(DeepNarrow(inserts, rng));
+        } else if (name == "wide_shallow") {
+            Rng rng(seed * 3 + 1);
+            workloads.push_back(WideShallow(inserts, rng));
+        } else if (name == "zipf") {
+            Rng rng(seed * 3 + 2);
+            workloads.push_back(Zipf(inserts, rng));
+        } else {
+            return Usage(argv[0]);
+        }
+    }
+    for (const auto& path : replays) {
+        Workload w;
+        if (!Replay(path.c_str(), &w)) {
+            std::perror(path.c_str());
+            return 1;
+        }
+        workloads.push_back(std::move(w));
+    }
+
+    // the file Dump writes to, made only for this run
+    char path_template[] = "/tmp/tree_bench.XXXXXX";
+    int fd = mkstemp(path_template);
+    if (fd < 0) {
+        std::perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    std::string path = path_template;
+    std::printf("{\n  \"seed\": %llu,\n  \"repeat\": %d,\n  \"results\": [\n",
+                (unsigned long long)seed, repeat);
+    for (size_t i = 0; i < workloads.size(); ++i) {
+        Result r = Run(workloads[i], repeat, path);
+        Print(workloads[i], r, i + 1 == workloads.size());
+        std::fflush(stdout);
+    }
+    std::printf("  ]\n}\n");
+    std::remove(path.c_str());
+    return 0;
+}
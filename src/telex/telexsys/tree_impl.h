@@ -0,0 +1,108 @@
+#ifndef TELE_TREE_IMPL_H
+#define TELE_TREE_IMPL_H
+
+// C++ view of the StackTree, shared by the native writers that walk the trie
+// directly instead of going through Dumps.
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "tree.h"
+
+
+struct Node {
+    std::string name;
+    // 64 bits wide everywhere, the chrome trace converter counts time in
+    // 1/100us which would wrap after 43s in a 32 bits unsigned long
+    uint64_t cnt;      // called count
+    uint64_t acc_cnt;  // accumulated count
+    Node* child;
+    Node* sibling;
+
+    // no virtual destructor to save memory
+    ~Node() {
+        delete child;
+        delete sibling;
+    }
+};
+
+
+// the bytes a node allocates, its name's buffer unless the name is stored
+// in the node itself
+inline size_t
+NodeBytes(const Node* node) {
+    const char* data = node->name.data();
+    const char* self = (const char*)node;
+    if (data >= self && data < self + sizeof(Node)) {
+        return sizeof(Node);
+    }
+    return sizeof(Node) + node->name.capacity() + 1;
+}
+
+
+struct StackTree {
+    Node* root;
+    TreeStats stats;
+    std::vector<uint64_t> depths;  // the number of frames at every depth
+
+    StackTree();
+
+    // A frame named `name` to be linked as a child of `parent` at `depth`,
+    // the root's children are at depth 1. Every node of the tree is made
+    // here so that `stats` stays up to date.
+    Node* NewNode(const Node* parent, const char* name, size_t size,
+                  size_t depth);
+
+    // take `node` and its subtree, about to be deleted, out of `stats`. It
+    // must be unlinked from `parent` already.
+    void Forget(const Node* parent, const Node* node, size_t depth);
+
+    // callstack exmplae: main.py:hello:world
+    void AddCallStack(const char* callstack);
+
+    void Save(std::ostream& out);
+
+    // see MergeTree and SubtractTree
+    void Merge(const StackTree& other);
+    void Subtract(const StackTree& other);
+
+    virtual ~StackTree();
+};
+
+
+// A frame name, "file:function:line" as built by call_stack, or a bare name
+// such as a thread, which has no file and line 0. The file name itself may
+// contain ':' on Windows.
+struct Frame {
+    std::string filename;
+    std::string function;
+    uint64_t line;
+};
+
+inline Frame
+SplitFrame(const std::string& name) {
+    Frame frame{std::string(), name, 0};
+    size_t last = name.rfind(':');
+    if (last == std::string::npos || last == 0 || last + 1 == name.size()) {
+        return frame;
+    }
+    uint64_t line = 0;
+    for (size_t i = last + 1; i < name.size(); ++i) {
+        if (name[i] < '0' || name[i] > '9') {
+            return frame;
+        }
+        line = line * 10 + (uint64_t)(name[i] - '0');
+    }
+    size_t middle = name.rfind(':', last - 1);
+    if (middle == std::string::npos) {
+        return frame;
+    }
+    frame.filename = name.substr(0, middle);
+    frame.function = name.substr(middle + 1, last - middle - 1);
+    frame.line = line;
+    return frame;
+}
+
+#endif
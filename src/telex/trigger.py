@@ -0,0 +1,208 @@
+"""
+Detailed profiles captured when a process gets busy or slow.
+
+A sampler runs at a low rate all the time while a watchdog checks the
+process's CPU usage and the worst latency the application reported since
+the last check. When a threshold is crossed the sampler switches to a high
+rate for ``duration`` seconds, and the capture is saved together with the
+low-rate stacks of the seconds before the trigger, which show how it came
+to that.
+"""
+
+from __future__ import annotations
+
+import os
+import threading
+import time
+from collections import deque
+from collections.abc import Callable
+from typing import NamedTuple
+
+from . import _telexsys
+from .sampler import TelexSysAsyncSampler, TelexSysSampler
+
+
+def process_cpu_seconds() -> float:
+    """User and system CPU time the process has used, in seconds."""
+    try:
+        with open("/proc/self/stat", "rb") as f:
+            stat = f.read()
+    except OSError:
+        times = os.times()
+        return times.user + times.system
+    # utime and stime are the 14th and 15th fields, the 2nd may hold spaces
+    fields = stat[stat.rindex(b")") + 2 :].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+
+class Capture(NamedTuple):
+    reason: str
+    started: float  # time.time() of the trigger
+    path: str  # the high-rate stacks, folded
+    pre_path: str  # the low-rate stacks before the trigger, folded
+
+
+class TriggeredCapture:
+    def __init__(
+        self,
+        sampler: TelexSysSampler | TelexSysAsyncSampler,
+        cpu: float | None = None,
+        latency: float | None = None,
+        slow_interval: int = 50_000,
+        fast_interval: int = 1_000,
+        duration: float = 10.0,
+        pre_seconds: float = 30.0,
+        check: float = 1.0,
+        cooldown: float = 60.0,
+        directory: str = ".",
+        clock: Callable[[], float] = time.monotonic,
+        cpu_seconds: Callable[[], float] = process_cpu_seconds,
+    ) -> None:
+        """
+        Args:
+            sampler: The sampler switched between the two rates, it is started
+                and stopped with the watchdog.
+            cpu: Trigger when the process uses more CPU than this, in percent
+                of one core over a check, None to ignore the CPU.
+            latency: Trigger when a latency above this many seconds is
+                reported with ``report_latency``, None to ignore latencies.
+            slow_interval: Sampling interval in microseconds between captures.
+            fast_interval: Sampling interval in microseconds of a capture.
+            duration: Seconds a capture lasts.
+            pre_seconds: Seconds of low-rate stacks saved with a capture.
+            check: Seconds between two checks of the watchdog.
+            cooldown: Seconds after a capture before the next may start.
+            directory: Where the captures are saved.
+            clock: The time in seconds, monotonic.
+            cpu_seconds: The CPU time the process used, in seconds.
+        """
+        if cpu is None and latency is None:
+            raise ValueError("at least one of cpu and latency must be given")
+        if duration <= 0 or check <= 0:
+            raise ValueError("duration and check must be positive")
+        self.sampler = sampler
+        self.cpu = cpu
+        self.latency = latency
+        self.slow_interval = slow_interval
+        self.fast_interval = fast_interval
+        self.duration = duration
+        self.pre_seconds = pre_seconds
+        self.check = check
+        self.cooldown = cooldown
+        self.directory = directory
+        self.captures: list[Capture] = []
+        self._clock = clock
+        self._cpu_seconds = cpu_seconds
+        self._lock = threading.Lock()
+        # low-rate stacks taken at every check, oldest first
+        self._pre: deque[tuple[float, _telexsys.StackTree]] = deque()
+        self._worst = 0.0
+        self._last: tuple[float, float] = (0.0, 0.0)
+        # (reason, time.time(), monotonic end, pre-trigger stacks) of a capture
+        self._capturing: tuple[str, float, float, _telexsys.StackTree] | None = None
+        self._quiet_until = 0.0
+        self._stopped = threading.Event()
+        self._thread: threading.Thread | None = None
+
+    @property
+    def capturing(self) -> bool:
+        return self._capturing is not None
+
+    def report_latency(self, seconds: float) -> None:
+        """Report how long an operation took, cheap enough to call for every one."""
+        if seconds > self._worst:
+            self._worst = seconds
+
+    def start(self) -> None:
+        """Start the sampler at the low rate and the watchdog."""
+        self.sampler.set_interval(self.slow_interval)
+        self.sampler.start()
+        self._last = (self._clock(), self._cpu_seconds())
+        self._stopped.clear()
+        self._thread = threading.Thread(
+            target=self._run, name="telex-trigger", daemon=True
+        )
+        self._thread.start()
+
+    def stop(self) -> None:
+        """Stop the watchdog and the sampler, a running capture is saved."""
+        self._stopped.set()
+        if self._thread is not None:
+            self._thread.join()
+            self._thread = None
+        with self._lock:
+            if self._capturing is not None:
+                self._finish()
+        self.sampler.stop()
+
+    def _run(self) -> None:
+        while not self._stopped.wait(self.check):
+            self.poll()
+
+    def poll(self) -> Capture | None:
+        """
+        Run one check of the watchdog.
+
+        Returns:
+            The capture saved by this check, if any.
+        """
+        with self._lock:
+            now = self._clock()
+            if self._capturing is not None:
+                if now >= self._capturing[2]:
+                    return self._finish()
+                return None
+            self._keep_pre(now)
+            reason = self._crossed(now)
+            if reason is not None and now >= self._quiet_until:
+                self._begin(reason, now)
+            return None
+
+    def _keep_pre(self, now: float) -> None:
+        taken = _telexsys.take_stacks(self.sampler)
+        if taken.samples > 0:
+            self._pre.append((now, taken))
+        while self._pre and self._pre[0][0] <= now - self.pre_seconds:
+            self._pre.popleft()
+
+    def _crossed(self, now: float) -> str | None:
+        """The threshold crossed since the last check, None if none was."""
+        worst, self._worst = self._worst, 0.0
+        cpu_seconds = self._cpu_seconds()
+        last_now, last_cpu = self._last
+        self._last = (now, cpu_seconds)
+        if self.cpu is not None and now > last_now:
+            usage = (cpu_seconds - last_cpu) * 100 / (now - last_now)
+            if usage > self.cpu:
+                return f"cpu {usage:.0f}%"
+        if self.latency is not None and worst > self.latency:
+            return f"latency {worst:.3f}s"
+        return None
+
+    def _begin(self, reason: str, now: float) -> None:
+        pre = _telexsys.StackTree()
+        for _, tree in self._pre:
+            pre.merge(tree)
+        self._pre.clear()
+        self._capturing = (reason, time.time(), now + self.duration, pre)
+        self.sampler.set_interval(self.fast_interval)
+
+    def _finish(self) -> Capture:
+        assert self._capturing is not None
+        reason, started, _, pre = self._capturing
+        self._capturing = None
+        self.sampler.set_interval(self.slow_interval)
+        taken = _telexsys.take_stacks(self.sampler)
+        now = self._clock()
+        self._quiet_until = now + self.cooldown
+        # the cpu time spent capturing does not count for the next check
+        self._last = (now, self._cpu_seconds())
+        name = os.path.join(
+            self.directory,
+            f"telex-trigger-{os.getpid()}-{int(started)}-{len(self.captures)}",
+        )
+        capture = Capture(reason, started, f"{name}.folded", f"{name}.pre.folded")
+        taken.save(capture.path)
+        pre.save(capture.pre_path)
+        self.captures.append(capture)
+        return capture
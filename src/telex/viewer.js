@@ -0,0 +1,279 @@
+"use strict";
+// Lazy flame graph viewer, loaded after script.js by FlameGraph.save_html.
+// Frames are not baked into the page: they are drawn from chunks of the call
+// tree, and a chunk is only parsed once a frame in it is wide enough to be
+// seen at the current zoom, so the work done per view does not grow with the
+// size of the profile. The chunk format is described in flamegraph.cc.
+//
+// zoom and unzoom replace the ones of script.js, which keeps handling
+// clicks, the details line and search on the frames drawn here.
+var viewer;
+var SVG_NS = "http://www.w3.org/2000/svg";
+var COALESCED_COLOR = "hsl(0, 0%, 80%)";
+
+function viewer_init() {
+	var config = JSON.parse(document.getElementById("telex-config").textContent);
+	viewer = {
+		config: config,
+		chunks: {},   // chunk id -> parts
+		pending: {},
+		root: null,
+		zoomed: null,
+	};
+	viewer.root = decode_chunk(read_chunk(0))[0][0];
+	viewer.root.parent = null;
+	viewer.zoomed = viewer.root;
+	init();
+	render();
+	search();
+}
+
+// chunk data
+function read_chunk(id) {
+	var el = document.getElementById("telex-chunk-" + id);
+	if (!el) return null;
+	var data = JSON.parse(el.textContent);
+	// the parsed tree replaces the text
+	el.parentNode.removeChild(el);
+	return data;
+}
+// the parts of a chunk, each a list of subtrees
+function decode_chunk(data) {
+	var nodes = data.nodes;
+	var i = 0;
+	// a part is at most 64 levels deep
+	function next() {
+		var node = {
+			name: data.names[nodes[i]],
+			hash: data.hashes[nodes[i]],
+			total: nodes[i + 1],
+			ord: nodes[i + 2],
+			kids: [],
+			group: nodes[i + 4] < 0 ? null : data.groups[nodes[i + 4]],
+			parent: null,
+		};
+		var count = nodes[i + 3];
+		i += 5;
+		for (var k = 0; k < count; k++) {
+			var kid = next();
+			kid.parent = node;
+			node.kids.push(kid);
+		}
+		return node;
+	}
+	var parts = [];
+	for (var p = 0; p < data.parts.length; p++) {
+		var roots = [];
+		for (var r = 0; r < data.parts[p]; r++) roots.push(next());
+		parts.push(roots);
+	}
+	return parts;
+}
+function attach_group(node) {
+	var roots = viewer.chunks[node.group[0]][node.group[1]];
+	for (var i = 0; i < roots.length; i++) {
+		roots[i].parent = node;
+		node.kids.push(roots[i]);
+	}
+	node.kids.sort(function (a, b) {
+		return a.ord - b.ord;
+	});
+	node.group = null;
+}
+// Load the children `node` lost to another chunk. Embedded chunks are read
+// right away, the monitor server serves them on demand and the view is drawn
+// again once they arrive. Returns false while they are still on their way.
+function load_group(node, done) {
+	var id = node.group[0];
+	if (!viewer.chunks[id]) {
+		var data = read_chunk(id);
+		if (data) viewer.chunks[id] = decode_chunk(data);
+	}
+	if (viewer.chunks[id]) {
+		attach_group(node);
+		return true;
+	}
+	var url = viewer.config.chunk_url;
+	if (!url || viewer.pending[id]) return false;
+	viewer.pending[id] = true;
+	fetch(url + id).then(function (resp) {
+		if (!resp.ok) throw new Error(resp.status + " " + resp.statusText);
+		return resp.json();
+	}).then(function (data) {
+		delete viewer.pending[id];
+		viewer.chunks[id] = decode_chunk(data);
+		if (done) done(); else render();
+	}).catch(function (err) {
+		delete viewer.pending[id];
+		details.nodeValue = "Failed to load frames: " + err.message;
+	});
+	return false;
+}
+
+// layout, the same as FlameGraph._layout_tree
+function place(node, total, scale, arg, L, R) {
+	var width = total * scale;
+	var x = arg - width;
+	if (x < L) x = L;
+	if (x + width > R) width = R - x;
+	return { node: node, total: total, arg: arg, x: x, width: width, count: 0 };
+}
+function layout_children(p, scale, next) {
+	var node = p.node;
+	var minwidth = viewer.config.minwidth;
+	if (node.group && node.group[4] * scale >= minwidth) load_group(node);
+	var current = p.arg;
+	var L = p.x, R = p.x + p.width;
+	var count = 0, total = 0;
+	// children that were never loaded are all narrower than minwidth
+	if (node.group) {
+		count = node.group[2];
+		total = node.group[3];
+	}
+	var placed = [];
+	for (var i = node.kids.length - 1; i >= 0; i--) {
+		var kid = node.kids[i];
+		if (kid.total * scale < minwidth) {
+			count++;
+			total += kid.total;
+			continue;
+		}
+		var q = place(kid, kid.total, scale, current, L, R);
+		placed.push(q);
+		current -= q.width;
+	}
+	placed.reverse();
+	if (count > 0 && total * scale >= minwidth) {
+		var box = place(node, total, scale, current, L, R);
+		box.count = count;
+		box.scale = scale;
+		placed.unshift(box);
+	}
+	for (var j = 0; j < placed.length; j++) next.push(placed[j]);
+}
+function render() {
+	var cfg = viewer.config;
+	var zoomed = viewer.zoomed;
+	var scale = (cfg.width - 20) / Math.max(1, zoomed.total);
+	var levels = [];
+	// what the zoomed frame is called from spans the whole width
+	var ancestors = [];
+	for (var a = zoomed.parent; a; a = a.parent) ancestors.unshift(a);
+	for (var i = 0; i < ancestors.length; i++) {
+		var node = ancestors[i];
+		levels.push([{
+			node: node, total: node.total, x: 10, width: cfg.width - 20,
+			count: 0, parent: true,
+		}]);
+	}
+	var level = [place(zoomed, Math.max(1, zoomed.total), scale, cfg.width - 10, 10, cfg.width - 10)];
+	while (level.length) {
+		levels.push(level);
+		var next = [];
+		for (var k = 0; k < level.length; k++) {
+			if (level[k].count == 0 && level[k].width >= cfg.minwidth)
+				layout_children(level[k], scale, next);
+		}
+		level = next;
+	}
+	draw(levels);
+}
+
+// drawing
+function frame_color(p) {
+	var h = p.node.hash;
+	if (p.count > 0 || h === undefined) return COALESCED_COLOR;
+	return "hsl(" + h % 360 + ", " + (35 + h % 30) + "%, " + (65 + h % 10) + "%)";
+}
+// FlameGraph._trim_text
+function trim_text(text, width) {
+	if (width / 6.5 < 3) return "";
+	var chars = Array.from(text);
+	if (chars.length * 6.5 <= width) return text;
+	return chars.slice(0, Math.floor(width / 6.5) - 2).join("") + "..";
+}
+function svg_element(name, attrs, text) {
+	var e = document.createElementNS(SVG_NS, name);
+	for (var key in attrs) e.setAttribute(key, attrs[key]);
+	if (text !== undefined) e.textContent = text;
+	return e;
+}
+function draw(levels) {
+	var cfg = viewer.config;
+	var fh = cfg.frame_height;
+	var height = levels.length * fh + cfg.top_margin + cfg.bottom_margin;
+	svg.setAttribute("height", height);
+	svg.setAttribute("viewBox", "0 0 " + cfg.width + " " + height);
+	document.getElementById("canvas").setAttribute("height", height);
+	document.getElementById("details").setAttribute("y", height - 10);
+	document.getElementById("matched").setAttribute("y", height - 10);
+
+	var all = Math.max(1, viewer.root.total);
+	var frames = document.getElementById("frames");
+	var fragment = document.createDocumentFragment();
+	for (var depth = 1; depth <= levels.length; depth++) {
+		var y = orientationInverted
+			? cfg.top_margin + (depth - 1) * fh
+			: height - cfg.bottom_margin - depth * fh;
+		var level = levels[depth - 1];
+		for (var i = 0; i < level.length; i++) {
+			var p = level[i];
+			if (p.width < cfg.minwidth) continue;
+			var name = p.count > 0 ? "[" + p.count + " frames]" : p.node.name;
+			var g = svg_element("g", p.parent ? { "class": "parent" } : {});
+			g.appendChild(svg_element("title", {}, name + " (" + p.total + " " +
+				cfg.countname + ", " + (p.total / all * 100).toFixed(2) + "%)"));
+			g.appendChild(svg_element("rect", {
+				x: p.x, y: y, width: p.width, height: fh,
+				fill: frame_color(p), rx: 2, ry: 2,
+			}));
+			g.appendChild(svg_element("text", { x: p.x + 5, y: y + fh - 4.5 },
+				trim_text(name, p.width)));
+			g.telex = p;
+			fragment.appendChild(g);
+		}
+	}
+	while (frames.firstChild) frames.removeChild(frames.firstChild);
+	frames.appendChild(fragment);
+}
+
+// zoom
+// A coalesced box zooms into a frame of its own that holds just the
+// narrow children it stands for.
+function coalesced_frame(p) {
+	var node = p.node;
+	if (node.group && !load_group(node, function () { zoom_frame(p); }))
+		return null;
+	var minwidth = viewer.config.minwidth;
+	var kids = node.kids.filter(function (kid) {
+		return kid.total * p.scale < minwidth;
+	});
+	return {
+		name: "[" + kids.length + " frames]",
+		hash: undefined,
+		total: p.total,
+		kids: kids,
+		group: null,
+		parent: node,
+	};
+}
+function zoom_frame(p) {
+	var node = p.count > 0 ? coalesced_frame(p) : p.node;
+	if (!node) return;
+	viewer.zoomed = node;
+	unzoombtn.classList.remove("hide");
+	render();
+	search();
+}
+function zoom(g) {
+	zoom_frame(g.telex);
+}
+function unzoom(dont_update_text) {
+	viewer.zoomed = viewer.root;
+	unzoombtn.classList.add("hide");
+	// script.js unzooms this way right before zooming into a parent frame,
+	// which draws everything again anyway
+	if (dont_update_text) return;
+	render();
+	search();
+}
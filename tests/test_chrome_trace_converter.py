@@ -401,24 +401,17 @@ class TestChromeTraceConverter(TestBase):
         total_samples = sum(stacks.values())
         self.assertGreater(total_samples, 0, "Total samples should be positive")
 
-        # Verify it's approximately equal to the sum of durations from events
-        # multiplied by 100 (durations are converted to integers and multiplied by 100)
-        total_duration = sum(
-            event.get("dur", 0) for event in converter.events if event.get("ph") == "X"
-        )
-        expected_total = total_duration * 100
-
-        # Allow for small rounding differences
-        # (durations may be floats but counts are integers)
-        difference = abs(total_samples - expected_total)
-        max_allowed_diff = len(stacks) * 100.0  # Allow up to 100 units per stack
-
-        self.assertLess(
-            difference,
-            max_allowed_diff,
-            f"Total samples ({total_samples}) should be close to "
-            f"sum of durations ({total_duration}) * 100 = {expected_total}",
-        )
+        # Self times add up to the time spent in the outermost events
+        outermost = 0
+        for events in converter._build_call_tree().values():
+            end = None
+            for event in events:
+                if end is None or event["start"] >= end:
+                    outermost += event["end"] - event["start"]
+                    end = event["end"]
+                else:
+                    end = max(end, event["end"])
+        self.assertEqual(total_samples, outermost)
 
     def test_event_types_filtering(self):
         """Test that Complete events ('X') are present in the trace."""
@@ -556,27 +549,25 @@ class TestChromeTraceConverter(TestBase):
         self.assertEqual(events[1]["name"], "func2")
         self.assertEqual(events[2]["name"], "func3")
 
-    def test_build_stack_trace_empty_events(self):
-        """Test _build_stack_trace with empty events list."""
+    def test_nested_events_self_time(self):
+        """Test that each frame is charged its duration minus its children's."""
         converter = ChromeTraceConverter(str(self.trace_file))
-        result = converter._build_stack_trace([], 0, 100.0)
-        self.assertEqual(result, [], "Should return empty list for empty events")
+        converter.events = [
+            {"ph": "X", "pid": 1, "tid": 2, "ts": 0, "dur": 10, "name": "a"},
+            {"ph": "X", "pid": 1, "tid": 2, "ts": 1, "dur": 4, "name": "b"},
+            {"ph": "X", "pid": 1, "tid": 2, "ts": 2, "dur": 1.5, "name": "c"},
+            {"ph": "X", "pid": 1, "tid": 2, "ts": 6, "dur": 2, "name": "b"},
+        ]
 
-    def test_build_stack_trace_out_of_bounds(self):
-        """Test _build_stack_trace with index out of bounds."""
-        converter = ChromeTraceConverter(str(self.trace_file))
-        events = [
+        stacks = converter.convert_to_folded()
+        self.assertEqual(
+            stacks,
             {
-                "ph": "X",
-                "start": 100,
-                "end": 200,
-                "name": "func1",
-                "ts": 100,
-                "dur": 100,
-            }
-        ]
-        result = converter._build_stack_trace(events, 10, 100.0)
-        self.assertEqual(result, [], "Should return empty list for out of bounds")
+                "Process(1);Thread(2);a": 400,
+                "Process(1);Thread(2);a;b": 450,
+                "Process(1);Thread(2);a;b;c": 150,
+            },
+        )
 
     def test_convert_with_events_producing_empty_stacks(self):
         """Test conversion where events produce empty stacks."""
@@ -605,6 +596,102 @@ class TestChromeTraceConverter(TestBase):
         # Should produce empty stacks dict since events have no names
         self.assertEqual(len(stacks), 0, "Should produce no stacks for nameless events")
 
+    def test_native_matches_python(self):
+        """Test that the native converter writes the same stacks."""
+        converter = ChromeTraceConverter(str(self.trace_file))
+        converter.load_trace()
+        expected = converter.convert_to_folded()
+
+        output_file = os.path.join(self.temp_dir, "native.folded")
+        self.__class__.temp_files.append(output_file)
+        converter.convert(output_file)
+        with open(output_file) as f:
+            stacks = {}
+            for line in f:
+                stack, count = line.rsplit(" ", 1)
+                stacks[stack] = int(count)
+        self.assertEqual(stacks, expected)
+        self.assertEqual(converter.stats["stacks"], len(expected))
+        self.assertEqual(converter.stats["samples"], sum(expected.values()))
+
+    def test_native_bare_array(self):
+        """Test that a bare array of events is accepted too."""
+        trace = os.path.join(self.temp_dir, "array.json")
+        self.__class__.temp_files.append(trace)
+        with open(trace, "w") as f:
+            f.write(
+                '[{"ph": "X", "pid": 3, "tid": 4, "ts": 1.5, "dur": 2, '
+                '"cat": "k", "name": "f\\u00e9", "args": {"x": [1, {}]}},'
+                '{"ph": "i", "pid": 3, "tid": 4, "ts": 2, "name": "g"}]'
+            )
+        output_file = os.path.join(self.temp_dir, "array.folded")
+        self.__class__.temp_files.append(output_file)
+
+        converter = ChromeTraceConverter(trace)
+        converter.convert(output_file)
+        with open(output_file, encoding="utf-8") as f:
+            self.assertEqual(f.read().strip(), "Process(3);Thread(4);k::f\u00e9 200")
+        self.assertEqual(converter.stats["events"], 1)
+        self.assertEqual(converter.stats["max_depth"], 3)
+
+    def test_native_long_trace(self):
+        """Test that counts past 32 bits, 43s of traced time, do not wrap."""
+        trace = os.path.join(self.temp_dir, "long.json")
+        self.__class__.temp_files.append(trace)
+        with open(trace, "w") as f:
+            f.write(
+                '[{"ph": "X", "pid": 1, "tid": 2, "ts": 0, "dur": 50000000, '
+                '"name": "main"},'
+                '{"ph": "X", "pid": 1, "tid": 2, "ts": 0, "dur": 45000000, '
+                '"name": "work"}]'
+            )
+        output_file = os.path.join(self.temp_dir, "long.folded")
+        self.__class__.temp_files.append(output_file)
+
+        converter = ChromeTraceConverter(trace)
+        converter.convert(output_file)
+        with open(output_file) as f:
+            self.assertEqual(
+                sorted(f.read().split("\n")),
+                [
+                    "Process(1);Thread(2);main 500000000",
+                    "Process(1);Thread(2);main;work 4500000000",
+                ],
+            )
+        self.assertEqual(converter.stats["samples"], 5_000_000_000)
+
+    def test_native_surrogates(self):
+        """Test that a surrogate pair needs a low half."""
+        trace = os.path.join(self.temp_dir, "surrogates.json")
+        self.__class__.temp_files.append(trace)
+        output_file = os.path.join(self.temp_dir, "surrogates.folded")
+        self.__class__.temp_files.append(output_file)
+        event = '[{"ph": "X", "pid": 1, "tid": 2, "ts": 0, "dur": 1, "name": "%s"}]'
+
+        with open(trace, "w") as f:
+            f.write(event % "\\ud83d\\ude00")
+        ChromeTraceConverter(trace).convert(output_file)
+        with open(output_file, encoding="utf-8") as f:
+            self.assertEqual(f.read().strip(), "Process(1);Thread(2);\U0001f600 100")
+
+        with open(trace, "w") as f:
+            f.write(event % "\\ud800\\u0041")
+        with self.assertRaisesRegex(ValueError, "invalid surrogate pair"):
+            ChromeTraceConverter(trace).convert(output_file)
+
+    def test_native_invalid_json(self):
+        """Test that malformed input is reported with its offset."""
+        trace = os.path.join(self.temp_dir, "broken.json")
+        self.__class__.temp_files.append(trace)
+        with open(trace, "w") as f:
+            f.write('{"traceEvents": [{"ph": "X", "ts": 1,}]}')
+
+        output_file = os.path.join(self.temp_dir, "broken.folded")
+        with self.assertRaisesRegex(ValueError, "at byte"):
+            ChromeTraceConverter(trace).convert(output_file)
+        with self.assertRaises(FileNotFoundError):
+            ChromeTraceConverter("nonexistent_trace.json").convert(output_file)
+
     # ==================== CLI Tests ====================
 
     def test_cli_help_display(self):
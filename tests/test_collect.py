@@ -0,0 +1,80 @@
+"""
+Unit tests for the stacks child processes send to their parent.
+"""
+
+from __future__ import annotations
+
+import os
+import socket
+import sys
+import tempfile
+import unittest
+
+from telex import _telexsys
+from telex.collect import COLLECTORS_ENV, ChildCollector, collector_path, send_tree
+from tests.base import TestBase
+
+
+@unittest.skipIf(sys.platform == "win32", "no fork on Windows")
+class TestChildCollector(TestBase):
+    def setUp(self):
+        super().setUp()
+        self.collector = ChildCollector()
+        self.addCleanup(self.collector.close)
+
+    def fork(self, *lines: str) -> int:
+        pid = os.fork()
+        if pid == 0:
+            tree = _telexsys.StackTree()
+            tree.add_lines([f"Process({os.getpid()});{line}" for line in lines])
+            os._exit(0 if send_tree(tree, os.getppid()) else 1)
+        return pid
+
+    def test_collect(self):
+        self.assertEqual(self.collector.path, collector_path(os.getpid()))
+        pids = [self.fork("main;work 2", "main 1") for _ in range(8)]
+        for pid in pids:
+            _, status = os.waitpid(pid, 0)
+            self.assertEqual(status, 0)
+        self.assertTrue(self.collector.wait(8, 10))
+        tree = self.collector.take()
+        self.assertEqual(tree.samples, 24)
+        for pid in pids:
+            self.assertIn(f"Process({pid});main;work 2", tree.dumps())
+        self.assertEqual(self.collector.take().samples, 0)
+
+    def test_private(self):
+        # a directory of its own, which the children find in the environment
+        directory = os.path.dirname(self.collector.path)
+        self.assertEqual(os.stat(directory).st_mode & 0o777, 0o700)
+        self.assertIn(self.collector.path, os.environ[COLLECTORS_ENV])
+        self.assertIsNone(collector_path(os.getpid() + 1))
+        # a socket other users can reach is not trusted with the stacks
+        os.chmod(directory, 0o755)
+        self.addCleanup(os.chmod, directory, 0o700)
+        tree = _telexsys.StackTree()
+        tree.add_lines(["main 1"])
+        self.assertFalse(send_tree(tree, os.getpid()))
+        self.assertEqual(self.collector.received, 0)
+
+    def test_invalid(self):
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+            sock.connect(self.collector.path)
+            sock.sendall(b"main 1")
+        self.assertTrue(self.collector.wait(1, 10))
+        self.assertEqual((self.collector.invalid, self.collector.tree.samples), (1, 0))
+        self.assertFalse(self.collector.wait(2, 0.01))
+
+    def test_close(self):
+        self.collector.close()
+        self.assertFalse(os.path.exists(os.path.dirname(self.collector.path)))
+        self.assertIsNone(collector_path(os.getpid()))
+        tree = _telexsys.StackTree()
+        tree.add_lines(["main 1"])
+        # nobody listens, the child writes its file instead
+        self.assertFalse(send_tree(tree, os.getpid()))
+        path = os.path.join(tempfile.mkdtemp(), "c.sock")
+        collector = ChildCollector(path)
+        self.assertTrue(os.path.exists(path))
+        collector.close()
+        self.assertFalse(os.path.exists(path))
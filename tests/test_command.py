@@ -1,5 +1,6 @@
 from __future__ import annotations
 
+import gzip
 import logging
 import os
 import re
@@ -984,6 +985,154 @@ MainThread;Users/huchang/miniconda3/bin/coverage:<module>:1;coverage/cmdline.py:
                 if os.path.exists(path):
                     os.unlink(path)
 
+    def test_parse_stack_trace_pprof(self):
+        """Test converting a stack trace file into a pprof profile."""
+        folded = tempfile.NamedTemporaryFile(delete=False, mode="w+")
+        output = folded.name + ".pb.gz"
+        try:
+            folded.write("MainThread;app.py:main:1;app.py:work:5 3\n")
+            folded.close()
+            self.run_command(
+                options=[folded.name, "--parse", "-o", output],
+                stdout_check_list=["Generated a pprof profile file"],
+            )
+            with gzip.open(output, "rb") as f:
+                data = f.read()
+            self.assertIn(b"app.py", data)
+            self.assertIn(b"work", data)
+        finally:
+            for path in (folded.name, output):
+                if os.path.exists(path):
+                    os.unlink(path)
+
+    def test_parse_stack_trace_diff(self):
+        """Test rendering a differential flame graph against a baseline."""
+        old = tempfile.NamedTemporaryFile(delete=False, mode="w+")
+        new = tempfile.NamedTemporaryFile(delete=False, mode="w+")
+        output = new.name + ".svg"
+        try:
+            old.write("MainThread;app.py:main:1;app.py:slow:5 1\n")
+            old.write("MainThread;app.py:main:1;app.py:fast:9 9\n")
+            old.close()
+            new.write("MainThread;app.py:main:1;app.py:slow:5 9\n")
+            new.write("MainThread;app.py:main:1;app.py:fast:9 1\n")
+            new.close()
+            self.run_command(
+                options=[new.name, "--parse", "--diff", old.name, "-o", output],
+                stdout_check_list=["Generated a differential flamegraph svg file"],
+            )
+            with open(output, encoding="utf-8") as f:
+                svg = f.read()
+            self.assertIn("app.py:slow:5 (9 samples, 90.00%, +80.00%)", svg)
+            self.assertIn("app.py:fast:9 (1 samples, 10.00%, -80.00%)", svg)
+
+            # the outputs --diff can not apply to are rejected
+            for options in (
+                [new.name, "--diff", old.name, "-o", output],
+                [new.name, "--parse", "--diff", old.name, "-o", new.name + ".html"],
+                [new.name, "--parse", "--diff", old.name, "-o", new.name + ".pprof"],
+            ):
+                self.run_command(
+                    options=options, stderr_check_list=["--diff"], exit_code=2
+                )
+        finally:
+            for path in (old.name, new.name, output):
+                if os.path.exists(path):
+                    os.unlink(path)
+
+    def test_parse_stack_trace_gzip(self):
+        """Test parsing a gzipped folded file, as saved with a .gz name."""
+        from telex import _telexsys
+
+        folded = tempfile.NamedTemporaryFile(delete=False, suffix=".folded.gz")
+        folded.close()
+        output = folded.name + ".svg"
+        try:
+            tree = _telexsys.StackTree()
+            tree.add_lines(["MainThread;app.py:main:1;app.py:compressed:5 3"])
+            tree.save(folded.name)
+            self.run_command(
+                options=[folded.name, "--parse", "-o", output],
+                stdout_check_list=["Generated a flamegraph svg file"],
+            )
+            with open(output, encoding="utf-8") as f:
+                self.assertIn("app.py:compressed:5", f.read())
+        finally:
+            for path in (folded.name, output):
+                if os.path.exists(path):
+                    os.unlink(path)
+
+    def test_shm_attach(self):
+        """Test rendering the ring another process exports, from outside it."""
+        import telex
+
+        directory = tempfile.mkdtemp()
+        ring = os.path.join(directory, "telex.ring")
+        output = os.path.join(directory, "attached.svg")
+        sampler = telex.TelexSysSampler(sampling_interval=50, shm_ring=ring)
+        try:
+
+            def attached_work(n: int) -> int:
+                return n if n < 2 else attached_work(n - 1) + attached_work(n - 2)
+
+            sampler.start()
+            while sampler.dumps() == "":
+                attached_work(18)
+            sampler.stop()
+            self.run_command(
+                options=["--shm-attach", ring, "--shm-seconds", "0", "-o", output],
+                stdout_check_list=["Generated a flamegraph svg file", "0 lost"],
+            )
+            with open(output, encoding="utf-8") as f:
+                self.assertIn("attached_work", f.read())
+        finally:
+            sampler.shm_ring = None
+            if os.path.exists(output):
+                os.unlink(output)
+
+    @unittest.skipIf(sys.platform == "win32", "no SIGUSR2 on Windows")
+    def test_dump_signal(self):
+        """Test --dump-signal writing the profile while the script runs."""
+        svg_file = os.path.join(tempfile.mkdtemp(), "result.svg")
+        output = self.run_filename(
+            "test_files/test_dump_signal.py",
+            [r"dumped telex-\d+-\d+\.folded"],
+            options=["--dump-signal", "USR2", "-o", svg_file],
+        )
+        dumped = re.findall(r"telex-\d+-\d+\.folded", output.stdout.decode())
+        self.assertEqual(len(dumped), 1)
+        try:
+            with open(dumped[0], encoding="utf-8") as f:
+                self.assertIn("fib", f.read())
+        finally:
+            os.unlink(dumped[0])
+
+    @unittest.skipUnless(
+        sys.platform == "linux" and (3, 11) <= sys.version_info[:2] <= (3, 12),
+        "remote sampling needs Linux and Python 3.11 or 3.12",
+    )
+    def test_remote_children(self):
+        """Test --remote-children sampling forkserver and subprocess children."""
+        directory = tempfile.mkdtemp()
+        folded_file = os.path.join(directory, "result.folded")
+        self.run_filename(
+            "test_files/test_remote_children.py",
+            ["remote children done"],
+            options=[
+                "--remote-children",
+                "--folded-save",
+                "--folded-file",
+                folded_file,
+                "-o",
+                os.path.join(directory, "result.svg"),
+            ],
+        )
+        with open(folded_file, encoding="utf-8") as f:
+            folded = f.read()
+        self.assertIn("Process(root, pid=", folded)
+        self.assertIn(":remote_work:", folded)
+        self.assertIn(":remote_spawned:", folded)
+
     def test_time_cpu_flag(self):
         """Test --time cpu command line option."""
         import os
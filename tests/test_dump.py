@@ -0,0 +1,79 @@
+"""
+Unit tests for the profiles dumped on a signal.
+"""
+
+from __future__ import annotations
+
+import gzip
+import os
+import signal
+import sys
+import tempfile
+import time
+import unittest
+
+import telex
+from telex.dump import SignalDump, parse_signal
+from tests.base import TestBase
+
+
+def fib(n: int) -> int:
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+
+
+@unittest.skipIf(sys.platform == "win32", "no SIGUSR2 on Windows")
+class TestSignalDump(TestBase):
+    def setUp(self):
+        super().setUp()
+        self.directory = tempfile.mkdtemp()
+        self.sampler = telex.TelexSysSampler(sampling_interval=50)
+        self.sampler.start()
+        while self.sampler.dumps() == "":
+            fib(18)
+        self.sampler.stop()
+
+    def wait(self, dump: SignalDump, n: int) -> None:
+        deadline = time.time() + 10
+        while len(dump.paths) < n and time.time() < deadline:
+            time.sleep(0.01)
+        self.assertEqual(len(dump.paths), n)
+
+    def test_signal(self):
+        previous = signal.getsignal(signal.SIGUSR2)
+        dump = SignalDump(self.sampler, "usr2", directory=self.directory).install()
+        try:
+            os.kill(os.getpid(), signal.SIGUSR2)
+            self.wait(dump, 1)
+            os.kill(os.getpid(), signal.SIGUSR2)
+            self.wait(dump, 2)
+        finally:
+            dump.uninstall()
+        self.assertEqual(signal.getsignal(signal.SIGUSR2), previous)
+        self.assertNotEqual(dump.paths[0], dump.paths[1])
+        for path in dump.paths:
+            self.assertRegex(os.path.basename(path), rf"^telex-{os.getpid()}-\d+")
+            with open(path, encoding="utf-8") as f:
+                self.assertEqual(
+                    sorted(f.read().splitlines()),
+                    sorted(self.sampler.dumps().splitlines()),
+                )
+        # the sampler keeps what it collected
+        self.assertNotEqual(self.sampler.dumps(), "")
+
+    def test_pprof(self):
+        dump = SignalDump(self.sampler, directory=self.directory, format="pprof")
+        path = dump.dump()
+        self.assertTrue(path.endswith(".pb.gz"))
+        with gzip.open(path) as f:
+            self.assertIn(b"fib", f.read())
+
+    def test_parse_signal(self):
+        self.assertEqual(parse_signal("USR2"), signal.SIGUSR2)
+        self.assertEqual(parse_signal("SIGUSR1"), signal.SIGUSR1)
+        self.assertEqual(parse_signal(str(int(signal.SIGUSR2))), signal.SIGUSR2)
+        with self.assertRaises(ValueError):
+            parse_signal("NOPE")
+        with self.assertRaises(ValueError):
+            SignalDump(self.sampler, format="svg")  # type: ignore
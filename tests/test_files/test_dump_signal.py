@@ -0,0 +1,21 @@
+import glob
+import os
+import signal
+import time
+
+
+def fib(n: int) -> int:
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+
+
+if __name__ == "__main__":
+    fib(25)
+    os.kill(os.getpid(), signal.SIGUSR2)
+    deadline = time.time() + 10
+    dumped: list[str] = []
+    while not dumped and time.time() < deadline:
+        fib(15)
+        dumped = glob.glob(f"telex-{os.getpid()}-*.folded")
+    print("dumped", " ".join(dumped))
@@ -0,0 +1,20 @@
+import subprocess
+import sys
+import time
+from multiprocessing import Process, set_start_method
+
+
+def remote_work(seconds):
+    end = time.time() + seconds
+    while time.time() < end:
+        pass
+
+
+if __name__ == "__main__":
+    set_start_method("forkserver")
+    p = Process(target=remote_work, args=(0.5,))
+    p.start()
+    p.join()
+    code = "import time\ndef remote_spawned():\n    time.sleep(0.5)\nremote_spawned()"
+    subprocess.run([sys.executable, "-c", code], check=True)
+    print("remote children done")
@@ -0,0 +1,284 @@
+"""
+Unit tests for the native flamegraph renderer.
+"""
+
+import json
+import os
+import random
+import re
+import site
+import tempfile
+
+import telex
+from telex.flamegraph import FlameGraph, process_stack_trace, stack_trace_prefixes
+from tests.base import TestBase
+
+
+class TestNativeFlameGraph(TestBase):
+    """FlameGraph.save must produce the same svg as generate_svg."""
+
+    def setUp(self):
+        super().setUp()
+        fd, self.svg_file = tempfile.mkstemp(suffix=".svg")
+        os.close(fd)
+
+    def tearDown(self):
+        os.unlink(self.svg_file)
+        super().tearDown()
+
+    def assert_same_svg(self, lines: list[str], **kwargs) -> None:
+        expected = FlameGraph(lines, **kwargs)
+        expected.parse_input()
+        svg = expected.generate_svg()
+
+        native = FlameGraph(lines, **kwargs)
+        native.save(self.svg_file)
+        with open(self.svg_file, encoding="utf-8") as f:
+            self.assertEqual(f.read(), svg)
+        self.assertEqual(native.sample_count, expected.sample_count)
+
+    def test_simple(self):
+        lines = [
+            "main;foo;bar 10",
+            "main;foo;baz 5",
+            "main;qux 3",
+            "main;foo;bar 2",
+        ]
+        self.assert_same_svg(lines)
+        self.assert_same_svg(lines, inverted=True)
+
+    def test_empty(self):
+        self.assert_same_svg([])
+        self.assert_same_svg(["", "   "])
+
+    def test_escape_and_unicode(self):
+        lines = [
+            "main;<lambda>;a&b 7",
+            "main;\"quoted\";'single' 3",
+            "main;函数;ünïcödé_function_with_a_rather_long_name 11",
+        ]
+        self.assert_same_svg(lines, title="<Title & more>", width=300)
+
+    def test_invalid_lines(self):
+        lines = ["main;foo 1", "broken", "main;bar x", "main;baz -2", "  main 4 "]
+        self.assert_same_svg(lines)
+
+    def test_header_wrapping(self):
+        self.assert_same_svg(
+            ["a;b 1"],
+            command="python " + "argument " * 100,
+            package_path="/usr/lib/python3/site-packages",
+            work_dir="/home/user/project",
+        )
+
+    def test_random_profiles(self):
+        rng = random.Random(42)
+        names = [f"module.py:func_{i}:{i * 7}" for i in range(40)]
+        for _ in range(20):
+            lines = []
+            for _ in range(rng.randint(1, 200)):
+                depth = rng.randint(1, 30)
+                stack = ";".join(rng.choice(names) for _ in range(depth))
+                lines.append(f"{stack} {rng.randint(1, 500)}")
+            self.assert_same_svg(
+                lines,
+                width=rng.choice([200, 1200, 1920]),
+                minwidth=rng.choice([0, 0.1, 2.5, 40, "1%"]),
+                inverted=rng.random() < 0.5,
+            )
+
+    def test_coalesce_narrow_frames(self):
+        lines = [f"main;wide {1000}"]
+        lines += [f"main;narrow_{i} 1" for i in range(500)]
+        self.assert_same_svg(lines, minwidth="0.5%")
+
+        fg = FlameGraph(lines, minwidth="0.5%")
+        fg.save(self.svg_file)
+        with open(self.svg_file, encoding="utf-8") as f:
+            svg = f.read()
+        self.assertIn("<title>[500 frames] (500 samples, 33.33%)</title>", svg)
+        self.assertNotIn("narrow_", svg)
+        self.assertEqual(fg.sample_count, 1500)
+
+    def test_coalesce_bounds_frame_count(self):
+        rng = random.Random(7)
+        lines = []
+        for i in range(5000):
+            stack = ";".join(f"f{rng.randint(0, 3000)}" for _ in range(8))
+            lines.append(f"main;{stack} {rng.randint(1, 3)}")
+        width = 600
+        fg = FlameGraph(lines, width=width, minwidth=2)
+        fg.save(self.svg_file)
+        with open(self.svg_file, encoding="utf-8") as f:
+            frames = f.read().count("<g>\n<title>")
+        # siblings at minwidth or wider can not overlap, so each level holds
+        # at most width / minwidth boxes
+        self.assertLessEqual(frames, (width - 20) // 2 * 10)
+
+    def test_render_from_sampler(self):
+        def fib(n: int) -> int:
+            if n < 2:
+                return n
+            return fib(n - 1) + fib(n - 2)
+
+        sampler = telex.TelexSysSampler(sampling_interval=50)
+        sampler.start()
+        fib(24)
+        sampler.stop()
+
+        site_path = site.getsitepackages()[0]
+        work_dir = os.getcwd()
+        for prefixes in ([], stack_trace_prefixes(site_path, work_dir)):
+            lines = sampler.dumps().splitlines()
+            if prefixes:
+                lines = process_stack_trace(lines, site_path, work_dir)
+            expected = FlameGraph(lines)
+            expected.parse_input()
+            svg = expected.generate_svg()
+
+            native = FlameGraph([])
+            native.save(self.svg_file, source=sampler, strip_prefixes=prefixes)
+            with open(self.svg_file, encoding="utf-8") as f:
+                self.assertEqual(f.read(), svg)
+            self.assertEqual(native.sample_count, expected.sample_count)
+
+    def test_strip_prefixes_merge_frames(self):
+        lines = [
+            "main;/site/pkg/a.py:f:1;/work/b.py:g:2 3",
+            "main;/work/pkg/a.py:f:1;b.py:g:2 4",
+        ]
+        prefixes = stack_trace_prefixes("/site", "/work")
+        expected = FlameGraph(process_stack_trace(lines, "/site", "/work"))
+        expected.parse_input()
+
+        native = FlameGraph(lines)
+        native.save(self.svg_file, strip_prefixes=prefixes)
+        with open(self.svg_file, encoding="utf-8") as f:
+            self.assertEqual(f.read(), expected.generate_svg())
+
+    def test_differential(self):
+        from telex import _telexsys
+
+        old = ["main;foo 50", "main;bar 50", "main;gone 10"]
+        new = ["main;foo 90", "main;bar 10"]
+        FlameGraph(new).save(self.svg_file)
+        with open(self.svg_file, encoding="utf-8") as f:
+            plain = f.read()
+
+        baseline = _telexsys.StackTree()
+        baseline.add_lines(old)
+        # bar before foo in the baseline
+        reordered = _telexsys.StackTree()
+        reordered.add_lines(old[::-1])
+        for source in (old, baseline, old[::-1], reordered):
+            fg = FlameGraph(new)
+            fg.save(self.svg_file, baseline=source)
+            with open(self.svg_file, encoding="utf-8") as f:
+                svg = f.read()
+            # the layout is the one of the new profile
+            rects = re.compile(r'<rect x="[^"]*" y="[^"]*" width="[^"]*"')
+            self.assertEqual(rects.findall(svg), rects.findall(plain))
+            self.assertEqual(fg.sample_count, 100)
+            self.assertNotIn("gone", svg)
+            self.assertIn("<title>foo (90 samples, 90.00%, +44.55%)</title>", svg)
+            self.assertIn("<title>bar (10 samples, 10.00%, -35.45%)</title>", svg)
+            # the largest change is the most saturated
+            self.assertIn('fill="rgb(255, 45, 45)"', svg)
+            self.assertIn('fill="rgb(88, 88, 255)"', svg)
+
+
+class TestHtmlFlameGraph(TestBase):
+    """The chunked call tree behind FlameGraph.save_html."""
+
+    def decode(self, chunks: list[bytes]) -> dict:
+        """Rebuild {path: total} from every chunk, the way viewer.js does."""
+        data = [json.loads(chunk) for chunk in chunks]
+        totals: dict[tuple[str, ...], int] = {}
+        seen_ords: dict[tuple[str, ...], set[int]] = {}
+
+        parts: dict[tuple[int, int], list] = {}
+        for idx, chunk in enumerate(data):
+            nodes = chunk["nodes"]
+            pos = 0
+
+            def node(chunk: dict = chunk) -> list:
+                nonlocal pos
+                name, total, ord_, count, group = nodes[pos : pos + 5]
+                pos += 5
+                kids = [node() for _ in range(count)]
+                group = chunk["groups"][group] if group >= 0 else None
+                return [chunk["names"][name], total, ord_, kids, group]
+
+            for part, roots in enumerate(chunk["parts"]):
+                parts[idx, part] = [node() for _ in range(roots)]
+
+        def walk(entry: list, parent: tuple[str, ...]) -> None:
+            name, total, ord_, kids, group = entry
+            path = (*parent, name)
+            totals[path] = total
+            seen_ords.setdefault(parent, set()).add(ord_)
+            if group is not None:
+                lost = parts.pop((group[0], group[1]))
+                self.assertEqual(len(lost), group[2])
+                self.assertEqual(sum(kid[1] for kid in lost), group[3])
+                kids = kids + lost
+            for kid in kids:
+                walk(kid, path)
+
+        (root,) = parts.pop((0, 0))
+        walk(root, ())
+        self.assertEqual(parts, {})
+        for parent, ords in seen_ords.items():
+            assert ords == set(range(len(ords))), parent
+        return totals
+
+    def test_chunks_cover_the_tree(self):
+        rng = random.Random(3)
+        lines = []
+        for _ in range(1000):
+            stack = ";".join(f"f{rng.randint(0, 40)}" for _ in range(rng.randint(1, 80)))
+            lines.append(f"{stack} {rng.randint(1, 9)}")
+        expected = FlameGraph(lines)
+        expected.parse_input()
+        root = expected._build_call_tree()
+        paths: dict[tuple[str, ...], int] = {}
+        pending = [(("root",), root)]
+        while pending:
+            path, node = pending.pop()
+            paths[path] = node.total
+            for name, child in node.children.items():
+                pending.append(((*path, name), child))
+
+        for minwidth, max_nodes in ((0.1, 4096), (0, 50), ("1%", 10)):
+            fg = FlameGraph(lines, minwidth=minwidth)
+            chunks = fg.html_chunks(max_nodes=max_nodes)
+            self.assertEqual(self.decode(chunks), paths)
+            self.assertEqual(fg.sample_count, expected.sample_count)
+
+    def test_first_chunk_holds_visible_frames(self):
+        lines = ["main;wide 1000"] + [f"main;narrow_{i};leaf 1" for i in range(500)]
+        fg = FlameGraph(lines, minwidth="0.5%")
+        chunks = fg.html_chunks()
+        first = json.loads(chunks[0])
+        self.assertEqual(first["names"], ["root", "main", "wide"])
+        # the narrow frames wait in a group: [chunk, part, count, total, max]
+        self.assertEqual(first["groups"], [[1, 0, 500, 500, 1]])
+        # and their own children are packed into one chunk, not one each
+        self.assertEqual(len(chunks), 3)
+        self.assertEqual(json.loads(chunks[2])["parts"], [1] * 500)
+
+    def test_save_html(self):
+        fd, filename = tempfile.mkstemp(suffix=".html")
+        os.close(fd)
+        self.addCleanup(os.unlink, filename)
+        lines = ["main;</script><b>;x 3", "main;y 1"]
+        fg = FlameGraph(lines, title="Lazy")
+        fg.save_html(filename)
+        with open(filename, encoding="utf-8") as f:
+            page = f.read()
+        self.assertEqual(page.count("</script>"), 2 + len(fg.html_chunks()))
+        self.assertIn("function viewer_init()", page)
+        self.assertIn("<title>Lazy</title>", page)
+        chunk = re.search(r'id="telex-chunk-0">(.*?)</script>', page).group(1)
+        self.assertIn("</script><b>", json.loads(chunk)["names"])
+        self.assertEqual(fg.sample_count, 4)
@@ -499,6 +499,125 @@ class TestMonitor(TestBase):
         with request.urlopen(req) as response:
             self.assertEqual(response.status, 200)
 
+    @unittest.skipIf(sys.platform == "win32", "fork not supported on Windows")
+    def test_flamegraph_html(self):
+        import json
+        import os
+        import re
+        import time
+        from urllib import error, request
+
+        port = 4556
+        pid = os.fork()
+        if pid == 0:
+            self.launch_server(port, True)
+            os._exit(0)
+
+        time.sleep(1)
+        base = f"http://127.0.0.1:{port}"
+        with request.urlopen(f"{base}/flamegraph") as response:
+            data = json.loads(response.read().decode())
+            self.assertEqual(data["code"], -1)
+
+        headers = {"args": "start --interval 500000"}
+        req = request.Request(f"{base}/profile", headers=headers)
+        with request.urlopen(req) as response:
+            self.assertEqual(response.status, 200)
+
+        with request.urlopen(f"{base}/flamegraph") as response:
+            self.assertIn("text/html", response.headers["Content-Type"])
+            page = response.read().decode()
+        self.assertIn('id="telex-chunk-0"', page)
+        self.assertNotIn('id="telex-chunk-1"', page)
+        config = re.search(r'id="telex-config">(.*?)</script>', page)
+        chunk_url = json.loads(config.group(1))["chunk_url"]
+        self.assertTrue(chunk_url.startswith("/flamegraph/chunk?snapshot="))
+
+        with request.urlopen(f"{base}{chunk_url}0") as response:
+            chunk = json.loads(response.read().decode())
+            self.assertEqual(chunk["names"][0], "root")
+        with self.assertRaises(error.HTTPError) as ctx:
+            request.urlopen(f"{base}/flamegraph/chunk?snapshot=0&id=0")
+        self.assertEqual(ctx.exception.code, 404)
+        ctx.exception.close()
+
+        req = request.Request(f"{base}/profile", headers={"args": "stop"})
+        with request.urlopen(req) as response:
+            self.assertEqual(response.status, 200)
+        os.unlink(f"telex-monitor-{pid}.svg")
+
+        req = request.Request(f"{base}/shutdown")
+        with request.urlopen(req) as response:
+            self.assertEqual(response.status, 200)
+
+    @unittest.skipIf(sys.platform == "win32", "fork not supported on Windows")
+    def test_continuous_windows(self):
+        import gzip
+        import json
+        import os
+        import time
+        from urllib import request
+
+        port = 4557
+        pid = os.fork()
+        if pid == 0:
+            self.launch_server(port, True)
+            os._exit(0)
+
+        time.sleep(1)
+        base = f"http://127.0.0.1:{port}"
+
+        def call(endpoint: str, args: str) -> dict:
+            req = request.Request(f"{base}/{endpoint}", headers={"args": args})
+            with request.urlopen(req) as response:
+                return json.loads(response.read().decode())
+
+        self.assertEqual(call("window", "")["code"], -1)
+        self.assertEqual(call("sampler-stats", "")["code"], -1)
+        args = "start --interval 1000 --phase-stats"
+        self.assertEqual(call("continuous", args)["code"], 0)
+        data = call("sampler-stats", "")
+        self.assertEqual(data["code"], 0)
+        self.assertIn("round", data["data"]["phases"])
+        self.assertIn("heap_bytes", data["data"]["tree"])
+        self.assertIn("nodes", data["data"]["windows"]["all"])
+        self.assertEqual(call("continuous", "start")["code"], -1)
+        self.assertIn("already", call("profile", "start")["data"])
+        # the server process is idle, so the cpu timer may not have sampled
+        data = call("window", "--window 5m")
+        self.assertEqual(data["code"], 0)
+        self.assertIsInstance(data["data"], str)
+        data = call("window", "--window all --format top -k 3")
+        self.assertEqual(data["code"], 0)
+        self.assertLessEqual(len(data["data"]), 3)
+        data = call("window", "--window 15m --format pprof")
+        filename = f"telex-window-15m-{pid}.pb.gz"
+        self.assertIn(filename, data["data"])
+        with gzip.open(filename) as f:
+            self.assertGreater(len(f.read()), 0)
+        os.unlink(filename)
+        with request.urlopen(f"{base}/window/pprof?window=1m") as response:
+            self.assertGreater(len(gzip.decompress(response.read())), 0)
+
+        args = "--interval 0.2 --count 2 -k 5"
+        req = request.Request(f"{base}/profile/stream", headers={"args": args})
+        with request.urlopen(req) as response:
+            self.assertEqual(response.headers["Transfer-Encoding"], "chunked")
+            deltas = [json.loads(line) for line in response]
+        self.assertEqual(len(deltas), 2)
+        for delta in deltas:
+            self.assertLessEqual(len(delta["top"]), 5)
+            self.assertGreater(delta["seconds"], 0)
+
+        self.assertEqual(call("continuous", "stop")["code"], 0)
+        self.assertEqual(call("continuous", "stop")["code"], -1)
+        self.assertEqual(call("profile/stream", "")["code"], -1)
+        self.assertEqual(call("window", "--window 1m")["code"], -1)
+
+        req = request.Request(f"{base}/shutdown")
+        with request.urlopen(req) as response:
+            self.assertEqual(response.status, 200)
+
     def test_gc_status(self):
         """Test gc-status command."""
         self.compound_template_command(
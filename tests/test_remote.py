@@ -0,0 +1,126 @@
+"""
+Unit tests for sampling child processes by reading their memory.
+"""
+
+from __future__ import annotations
+
+import os
+import subprocess
+import sys
+import time
+import unittest
+
+from telex import _telexsys
+from telex.remote import RemoteProfiler, descendants
+from tests.base import TestBase
+
+SUPPORTED = sys.platform == "linux" and (3, 11) <= sys.version_info[:2] <= (3, 12)
+
+CHILD = """
+import subprocess, sys, threading, time
+
+def remote_sleep():
+    sleeping.set()
+    time.sleep(30)
+
+def remote_spin():
+    print("ready", flush=True)
+    while True:
+        pass
+
+sleeping = threading.Event()
+threading.Thread(target=remote_sleep, daemon=True).start()
+sleeping.wait()
+if len(sys.argv) > 1:
+    subprocess.Popen([sys.executable, "-c", "import time; time.sleep(30)"])
+remote_spin()
+"""
+
+
+@unittest.skipUnless(SUPPORTED, "remote sampling needs Linux and Python 3.11 or 3.12")
+class TestRemoteProcess(TestBase):
+    def spawn(self, *args: str) -> subprocess.Popen:
+        child = subprocess.Popen(
+            [sys.executable, "-c", CHILD, *args], stdout=subprocess.PIPE
+        )
+        self.addCleanup(child.wait)
+        self.addCleanup(child.kill)
+        assert child.stdout is not None
+        self.assertEqual(child.stdout.readline(), b"ready\n")
+        return child
+
+    def test_sample(self):
+        child = self.spawn()
+        remote = _telexsys.RemoteProcess(child.pid)
+        self.assertEqual(remote.pid, child.pid)
+        tree = _telexsys.StackTree()
+        for _ in range(10):
+            self.assertEqual(remote.sample(tree, "Process(child)"), 2)
+        self.assertEqual(tree.samples, 20)
+        lines = tree.dumps().splitlines()
+        main = "MainThread;<string>:<module>:1;<string>:remote_spin:8"
+        self.assertIn(f"Process(child);{main} 10", lines)
+        self.assertTrue(
+            any(
+                line.startswith("Process(child);Thread-")
+                and ";<string>:remote_sleep:4 " in line
+                for line in lines
+            ),
+            lines,
+        )
+        remote.sample(tree)
+        self.assertIn(f"{main} 1", tree.dumps().splitlines())
+        with self.assertRaises(TypeError):
+            remote.sample([])  # type: ignore[arg-type]
+        child.kill()
+        child.wait()
+        with self.assertRaises(ProcessLookupError):
+            remote.sample(tree)
+        remote.close()
+        with self.assertRaises(ValueError):
+            remote.sample(tree)
+
+    def test_attach_errors(self):
+        with subprocess.Popen(["sleep", "30"]) as other:
+            with self.assertRaises(ValueError):
+                _telexsys.RemoteProcess(other.pid)
+            other.kill()
+        with self.assertRaises(ProcessLookupError):
+            _telexsys.RemoteProcess(other.pid)
+
+    def test_profiler(self):
+        child = self.spawn("grandchild")
+        with subprocess.Popen(["sleep", "30"]) as other:
+            profiler = RemoteProfiler(interval=0.001).start()
+            found: dict[int, int] = {}
+            deadline = time.time() + 10
+            while not found and time.time() < deadline:
+                time.sleep(0.05)
+                found = {
+                    pid: ppid
+                    for pid, ppid in descendants(os.getpid()).items()
+                    if ppid == child.pid
+                }
+            time.sleep(0.3)
+            tree = profiler.stop()
+            other.kill()
+        self.assertIn(child.pid, profiler.sampled)
+        self.assertIn(other.pid, profiler.skipped)
+        self.assertEqual(len(found), 1)
+        grandchild = next(iter(found))
+        self.assertIn(grandchild, profiler.sampled)
+        folded = tree.dumps()
+        self.assertIn(
+            f"Process(pid-{child.pid}, ppid-{os.getpid()});MainThread;", folded
+        )
+        self.assertIn(
+            f"Process(pid-{grandchild}, ppid-{child.pid});MainThread;", folded
+        )
+        self.assertEqual(profiler.stop().samples, tree.samples)
+
+
+@unittest.skipIf(SUPPORTED, "remote sampling is supported here")
+class TestRemoteUnsupported(TestBase):
+    def test_attach(self):
+        with self.assertRaises((NotImplementedError, OSError)):
+            _telexsys.RemoteProcess(os.getpid())
@@ -0,0 +1,91 @@
+"""
+Unit tests for the rolling windows of continuous profiling.
+"""
+
+from unittest import mock
+
+from telex import _telexsys
+from telex.rolling import RollingProfile
+from tests.base import TestBase
+
+
+class TestRollingProfile(TestBase):
+    def setUp(self):
+        super().setUp()
+        self.now = 0.0
+        self.pending: list[str] = []
+
+        def take_stacks(sampler):
+            tree = _telexsys.StackTree()
+            tree.add_lines(self.pending)
+            self.pending = []
+            return tree
+
+        patcher = mock.patch.object(_telexsys, "take_stacks", take_stacks)
+        patcher.start()
+        self.addCleanup(patcher.stop)
+        self.profile = RollingProfile(
+            None,  # type: ignore
+            slot=5.0,
+            windows={"10s": 10.0, "20s": 20.0, "all": None},
+            clock=lambda: self.now,
+        )
+
+    def read(self, name: str) -> str:
+        with self.profile.window(name) as tree:
+            return tree.dumps()
+
+    def test_windows_expire(self):
+        for second, line in ((5, "main;a 1"), (10, "main;b 2"), (15, "main;c 3")):
+            self.now = second
+            self.pending.append(line)
+            self.profile.rotate()
+        self.assertEqual(self.read("10s"), "main;b 2\nmain;c 3")
+        self.assertEqual(self.read("20s"), "main;a 1\nmain;b 2\nmain;c 3")
+
+        self.now = 26
+        self.pending.append("main;c 1")
+        # a query takes what was sampled since the last slot
+        self.assertEqual(self.read("10s"), "main;c 1")
+        self.assertEqual(self.read("20s"), "main;b 2\nmain;c 4")
+        self.assertEqual(self.read("all"), "main;a 1\nmain;b 2\nmain;c 4")
+
+        self.now = 100
+        self.profile.rotate()
+        self.assertEqual(self.read("10s"), "")
+        self.assertEqual(self.read("20s"), "")
+        self.assertEqual(len(self.profile._slots), 0)
+        with self.profile.window("all") as tree:
+            self.assertEqual(tree.samples, 7)
+        self.assertEqual(self.profile.duration("10s"), 10.0)
+        self.assertEqual(self.profile.duration("all"), 100.0)
+        with self.assertRaises(KeyError):
+            self.read("1h")
+
+    def test_queries_add_no_slots(self):
+        for second in range(1, 5):
+            self.now = second
+            self.pending.append("main;a 1")
+            self.assertEqual(self.read("10s"), f"main;a {second}")
+        self.assertEqual(len(self.profile._slots), 0)
+        self.now = 5
+        self.profile.rotate()
+        self.assertEqual(len(self.profile._slots), 1)
+        # the slot dates from the last samples a query took
+        self.now = 14
+        self.assertEqual(self.read("10s"), "")
+
+    def test_deltas(self):
+        first = self.profile.subscribe()
+        self.pending.append("main;a 1")
+        self.profile.rotate()
+        second = self.profile.subscribe()
+        self.pending.append("main;b 2")
+        self.assertEqual(self.profile.delta(first).dumps(), "main;a 1\nmain;b 2")
+        self.assertEqual(self.profile.delta(first).samples, 0)
+        self.assertEqual(self.profile.delta(second).dumps(), "main;b 2")
+        self.profile.unsubscribe(first)
+        with self.assertRaises(KeyError):
+            self.profile.delta(first)
+        # the windows are not changed by the subscribers
+        self.assertEqual(self.read("all"), "main;a 1\nmain;b 2")
@@ -1,9 +1,14 @@
+import gzip
+import json
 import os
 import sys
 import threading
+import time
 import unittest
+from unittest import mock
 
 import telex
+from telex import _telexsys
 
 from .base import TestBase  # type: ignore
 
@@ -89,6 +94,26 @@ class TestAsyncSampler(TestBase):
         async_sampler.adjust()
         self.assertEqual(async_sampler.getswitchinterval(), 0.001)
 
+    def test_set_interval(self):
+        import signal
+
+        async_sampler = telex.TelexSysAsyncSampler(sampling_interval=10_000)
+        async_sampler.start()
+        try:
+            async_sampler.set_interval(2_000)
+            self.assertEqual(async_sampler.sampling_interval, 2_000)
+            _, interval = signal.getitimer(signal.ITIMER_PROF)
+            self.assertAlmostEqual(interval, 0.002)
+        finally:
+            async_sampler.stop()
+
+        # a thread sampler sleeping for more than a second
+        sampler = telex.TelexSysSampler(sampling_interval=1_500_000)
+        sampler.start()
+        sampler.set_interval(50)
+        sampler.stop()
+        self.assertEqual(sampler.sampling_interval, 50)
+
     def test_sampler_runtime_error(self):
         async_sampler = telex.TelexSysAsyncSampler()
         async_sampler.start()
@@ -323,3 +348,347 @@ class TestSamplerContextManager(TestBase):
 
         self.assertEqual(worker_sampler._timer_signal, signal.SIGALRM)
         self.assertEqual(worker_sampler._timer_type, signal.ITIMER_REAL)
+
+
+def _read_varint(data: bytes, pos: int) -> tuple[int, int]:
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if byte < 0x80:
+            return value, pos
+
+
+def _decode(data: bytes) -> dict[int, list]:
+    """Decode one protobuf message into field -> values (ints or bytes)."""
+    fields: dict[int, list] = {}
+    pos = 0
+    while pos < len(data):
+        key, pos = _read_varint(data, pos)
+        if key & 7 == 0:
+            value, pos = _read_varint(data, pos)
+        else:
+            assert key & 7 == 2, key
+            size, pos = _read_varint(data, pos)
+            value, pos = data[pos : pos + size], pos + size
+        fields.setdefault(key >> 3, []).append(value)
+    return fields
+
+
+def _packed(data: bytes) -> list[int]:
+    values, pos = [], 0
+    while pos < len(data):
+        value, pos = _read_varint(data, pos)
+        values.append(value)
+    return values
+
+
+class TestPprof(TestBase):
+    def tearDown(self):
+        super().tearDown()
+        for file in ("test.pprof", "test.pb", "test.pb.gz"):
+            if os.path.exists(file):
+                os.remove(file)
+
+    def load(self, filename: str, compressed: bool = True):
+        """Returns the profile, its string table and the folded stacks."""
+        with open(filename, "rb") as f:
+            data = f.read()
+        if compressed:
+            self.assertEqual(data[:2], b"\x1f\x8b")
+            data = gzip.decompress(data)
+        profile = _decode(data)
+        strings = [s.decode() for s in profile[6]]
+        self.assertEqual(strings[0], "")
+        functions = {}
+        for raw in profile.get(5, []):
+            function = _decode(raw)
+            name, filename = strings[function[2][0]], strings[function[4][0]]
+            functions[function[1][0]] = (filename, name)
+        frames = {}
+        for raw in profile.get(4, []):
+            location = _decode(raw)
+            line = _decode(location[4][0])
+            filename, name = functions[line[1][0]]
+            lineno = line.get(2, [0])[0]
+            frames[location[1][0]] = f"{filename}:{name}:{lineno}" if filename else name
+        stacks: dict[str, list[int]] = {}
+        for raw in profile.get(2, []):
+            sample = _decode(raw)
+            ids = _packed(sample[1][0])
+            stack = ";".join(frames[i] for i in reversed(ids))
+            stacks[stack] = _packed(sample[2][0])
+        return profile, strings, stacks
+
+    def test_write_pprof_folded(self):
+        lines = [
+            "MainThread;/app/main.py:main:1;/app/main.py:work:10 5",
+            "MainThread;/app/main.py:main:1;C:\\app\\win.py:run:3 2",
+            "MainThread;/app/main.py:main:1 1",
+            "invalid",
+            "",
+        ]
+        total = _telexsys.write_pprof(
+            lines,
+            "test.pprof",
+            period=10_000_000,
+            sample_type="wall",
+            time_nanos=1_700_000_000_000_000_000,
+            duration_nanos=3_000_000_000,
+        )
+        self.assertEqual(total, 8)
+        profile, strings, stacks = self.load("test.pprof")
+        sample_types = [
+            (strings[t[1][0]], strings[t[2][0]]) for t in map(_decode, profile[1])
+        ]
+        self.assertEqual(sample_types, [("samples", "count"), ("wall", "nanoseconds")])
+        self.assertEqual(profile[12], [10_000_000])
+        self.assertEqual(profile[9], [1_700_000_000_000_000_000])
+        self.assertEqual(profile[10], [3_000_000_000])
+        self.assertEqual(
+            stacks,
+            {
+                "MainThread;/app/main.py:main:1;/app/main.py:work:10": [5, 50_000_000],
+                "MainThread;/app/main.py:main:1;C:\\app\\win.py:run:3": [2, 20_000_000],
+                "MainThread;/app/main.py:main:1": [1, 10_000_000],
+            },
+        )
+
+    def test_write_pprof_uncompressed(self):
+        lines = [f"main;f{i} {i + 1}" for i in range(20000)]
+        total = _telexsys.write_pprof(lines, "test.pb", compress=False)
+        self.assertEqual(total, sum(range(1, 20001)))
+        profile, strings, stacks = self.load("test.pb", compressed=False)
+        # no period, only the sample count
+        self.assertEqual(len(profile[1]), 1)
+        self.assertNotIn(12, profile)
+        self.assertEqual(stacks["main;f19999"], [20000])
+        self.assertEqual(len(stacks), 20000)
+
+    def test_write_pprof_without_zlib(self):
+        # where the extension has no zlib, as on Windows, the profile is
+        # gzipped by python instead of being left uncompressed
+        from telex.sampler import write_pprof
+
+        before = set(os.listdir())
+        with mock.patch.object(_telexsys, "HAVE_ZLIB", False):
+            total = write_pprof(["main;a 1", "main;b 2"], "test.pb.gz")
+        self.assertEqual(total, 3)
+        _, _, stacks = self.load("test.pb.gz")
+        self.assertEqual(stacks, {"main;a": [1], "main;b": [2]})
+        self.assertEqual(set(os.listdir()) - before, {"test.pb.gz"})
+
+    def test_write_pprof_error(self):
+        with self.assertRaises(OSError):
+            _telexsys.write_pprof(["a 1"], "/nonexistent/dir/test.pprof")
+
+    @unittest.skipIf(
+        sys.platform == "win32", "TelexSysAsyncSampler not supported on Windows"
+    )
+    def test_sampler_save_pprof(self):
+        def fib(n: int) -> int:
+            if n < 2:
+                return n
+            return fib(n - 1) + fib(n - 2)
+
+        sampler = telex.TelexSysAsyncSampler(sampling_interval=100, time_mode="wall")
+        sampler.start()
+        fib(25)
+        sampler.stop()
+        sampler.save("test.pprof", format="pprof")
+        profile, strings, stacks = self.load("test.pprof")
+        self.assertIn("wall", strings)
+        self.assertEqual(profile[12], [100_000])
+        self.assertGreater(profile[10][0], 0)
+        # started a moment ago
+        self.assertAlmostEqual(profile[9][0] / 1e9, time.time(), delta=60)
+
+        expected = {}
+        for line in sampler.dumps().splitlines():
+            stack, count = line.rsplit(" ", 1)
+            expected[stack] = [int(count), int(count) * 100_000]
+        self.assertEqual(stacks, expected)
+        self.assertTrue(any("fib:" in stack for stack in stacks))
+
+        with self.assertRaises(ValueError):
+            sampler.save("test.pprof", format="svg")  # type: ignore[arg-type]
+
+
+class TestSampleLog(TestBase):
+    def tearDown(self):
+        super().tearDown()
+        for file in ("test.speedscope.json", "test.trace.json"):
+            if os.path.exists(file):
+                os.remove(file)
+
+    @staticmethod
+    def fib(n: int) -> int:
+        if n < 2:
+            return n
+        return TestSampleLog.fib(n - 1) + TestSampleLog.fib(n - 2)
+
+    def sample(self) -> telex.TelexSysAsyncSampler:
+        sampler = telex.TelexSysAsyncSampler(
+            sampling_interval=100, time_mode="wall", sample_log=True
+        )
+        self.assertTrue(sampler.sample_log)
+        sampler.start()
+        worker = threading.Thread(target=self.fib, args=(22,))
+        worker.start()
+        self.fib(22)
+        worker.join()
+        sampler.stop()
+        return sampler
+
+    def total(self, sampler: telex.TelexSysAsyncSampler) -> int:
+        return sum(int(line.rsplit(" ", 1)[1]) for line in sampler.dumps().splitlines())
+
+    def test_speedscope(self):
+        sampler = self.sample()
+        sampler.save("test.speedscope.json", format="speedscope")
+        with open("test.speedscope.json") as f:
+            data = json.load(f)
+        frames = data["shared"]["frames"]
+        self.assertTrue(any(frame["name"].endswith("fib") for frame in frames))
+        samples = 0
+        for profile in data["profiles"]:
+            self.assertEqual(profile["type"], "sampled")
+            self.assertEqual(len(profile["samples"]), len(profile["weights"]))
+            self.assertTrue(all(w >= 0 for w in profile["weights"]))
+            self.assertEqual(profile["weights"][-1], 100)
+            self.assertEqual(
+                profile["endValue"] - profile["startValue"], sum(profile["weights"])
+            )
+            for stack in profile["samples"]:
+                self.assertTrue(all(0 <= i < len(frames) for i in stack))
+            samples += len(profile["samples"])
+        self.assertEqual(samples, self.total(sampler))
+        self.assertIn("MainThread", [profile["name"] for profile in data["profiles"]])
+
+    def test_chrome_trace(self):
+        sampler = self.sample()
+        sampler.save("test.trace.json", format="chrome")
+        with open("test.trace.json") as f:
+            events = json.load(f)["traceEvents"]
+        names = [e["args"]["name"] for e in events if e["ph"] == "M"]
+        self.assertIn("MainThread", names)
+        # every thread's B and E events nest and balance, in time order
+        open_frames: dict[int, list[str]] = {}
+        last: dict[int, int] = {}
+        for event in events:
+            self.assertEqual(event["pid"], os.getpid())
+            tid = event["tid"]
+            if event["ph"] == "B":
+                open_frames.setdefault(tid, []).append(event["name"])
+            elif event["ph"] == "E":
+                self.assertTrue(open_frames[tid])
+                open_frames[tid].pop()
+            else:
+                continue
+            self.assertGreaterEqual(event["ts"], last.get(tid, 0))
+            last[tid] = event["ts"]
+        self.assertTrue(open_frames)
+        self.assertTrue(all(not frames for frames in open_frames.values()))
+
+    def test_disabled(self):
+        sampler = self.sample()
+        sampler.clear()
+        self.assertTrue(sampler.sample_log)
+        sampler.save("test.speedscope.json", format="speedscope")
+        with open("test.speedscope.json") as f:
+            self.assertEqual(json.load(f)["profiles"], [])
+
+        sampler.sample_log = False
+        with self.assertRaises(RuntimeError):
+            sampler.save("test.trace.json", format="chrome")
+        with self.assertRaises(RuntimeError):
+            telex.TelexSysAsyncSampler().save_speedscope("test.speedscope.json")
+
+
+class TestPhaseStats(TestBase):
+    PHASES = (
+        "round",
+        "current_frames",
+        "threads",
+        "thread_name",
+        "frame_walk",
+        "filter",
+        "format",
+        "add",
+    )
+
+    def check(self, sampler: telex.TelexSysSampler | telex.TelexSysAsyncSampler):
+        self.assertTrue(sampler.phase_stats)
+        sampler.start()
+        worker = threading.Thread(target=TestSampleLog.fib, args=(22,))
+        worker.start()
+        while sampler.stats()["format"]["count"] < 10:
+            TestSampleLog.fib(18)
+        worker.join()
+        sampler.stop()
+        stats = sampler.stats()
+        self.assertEqual(tuple(stats), self.PHASES)
+        self.assertGreater(stats["round"]["count"], 0)
+        self.assertLessEqual(stats["round"]["count"], sampler.sampling_times)
+        # the frames of every stack walked are filtered and formatted
+        self.assertEqual(stats["filter"]["count"], stats["format"]["count"])
+        self.assertGreaterEqual(stats["frame_walk"]["count"], stats["format"]["count"])
+        for name, phase in stats.items():
+            self.assertEqual(sum(phase["histogram"].values()), phase["count"], name)
+            self.assertLessEqual(phase["p50_ns"], phase["p99_ns"])
+            self.assertLessEqual(phase["p99_ns"], phase["max_ns"])
+            for lower in phase["histogram"]:
+                self.assertEqual(lower & (lower - 1), 0)
+        self.assertGreaterEqual(
+            stats["round"]["total_ns"], stats["current_frames"]["total_ns"]
+        )
+
+        tree = sampler.tree_stats
+        self.assertGreater(tree["nodes"], 0)
+        self.assertLessEqual(tree["leaves"], tree["nodes"])
+        self.assertLessEqual(tree["total_depth"], tree["max_depth"] * tree["leaves"])
+
+        sampler.clear()
+        self.assertTrue(all(phase["count"] == 0 for phase in sampler.stats().values()))
+        self.assertEqual(set(sampler.tree_stats.values()), {0})
+        sampler.phase_stats = False
+        with self.assertRaises(RuntimeError):
+            sampler.stats()
+
+    def test_sampler(self):
+        self.check(telex.TelexSysSampler(sampling_interval=100, phase_stats=True))
+
+    def test_async_sampler(self):
+        self.check(
+            telex.TelexSysAsyncSampler(
+                sampling_interval=100, time_mode="wall", phase_stats=True
+            )
+        )
+
+    def test_enabled_mid_round(self):
+        # a phase that started before phase_stats was switched on has no
+        # start to measure from, it is not recorded
+        sampler = telex.TelexSysSampler(sampling_interval=100)
+        enumerate_threads = threading.enumerate
+
+        def enable():
+            sampler.phase_stats = True
+            return enumerate_threads()
+
+        with mock.patch.object(threading, "enumerate", enable):
+            sampler.start()
+            while not sampler.phase_stats or sampler.stats()["add"]["count"] < 3:
+                TestSampleLog.fib(15)
+            sampler.stop()
+        for name, phase in sampler.stats().items():
+            self.assertLess(phase["max_ns"], 10**10, name)
+
+    def test_disabled(self):
+        sampler = telex.TelexSysSampler()
+        self.assertFalse(sampler.phase_stats)
+        with self.assertRaises(RuntimeError):
+            sampler.stats()
+        with self.assertRaises(TypeError):
+            sampler.phase_stats = 1  # type: ignore[assignment]
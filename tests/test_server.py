@@ -738,3 +738,232 @@ class TestApp(TestBase):
         app.run()
         t.join()
         app.close()
+
+    def test_stream_response(self):
+        """Test chunked streaming and a client leaving early"""
+        from http.server import HTTPServer
+
+        # the server closes every streamed connection itself
+        reuse = HTTPServer.allow_reuse_address
+        TeleXApp.enable_address_reuse()
+        self.addCleanup(setattr, HTTPServer, "allow_reuse_address", reuse)
+        app = TeleXApp(port=8037)
+        closed = threading.Event()
+
+        @app.route("/stream")
+        def stream(req: TeleXRequest, resp: TeleXResponse) -> None:
+            def chunks():
+                try:
+                    yield b"first\n"
+                    yield b""
+                    yield b"second\n"
+                    if "forever" in req.query:
+                        while True:
+                            yield b"more\n"
+                finally:
+                    closed.set()
+
+            resp.stream(chunks())
+
+        @app.route("/shutdown")
+        def shutdown(req: TeleXRequest, resp: TeleXResponse) -> None:
+            req.app.defered_shutdown()
+            resp.return_json({"message": "shutting down"})
+
+        def client() -> None:
+            import socket
+            import time
+            from urllib import request
+
+            time.sleep(1)
+
+            with request.urlopen("http://127.0.0.1:8037/stream") as response:
+                self.assertEqual(response.status, 200)
+                self.assertEqual(response.headers["Transfer-Encoding"], "chunked")
+                self.assertNotIn("Content-Length", response.headers)
+                self.assertEqual(list(response), [b"first\n", b"second\n"])
+            self.assertTrue(closed.wait(1))
+
+            # an HTTP/1.0 client reads until the connection is closed
+            with socket.create_connection(("127.0.0.1", 8037)) as sock:
+                sock.sendall(b"GET /stream HTTP/1.0\r\n\r\n")
+                data = b""
+                while chunk := sock.recv(4096):
+                    data += chunk
+            head, body = data.split(b"\r\n\r\n", 1)
+            self.assertNotIn(b"chunked", head)
+            self.assertEqual(body, b"first\nsecond\n")
+
+            closed.clear()
+            with request.urlopen("http://127.0.0.1:8037/stream?forever") as response:
+                self.assertEqual(response.readline(), b"first\n")
+            self.assertTrue(closed.wait(5))
+
+            with request.urlopen("http://127.0.0.1:8037/shutdown") as response:
+                self.assertEqual(response.status, 200)
+
+        t = threading.Thread(target=client)
+        t.start()
+        app.run()
+        t.join()
+        app.close()
+
+    def test_concurrent_keep_alive(self):
+        """Test keep-alive, parallel requests, budgets and a full queue"""
+        app = TeleXApp(port=8038, workers=2, backlog=1)
+        release = threading.Event()
+
+        @app.route("/slow")
+        def slow(req: TeleXRequest, resp: TeleXResponse) -> None:
+            release.wait(10)
+            resp.return_json({"slow": True})
+
+        @app.route("/ping")
+        def ping(req: TeleXRequest, resp: TeleXResponse) -> None:
+            resp.return_str("pong")
+
+        @app.route("/late", budget=0.2)
+        def late(req: TeleXRequest, resp: TeleXResponse) -> None:
+            time.sleep(1)
+            resp.return_str("late")
+
+        @app.route("/shutdown")
+        def shutdown(req: TeleXRequest, resp: TeleXResponse) -> None:
+            req.app.defered_shutdown()
+            resp.return_json({"message": "shutting down"})
+
+        import http.client
+        import socket
+        import time
+
+        def client() -> None:
+            time.sleep(1)
+            try:
+                requests()
+            finally:
+                release.set()
+                with request.urlopen("http://127.0.0.1:8038/shutdown") as response:
+                    self.assertEqual(response.status, 200)
+
+        def requests() -> None:
+            conn = http.client.HTTPConnection("127.0.0.1", 8038, timeout=5)
+            conn.request("GET", "/ping")
+            sock = conn.sock
+            for _ in range(3):
+                response = conn.getresponse()
+                self.assertEqual(response.read(), b"pong")
+                self.assertIsNone(response.getheader("Connection"))
+                # the same connection serves every request
+                self.assertIs(conn.sock, sock)
+                conn.request("GET", "/ping")
+            conn.getresponse().read()
+            # an error closes the connection
+            conn.request("GET", "/nonexistent")
+            response = conn.getresponse()
+            self.assertEqual(response.status, 404)
+            self.assertEqual(response.getheader("Connection"), "close")
+            response.read()
+
+            conn.request("GET", "/late")
+            response = conn.getresponse()
+            self.assertEqual(response.status, 503)
+            self.assertIn(b"budget", response.read())
+
+            slow = threading.Thread(
+                target=lambda: request.urlopen("http://127.0.0.1:8038/slow").read()
+            )
+            slow.start()
+            time.sleep(0.2)
+            # an idle keep-alive connection does not hold a worker either
+            conn.request("GET", "/ping")
+            self.assertEqual(conn.getresponse().read(), b"pong")
+
+            # one more slow request takes the last worker, another one waits
+            # in the queue and the next is turned away
+            busy = threading.Thread(
+                target=lambda: request.urlopen("http://127.0.0.1:8038/slow").read()
+            )
+            busy.start()
+            time.sleep(0.2)
+            waiting = socket.create_connection(("127.0.0.1", 8038))
+            time.sleep(0.2)
+            with socket.create_connection(("127.0.0.1", 8038)) as rejected:
+                rejected.sendall(b"GET /ping HTTP/1.1\r\nHost: x\r\n\r\n")
+                self.assertTrue(rejected.recv(4096).startswith(b"HTTP/1.1 503"))
+            release.set()
+            slow.join()
+            busy.join()
+            waiting.close()
+            conn.close()
+
+        from urllib import request
+
+        t = threading.Thread(target=client)
+        t.start()
+        app.run()
+        t.join()
+        app.close()
+
+    def test_streams_leave_workers(self):
+        """Test that open streams do not hold the workers"""
+        from http.server import HTTPServer
+
+        # the server closes every streamed connection itself
+        reuse = HTTPServer.allow_reuse_address
+        TeleXApp.enable_address_reuse()
+        self.addCleanup(setattr, HTTPServer, "allow_reuse_address", reuse)
+        app = TeleXApp(port=8039, workers=2, streams=3)
+        release = threading.Event()
+
+        @app.route("/stream")
+        def stream(req: TeleXRequest, resp: TeleXResponse) -> None:
+            def chunks():
+                while not release.wait(0.05):
+                    yield b"tick\n"
+
+            resp.stream(chunks())
+
+        @app.route("/ping")
+        def ping(req: TeleXRequest, resp: TeleXResponse) -> None:
+            resp.return_str("pong")
+
+        @app.route("/shutdown")
+        def shutdown(req: TeleXRequest, resp: TeleXResponse) -> None:
+            req.app.defered_shutdown()
+            resp.return_json({"message": "shutting down"})
+
+        import time
+        from urllib import error, request
+
+        def client() -> None:
+            time.sleep(1)
+            streams = []
+            try:
+                # as many streams as workers, then one more up to the cap
+                for _ in range(3):
+                    response = request.urlopen("http://127.0.0.1:8039/stream")
+                    streams.append(response)
+                    self.assertEqual(response.readline(), b"tick\n")
+                    with request.urlopen("http://127.0.0.1:8039/ping", timeout=5) as ping:
+                        self.assertEqual(ping.read(), b"pong")
+                with self.assertRaises(error.HTTPError) as cm:
+                    request.urlopen("http://127.0.0.1:8039/stream", timeout=5)
+                self.assertEqual(cm.exception.code, 503)
+                self.assertIn(b"streams", cm.exception.read())
+            finally:
+                release.set()
+                for response in streams:
+                    response.read()
+                    response.close()
+            # the reservations are released once the streams have ended
+            time.sleep(0.2)
+            with request.urlopen("http://127.0.0.1:8039/stream", timeout=5) as response:
+                self.assertEqual(response.read(), b"")
+            with request.urlopen("http://127.0.0.1:8039/shutdown") as response:
+                self.assertEqual(response.status, 200)
+
+        t = threading.Thread(target=client)
+        t.start()
+        app.run()
+        t.join()
+        app.close()
@@ -504,3 +504,22 @@ class TestShell(TestBase):
                 # This should handle EOFError gracefully and exit
                 shell.run()
                 # If we reach here, the exception was handled correctly
+
+    def test_format_delta(self):
+        from telex.commands import format_delta
+
+        delta = {
+            "time": 0.0,
+            "seconds": 2.04,
+            "samples": 8,
+            "top": [["leaf", 6, 6], ["main", 2, 8]],
+        }
+        lines = format_delta(delta).splitlines()
+        self.assertTrue(lines[0].endswith("8 samples in 2.0s"))
+        self.assertEqual(lines[2], "  75.0%   75.0%  leaf")
+        self.assertEqual(lines[3], "  25.0%  100.0%  main")
+        delta.update(samples=0, top=[])
+        self.assertEqual(len(format_delta(delta).splitlines()), 1)
+        del delta["top"]
+        delta.update(samples=1, folded="main 1")
+        self.assertEqual(format_delta(delta).splitlines()[1], "main 1")
@@ -0,0 +1,109 @@
+"""
+Unit tests for reading the shared-memory sample ring from outside.
+"""
+
+from __future__ import annotations
+
+import os
+import tempfile
+
+import telex
+from telex import shm
+from tests.base import TestBase
+
+
+def fib(n: int) -> int:
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+
+
+def spin(n: int) -> int:
+    return sum(i * i for i in range(n * 1000))
+
+
+class TestShmRing(TestBase):
+    def setUp(self):
+        super().setUp()
+        self.path = os.path.join(tempfile.mkdtemp(), "telex.ring")
+        self.sampler = telex.TelexSysSampler(sampling_interval=50, shm_ring=self.path)
+        self.addCleanup(setattr, self.sampler, "shm_ring", None)
+
+    def sample(self, work=fib) -> dict[str, int]:
+        """Sample until something is caught, returns what the tree counted."""
+        self.sampler.clear()
+        self.sampler.start()
+        while self.sampler.dumps() == "":
+            work(18)
+        self.sampler.stop()
+        counts: dict[str, int] = {}
+        for line in self.sampler.dumps().splitlines():
+            stack, count = line.rsplit(" ", 1)
+            counts[stack] = counts.get(stack, 0) + int(count)
+        return counts
+
+    def test_replaces_symlink(self):
+        # a link left at the path is replaced, its target is not truncated
+        self.sampler.shm_ring = None
+        victim = os.path.join(os.path.dirname(self.path), "victim")
+        with open(victim, "w") as f:
+            f.write("keep")
+        os.symlink(victim, self.path)
+        self.sampler.shm_ring = self.path
+        self.assertFalse(os.path.islink(self.path))
+        with open(victim) as f:
+            self.assertEqual(f.read(), "keep")
+        self.assertEqual(shm.ShmRingReader(self.path).poll(), [])
+
+    def test_poll(self):
+        reader = shm.ShmRingReader(self.path)
+        self.assertEqual(reader.poll(), [])
+        counts = self.sample()
+        samples = reader.poll()
+        polled: dict[str, int] = {}
+        for _, _, stack in samples:
+            polled[stack] = polled.get(stack, 0) + 1
+        self.assertEqual(polled, counts)
+        self.assertEqual(reader.poll(), [])
+        self.assertEqual((reader.lost, reader.dropped), (0, 0))
+
+    def test_recreated_ring(self):
+        reader = shm.ShmRingReader(self.path)
+        self.sample()
+        self.assertTrue(reader.poll())
+        # another ring at the same path, whose stack ids start over
+        self.sampler.shm_ring = None
+        self.sampler.shm_ring = self.path
+        counts = self.sample(spin)
+        polled: dict[str, int] = {}
+        for _, _, stack in reader.poll():
+            polled[stack] = polled.get(stack, 0) + 1
+        self.assertEqual(polled, counts)
+
+    def test_aggregate(self):
+        counts = self.sample()
+        now = [0.0]
+
+        def clock() -> float:
+            now[0] += 1.0
+            return now[0]
+
+        aggregated, reader = shm.aggregate(self.path, 2.0, interval=0, clock=clock)
+        self.assertEqual(dict(aggregated), counts)
+        self.assertEqual(reader.lost, 0)
+
+    def test_aggregate_until_exit(self):
+        counts = self.sample()
+        calls = [0]
+
+        def clock() -> float:
+            # the target exits, removing its ring, after the first poll
+            calls[0] += 1
+            self.sampler.shm_ring = None
+            return 0.0
+
+        aggregated, _ = shm.aggregate(self.path, 100.0, interval=0, clock=clock)
+        self.assertEqual(dict(aggregated), counts)
+        self.assertEqual(calls[0], 2)
+        with self.assertRaises(FileNotFoundError):
+            shm.aggregate(self.path, 1.0, interval=0)
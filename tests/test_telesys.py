@@ -125,6 +125,32 @@ class TestTeleXSys(TestBase):
         # Check that our threads are in the call stack (may have other system threads)
         self.assertTrue(tids.issubset(set(call_stack.keys())))
 
+    def test_thread_stacks(self):
+        import threading
+
+        from telex import _telexsys
+
+        event = threading.Event()
+        thread = threading.Thread(target=event.wait)
+        thread.start()
+        try:
+            stacks = _telexsys.thread_stacks()
+            here = os.path.dirname(threading.__file__)
+            stripped = _telexsys.thread_stacks(strip=["/nowhere", here], indent="  ")
+        finally:
+            event.set()
+            thread.join()
+        assert thread.ident is not None
+        mine = stacks[threading.get_ident()].split("\n")
+        self.assertEqual(mine[0].split(":")[0], __file__)
+        self.assertTrue(mine[0].endswith(".test_thread_stacks"))
+        waiting = stripped[thread.ident].split("\n")
+        self.assertEqual(waiting[0].split(":")[0], "  threading.py")
+        self.assertTrue(all(line.startswith("  ") for line in waiting))
+        self.assertEqual(len(waiting), len(stacks[thread.ident].split("\n")))
+        with self.assertRaises(TypeError):
+            _telexsys.thread_stacks(strip=[1])
+
 
 class TestSampler(TestBase):
     def tearDown(self):
@@ -574,6 +600,68 @@ class TestVMRead(TestBase):
         with self.assertRaises(TypeError):
             _telexsys.vm_read(123, 456)  # name must be string
 
+    def test_vm_read_many(self):
+        """Test reading several variables of several threads in one call."""
+        import threading
+
+        from telex import _telexsys
+
+        global test_global_var
+        test_global_var = "shared"
+        # plain locks block in C, the top python frame stays inner's
+        gate = threading.Lock()
+        gate.acquire()
+        started = [threading.Lock(), threading.Lock()]
+
+        def inner(value):
+            inner_var = value  # noqa: F841
+            started[value - 1].release()
+            with gate:
+                pass
+
+        def worker(value):
+            outer_var = value * 2  # noqa: F841
+            inner(value)
+
+        threads = [threading.Thread(target=worker, args=(i,)) for i in (1, 2)]
+        for lock, thread in zip(started, threads):
+            lock.acquire()
+            thread.start()
+        for lock in started:
+            lock.acquire()
+        try:
+            first, second = (thread.ident for thread in threads)
+            requests = [
+                (first, "inner_var"),
+                (second, "inner_var", 0),
+                (first, "outer_var", 1),
+                (second, "outer_var", 1),
+                (second, "test_global_var"),
+                (first, "missing"),
+                (first, "inner_var", 100),
+                (123456789, "inner_var"),
+            ]
+            values = _telexsys.vm_read_many(requests)
+            self.assertEqual(values, [1, 2, 2, 4, "shared", None, None, None])
+            # the same answers as one call per variable
+            expected = [_telexsys.vm_read(*request) for request in requests]
+            self.assertEqual(values, expected)
+            self.assertEqual(_telexsys.vm_read_many(iter([(first, "inner_var")])), [1])
+            self.assertEqual(_telexsys.vm_read_many([]), [])
+        finally:
+            gate.release()
+            for thread in threads:
+                thread.join()
+
+        with self.assertRaises(TypeError):
+            _telexsys.vm_read_many([(1,)])
+        with self.assertRaises(TypeError):
+            _telexsys.vm_read_many([("tid", "name")])
+        with self.assertRaises(TypeError):
+            _telexsys.vm_read_many(1)
+        with self.assertRaises(ValueError):
+            _telexsys.vm_read_many([(1, "name", -1)])
+
 
 class TestVMWrite(TestBase):
     """Test cases for vm_write function.
@@ -1200,3 +1288,361 @@ class TestTopNamespace(TestBase):
 
         # Cleanup
         del globals()["test_consistency_var"]
+
+
+class TestLoadFolded(TestBase):
+    """Test cases for load_folded and StackTree."""
+
+    def setUp(self):
+        super().setUp()
+        import tempfile
+
+        self.tmp = tempfile.TemporaryDirectory()
+
+    def tearDown(self):
+        self.tmp.cleanup()
+        super().tearDown()
+
+    def write(self, name: str, text: str) -> str:
+        path = os.path.join(self.tmp.name, name)
+        with open(path, "w", newline="") as f:
+            f.write(text)
+        return path
+
+    @staticmethod
+    def stacks(text: str) -> dict[str, int]:
+        res: dict[str, int] = {}
+        for line in text.splitlines():
+            stack, count = line.rsplit(" ", 1)
+            res[stack] = res.get(stack, 0) + int(count)
+        return res
+
+    def test_load_folded_merges_files(self):
+        from telex import _telexsys
+
+        first = self.write(
+            "1.folded",
+            "Process(pid-1, ppid-0);main;a 3\n"
+            "Process(pid-1, ppid-0);main;a;b 2\r\n"
+            "\n"
+            "no count\n"
+            "Process(pid-1, ppid-0);main;a 4  \n",
+        )
+        second = self.write("2.folded", "Process(pid-1, ppid-0);main;a;b 5")
+        tree = _telexsys.load_folded([first, second])
+        self.assertEqual(
+            self.stacks(tree.dumps()),
+            {
+                "Process(pid-1, ppid-0);main;a": 7,
+                "Process(pid-1, ppid-0);main;a;b": 7,
+            },
+        )
+        self.assertEqual(tree.samples, 14)
+        self.assertEqual(tree.stats["lines"], 4)
+        self.assertEqual(tree.stats["invalid"], 1)
+        self.assertEqual(tree.stats["threads"], 1)
+        # a single path is accepted too
+        self.assertEqual(_telexsys.load_folded(second).samples, 5)
+
+    def test_folded_line_rules(self):
+        from telex import _telexsys
+
+        # the rules of every native reader, see folded_line.h
+        lines = ["\tmain;a +2\x0b", "main;b -1", "main;c x", f"main;c {2**64}", "main;d 1"]
+        text = "\n".join(lines)
+        tree = _telexsys.load_folded(self.write("rules.folded", text))
+        self.assertEqual(self.stacks(tree.dumps()), {"main;a": 2, "main;d": 1})
+        self.assertEqual(tree.stats["invalid"], 3)
+        added = _telexsys.StackTree()
+        added.add_lines([lines[0], lines[-1]])
+        self.assertEqual(added.dumps(), tree.dumps())
+
+    def test_load_folded_threads(self):
+        from telex import _telexsys
+
+        lines = [
+            f"MainThread;m{i % 7}.py:f:{i % 13};g{i % 101} {i % 5 + 1}"
+            for i in range(100_000)
+        ]
+        path = self.write("big.folded", "\n".join(lines))
+        single = _telexsys.load_folded(path, threads=1)
+        parallel = _telexsys.load_folded(path, threads=4)
+        self.assertEqual(single.stats["threads"], 1)
+        self.assertGreater(parallel.stats["threads"], 1)
+        # merged in input order, the output does not depend on the threads
+        self.assertEqual(single.dumps(), parallel.dumps())
+        self.assertEqual(parallel.samples, sum(i % 5 + 1 for i in range(100_000)))
+        self.assertEqual(parallel.stats["lines"], 100_000)
+
+    def test_stack_tree_as_source(self):
+        from telex import _telexsys
+
+        tree = _telexsys.StackTree()
+        tree.add_lines(["main;a 1", "main;b 2", ""])
+        tree.load([self.write("1.folded", "main;a 3\n")])
+        self.assertEqual(self.stacks(tree.dumps()), {"main;a": 4, "main;b": 2})
+        svg = os.path.join(self.tmp.name, "out.svg")
+        self.assertEqual(_telexsys.render_flamegraph(tree, svg), 6)
+        pprof = os.path.join(self.tmp.name, "out.pprof")
+        self.assertEqual(_telexsys.write_pprof(tree, pprof), 6)
+        folded = os.path.join(self.tmp.name, "out.folded")
+        tree.save(folded)
+        self.assertEqual(_telexsys.load_folded(folded).dumps(), tree.dumps())
+
+    def test_gzip_dump_and_load(self):
+        import gzip
+
+        from telex import _telexsys
+
+        lines = [
+            f"MainThread;m{i % 7}.py:f:{i % 13};g{i % 997}:{i} {i % 5 + 1}"
+            for i in range(100_000)
+        ]
+        tree = _telexsys.StackTree()
+        tree.add_lines(lines)
+        path = os.path.join(self.tmp.name, "out.folded.gz")
+        tree.save(path)
+        # framed into several members, read by gzip as one stream
+        with gzip.open(path, "rt") as f:
+            self.assertEqual(f.read(), tree.dumps())
+        with open(path, "rb") as f:
+            self.assertGreater(f.read().count(b"TX\x04\x00"), 1)
+        single = _telexsys.load_folded(path, threads=1)
+        parallel = _telexsys.load_folded(path, threads=4)
+        self.assertEqual(single.dumps(), tree.dumps())
+        self.assertEqual(parallel.dumps(), tree.dumps())
+        self.assertEqual(parallel.stats["bytes"], os.path.getsize(path))
+        self.assertGreater(parallel.stats["threads"], 1)
+
+        # other gzip files are inflated whole
+        plain = os.path.join(self.tmp.name, "plain.gz")
+        with gzip.open(plain, "wt") as f:
+            f.write("main;a 1\nmain;b 2\n")
+        self.assertEqual(_telexsys.load_folded(plain).dumps(), "main;a 1\nmain;b 2")
+
+        with open(path, "rb") as f:
+            data = f.read()
+        broken = os.path.join(self.tmp.name, "broken.gz")
+        with open(broken, "wb") as f:
+            f.write(data[: len(data) // 2])
+        with self.assertRaises(OSError):
+            _telexsys.load_folded(broken)
+
+    def test_gzip_without_zlib(self):
+        # where the extension has no zlib, as on Windows, ".gz" files are
+        # gzipped and inflated by python
+        import gzip
+        from unittest import mock
+
+        import telex
+        from telex import _telexsys
+        from telex.flamegraph import load_stacks, save_stacks
+
+        tree = _telexsys.StackTree()
+        tree.add_lines(["main;a 1", "main;b 2"])
+        path = os.path.join(self.tmp.name, "out.folded.gz")
+        sampler = telex.TelexSysSampler()
+        sampled = os.path.join(self.tmp.name, "sampler.folded.gz")
+        with mock.patch.object(_telexsys, "HAVE_ZLIB", False):
+            save_stacks(tree, path)
+            sampler.save(sampled)
+            loaded = _telexsys.StackTree()
+            spy = mock.Mock(wraps=loaded)
+            load_stacks(spy, [path, self.write("1.folded", "main;c 3\n")])
+        # a single member without the "TX" subfield of the native writer
+        with open(path, "rb") as f:
+            self.assertNotIn(b"TX\x04\x00", f.read())
+        with gzip.open(path, "rt") as f:
+            self.assertEqual(f.read(), tree.dumps())
+        with gzip.open(sampled, "rt") as f:
+            self.assertEqual(f.read(), sampler.dumps())
+        # the gzipped file was inflated before the native load
+        names = spy.load.call_args.args[0]
+        self.assertNotEqual(names[0], path)
+        self.assertFalse(os.path.exists(names[0]))
+        self.assertEqual(loaded.dumps(), "main;a 1\nmain;b 2\nmain;c 3")
+
+    def test_load_folded_errors(self):
+        from telex import _telexsys
+
+        tree = _telexsys.StackTree()
+        tree.add_lines(["main 1"])
+        missing = os.path.join(self.tmp.name, "missing.folded")
+        with self.assertRaises(FileNotFoundError):
+            tree.load([self.write("1.folded", "main 2\n"), missing])
+        # nothing is added when a file can not be read
+        self.assertEqual(tree.dumps(), "main 1")
+        with self.assertRaises(OSError):
+            tree.save(os.path.join(missing, "out.folded"))
+        with self.assertRaises(TypeError):
+            _telexsys.load_folded([1])
+
+    def test_merge_subtract_top(self):
+        from telex import _telexsys
+
+        old = _telexsys.StackTree()
+        old.add_lines(["main;a;b 3", "main;a 2", "main;c 1"])
+        new = _telexsys.StackTree()
+        new.add_lines(["main;a;b 4", "main;d;d 5"])
+        tree = _telexsys.StackTree()
+        tree.merge(old)
+        tree.merge(new)
+        self.assertEqual(tree.samples, 15)
+        self.assertEqual(
+            self.stacks(tree.dumps()),
+            {"main;a;b": 7, "main;a": 2, "main;c": 1, "main;d;d": 5},
+        )
+        # the recursive frame counts once toward its total
+        self.assertEqual(tree.top(3), [("b", 7, 7), ("d", 5, 5), ("a", 2, 9)])
+        tree.subtract(old)
+        self.assertEqual(tree.samples, 9)
+        self.assertEqual(tree.dumps(), new.dumps())
+        tree.subtract(new)
+        self.assertEqual((tree.dumps(), tree.samples, tree.top()), ("", 0, []))
+        with self.assertRaises(TypeError):
+            tree.merge("main 1")
+
+    def test_tree_stats(self):
+        from telex import _telexsys
+
+        tree = _telexsys.StackTree()
+        tree.add_lines(["main;a;b 3", "main;a 2", "main;c 1"])
+        stats = tree.tree_stats
+        self.assertEqual(
+            {k: v for k, v in stats.items() if k != "heap_bytes"},
+            {
+                "nodes": 4,
+                "leaves": 2,
+                "max_depth": 3,
+                "total_depth": 5,
+                "name_bytes": 7,
+            },
+        )
+        self.assertGreater(stats["heap_bytes"], stats["name_bytes"])
+        new = _telexsys.StackTree()
+        new.add_lines(["main;a;b 4", "main;d;d;e 5"])
+        tree.merge(new)
+        self.assertEqual(
+            (tree.tree_stats["nodes"], tree.tree_stats["leaves"]), (7, 3)
+        )
+        self.assertEqual(tree.tree_stats["max_depth"], 4)
+        # kept as frames are removed, the same as a tree built from scratch
+        tree.subtract(new)
+        self.assertEqual(tree.tree_stats, stats)
+        path = os.path.join(self.tmp.name, "out.folded")
+        tree.save(path)
+        self.assertEqual(_telexsys.load_folded(path).tree_stats, stats)
+        packed = _telexsys.StackTree()
+        packed.merge_packed(tree.pack())
+        self.assertEqual(packed.tree_stats, stats)
+        tree.subtract(packed)
+        self.assertEqual(set(tree.tree_stats.values()), {0})
+
+    def test_pack_merge_packed(self):
+        from telex import _telexsys
+
+        tree = _telexsys.StackTree()
+        tree.add_lines(["main;a;b 3", "main;a 2", "main;b;a 1", "other 4"])
+        packed = tree.pack()
+        # every frame name is stored once
+        self.assertEqual(packed.count(b"main"), 1)
+        merged = _telexsys.StackTree()
+        merged.add_lines(["main;a;b 1", "main;c 5"])
+        merged.merge_packed(packed)
+        merged.merge_packed(bytearray(packed))
+        self.assertEqual(merged.samples, 26)
+        self.assertEqual(
+            self.stacks(merged.dumps()),
+            {"main;a;b": 7, "main;a": 4, "main;b;a": 2, "main;c": 5, "other": 8},
+        )
+        empty = _telexsys.StackTree()
+        empty.merge_packed(_telexsys.StackTree().pack())
+        self.assertEqual((empty.dumps(), empty.samples), ("", 0))
+        for bad in (b"", b"main 1", packed[:-1], packed + b"\0"):
+            with self.assertRaises(ValueError):
+                merged.merge_packed(bad)
+        self.assertEqual(merged.samples, 26)
+
+    def test_take_stacks(self):
+        import telex
+        from telex import _telexsys
+
+        def fib(n: int) -> int:
+            if n < 2:
+                return n
+            return fib(n - 1) + fib(n - 2)
+
+        def run_until_sampled() -> None:
+            while sampler.dumps() == "":
+                fib(18)
+
+        sampler = telex.TelexSysSampler(sampling_interval=50)
+        sampler.start()
+        run_until_sampled()
+        taken = _telexsys.take_stacks(sampler)
+        run_until_sampled()
+        sampler.stop()
+        self.assertGreater(taken.samples, 0)
+        self.assertIn("fib", taken.dumps())
+        # the sampler kept running on an empty tree
+        rest = sampler.dumps()
+        self.assertNotEqual(rest, "")
+        again = _telexsys.take_stacks(sampler)
+        self.assertEqual(again.dumps(), rest)
+        self.assertEqual(again.samples, sum(self.stacks(rest).values()))
+        self.assertEqual(sampler.dumps(), "")
+        with self.assertRaises(TypeError):
+            _telexsys.take_stacks(again)
+
+    def test_shm_ring(self):
+        import tempfile
+        import threading
+
+        import telex
+        from telex import _telexsys
+
+        def fib(n: int) -> int:
+            if n < 2:
+                return n
+            return fib(n - 1) + fib(n - 2)
+
+        def run_until_sampled() -> None:
+            while sampler.dumps() == "":
+                fib(18)
+
+        path = os.path.join(tempfile.mkdtemp(), "telex.ring")
+        sampler = telex.TelexSysSampler(sampling_interval=50, shm_ring=path)
+        self.assertEqual(sampler.shm_ring, path)
+        sampler.start()
+        run_until_sampled()
+        sampler.stop()
+        cursor, samples, stacks = _telexsys.shm_ring_read(path)
+        # the ring saw exactly what the tree counted
+        counts = self.stacks(sampler.dumps())
+        self.assertEqual(len(samples), sum(counts.values()))
+        self.assertEqual(set(stacks), set(counts))
+        self.assertTrue(all(tid == threading.get_ident() for _, tid, _ in samples))
+        self.assertEqual(cursor[0], len(samples))
+        self.assertEqual(cursor[2:4], (0, 0))
+        self.assertEqual(_telexsys.shm_ring_read(path, cursor), (cursor, [], []))
+        # a reader that resumes only gets the new samples and stacks
+        sampler.clear()
+        sampler.start()
+        run_until_sampled()
+        sampler.stop()
+        after, more, new_stacks = _telexsys.shm_ring_read(path, cursor)
+        self.assertEqual(len(more), sum(self.stacks(sampler.dumps()).values()))
+        self.assertEqual(after[0], cursor[0] + len(more))
+        self.assertTrue(all(stack < len(stacks) + len(new_stacks) for *_, stack in more))
+        # the ring goes away with the sampler's export
+        sampler.shm_ring = None
+        self.assertFalse(os.path.exists(path))
+        with self.assertRaises(FileNotFoundError):
+            _telexsys.shm_ring_read(path)
+        with open(path, "wb") as f:
+            f.write(b"not a ring" * 100)
+        with self.assertRaises(OSError):
+            _telexsys.shm_ring_read(path)
+        os.unlink(path)
+        with self.assertRaises(TypeError):
+            sampler.shm_ring = 1  # type: ignore[assignment]
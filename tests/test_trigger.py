@@ -0,0 +1,152 @@
+"""
+Unit tests for the captures triggered by CPU usage or latency.
+"""
+
+from __future__ import annotations
+
+import os
+import tempfile
+from unittest import mock
+
+from telex import _telexsys
+from telex.trigger import TriggeredCapture, process_cpu_seconds
+from tests.base import TestBase
+
+
+class FakeSampler:
+    def __init__(self) -> None:
+        self.intervals: list[int] = []
+        self.started = False
+
+    def set_interval(self, sampling_interval: int) -> None:
+        self.intervals.append(sampling_interval)
+
+    def start(self) -> None:
+        self.started = True
+
+    def stop(self) -> None:
+        self.started = False
+
+
+class TestTriggeredCapture(TestBase):
+    def setUp(self):
+        super().setUp()
+        self.now = 0.0
+        self.cpu = 0.0
+        self.pending: list[str] = []
+
+        def take_stacks(sampler):
+            tree = _telexsys.StackTree()
+            tree.add_lines(self.pending)
+            self.pending = []
+            return tree
+
+        patcher = mock.patch.object(_telexsys, "take_stacks", take_stacks)
+        patcher.start()
+        self.addCleanup(patcher.stop)
+        self.directory = tempfile.mkdtemp()
+        self.sampler = FakeSampler()
+
+    def capture(self, **kwargs) -> TriggeredCapture:
+        options = dict(
+            slow_interval=50_000,
+            fast_interval=1_000,
+            duration=5.0,
+            pre_seconds=10.0,
+            check=1.0,
+            cooldown=30.0,
+            directory=self.directory,
+            clock=lambda: self.now,
+            cpu_seconds=lambda: self.cpu,
+        )
+        options.update(kwargs)
+        trigger = TriggeredCapture(self.sampler, **options)  # type: ignore
+        # started by hand, the tests drive the checks
+        trigger.sampler.set_interval(trigger.slow_interval)
+        trigger._last = (self.now, self.cpu)
+        return trigger
+
+    def step(self, trigger: TriggeredCapture, cpu: float, *lines: str):
+        """One second passes using ``cpu`` seconds of CPU, then a check."""
+        self.now += 1.0
+        self.cpu += cpu
+        self.pending.extend(lines)
+        return trigger.poll()
+
+    @staticmethod
+    def read(path: str) -> str:
+        with open(path, encoding="utf-8") as f:
+            return f.read()
+
+    def test_cpu_trigger(self):
+        trigger = self.capture(cpu=80.0)
+        for second in range(12):
+            self.assertIsNone(self.step(trigger, 0.1, f"main;idle{second} 1"))
+        self.assertFalse(trigger.capturing)
+        self.assertIsNone(self.step(trigger, 0.95, "main;busy 1"))
+        self.assertTrue(trigger.capturing)
+        self.assertEqual(self.sampler.intervals, [50_000, 1_000])
+        for _ in range(4):
+            self.assertIsNone(self.step(trigger, 1.0, "main;hot 10"))
+        capture = self.step(trigger, 1.0, "main;hot 10")
+        self.assertIsNotNone(capture)
+        assert capture is not None
+        self.assertFalse(trigger.capturing)
+        self.assertEqual(self.sampler.intervals, [50_000, 1_000, 50_000])
+        self.assertEqual(capture.reason, "cpu 95%")
+        self.assertEqual(trigger.captures, [capture])
+        self.assertEqual(self.read(capture.path), "main;hot 50")
+        # only the seconds before the trigger that fit in pre_seconds
+        pre = self.read(capture.pre_path)
+        self.assertIn("main;busy 1", pre)
+        self.assertIn("main;idle11 1", pre)
+        self.assertIn("main;idle3 1", pre)
+        self.assertNotIn("main;idle2 1", pre)
+
+    def test_cooldown(self):
+        trigger = self.capture(cpu=50.0, duration=1.0, cooldown=5.0)
+        self.step(trigger, 1.0)
+        self.assertTrue(trigger.capturing)
+        self.assertIsNotNone(self.step(trigger, 1.0))
+        for _ in range(4):
+            self.step(trigger, 1.0)
+            self.assertFalse(trigger.capturing)
+        self.step(trigger, 1.0)
+        self.assertTrue(trigger.capturing)
+
+    def test_latency_trigger(self):
+        trigger = self.capture(latency=0.5, duration=1.0)
+        trigger.report_latency(0.2)
+        self.step(trigger, 1.0)
+        self.assertFalse(trigger.capturing)
+        trigger.report_latency(0.7)
+        trigger.report_latency(0.3)
+        self.step(trigger, 0.0)
+        self.assertTrue(trigger.capturing)
+        capture = self.step(trigger, 0.0, "main;slow 2")
+        assert capture is not None
+        self.assertEqual(capture.reason, "latency 0.700s")
+        self.assertTrue(os.path.exists(capture.pre_path))
+
+    def test_stop_saves_capture(self):
+        trigger = self.capture(cpu=10.0)
+        trigger.start()
+        self.step(trigger, 1.0)
+        self.assertTrue(trigger.capturing)
+        self.pending.append("main;cut 3")
+        trigger.stop()
+        self.assertFalse(self.sampler.started)
+        self.assertEqual(len(trigger.captures), 1)
+        self.assertEqual(self.read(trigger.captures[0].path), "main;cut 3")
+
+    def test_arguments(self):
+        with self.assertRaises(ValueError):
+            TriggeredCapture(self.sampler)  # type: ignore
+        with self.assertRaises(ValueError):
+            TriggeredCapture(self.sampler, cpu=1.0, duration=0)  # type: ignore
+
+    def test_process_cpu_seconds(self):
+        before = process_cpu_seconds()
+        sum(i * i for i in range(200_000))
+        self.assertGreaterEqual(process_cpu_seconds(), before)
+        self.assertGreater(before, 0)